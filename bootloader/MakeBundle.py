@@ -0,0 +1,82 @@
+import argparse
+import hashlib
+import os
+import struct
+import sys
+
+# Packs the kernel, its modules and the boot config into one boot bundle (boot.bnd) that
+# the loader reads with a single sequential read. Layout must match bundle.h:
+#
+#   BL_BUNDLE_HEADER   <Q signature, I version, I entry count, Q header size, Q bundle size>
+#   BL_BUNDLE_ENTRY[]  <32s name, I type, I reserved, Q offset, Q size, 32s SHA-256 of the payload>
+#   payloads, each starting on a page boundary
+
+SIGNATURE   = int.from_bytes(b"OPLIBNDL", "little")
+VERSION     = 2
+ALIGNMENT   = 0x1000
+NAME_LENGTH = 32
+MAX_ENTRIES = 64
+
+HEADER = struct.Struct("<QIIQQ")
+ENTRY  = struct.Struct("<%dsIIQQ32s" % NAME_LENGTH)
+
+TYPES = {"kernel": 1, "module": 2, "config": 3}
+
+
+def align(value):
+    return (value + ALIGNMENT - 1) & ~(ALIGNMENT - 1)
+
+
+def parse_payload(kind, spec):
+    # "path" or "name=path", the name defaults to the file name
+    name, sep, path = spec.partition("=")
+    if not sep:
+        name, path = os.path.basename(spec), spec
+    encoded = name.encode("ascii")
+    if len(encoded) >= NAME_LENGTH:
+        sys.exit("payload name '%s' is longer than %d characters" % (name, NAME_LENGTH - 1))
+    return TYPES[kind], encoded, path
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build an OpliOS boot bundle.")
+    parser.add_argument("-o", "--output", default="boot.bnd", help="bundle to write")
+    parser.add_argument("--kernel", required=True, help="[name=]path of the kernel image")
+    parser.add_argument("--module", action="append", default=[], help="[name=]path, may be repeated")
+    parser.add_argument("--config", action="append", default=[], help="[name=]path, may be repeated")
+    args = parser.parse_args()
+
+    payloads = [parse_payload("kernel", args.kernel)]
+    payloads += [parse_payload("module", spec) for spec in args.module]
+    payloads += [parse_payload("config", spec) for spec in args.config]
+
+    if len(payloads) > MAX_ENTRIES:
+        sys.exit("a bundle holds at most %d payloads" % MAX_ENTRIES)
+
+    header_size = align(HEADER.size + ENTRY.size * len(payloads))
+
+    entries = []
+    blobs = []
+    offset = header_size
+    for kind, name, path in payloads:
+        with open(path, "rb") as f:
+            data = f.read()
+        entries.append(ENTRY.pack(name, kind, 0, offset, len(data), hashlib.sha256(data).digest()))
+        blobs.append(data)
+        offset = align(offset + len(data))
+
+    bundle_size = offset
+
+    with open(args.output, "wb") as out:
+        out.write(HEADER.pack(SIGNATURE, VERSION, len(payloads), header_size, bundle_size))
+        out.write(b"".join(entries))
+        for data in blobs:
+            out.write(b"\0" * (align(out.tell()) - out.tell()))
+            out.write(data)
+        out.write(b"\0" * (bundle_size - out.tell()))
+
+    print(f"Wrote {args.output}: {len(payloads)} payloads, {bundle_size} bytes")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,147 @@
+import argparse
+import struct
+import sys
+
+# Packs a PE32+ kernel image for the loader's packed image path. The image is laid out the
+# way the loader maps it (headers and sections at their RVAs, .bss zeroed) and compressed
+# in fixed size LZ4 blocks, so each block unpacks straight into its place in memory.
+# Layout must match BL_PACKED_IMAGE_HEADER in image.h:
+#
+#   <Q signature, I version, I method, Q image size, Q preferred base, I chunk size, I chunk count>
+#   <I packed size> * chunk count
+#   chunks back to back, a chunk is stored when compressing does not make it smaller
+
+SIGNATURE  = int.from_bytes(b"OPLIPACK", "little")
+VERSION    = 1
+MAX_CHUNKS = 4096
+
+METHODS = {"stored": 0, "lz4": 1}
+
+HEADER = struct.Struct("<QIIQQII")
+
+MIN_MATCH    = 4
+LAST_LITERAL = 5   # the block ends with at least this many literals
+MATCH_LIMIT  = 12  # no match may start closer than this to the end of the block
+MAX_OFFSET   = 0xFFFF
+
+
+def layout_image(data):
+    if data[:2] != b"MZ":
+        sys.exit("not a PE image")
+    (lfanew,) = struct.unpack_from("<I", data, 0x3C)
+    if data[lfanew:lfanew + 4] != b"PE\0\0":
+        sys.exit("not a PE image")
+
+    machine, sections, _, _, _, optional_size, _ = struct.unpack_from("<HHIIIHH", data, lfanew + 4)
+    optional = lfanew + 24
+    magic, = struct.unpack_from("<H", data, optional)
+    if machine != 0x8664 or magic != 0x20B:
+        sys.exit("not a PE32+ x64 image")
+
+    (image_base,) = struct.unpack_from("<Q", data, optional + 24)
+    image_size, header_size = struct.unpack_from("<II", data, optional + 56)
+
+    image = bytearray(image_size)
+    image[:header_size] = data[:header_size]
+
+    table = optional + optional_size
+    for i in range(sections):
+        virtual_size, rva, raw_size, raw_pointer = struct.unpack_from("<IIII", data, table + 40 * i + 8)
+        # same rule as BlLoadPEImage64, padding past VirtualSize is not part of the image
+        if virtual_size and raw_size > virtual_size:
+            raw_size = virtual_size
+        image[rva:rva + raw_size] = data[raw_pointer:raw_pointer + raw_size]
+
+    return bytes(image), image_base
+
+
+def write_length(out, length):
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+
+def write_sequence(out, literals, offset=0, match=0):
+    token_match = match - MIN_MATCH if offset else 0
+    out.append((min(len(literals), 15) << 4) | min(token_match, 15))
+    if len(literals) >= 15:
+        write_length(out, len(literals) - 15)
+    out += literals
+    if offset:
+        out += offset.to_bytes(2, "little")
+        if token_match >= 15:
+            write_length(out, token_match - 15)
+
+
+def lz4_compress(src):
+    try:
+        import lz4.block
+        return lz4.block.compress(src, mode="high_compression", store_size=False)
+    except ImportError:
+        pass
+
+    # greedy single-probe matcher, slower and a little worse than liblz4 but dependency free
+    out = bytearray()
+    table = {}
+    anchor = 0
+    i = 0
+    end = len(src)
+    while i < end - MATCH_LIMIT:
+        key = src[i:i + MIN_MATCH]
+        candidate = table.get(key)
+        table[key] = i
+        if candidate is None or i - candidate > MAX_OFFSET:
+            i += 1
+            continue
+
+        match = MIN_MATCH
+        limit = end - LAST_LITERAL - i
+        while match < limit and src[candidate + match] == src[i + match]:
+            match += 1
+
+        write_sequence(out, src[anchor:i], i - candidate, match)
+        i += match
+        anchor = i
+
+    write_sequence(out, src[anchor:])
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Pack a PE32+ kernel image for the OpliOS loader.")
+    parser.add_argument("input", help="kernel image to pack")
+    parser.add_argument("-o", "--output", required=True, help="packed image to write")
+    parser.add_argument("--method", choices=METHODS, default="lz4")
+    parser.add_argument("--chunk-size", type=lambda v: int(v, 0), default=0x40000,
+                        help="unpacked bytes per chunk, also the loader's staging slot size")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        image, image_base = layout_image(f.read())
+
+    chunk = args.chunk_size
+    chunks = [image[i:i + chunk] for i in range(0, len(image), chunk)]
+    if len(chunks) > MAX_CHUNKS:
+        sys.exit("image needs %d chunks, at most %d are allowed" % (len(chunks), MAX_CHUNKS))
+
+    packed = []
+    for data in chunks:
+        if args.method == "lz4":
+            compressed = lz4_compress(data)
+            packed.append(compressed if len(compressed) < len(data) else data)
+        else:
+            packed.append(data)
+
+    with open(args.output, "wb") as out:
+        out.write(HEADER.pack(SIGNATURE, VERSION, METHODS[args.method], len(image), image_base, chunk, len(chunks)))
+        out.write(struct.pack("<%dI" % len(packed), *map(len, packed)))
+        for data in packed:
+            out.write(data)
+
+    total = HEADER.size + 4 * len(packed) + sum(map(len, packed))
+    print(f"Wrote {args.output}: {len(image)} byte image in {total} bytes, {len(chunks)} chunks")
+
+
+if __name__ == "__main__":
+    main()
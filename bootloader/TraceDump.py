@@ -0,0 +1,84 @@
+import argparse
+import json
+import struct
+import sys
+
+# Turns a memory dump of the BOOT_TRACE ring (bootinfo.h) into a Chrome trace, open it in
+# chrome://tracing or ui.perfetto.dev. The loader prints the ring's address before the
+# handoff, dump it from the QEMU monitor with
+#
+#   pmemsave <address> <size> trace.bin
+#
+# Layout must match bootinfo.h:
+#
+#   BOOT_TRACE         <Q signature, I capacity, I event size, Q count, Q TSC frequency, 32x reserved>
+#   BOOT_TRACE_EVENT[] <Q TSC, 20s name, B kind, B source, H CPU>
+
+SIGNATURE = int.from_bytes(b"OPLITRCE", "little")
+
+HEADER = struct.Struct("<QIIQQ32x")
+EVENT  = struct.Struct("<Q20sBBH")
+
+PHASES  = {1: "B", 2: "E", 3: "i"}
+SOURCES = {1: "loader", 2: "kernel"}
+
+
+def read_events(data):
+    signature, capacity, event_size, count, frequency = HEADER.unpack_from(data)
+    if signature != SIGNATURE:
+        sys.exit("not a boot trace, signature 0x%016x" % signature)
+    if event_size != EVENT.size or len(data) < HEADER.size + capacity * event_size:
+        sys.exit("trace layout does not match this tool")
+
+    # the ring keeps the newest capacity events, the oldest one sits at count % capacity
+    first = max(0, count - capacity)
+    events = []
+    for index in range(first, count):
+        tsc, name, kind, source, cpu = EVENT.unpack_from(data, HEADER.size + (index % capacity) * event_size)
+        events.append((tsc, name.rstrip(b"\0").decode("ascii", "replace"), kind, source, cpu))
+    return events, frequency, first > 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert an OpliOS boot trace dump to a Chrome trace.")
+    parser.add_argument("dump", help="raw dump of the BOOT_TRACE allocation")
+    parser.add_argument("-o", "--output", default="boot-trace.json", help="Chrome trace to write")
+    parser.add_argument("--frequency", type=float, help="TSC rate in Hz when the trace has none")
+    args = parser.parse_args()
+
+    with open(args.dump, "rb") as dump:
+        events, frequency, wrapped = read_events(dump.read())
+
+    frequency = args.frequency or frequency
+    if not frequency:
+        sys.exit("the trace was not calibrated, pass --frequency")
+    if wrapped:
+        print("ring wrapped, the oldest events are lost", file=sys.stderr)
+
+    base = min((event[0] for event in events), default=0)
+    trace = []
+    for tsc, name, kind, source, cpu in events:
+        entry = {
+            "name": name,
+            "cat": SOURCES.get(source, "unknown"),
+            "ph": PHASES.get(kind, "i"),
+            "ts": (tsc - base) * 1e6 / frequency,
+            "pid": 1,
+            "tid": source * 256 + cpu,
+        }
+        if entry["ph"] == "i":
+            entry["s"] = "t"
+        trace.append(entry)
+
+    # name the rows after the side that recorded them
+    for source, label in SOURCES.items():
+        trace.append({"name": "thread_name", "ph": "M", "pid": 1, "tid": source * 256, "args": {"name": label}})
+
+    with open(args.output, "w") as output:
+        json.dump({"traceEvents": trace, "displayTimeUnit": "ms"}, output, indent=1)
+
+    print("%d events, %.3f ms" % (len(events), (max((e[0] for e in events), default=base) - base) * 1e3 / frequency))
+
+
+if __name__ == "__main__":
+    main()
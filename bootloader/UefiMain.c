@@ -1,5 +1,15 @@
 #pragma once
 #include "filesystem.h"
+#include "image.h"
+#include "bundle.h"
+#include "preload.h"
+#include "paging.h"
+#include "handoff.h"
+#include "trace.h"
+#include "config.h"
+#include "log.h"
+#include "mp.h"
+#include "../kernal/rtl.h"
 
 CHAR8* gEfiCallerBaseName = "OpliOS";
 const UINT32 _gUefiDriverRevision = 0x1;
@@ -17,26 +27,38 @@ TRY(
 {
     if (EFI_ERROR(Status))
     {
-        Print(L"[ %r ] - %s\n", Status, Message);
+        BL_LOG(BL_LOG_ERROR, L"[ %r ] - %s\n", Status, Message);
         LAST_ERROR = Status;
         return FALSE;
     }
     return TRUE;
 }
 
+/**
+* Waits for a key unless the boot configuration turned interactive pauses off.
+*/
+VOID
+PAUSE(
+    VOID
+)
+{
+    if (BlGetConfig()->Pause)
+    {
+        getc();
+    }
+}
+
 VOID
 DEBUG_LOG(
     EFI_STATUS Status,
     CHAR16* Message
 )
 {
-#ifdef _DEBUG_
     if (EFI_ERROR(Status))
     {
-        Print(L"\n[ %r ] - %s\n", Status, Message);
+        BL_LOG(BL_LOG_DEBUG, L"\n[ %r ] - %s\n", Status, Message);
         LAST_ERROR = Status;
     }
-#endif
 }
 
 VOID
@@ -44,9 +66,7 @@ INFO(
     CHAR16* Message
 )
 {
-#ifdef _DEBUG_INFO_
-    Print(L"\ns\n", Message);
-#endif
+    BL_LOG(BL_LOG_INFO, L"\n%s\n", Message);
 };
 
 /**
@@ -72,15 +92,7 @@ static EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL* COUT = NULL;
 UINT8 compare(const void* firstitem, const void* seconditem, UINT64 comparelength)
 {
     // Using const since this is a read-only operation: absolutely nothing should be changed here.
-    const UINT8* one = firstitem, * two = seconditem;
-    for (UINT64 i = 0; i < comparelength; i++)
-    {
-        if (one[i] != two[i])
-        {
-            return 0;
-        }
-    }
-    return 1;
+    return RtlCompareMemory(firstitem, seconditem, comparelength) == 0;
 }
 
 /**
@@ -103,9 +115,12 @@ UefiMain(
     CIN  = SystemTable->ConIn;
     COUT = SystemTable->ConOut;
 
+    BlLogInit();
+    BlTraceInit();
+
     if( !TRY( COUT->ClearScreen(COUT), L"Failed to clear screen" ) )
     {
-        getc();
+        PAUSE();
         return LAST_ERROR;
     }
 
@@ -114,17 +129,18 @@ UefiMain(
     EFI_TIME time;
     if( !TRY( RT->GetTime( &time, NULL ), L"Failed to get time" ) )
     {
-        getc();
+        PAUSE();
         return LAST_ERROR;
     }
 
-    Print(L"%02d/%02d/%04d - %02d:%02d:%0d.%d\r\n\n", time.Month, time.Day, time.Year, time.Hour, time.Minute, time.Second, time.Nanosecond);
+    BlPrint(L"%02d/%02d/%04d - %02d:%02d:%0d.%d\r\n\n", time.Month, time.Day, time.Year, time.Hour, time.Minute, time.Second, time.Nanosecond);
 
     EFI_STATUS Status;
     EFI_EVENT                         TimerEvent;
+    EFI_EVENT                         DeadlineEvent;
     UINTN                             WaitIndex;
 
-    UINT64 timeout_seconds = 10; // 10 seconds
+    UINT64 timeout_seconds;
     EFI_INPUT_KEY key = { 0 };
 
     if (!TRY( 
@@ -133,147 +149,233 @@ UefiMain(
         )
     )
     {
-        getc();
+        PAUSE();
         return LAST_ERROR;
     }
 
-    if (!BlInitFileSystem())
-    {
-        return 1;
-    }
-
-    if (BlGetRootDirectory(NULL))
-    {
-        BlListAllFiles();
-    }
-    else
+    if (!TRY( 
+            gBS->CreateEvent(EVT_TIMER, TPL_CALLBACK, NULL, NULL, &DeadlineEvent),
+            L"Failed to create deadline event\n"
+        )
+    )
     {
-        if (EFI_ERROR(FILE_SYSTEM_STATUS))
-        {
-            Print(L"[ %r ] Failed to get root directory of current FS\n", BlGetLastFileError());
-        }
+        gBS->CloseEvent(TimerEvent);
+        PAUSE();
+        return LAST_ERROR;
     }
 
-    getc();
-
-    Print(L"Looking for 'kernel.exe' file pointer\n");
-    EFI_FILE_PROTOCOL* File = NULL;
-    if (BlFindFile(L"kernel.exe", &File))
+    BlTraceBegin("fs.init");
+    if (!BlInitFileSystem())
     {
-        CHAR16* Buffer;
-        if (BlGetFileName(File, &Buffer))
-        {
-            Print(L"Got the file -> %s\n",Buffer);
-        }
-        FreePool(Buffer);
+        BlLogFlush();
+        return 1;
     }
+    BlTraceEnd("fs.init");
 
-    getc();
+    // parsed once, decides where the kernel comes from and how long we wait for it
+    BlTraceBegin("config.load");
+    BL_STATUS ConfigStatus = BlLoadConfig();
+    BlTraceEnd("config.load");
 
-    if (BlGetRootDirectoryByIndex(FS1, NULL))
+    CONST BL_CONFIG* Config = BlGetConfig();
+    if (Config->Loaded)
     {
-        BlListAllFiles();
+        BlPrint(L"Using %s%s, %s profile\n", Config->LoadedFrom, BL_SUCCESS(ConfigStatus) ? L"" : L" with errors", Config->Profile == BlProfileFast ? L"fast" : L"interactive");
     }
-    else
+    timeout_seconds = Config->Timeout;
+
+    // the kernel and bundle are unpacked and checked on every processor the config allows
+    BlTraceBegin("mp.init");
+    BlMpInit();
+    BlTraceEnd("mp.init");
+
+    // the kernel is found and loaded in steps between countdown ticks, nothing after the
+    // countdown waits on the disk unless the countdown was shorter than the load
+    BL_PRELOAD     Preload;
+    BL_PAGE_TABLES PageTables;
+    BOOLEAN        KernelReady = FALSE;
+    BlStartPreload(&Preload);
+
+    // the countdown runs against one deadline so time spent in preload steps still counts,
+    // the periodic tick only redraws it
+    if (!TRY(gBS->SetTimer(DeadlineEvent, TimerRelative, timeout_seconds * 10000000), L"\nError setting deadline event") ||
+        !TRY(gBS->SetTimer(TimerEvent, TimerPeriodic, 10000000), L"\nError setting timer event"))
     {
-        if (EFI_ERROR(FILE_SYSTEM_STATUS))
-        {
-            Print(L"[ %r ] Failed to get root directory of current FS\n", BlGetLastFileError());
-        }
+        BlClosePreload(&Preload);
+        gBS->CloseEvent(DeadlineEvent);
+        gBS->CloseEvent(TimerEvent);
+        PAUSE();
+        return LAST_ERROR;
     }
 
-    getc();
-
-    Print(L"Looking for 'kernel.exe' file pointer\n");
-    if (BlFindFile(L"kernel.exe", &File))
+    BlTraceBegin("countdown");
+    while (timeout_seconds > 0) 
     {
-        CHAR16* Buffer;
-        if (BlGetFileName(File, &Buffer))
+        BlPrint(L"Continuing in %llu, press 's' to stop timer or press any other key to continue. %s\r", timeout_seconds, BlPreloadFinished(&Preload) ? L"(kernel ready)  " : L"(loading kernel)");
+
+        // Wait on the key, the redraw tick, the deadline and the next preload step. Once the
+        // preload is finished its step event is never signalled again.
+        EFI_EVENT WaitList[4] = { CIN->WaitForKey, TimerEvent, DeadlineEvent, Preload.StepEvent };
+        BlLogFlush();
+        Status = gBS->WaitForEvent(Preload.StepEvent ? 4 : 3, WaitList, &WaitIndex);
+        if (EFI_ERROR(Status))
         {
-            Print(L"Got the file -> %s\n", Buffer);
+            break;
         }
-        FreePool(Buffer);
-    }
 
-    while (timeout_seconds > 0) 
-    {
-        Print(L"Continuing in %llu, press 's' to stop timer or press any other key to continue. \r", timeout_seconds);
-
-        // Set the timer event to fire after 1 second (10,000,000 x 100ns)
-        if (!TRY(gBS->SetTimer(TimerEvent, TimerRelative, 10000000), L"\nError setting timer event"))
+        if (WaitIndex == 3)
         {
-            gBS->CloseEvent(TimerEvent);
-            getc();
-            return LAST_ERROR;
+            BlPreloadStep(&Preload);
+            continue;
         }
 
-        // Wait on both the key event and the timer event
-        EFI_EVENT WaitList[2] = { CIN->WaitForKey, TimerEvent };
-        Status = gBS->WaitForEvent(2, WaitList, &WaitIndex);
+        if (WaitIndex == 0) 
+        {  // Key event occurred
 
-        // Cancel the timer so it doesn't fire again
-        gBS->SetTimer(TimerEvent, TimerCancel, 0);
-
-        // check if the key event occurred
-        if (Status != EFI_TIMEOUT)
-        {
-            if (WaitIndex == 0) 
-            {  // Key event occurred
+            if( !TRY( CIN->ReadKeyStroke(CIN, &key ), L"Error reading keystroke") )
+            {
+                BlClosePreload(&Preload);
+                gBS->CloseEvent(DeadlineEvent);
+                gBS->CloseEvent(TimerEvent);
+                PAUSE();
+                return LAST_ERROR;
+            }
 
-                if( !TRY( CIN->ReadKeyStroke(CIN, &key ), L"Error reading keystroke") )
+            if (key.UnicodeChar == L's') 
+            {
+                BlPrint(L"\nTimer stopped.\n");
+                getc();
+            }
+            else 
+            {
+                BlPrint(L"\n");
+                if ( !TRY( CIN->Reset(CIN, FALSE), L"Error resetting input buffer") )
                 {
+                    BlClosePreload(&Preload);
+                    gBS->CloseEvent(DeadlineEvent);
                     gBS->CloseEvent(TimerEvent);
-                    getc();
+                    PAUSE();
                     return LAST_ERROR;
                 }
-
-                if (key.UnicodeChar == L's') 
-                {
-                    Print(L"\nTimer stopped.\n");
-                    getc();
-                }
-                else 
-                {
-                    Print(L"\n");
-                    if ( !TRY( CIN->Reset(CIN, FALSE), L"Error resetting input buffer") )
-                    {
-                        gBS->CloseEvent(TimerEvent);
-                        getc();
-                        return LAST_ERROR;
-                    }
-                }
-                break;  // Exit the loop if a key was pressed
             }
+            break;  // Exit the loop if a key was pressed
         }
 
-        // Timer event occurred: decrement the timeout counter.
-        timeout_seconds--;
+        if (WaitIndex == 2)
+        {
+            timeout_seconds = 0;
+            break;
+        }
+
+        // Tick: a long preload step can swallow ticks, the deadline decides when we are done
+        if (timeout_seconds > 1)
+        {
+            timeout_seconds--;
+        }
     }
 
+    gBS->CloseEvent(DeadlineEvent);
+    gBS->CloseEvent(TimerEvent);
+    BlTraceEnd("countdown");
+
     if (!timeout_seconds)
     {
-        Print(L"\n");
+        BlPrint(L"\n");
     }
-    Print(L"\r\n");
+    BlPrint(L"\r\n");
+
+    // only whatever the countdown did not already cover is waited for here
+    BlLogFlush();
+    BlTraceBegin("preload.wait");
+    BL_STATUS PreloadStatus = BlWaitPreload(&Preload);
+    BlTraceEnd("preload.wait");
+
+    if (BL_SUCCESS(PreloadStatus))
+    {
+        BlPrint(L"Loaded kernel%s at 0x%llx (preferred 0x%llx), entry 0x%llx, %llu bytes read%s%s\n", Preload.FromBundle ? L" from boot bundle" : L"", Preload.Kernel.ImageBase, Preload.Kernel.PreferredBase, Preload.Kernel.EntryPoint, Preload.Kernel.BytesRead, Preload.Kernel.Verified ? L", digest verified" : L"", Preload.Cached ? L", remembered target" : L"");
+
+        // built while boot services can still allocate, handed over with the kernel
+        BlTraceBegin("paging.build");
+        KernelReady = BL_SUCCESS(BlBuildPageTables(&Preload.Kernel, &PageTables));
+        BlTraceEnd("paging.build");
+
+        if (KernelReady)
+        {
+            BlPrint(L"Page tables at 0x%llx: %llu GiB direct mapped with %s pages, kernel at 0x%llx entry 0x%llx, %llu x 1G %llu x 2M %llu x 4K pages\n",
+                PageTables.Root, PageTables.DirectMapSize / SIZE_1GB, PageTables.LargePageSize == SIZE_1GB ? L"1 GiB" : L"2 MiB",
+                PageTables.KernelBase, PageTables.KernelEntry, PageTables.PageCount[2], PageTables.PageCount[1], PageTables.PageCount[0]);
+        }
+    }
+    else
+    {
+        BlPrint(L"Failed to load the kernel (0x%08x)\n", Preload.Status);
+    }
+
+    BlClosePreload(&Preload);
+
+#ifdef _DEBUG_
+    if (Config->ListFiles && BlGetRootDirectory(NULL))
+    {
+        BlListAllFiles();
+    }
+#endif
 
 #ifdef _DEBUG_
-    Print(L"EFI System Table Info\r\n   Signature: 0x%lx\r\n   UEFI Revision: 0x%08x\r\n   Header Size: %u Bytes\r\n   CRC32: 0x%08x\r\n   Reserved: 0x%x\r\n", ST->Hdr.Signature, ST->Hdr.Revision, ST->Hdr.HeaderSize, ST->Hdr.CRC32, ST->Hdr.Reserved);
+    BlPrint(L"EFI System Table Info\r\n   Signature: 0x%lx\r\n   UEFI Revision: 0x%08x\r\n   Header Size: %u Bytes\r\n   CRC32: 0x%08x\r\n   Reserved: 0x%x\r\n", ST->Hdr.Signature, ST->Hdr.Revision, ST->Hdr.HeaderSize, ST->Hdr.CRC32, ST->Hdr.Reserved);
 #else
-    Print(L"EFI System Table Info\r\n   Signature: 0x%lx\r\n   UEFI Revision: %u.%u", ST->Hdr.Signature, ST->Hdr.Revision >> 16, (ST->Hdr.Revision & 0xFFFF) / 10);
+    BlPrint(L"EFI System Table Info\r\n   Signature: 0x%lx\r\n   UEFI Revision: %u.%u", ST->Hdr.Signature, ST->Hdr.Revision >> 16, (ST->Hdr.Revision & 0xFFFF) / 10);
     if ((ST->Hdr.Revision & 0xFFFF) % 10)
     {
-        Print(L".%u\r\n", (ST->Hdr.Revision & 0xFFFF) % 10); // UEFI major.minor version numbers are defined in BCD (in a 65535.65535 format) and are meant to be displayed as 2 digits if the minor ones digit is 0. Sub-minor revisions are included in the minor number. See the "EFI_TABLE_HEADER" section in any UEFI spec.
+        BlPrint(L".%u\r\n", (ST->Hdr.Revision & 0xFFFF) % 10); // UEFI major.minor version numbers are defined in BCD (in a 65535.65535 format) and are meant to be displayed as 2 digits if the minor ones digit is 0. Sub-minor revisions are included in the minor number. See the "EFI_TABLE_HEADER" section in any UEFI spec.
         // The spec also states that minor versions are limited to a max of 99, even though they get to have a whole 16-bit number.
     }
     else
     {
-        Print(L"\r\n");
+        BlPrint(L"\r\n");
+    }
+#endif
+
+    BlPrint(L"   Firmware Vendor: %s\r\n   Firmware Revision: 0x%08x\r\n", ST->FirmwareVendor, ST->FirmwareRevision);
+
+#ifdef _DEBUG_
+    // dumped from the host, e.g. pmemsave in the QEMU monitor, and fed to TraceDump.py
+    if (BlGetTrace())
+    {
+        BlPrint(L"Boot trace at 0x%llx, %u bytes\r\n", (UINT64)(UINTN)BlGetTrace(), (UINT32)sizeof(BOOT_TRACE));
     }
+
+    // calibrated here rather than at the handoff so the counters come out in microseconds
+    BlTraceCalibrate();
+    BlPrint(L"Loader I/O\r\n");
+    BlTracePrintCounters();
 #endif
 
-    Print(L"   Firmware Vendor: %s\r\n   Firmware Revision: 0x%08x\r\n", ST->FirmwareVendor, ST->FirmwareRevision);
+    BlTraceBegin("console.wait");
+    PAUSE();
+    BlTraceEnd("console.wait");
+
+    // the last allocations are made here, the memory map the kernel gets is the one after them
+    BL_HANDOFF Handoff;
+    if (KernelReady)
+    {
+        BlTraceBegin("handoff.prepare");
+        BL_STATUS HandoffStatus = BlPrepareHandoff(&Preload, &PageTables, &Handoff);
+        BlTraceEnd("handoff.prepare");
+
+        if (BL_SUCCESS(HandoffStatus))
+        {
+            // the last point boot services are still there, the next boot goes straight to it
+            BlTraceBegin("target.save");
+            BlSaveBootTarget(&Preload.Target, Preload.Volume);
+            BlTraceEnd("target.save");
 
-    getc();
+            BlEnterKernel(ImageHandle, &Handoff, &PageTables);
+
+            // boot services may already be partly shut down, there is nobody left to tell
+            CpuDeadLoop();
+        }
+    }
 
+    BlLogFlush();
     return EFI_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "arena.h"
+#include "log.h"
+#include "trace.h"
+
+static BL_ARENA LoaderArena;
+
+BOOLEAN
+BLAPI
+BlArenaCreate(
+    _Out_ PBL_ARENA Arena,
+    _In_  UINT64 Size
+)
+{
+    if (!Arena || !Size)
+    {
+        return FALSE;
+    }
+
+    ZeroMem(Arena, sizeof(BL_ARENA));
+
+    EFI_PHYSICAL_ADDRESS Base;
+    EFI_STATUS Status = gBS->AllocatePages(AllocateAnyPages, EfiLoaderData, EFI_SIZE_TO_PAGES(Size), &Base);
+    if (EFI_ERROR(Status))
+    {
+        BlPrint(L"[ %r ] - Failed to allocate %llu bytes for arena\n", Status, Size);
+        return FALSE;
+    }
+
+    Arena->Base = (UINT8*)(UINTN)Base;
+    Arena->Size = EFI_PAGES_TO_SIZE(EFI_SIZE_TO_PAGES(Size));
+    return TRUE;
+}
+
+VOID*
+BLAPI
+BlArenaAlloc(
+    _Inout_ PBL_ARENA Arena,
+    _In_    UINT64 Size,
+    _In_    UINT64 Align
+)
+{
+    if (!Arena || !Arena->Base)
+    {
+        return NULL;
+    }
+
+    if (!Align)
+    {
+        Align = 8;
+    }
+
+    UINT64 Offset = ALIGN_VALUE(Arena->Used, Align);
+    if (Offset > Arena->Size || Size > Arena->Size - Offset)
+    {
+        return NULL;
+    }
+
+    BlTraceCount(BlCounterArena, Size);
+    Arena->Used = Offset + Size;
+    return Arena->Base + Offset;
+}
+
+UINT64
+BLAPI
+BlArenaMark(
+    _In_ PBL_ARENA Arena
+)
+{
+    return Arena ? Arena->Used : 0;
+}
+
+VOID
+BLAPI
+BlArenaReset(
+    _Inout_ PBL_ARENA Arena,
+    _In_    UINT64 Mark
+)
+{
+    if (Arena && Mark <= Arena->Used)
+    {
+        Arena->Used = Mark;
+    }
+}
+
+VOID
+BLAPI
+BlArenaDestroy(
+    _Inout_ PBL_ARENA Arena
+)
+{
+    if (!Arena || !Arena->Base)
+    {
+        return;
+    }
+
+    gBS->FreePages((EFI_PHYSICAL_ADDRESS)(UINTN)Arena->Base, EFI_SIZE_TO_PAGES(Arena->Size));
+    ZeroMem(Arena, sizeof(BL_ARENA));
+}
+
+PBL_ARENA
+BLAPI
+BlGetLoaderArena(
+    VOID
+)
+{
+    if (!LoaderArena.Base && !BlArenaCreate(&LoaderArena, BL_LOADER_ARENA_SIZE))
+    {
+        return NULL;
+    }
+
+    return &LoaderArena;
+}
\ No newline at end of file
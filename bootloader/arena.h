@@ -0,0 +1,91 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include "boot.h"
+
+//
+//
+// Bump allocator over one block of pages. Loader-lifetime data is carved out of it instead
+// of going through AllocatePool every time, and scratch users rewind it with a mark.
+//
+//
+
+#define BL_LOADER_ARENA_SIZE 0x40000
+
+typedef struct _BL_ARENA
+{
+    UINT8* Base;
+    UINT64 Size;
+    UINT64 Used;
+} BL_ARENA, *PBL_ARENA;
+
+/**
+* Creates an arena backed by freshly allocated EfiLoaderData pages.
+* 
+* @param Arena The arena to initialise.
+* @param Size  Bytes to reserve, rounded up to whole pages.
+* 
+* @return TRUE on success, FALSE if the pages could not be allocated.
+*/
+BOOLEAN
+BLAPI
+BlArenaCreate(
+    _Out_ PBL_ARENA Arena,
+    _In_  UINT64 Size
+);
+
+/**
+* Takes Size bytes from the arena. The memory is not zeroed.
+* 
+* @param Align Power of two alignment, 0 for the default of 8.
+* 
+* @return The memory, NULL if the arena is exhausted.
+*/
+VOID*
+BLAPI
+BlArenaAlloc(
+    _Inout_ PBL_ARENA Arena,
+    _In_    UINT64 Size,
+    _In_    UINT64 Align
+);
+
+/**
+* Gets the current fill level, pass it to BlArenaReset to free everything taken since.
+*/
+UINT64
+BLAPI
+BlArenaMark(
+    _In_ PBL_ARENA Arena
+);
+
+/**
+* Rewinds the arena to a mark taken earlier.
+*/
+VOID
+BLAPI
+BlArenaReset(
+    _Inout_ PBL_ARENA Arena,
+    _In_    UINT64 Mark
+);
+
+/**
+* Gives the arena's pages back to the firmware.
+*/
+VOID
+BLAPI
+BlArenaDestroy(
+    _Inout_ PBL_ARENA Arena
+);
+
+/**
+* Gets the loader wide arena, created on first use.
+* 
+* @return The arena, NULL if it could not be created.
+*/
+PBL_ARENA
+BLAPI
+BlGetLoaderArena(
+    VOID
+);
+
+#endif // !_ARENA_H
\ No newline at end of file
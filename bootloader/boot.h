@@ -4,6 +4,7 @@
 #include <Library/UefiLib.h>
 #include <Library/DebugLib.h>
 #include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiRuntimeServicesTableLib.h>
 #include <Library/DevicePathLib.h>
@@ -17,3 +18,8 @@
 #include "efi.h"
 #include "bdefs.h"
 #include "status.h"
+#include "../kernal/bootinfo.h"
+
+// EFI reserves memory types from 0x80000000 up for OS loaders, allocations made for the
+// kernel carry the BOOT_MEMORY_TYPE they are handed over as
+#define BL_MEMORY_TYPE(Type) ((EFI_MEMORY_TYPE)(0x80000000 | (Type)))
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "bootvar.h"
+#include "log.h"
+#include "filesystem.h"
+
+BOOLEAN
+BLAPI
+BlFindBootTarget(
+    _Out_ PBL_BOOT_TARGET Target,
+    _Out_ UINT32* Index
+)
+{
+    EFI_GUID Vendor     = BL_LOADER_VENDOR_GUID;
+    EFI_GUID FileSystem = EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID;
+    UINT32   Attributes;
+    UINTN    Size = sizeof(BL_BOOT_TARGET);
+
+    ZeroMem(Target, sizeof(BL_BOOT_TARGET));
+    if (EFI_ERROR(gRT->GetVariable(BL_BOOT_TARGET_VARIABLE, &Vendor, &Attributes, &Size, Target)))
+    {
+        return FALSE;
+    }
+
+    // written by us with these exact sizes, anything else is stale or was not ours
+    if (Size < OFFSET_OF(BL_BOOT_TARGET, DevicePath) ||
+        Target->Version != BL_BOOT_TARGET_VERSION ||
+        Target->DevicePathSize > BL_BOOT_TARGET_MAX_DEVICE_PATH ||
+        Size != BL_BOOT_TARGET_SIZE(Target) ||
+        Target->Path[BL_CONFIG_MAX_PATH - 1] != L'\0' ||
+        !IsDevicePathValid((EFI_DEVICE_PATH_PROTOCOL*)Target->DevicePath, Target->DevicePathSize))
+    {
+        return FALSE;
+    }
+
+    // the device path has to name the file system itself, not something below or above it
+    EFI_DEVICE_PATH_PROTOCOL* Remaining = (EFI_DEVICE_PATH_PROTOCOL*)Target->DevicePath;
+    EFI_HANDLE                Handle;
+    if (EFI_ERROR(gBS->LocateDevicePath(&FileSystem, &Remaining, &Handle)) || !IsDevicePathEnd(Remaining))
+    {
+        return FALSE;
+    }
+
+    return BlFindVolumeIndex(Handle, Index);
+}
+
+BL_STATUS
+BLAPI
+BlSaveBootTarget(
+    _Inout_ PBL_BOOT_TARGET Target,
+    _In_    UINT32 Volume
+)
+{
+    CONST BL_VOLUME* Entry = BlGetVolume(Volume);
+    if (!Target || !Target->Path[0] || !Entry)
+    {
+        return BL_STATUS_INVALID_PARAMETER;
+    }
+
+    EFI_DEVICE_PATH_PROTOCOL* DevicePath = DevicePathFromHandle(Entry->Handle);
+    UINTN                     PathSize   = DevicePath ? GetDevicePathSize(DevicePath) : 0;
+    if (!PathSize || PathSize > BL_BOOT_TARGET_MAX_DEVICE_PATH)
+    {
+        return BL_STATUS_UNSUPPORTED;
+    }
+
+    Target->Version        = BL_BOOT_TARGET_VERSION;
+    Target->DevicePathSize = (UINT32)PathSize;
+    CopyMem(Target->DevicePath, DevicePath, PathSize);
+    ZeroMem(Target->DevicePath + PathSize, BL_BOOT_TARGET_MAX_DEVICE_PATH - PathSize);
+
+    // a warm reboot finds the variable unchanged, nothing gets written then
+    BL_BOOT_TARGET Stored;
+    UINT32         StoredVolume;
+    if (BlFindBootTarget(&Stored, &StoredVolume) && !CompareMem(&Stored, Target, BL_BOOT_TARGET_SIZE(Target)))
+    {
+        return BL_STATUS_OK;
+    }
+
+    EFI_GUID   Vendor = BL_LOADER_VENDOR_GUID;
+    EFI_STATUS Status = gRT->SetVariable(BL_BOOT_TARGET_VARIABLE, &Vendor, EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS, BL_BOOT_TARGET_SIZE(Target), Target);
+    if (EFI_ERROR(Status))
+    {
+        BlPrint(L"[ %r ] - Failed to remember the boot target\n", Status);
+        return BL_STATUS_GENERIC_ERROR;
+    }
+
+    return BL_STATUS_OK;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef _BOOTVAR_H
+#define _BOOTVAR_H
+
+#include "boot.h"
+#include "config.h"
+
+//
+//
+// Remembers where the last boot found its kernel in a non-volatile EFI variable. The next
+// boot resolves the stored device path straight to its volume, opens the one file there
+// and checks its size and modification time, so a warm reboot touches a single volume.
+// Anything that does not match, a changed file, a moved disk or a different
+// configuration, falls back to full discovery. The variable is only written when the
+// target changed, flash wears out.
+//
+//
+
+#define BL_BOOT_TARGET_VARIABLE        L"OpliOSBootTarget"
+#define BL_BOOT_TARGET_VERSION         1
+#define BL_BOOT_TARGET_MAX_DEVICE_PATH 512
+
+// the loader's own variable namespace
+#define BL_LOADER_VENDOR_GUID \
+    { 0x6f706c69, 0x4f53, 0x4c64, { 0x8a, 0x1e, 0x3c, 0x52, 0x9b, 0x07, 0xd4, 0x61 } }
+
+// BL_BOOT_TARGET Flags
+#define BL_BOOT_TARGET_BUNDLE 0x00000001 // Path is a boot bundle, a bare kernel otherwise
+
+typedef struct _BL_BOOT_TARGET
+{
+    UINT32   Version;                        // BL_BOOT_TARGET_VERSION
+    UINT32   Flags;                          // BL_BOOT_TARGET_*
+    UINT64   FileSize;
+    EFI_TIME ModificationTime;
+    CHAR16   Path[BL_CONFIG_MAX_PATH];       // from the volume root
+    UINT32   DevicePathSize;                 // bytes of DevicePath in use, end node included
+    UINT8    DevicePath[BL_BOOT_TARGET_MAX_DEVICE_PATH]; // the volume's device path
+} BL_BOOT_TARGET, *PBL_BOOT_TARGET;
+
+// only the used part of DevicePath is stored
+#define BL_BOOT_TARGET_SIZE(Target) (OFFSET_OF(BL_BOOT_TARGET, DevicePath) + (Target)->DevicePathSize)
+
+/**
+* Reads the target the last boot stored and finds its volume, without opening any volume.
+*
+* @param Target Receives the stored target.
+* @param Index  Receives the volume table index of its volume.
+*
+* @return TRUE if there is a well formed target whose volume is still present.
+*/
+BOOLEAN
+BLAPI
+BlFindBootTarget(
+    _Out_ PBL_BOOT_TARGET Target,
+    _Out_ UINT32* Index
+);
+
+/**
+* Stores the target the kernel was loaded from, unless the variable already holds it.
+* Needs boot services, the variable is not visible at runtime.
+*
+* @param Target The target, DevicePath is filled in from the volume's handle.
+* @param Volume The volume table index Target was found on.
+*
+* @return BL_STATUS_OK if the variable holds the target now.
+*/
+BL_STATUS
+BLAPI
+BlSaveBootTarget(
+    _Inout_ PBL_BOOT_TARGET Target,
+    _In_    UINT32 Volume
+);
+
+#endif // !_BOOTVAR_H
\ No newline at end of file
@@ -0,0 +1,402 @@
+#include "bundle.h"
+#include "log.h"
+#include "filesystem.h"
+#include "mp.h"
+#include "../kernal/rtl.h"
+
+/**
+* Checks the index of a bundle whose header is in memory. Every payload must be aligned,
+* lie inside the file and come after the one before it, so lookups afterwards need no
+* checks of their own.
+*/
+static
+BOOLEAN
+BlpValidateBundle(
+    _In_ CONST UINT8* Base,
+    _In_ UINT64 Size
+)
+{
+    CONST BL_BUNDLE_HEADER* Header = (CONST BL_BUNDLE_HEADER*)Base;
+    if (Size < sizeof(BL_BUNDLE_HEADER) ||
+        Header->Signature != BL_BUNDLE_SIGNATURE ||
+        Header->Version != BL_BUNDLE_VERSION)
+    {
+        BlPrint(L"File is not a version %u boot bundle\n", BL_BUNDLE_VERSION);
+        return FALSE;
+    }
+
+    if (!Header->EntryCount || Header->EntryCount > BL_BUNDLE_MAX_ENTRIES ||
+        Header->HeaderSize < sizeof(BL_BUNDLE_HEADER) + Header->EntryCount * sizeof(BL_BUNDLE_ENTRY) ||
+        Header->HeaderSize & (BL_BUNDLE_ALIGNMENT - 1) ||
+        Header->HeaderSize > Header->BundleSize || Header->BundleSize > Size)
+    {
+        BlPrint(L"Boot bundle has a malformed header\n");
+        return FALSE;
+    }
+
+    CONST BL_BUNDLE_ENTRY* Entries = (CONST BL_BUNDLE_ENTRY*)(Base + sizeof(BL_BUNDLE_HEADER));
+    UINT64                 End     = Header->HeaderSize;
+    for (UINT32 i = 0; i < Header->EntryCount; i++)
+    {
+        CONST BL_BUNDLE_ENTRY* Entry = &Entries[i];
+        if (Entry->Name[BL_BUNDLE_NAME_LENGTH - 1] ||
+            Entry->Offset & (BL_BUNDLE_ALIGNMENT - 1) ||
+            Entry->Offset < End ||
+            Entry->Offset > Header->BundleSize ||
+            Entry->Size > Header->BundleSize - Entry->Offset)
+        {
+            BlPrint(L"Boot bundle entry %u is malformed\n", i);
+            return FALSE;
+        }
+
+        End = Entry->Offset + Entry->Size;
+    }
+
+    return TRUE;
+}
+
+/**
+* Called with every range of the file once it is in memory, in file order. Validates the
+* index as soon as it is there and hashes whatever payload bytes the range holds, so each
+* payload is checked while later ones are still being read. Once Indexed is set nothing
+* here calls into the firmware.
+*/
+static
+BL_STATUS
+BlpBundleArrived(
+    _Inout_ BL_BUNDLE_CHECK* Check,
+    _In_    UINT64 Start,
+    _In_    UINT64 End
+)
+{
+    CONST BL_BUNDLE_HEADER* Header = (CONST BL_BUNDLE_HEADER*)Check->Base;
+
+    if (!Check->Indexed)
+    {
+        // the index is a few pages at most, far less than one read
+        if (End < Check->Size && (End < sizeof(BL_BUNDLE_HEADER) || End < Header->HeaderSize))
+        {
+            return BL_STATUS_OK;
+        }
+
+        if (!BlpValidateBundle(Check->Base, Check->Size))
+        {
+            return BL_STATUS_INVALID_IMAGE;
+        }
+
+        // payloads start after the index, everything read so far is hashed from the top
+        Check->Indexed = TRUE;
+        Check->Next    = 0;
+        Start          = 0;
+        BlSha256Init(&Check->Hash);
+    }
+
+    CONST BL_BUNDLE_ENTRY* Entries = (CONST BL_BUNDLE_ENTRY*)(Check->Base + sizeof(BL_BUNDLE_HEADER));
+    while (Check->Next < Header->EntryCount)
+    {
+        CONST BL_BUNDLE_ENTRY* Entry      = &Entries[Check->Next];
+        UINT64                 PayloadEnd = Entry->Offset + Entry->Size;
+
+        if (Entry->Offset > End || (Entry->Offset == End && Entry->Size))
+        {
+            break;
+        }
+
+        UINT64 From = MAX(Start, Entry->Offset);
+        UINT64 To   = MIN(End, PayloadEnd);
+        if (To > From)
+        {
+            BlSha256Update(&Check->Hash, Check->Base + From, (UINTN)(To - From));
+        }
+
+        if (PayloadEnd > End)
+        {
+            break;
+        }
+
+        UINT8 Digest[BL_SHA256_DIGEST_SIZE];
+        BlSha256Final(&Check->Hash, Digest);
+        if (RtlCompareMemory(Digest, Entry->Digest, BL_SHA256_DIGEST_SIZE))
+        {
+            return BL_STATUS_INTEGRITY_ERROR;
+        }
+
+        Check->Next++;
+        BlSha256Init(&Check->Hash);
+    }
+
+    return BL_STATUS_OK;
+}
+
+/**
+* BL_MP_ROUTINE checking the range in Check->Start and Check->End.
+*/
+static
+BOOLEAN
+BLAPI
+BlpBundleHash(
+    _In_ VOID* Context,
+    _In_ UINT32 Index
+)
+{
+    BL_BUNDLE_CHECK* Check = (BL_BUNDLE_CHECK*)Context;
+
+    (VOID)Index; // one range per job
+    Check->Result = BlpBundleArrived(Check, Check->Start, Check->End);
+    return BL_SUCCESS(Check->Result);
+}
+
+/**
+* Waits for the range handed out before and hands out the one that just arrived. The
+* index is validated on the BSP, it prints what is wrong with it.
+*
+* @return What checking the previous range returned. Job is finished either way.
+*/
+static
+BL_STATUS
+BlpBundleNext(
+    _Inout_ PBL_MP_JOB Job,
+    _Inout_ BL_BUNDLE_CHECK* Check,
+    _In_    UINT64 Start,
+    _In_    UINT64 End
+)
+{
+    if (!BlMpFinish(Job))
+    {
+        return Check->Result;
+    }
+
+    if (!Check->Indexed)
+    {
+        return BlpBundleArrived(Check, Start, End);
+    }
+
+    Check->Start = Start;
+    Check->End   = End;
+    BlMpPrepare(Job, BlpBundleHash, Check, 1);
+    BlMpStart(Job);
+    return BL_STATUS_OK;
+}
+
+/**
+* Waits for the last range handed out.
+*
+* @return Result if it already is an error, else what checking that range returned.
+*/
+static
+BL_STATUS
+BlpBundleDone(
+    _Inout_ PBL_MP_JOB Job,
+    _In_    BL_BUNDLE_CHECK* Check,
+    _In_    BL_STATUS Result
+)
+{
+    if (!BlMpFinish(Job) && BL_SUCCESS(Result))
+    {
+        return Check->Result;
+    }
+
+    return Result;
+}
+
+BL_STATUS
+BLAPI
+BlBundleBegin(
+    _In_     EFI_FILE_PROTOCOL* File,
+    _In_opt_ PBL_FAT_FILE Raw,
+    _Out_    PBL_BOOT_BUNDLE Bundle,
+    _Out_    PBL_BUNDLE_LOAD Load
+)
+{
+    if (!File || !Bundle || !Load)
+    {
+        return BL_STATUS_INVALID_PARAMETER;
+    }
+
+    ZeroMem(Bundle, sizeof(BL_BOOT_BUNDLE));
+    ZeroMem(Load, sizeof(BL_BUNDLE_LOAD));
+
+    if (!BlReaderOpen(File, Raw, &Load->Reader))
+    {
+        BlPrint(L"[ %r ] - Failed to get boot bundle size\n", BlGetLastFileError());
+        return BL_STATUS_READ_ERROR;
+    }
+
+    UINT64 Size = Load->Reader.Size;
+    if (Size < sizeof(BL_BUNDLE_HEADER))
+    {
+        BlPrint(L"Boot bundle is too small\n");
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    Bundle->Pages = EFI_SIZE_TO_PAGES(Size);
+    EFI_STATUS Status = gBS->AllocatePages(AllocateAnyPages, BL_MEMORY_TYPE(BootMemoryModule), Bundle->Pages, &Bundle->Base);
+    if (EFI_ERROR(Status))
+    {
+        BlPrint(L"[ %r ] - Failed to allocate %llu pages for the boot bundle\n", Status, Bundle->Pages);
+        ZeroMem(Bundle, sizeof(BL_BOOT_BUNDLE));
+        return BL_STATUS_OUT_OF_RESOURCES;
+    }
+
+    // the whole file front to back, payloads are never opened or seeked to one by one and
+    // are verified as they come in
+    Load->Bundle        = Bundle;
+    Load->Reader.Buffer = (UINT8*)(UINTN)Bundle->Base;
+    Load->Check.Base    = Load->Reader.Buffer;
+    Load->Check.Size    = Size;
+    Load->Result        = BL_STATUS_OK;
+    BlMpPrepare(&Load->Job, BlpBundleHash, &Load->Check, 0);
+
+    return BL_STATUS_OK;
+}
+
+BL_STATUS
+BLAPI
+BlBundleStep(
+    _Inout_ PBL_BUNDLE_LOAD Load,
+    _In_    BOOLEAN Wait
+)
+{
+    if (Load->Finished)
+    {
+        return Load->Result;
+    }
+
+    UINT64 Start;
+    UINT64 End;
+    if (!BlReaderStep(&Load->Reader, Wait, &Start, &End))
+    {
+        BlPrint(L"[ %r ] - Failed to read the boot bundle\n", BlGetLastFileError());
+        Load->Result = BL_STATUS_READ_ERROR;
+    }
+    else if (End > Start)
+    {
+        // the chunk before this one is checked by now, this one goes to an AP
+        Load->Result = BlpBundleNext(&Load->Job, &Load->Check, Start, End);
+    }
+
+    Load->Finished = !BL_SUCCESS(Load->Result) || Load->Reader.Done == Load->Reader.Size;
+    return Load->Result;
+}
+
+BL_STATUS
+BLAPI
+BlBundleEnd(
+    _Inout_ PBL_BUNDLE_LOAD Load
+)
+{
+    BlReaderClose(&Load->Reader);
+
+    // a payload that failed its digest counts for more than a later read error
+    BL_STATUS Checked = BlpBundleDone(&Load->Job, &Load->Check, BL_STATUS_OK);
+    BL_STATUS Result  = BL_SUCCESS(Checked) ? Load->Result : Checked;
+
+    if (BL_SUCCESS(Result) && !Load->Finished)
+    {
+        // given up on before the last chunk
+        Result = BL_STATUS_GENERIC_ERROR;
+    }
+
+    CONST BL_BUNDLE_HEADER* Header = (CONST BL_BUNDLE_HEADER*)Load->Check.Base;
+    if (Result == BL_STATUS_INTEGRITY_ERROR)
+    {
+        CONST BL_BUNDLE_ENTRY* Entries = (CONST BL_BUNDLE_ENTRY*)(Load->Check.Base + sizeof(BL_BUNDLE_HEADER));
+        BlPrint(L"Boot bundle payload '%a' does not match its digest\n", Entries[Load->Check.Next].Name);
+    }
+
+    // every payload has to have been checked by the time the last byte is in
+    if (BL_SUCCESS(Result) && (!Load->Check.Indexed || Load->Check.Next != Header->EntryCount))
+    {
+        Result = BL_STATUS_INVALID_IMAGE;
+    }
+
+    if (!BL_SUCCESS(Result))
+    {
+        BlFreeBundle(Load->Bundle);
+        return Result;
+    }
+
+    Load->Bundle->Header  = Header;
+    Load->Bundle->Entries = (CONST BL_BUNDLE_ENTRY*)(Load->Check.Base + sizeof(BL_BUNDLE_HEADER));
+    return BL_STATUS_OK;
+}
+
+BL_STATUS
+BLAPI
+BlLoadBundle(
+    _In_     EFI_FILE_PROTOCOL* File,
+    _In_opt_ PBL_FAT_FILE Raw,
+    _Out_    PBL_BOOT_BUNDLE Bundle
+)
+{
+    BL_BUNDLE_LOAD Load;
+    BL_STATUS      Result = BlBundleBegin(File, Raw, Bundle, &Load);
+    if (!BL_SUCCESS(Result))
+    {
+        return Result;
+    }
+
+    while (!Load.Finished)
+    {
+        BlBundleStep(&Load, TRUE);
+    }
+
+    return BlBundleEnd(&Load);
+}
+
+CONST BL_BUNDLE_ENTRY*
+BLAPI
+BlBundleFind(
+    _In_     CONST BL_BOOT_BUNDLE* Bundle,
+    _In_     UINT32 Type,
+    _In_opt_ CONST CHAR8* Name
+)
+{
+    if (!Bundle || !Bundle->Header)
+    {
+        return NULL;
+    }
+
+    for (UINT32 i = 0; i < Bundle->Header->EntryCount; i++)
+    {
+        CONST BL_BUNDLE_ENTRY* Entry = &Bundle->Entries[i];
+        if (Entry->Type != Type)
+        {
+            continue;
+        }
+
+        if (!Name || !AsciiStrnCmp(Entry->Name, Name, BL_BUNDLE_NAME_LENGTH))
+        {
+            return Entry;
+        }
+    }
+
+    return NULL;
+}
+
+VOID*
+BLAPI
+BlBundlePayload(
+    _In_ CONST BL_BOOT_BUNDLE* Bundle,
+    _In_ CONST BL_BUNDLE_ENTRY* Entry
+)
+{
+    return (VOID*)(UINTN)(Bundle->Base + Entry->Offset);
+}
+
+VOID
+BLAPI
+BlFreeBundle(
+    _Inout_ PBL_BOOT_BUNDLE Bundle
+)
+{
+    if (Bundle && Bundle->Base)
+    {
+        gBS->FreePages(Bundle->Base, Bundle->Pages);
+    }
+
+    if (Bundle)
+    {
+        ZeroMem(Bundle, sizeof(BL_BOOT_BUNDLE));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,199 @@
+#ifndef _BUNDLE_H
+#define _BUNDLE_H
+
+#include "boot.h"
+#include "fat.h"
+#include "sha256.h"
+#include "filesystem.h"
+#include "mp.h"
+
+//
+//
+// Boot bundle, the kernel, its modules and the config packed into one file so the loader
+// opens one file and pulls it in with one sequential read. The layout is built by
+// MakeBundle.py on the host:
+//
+//   BL_BUNDLE_HEADER
+//   BL_BUNDLE_ENTRY[EntryCount]
+//   padding up to HeaderSize
+//   payloads, each starting on a BL_BUNDLE_ALIGNMENT boundary
+//
+// Because the whole file lands in one page allocation, every payload is already page
+// aligned in memory and can be handed to the kernel where it lies. Every entry carries the
+// SHA-256 of its payload, payloads are hashed chunk by chunk while the rest of the bundle
+// is still being read and a bundle with a bad payload is rejected.
+//
+//
+
+#define BL_BUNDLE_SIGNATURE   SIGNATURE_64('O', 'P', 'L', 'I', 'B', 'N', 'D', 'L')
+#define BL_BUNDLE_VERSION     2
+#define BL_BUNDLE_ALIGNMENT   EFI_PAGE_SIZE
+#define BL_BUNDLE_NAME_LENGTH 32
+#define BL_BUNDLE_MAX_ENTRIES 64
+#define BL_BUNDLE_PATH        L"boot.bnd"
+
+typedef enum _BL_BUNDLE_ENTRY_TYPE
+{
+    BlBundleKernel = 1,
+    BlBundleModule = 2,
+    BlBundleConfig = 3
+} BL_BUNDLE_ENTRY_TYPE;
+
+typedef struct _BL_BUNDLE_HEADER
+{
+    UINT64 Signature;  // BL_BUNDLE_SIGNATURE
+    UINT32 Version;    // BL_BUNDLE_VERSION
+    UINT32 EntryCount;
+    UINT64 HeaderSize; // header and entry table rounded up to BL_BUNDLE_ALIGNMENT
+    UINT64 BundleSize; // the whole file, payload padding included
+} BL_BUNDLE_HEADER;
+
+typedef struct _BL_BUNDLE_ENTRY
+{
+    CHAR8  Name[BL_BUNDLE_NAME_LENGTH]; // ASCII, NUL padded
+    UINT32 Type;                        // BL_BUNDLE_ENTRY_TYPE
+    UINT32 Reserved;
+    UINT64 Offset;                      // from the start of the bundle, BL_BUNDLE_ALIGNMENT aligned
+    UINT64 Size;                        // payload bytes, without padding
+    UINT8  Digest[BL_SHA256_DIGEST_SIZE]; // SHA-256 of the payload
+} BL_BUNDLE_ENTRY;
+
+typedef struct _BL_BOOT_BUNDLE
+{
+    EFI_PHYSICAL_ADDRESS    Base;   // the bundle file, read as is
+    UINT64                  Pages;
+    CONST BL_BUNDLE_HEADER* Header;
+    CONST BL_BUNDLE_ENTRY*  Entries;
+} BL_BOOT_BUNDLE, *PBL_BOOT_BUNDLE;
+
+//
+// Payload verification state, fed with every range of the file as it lands in memory.
+// Payloads are sorted and do not overlap, so one running hash is enough. Once the index is
+// validated each range is hashed on an AP while the BSP reads the next one.
+//
+typedef struct _BL_BUNDLE_CHECK
+{
+    CONST UINT8* Base;
+    UINT64       Size;    // bytes in the file
+    BOOLEAN      Indexed; // the header arrived and was validated
+    UINT32       Next;    // entry being hashed, the one that failed on an integrity error
+    BL_SHA256    Hash;
+    UINT64       Start;   // the range handed to an AP
+    UINT64       End;
+    BL_STATUS    Result;  // what checking that range returned
+} BL_BUNDLE_CHECK;
+
+//
+// A bundle being read in steps, for callers that service other events between chunks.
+//
+typedef struct _BL_BUNDLE_LOAD
+{
+    PBL_BOOT_BUNDLE Bundle;
+    BL_FILE_READER  Reader;
+    BL_BUNDLE_CHECK Check;
+    BL_MP_JOB       Job;      // hashes the last chunk while the next one is read
+    BL_STATUS       Result;
+    BOOLEAN         Finished; // the whole file is in or reading it failed, call BlBundleEnd
+} BL_BUNDLE_LOAD, *PBL_BUNDLE_LOAD;
+
+/**
+* Reads a whole bundle into one page allocation and validates its index.
+*
+* @param File   The opened bundle file.
+* @param Raw    Optional, the same file resolved by BlFatOpen. The bundle is then read with
+*               large block device transfers and File is only the fallback.
+* @param Bundle Receives the loaded bundle.
+*
+* @return BL_STATUS_OK on success, BL_STATUS_INVALID_IMAGE if the file is not a bundle,
+*         BL_STATUS_INTEGRITY_ERROR if a payload does not match its digest.
+*/
+BL_STATUS
+BLAPI
+BlLoadBundle(
+    _In_     EFI_FILE_PROTOCOL* File,
+    _In_opt_ PBL_FAT_FILE Raw,
+    _Out_    PBL_BOOT_BUNDLE Bundle
+);
+
+/**
+* Starts reading a bundle in steps. The file and Raw must stay open until BlBundleEnd.
+*
+* @param File   The opened bundle file.
+* @param Raw    Optional, the same file resolved by BlFatOpen.
+* @param Bundle Receives the bundle once BlBundleEnd succeeded.
+* @param Load   Receives the read state.
+*
+* @return BL_STATUS_OK if the read started, BlBundleStep and BlBundleEnd follow. On any
+*         other status nothing is left to clean up.
+*/
+BL_STATUS
+BLAPI
+BlBundleBegin(
+    _In_     EFI_FILE_PROTOCOL* File,
+    _In_opt_ PBL_FAT_FILE Raw,
+    _Out_    PBL_BOOT_BUNDLE Bundle,
+    _Out_    PBL_BUNDLE_LOAD Load
+);
+
+/**
+* Reads and checks the next chunk of the bundle, sets Load->Finished after the last one.
+*
+* @param Wait FALSE to return at once when the next chunk is still in flight.
+*
+* @return BL_STATUS_OK while the read is going well, else why it failed.
+*/
+BL_STATUS
+BLAPI
+BlBundleStep(
+    _Inout_ PBL_BUNDLE_LOAD Load,
+    _In_    BOOLEAN Wait
+);
+
+/**
+* Ends a stepped read, finished or not, and validates what was read.
+*
+* @return What BlLoadBundle would have returned. The bundle is freed unless it is BL_STATUS_OK.
+*/
+BL_STATUS
+BLAPI
+BlBundleEnd(
+    _Inout_ PBL_BUNDLE_LOAD Load
+);
+
+/**
+* Finds a payload in a loaded bundle.
+*
+* @param Bundle The bundle filled in by BlLoadBundle.
+* @param Type   The BL_BUNDLE_ENTRY_TYPE wanted.
+* @param Name   Optional, when NULL the first entry of Type is returned.
+*
+* @return The entry, or NULL if there is no such payload.
+*/
+CONST BL_BUNDLE_ENTRY*
+BLAPI
+BlBundleFind(
+    _In_     CONST BL_BOOT_BUNDLE* Bundle,
+    _In_     UINT32 Type,
+    _In_opt_ CONST CHAR8* Name
+);
+
+/**
+* @return Where the payload of Entry lies in memory, page aligned.
+*/
+VOID*
+BLAPI
+BlBundlePayload(
+    _In_ CONST BL_BOOT_BUNDLE* Bundle,
+    _In_ CONST BL_BUNDLE_ENTRY* Entry
+);
+
+/**
+* Releases the pages of a loaded bundle. Payloads handed to the kernel must not be freed.
+*/
+VOID
+BLAPI
+BlFreeBundle(
+    _Inout_ PBL_BOOT_BUNDLE Bundle
+);
+
+#endif // !_BUNDLE_H
\ No newline at end of file
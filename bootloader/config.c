@@ -0,0 +1,391 @@
+#include "config.h"
+#include "log.h"
+#include "filesystem.h"
+
+static BL_CONFIG Config =
+{
+    BlProfileInteractive,
+    BL_CONFIG_DEFAULT_TIMEOUT,
+    BL_CONFIG_ANY_VOLUME,
+    BL_CONFIG_ALL_PROCESSORS,
+    TRUE,
+    TRUE,
+    FALSE,
+    L"\\" BL_KERNEL_PATH,
+    L"\\" BL_BUNDLE_PATH,
+    0,
+    { { 0 } },
+    NULL
+};
+
+static
+VOID
+BlpApplyProfile(
+    _In_ BL_BOOT_PROFILE Profile
+)
+{
+    Config.Profile   = Profile;
+    Config.Timeout   = Profile == BlProfileFast ? 0 : BL_CONFIG_DEFAULT_TIMEOUT;
+    Config.ListFiles = Profile != BlProfileFast;
+    Config.Pause     = Profile != BlProfileFast;
+}
+
+/**
+* Cuts the blanks off both ends of a string in place.
+*/
+static
+CHAR8*
+BlpTrim(
+    _Inout_ CHAR8* String
+)
+{
+    while (*String == ' ' || *String == '\t')
+    {
+        String++;
+    }
+
+    UINTN Length = AsciiStrLen(String);
+    while (Length && (String[Length - 1] == ' ' || String[Length - 1] == '\t' || String[Length - 1] == '\r'))
+    {
+        String[--Length] = '\0';
+    }
+
+    return String;
+}
+
+static
+BOOLEAN
+BlpParseSwitch(
+    _In_  CONST CHAR8* Value,
+    _Out_ BOOLEAN* Switch
+)
+{
+    if (!AsciiStriCmp(Value, "yes") || !AsciiStriCmp(Value, "on") || !AsciiStriCmp(Value, "1"))
+    {
+        *Switch = TRUE;
+        return TRUE;
+    }
+
+    if (!AsciiStriCmp(Value, "no") || !AsciiStriCmp(Value, "off") || !AsciiStriCmp(Value, "0"))
+    {
+        *Switch = FALSE;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static
+BOOLEAN
+BlpParseNumber(
+    _In_  CONST CHAR8* Value,
+    _Out_ UINT32* Number
+)
+{
+    UINT64 Result = 0;
+    if (!*Value)
+    {
+        return FALSE;
+    }
+
+    for (; *Value; Value++)
+    {
+        if (*Value < '0' || *Value > '9')
+        {
+            return FALSE;
+        }
+
+        Result = Result * 10 + (*Value - '0');
+        if (Result >= MAX_UINT32)
+        {
+            return FALSE;
+        }
+    }
+
+    *Number = (UINT32)Result;
+    return TRUE;
+}
+
+/**
+* Copies a path from the volume root, either slash works and the leading one is optional.
+*/
+static
+BOOLEAN
+BlpParsePath(
+    _In_  CONST CHAR8* Value,
+    _Out_ CHAR16* Path
+)
+{
+    UINTN Length = 0;
+
+    if (*Value != '\\' && *Value != '/')
+    {
+        Path[Length++] = L'\\';
+    }
+
+    for (; *Value; Value++)
+    {
+        if (Length + 1 >= BL_CONFIG_MAX_PATH || (UINT8)*Value < ' ' || (UINT8)*Value > '~')
+        {
+            return FALSE;
+        }
+
+        Path[Length++] = *Value == '/' ? L'\\' : (CHAR16)*Value;
+    }
+
+    Path[Length] = L'\0';
+    return Length > 1;
+}
+
+/**
+* Applies one "key = value" line.
+*/
+static
+BOOLEAN
+BlpParseLine(
+    _In_ CONST CHAR8* Key,
+    _In_ CONST CHAR8* Value
+)
+{
+    if (!AsciiStriCmp(Key, "profile"))
+    {
+        if (!AsciiStriCmp(Value, "fast"))
+        {
+            BlpApplyProfile(BlProfileFast);
+            return TRUE;
+        }
+
+        if (!AsciiStriCmp(Value, "interactive"))
+        {
+            BlpApplyProfile(BlProfileInteractive);
+            return TRUE;
+        }
+
+        return FALSE;
+    }
+
+    if (!AsciiStriCmp(Key, "timeout"))
+    {
+        return BlpParseNumber(Value, &Config.Timeout);
+    }
+
+    if (!AsciiStriCmp(Key, "volume"))
+    {
+        if (!AsciiStriCmp(Value, "any"))
+        {
+            Config.Volume = BL_CONFIG_ANY_VOLUME;
+            return TRUE;
+        }
+
+        return BlpParseNumber(Value, &Config.Volume) && Config.Volume < BL_MAX_VOLUMES;
+    }
+
+    if (!AsciiStriCmp(Key, "kernel"))
+    {
+        return BlpParsePath(Value, Config.KernelPath);
+    }
+
+    if (!AsciiStriCmp(Key, "bundle"))
+    {
+        if (!AsciiStriCmp(Value, "none"))
+        {
+            Config.BundlePath[0] = L'\0';
+            return TRUE;
+        }
+
+        return BlpParsePath(Value, Config.BundlePath);
+    }
+
+    if (!AsciiStriCmp(Key, "module"))
+    {
+        UINTN Length = AsciiStrLen(Value);
+        if (!Length || Length >= BL_BUNDLE_NAME_LENGTH || Config.ModuleCount == BL_CONFIG_MAX_MODULES)
+        {
+            return FALSE;
+        }
+
+        CopyMem(Config.Modules[Config.ModuleCount++], Value, Length);
+        return TRUE;
+    }
+
+    if (!AsciiStriCmp(Key, "list"))
+    {
+        return BlpParseSwitch(Value, &Config.ListFiles);
+    }
+
+    if (!AsciiStriCmp(Key, "pause"))
+    {
+        return BlpParseSwitch(Value, &Config.Pause);
+    }
+
+    if (!AsciiStriCmp(Key, "cpus"))
+    {
+        if (!AsciiStriCmp(Value, "all"))
+        {
+            Config.Processors = BL_CONFIG_ALL_PROCESSORS;
+            return TRUE;
+        }
+
+        return BlpParseNumber(Value, &Config.Processors) && Config.Processors;
+    }
+
+    return FALSE;
+}
+
+/**
+* Parses the whole file, Text is NUL terminated and cut up in place.
+*/
+static
+BL_STATUS
+BlpParseConfig(
+    _Inout_ CHAR8* Text
+)
+{
+    BL_STATUS Status = BL_STATUS_OK;
+    UINT32    Line   = 0;
+
+    // editors like to start UTF-8 files with a byte order mark
+    if ((UINT8)Text[0] == 0xEF && (UINT8)Text[1] == 0xBB && (UINT8)Text[2] == 0xBF)
+    {
+        Text += 3;
+    }
+
+    while (*Text)
+    {
+        CHAR8* Start = Text;
+        Line++;
+
+        while (*Text && *Text != '\n')
+        {
+            Text++;
+        }
+
+        if (*Text)
+        {
+            *Text++ = '\0';
+        }
+
+        CHAR8* Comment = Start;
+        while (*Comment && *Comment != '#')
+        {
+            Comment++;
+        }
+        *Comment = '\0';
+
+        CHAR8* Key = BlpTrim(Start);
+        if (!*Key)
+        {
+            continue;
+        }
+
+        CHAR8* Value = Key;
+        while (*Value && *Value != '=')
+        {
+            Value++;
+        }
+
+        BOOLEAN Parsed = FALSE;
+        if (*Value)
+        {
+            *Value++ = '\0';
+            Parsed   = BlpParseLine(BlpTrim(Key), BlpTrim(Value));
+        }
+
+        if (!Parsed)
+        {
+            BlPrint(L"%s:%u: ignoring \"%a\"\n", BL_CONFIG_PATH, Line, Key);
+            Status = BL_STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    return Status;
+}
+
+BL_STATUS
+BLAPI
+BlLoadConfig(
+    VOID
+)
+{
+    static CONST CHAR16* CONST Paths[] =
+    {
+        L"\\" BL_LOADER_DIRECTORY L"\\" BL_CONFIG_PATH,
+        L"\\" BL_CONFIG_PATH
+    };
+
+    // the first lookup builds the loader directory index, later ones come out of it
+    UINT32             Volume = BlGetBootVolumeIndex();
+    EFI_FILE_PROTOCOL* File   = NULL;
+    UINT32             Found  = 0;
+    while (Found < ARRAY_SIZE(Paths) && !BlOpenVolumeFile(Volume, Paths[Found], &File))
+    {
+        Found++;
+    }
+
+    if (Found == ARRAY_SIZE(Paths))
+    {
+        return BL_STATUS_NOT_FOUND;
+    }
+
+    CHAR8* Text = AllocatePool(BL_CONFIG_MAX_SIZE + 1);
+    if (!Text)
+    {
+        File->Close(File);
+        return BL_STATUS_OUT_OF_RESOURCES;
+    }
+
+    UINTN      Size   = BL_CONFIG_MAX_SIZE;
+    EFI_STATUS Result = File->Read(File, &Size, Text);
+    File->Close(File);
+
+    if (EFI_ERROR(Result))
+    {
+        BlPrint(L"[ %r ] - Failed to read %s\n", Result, BL_CONFIG_PATH);
+        FreePool(Text);
+        return BL_STATUS_READ_ERROR;
+    }
+
+    if (Size == BL_CONFIG_MAX_SIZE)
+    {
+        BlPrint(L"%s is cut off after %u bytes\n", BL_CONFIG_PATH, BL_CONFIG_MAX_SIZE);
+    }
+
+    Text[Size]        = '\0';
+    Config.Loaded     = TRUE;
+    Config.LoadedFrom = Paths[Found];
+
+    BL_STATUS Status = BlpParseConfig(Text);
+    FreePool(Text);
+    return Status;
+}
+
+CONST BL_CONFIG*
+BLAPI
+BlGetConfig(
+    VOID
+)
+{
+    return &Config;
+}
+
+BOOLEAN
+BLAPI
+BlConfigWantsModule(
+    _In_ CONST CHAR8* Name
+)
+{
+    if (!Config.ModuleCount)
+    {
+        return TRUE;
+    }
+
+    for (UINT32 i = 0; i < Config.ModuleCount; i++)
+    {
+        if (!AsciiStrnCmp(Config.Modules[i], Name, BL_BUNDLE_NAME_LENGTH))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
\ No newline at end of file
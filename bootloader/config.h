@@ -0,0 +1,94 @@
+#ifndef _CONFIG_H
+#define _CONFIG_H
+
+#include "boot.h"
+#include "bundle.h"
+
+//
+//
+// Boot configuration, read once at startup from BL_CONFIG_PATH in BL_LOADER_DIRECTORY of
+// the boot volume, or failing that in its root. One "key = value" per line, '#' starts a comment, keys are case insensitive:
+//
+//   profile = fast | interactive   fast boots with no countdown, listings or pauses
+//   timeout = <seconds>            countdown before booting, 0 boots at once
+//   volume  = <index> | any        volume table index to boot from, any tries the boot
+//                                  device first and then every other volume
+//   kernel  = <path>               kernel image when there is no bundle
+//   bundle  = <path> | none        boot bundle, none always boots the bare kernel
+//   module  = <name>               bundle module handed to the kernel, may be repeated,
+//                                  every module is handed over when there is none
+//   list    = yes | no             list the volumes' files before booting
+//   pause   = yes | no             wait for a key before leaving boot services and on errors
+//   cpus    = <count> | all        processors loader work is spread over, 1 keeps it all on
+//                                  the boot processor
+//
+// A profile sets timeout, list and pause, so keys that should override it come after it.
+// A missing file boots with the interactive defaults, a bad line is reported and skipped.
+//
+//
+
+#define BL_CONFIG_PATH            L"oplios.cfg"
+#define BL_CONFIG_MAX_SIZE        4096
+#define BL_CONFIG_MAX_PATH        128
+#define BL_CONFIG_MAX_MODULES     16
+#define BL_CONFIG_DEFAULT_TIMEOUT 10
+#define BL_CONFIG_ANY_VOLUME      MAX_UINT32
+#define BL_CONFIG_ALL_PROCESSORS  0
+
+typedef enum _BL_BOOT_PROFILE
+{
+    BlProfileInteractive,
+    BlProfileFast
+} BL_BOOT_PROFILE;
+
+typedef struct _BL_CONFIG
+{
+    BL_BOOT_PROFILE Profile;
+    UINT32          Timeout;                        // seconds
+    UINT32          Volume;                         // BL_CONFIG_ANY_VOLUME to search
+    UINT32          Processors;                     // BL_CONFIG_ALL_PROCESSORS for no limit
+    BOOLEAN         ListFiles;
+    BOOLEAN         Pause;
+    BOOLEAN         Loaded;                         // read from BL_CONFIG_PATH, defaults otherwise
+    CHAR16          KernelPath[BL_CONFIG_MAX_PATH]; // from the volume root, leading backslash
+    CHAR16          BundlePath[BL_CONFIG_MAX_PATH]; // empty when bundles are off
+    UINT32          ModuleCount;
+    CHAR8           Modules[BL_CONFIG_MAX_MODULES][BL_BUNDLE_NAME_LENGTH];
+    CONST CHAR16*   LoadedFrom;                     // where it was read from when Loaded
+} BL_CONFIG, *PBL_CONFIG;
+
+/**
+* Reads BL_CONFIG_PATH from the boot volume into the loader's configuration. The file
+* system must be initialised.
+*
+* @return BL_STATUS_OK if the file was read cleanly, BL_STATUS_NOT_FOUND if there is none,
+*         BL_STATUS_INVALID_PARAMETER if some lines were skipped. The configuration is
+*         usable in every case.
+*/
+BL_STATUS
+BLAPI
+BlLoadConfig(
+    VOID
+);
+
+/**
+* @return The loader's configuration, the interactive defaults until BlLoadConfig ran.
+*/
+CONST BL_CONFIG*
+BLAPI
+BlGetConfig(
+    VOID
+);
+
+/**
+* @param Name Bundle entry name, NUL padded.
+*
+* @return TRUE if the module is handed to the kernel.
+*/
+BOOLEAN
+BLAPI
+BlConfigWantsModule(
+    _In_ CONST CHAR8* Name
+);
+
+#endif // !_CONFIG_H
\ No newline at end of file
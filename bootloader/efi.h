@@ -27,4 +27,4 @@ typedef EFI_IMAGE_NT_HEADERS64 EFI_IMAGE_NT_HEADERS;
           offsetof (EFI_IMAGE_NT_HEADERS, OptionalHeader) + \
           ((EFI_IMAGE_NT_HEADERS *) (ntheader))->FileHeader.SizeOfOptionalHeader \
         ) \
-    )
\ No newline at end of file
+    )
@@ -0,0 +1,796 @@
+#include "fat.h"
+#include "log.h"
+#include "trace.h"
+
+#define FAT_ENTRY_SIZE      32
+#define FAT_ATTR_VOLUME_ID  0x08
+#define FAT_ATTR_DIRECTORY  0x10
+#define FAT_ATTR_LONG_NAME  0x0F
+#define FAT_LFN_LAST        0x40
+#define FAT_LFN_CHARS       13
+#define FAT_LFN_MAX         20
+
+static
+UINT16
+BlpLe16(
+    _In_ CONST UINT8* p
+)
+{
+    return (UINT16)(p[0] | (p[1] << 8));
+}
+
+static
+UINT32
+BlpLe32(
+    _In_ CONST UINT8* p
+)
+{
+    return (UINT32)p[0] | ((UINT32)p[1] << 8) | ((UINT32)p[2] << 16) | ((UINT32)p[3] << 24);
+}
+
+/**
+* Reads whole, aligned blocks straight into Buffer. With BlockIo2 up to BL_FAT_DEPTH
+* transfers of BL_FAT_MAX_TRANSFER bytes are kept in flight.
+*/
+static
+BL_STATUS
+BlpFatReadBlocks(
+    _Inout_ PBL_FAT_FILE File,
+    _In_    EFI_LBA Lba,
+    _Out_   UINT8* Buffer,
+    _In_    UINT64 Size
+)
+{
+    EFI_STATUS Status;
+
+    if (!File->BlockIo2)
+    {
+        while (Size)
+        {
+            UINTN  Transfer = (UINTN)MIN(Size, (UINT64)BL_FAT_MAX_TRANSFER);
+            UINT64 Start    = AsmReadTsc();
+            Status = File->BlockIo->ReadBlocks(File->BlockIo, File->MediaId, Lba, Transfer, Buffer);
+            BlTraceCount(BlCounterBlockRead, Transfer);
+            BlTraceWait(BlCounterBlockRead, AsmReadTsc() - Start);
+            if (EFI_ERROR(Status))
+            {
+                BlPrint(L"[ %r ] - ReadBlocks failed at LBA 0x%llx\n", Status, Lba);
+                return BL_STATUS_READ_ERROR;
+            }
+
+            Lba    += Transfer / File->BlockSize;
+            Buffer += Transfer;
+            Size   -= Transfer;
+        }
+
+        return BL_STATUS_OK;
+    }
+
+    UINT32    Head   = 0;
+    UINT32    Count  = 0;
+    BL_STATUS Result = BL_STATUS_OK;
+
+    while (Size || Count)
+    {
+        // retire the oldest transfer when every token is busy or nothing is left to queue
+        if (Count == BL_FAT_DEPTH || !Size)
+        {
+            EFI_BLOCK_IO2_TOKEN* Done = &File->Tokens[Head];
+            UINTN  Index;
+            UINT64 Start = AsmReadTsc();
+
+            Status = gBS->WaitForEvent(1, &Done->Event, &Index);
+            BlTraceWait(BlCounterBlockRead, AsmReadTsc() - Start);
+            if (EFI_ERROR(Status) || EFI_ERROR(Done->TransactionStatus))
+            {
+                BlPrint(L"[ %r ] - ReadBlocksEx transfer failed\n", EFI_ERROR(Status) ? Status : Done->TransactionStatus);
+                Result = BL_STATUS_READ_ERROR;
+                Size   = 0;
+            }
+
+            Head = (Head + 1) % BL_FAT_DEPTH;
+            Count--;
+            continue;
+        }
+
+        EFI_BLOCK_IO2_TOKEN* Token = &File->Tokens[(Head + Count) % BL_FAT_DEPTH];
+        UINTN Transfer = (UINTN)MIN(Size, (UINT64)BL_FAT_MAX_TRANSFER);
+
+        Token->TransactionStatus = EFI_SUCCESS;
+        Status = File->BlockIo2->ReadBlocksEx(File->BlockIo2, File->MediaId, Lba, Token, Transfer, Buffer);
+        if (EFI_ERROR(Status))
+        {
+            // the event of a rejected request is never signalled, just drain what is queued
+            BlPrint(L"[ %r ] - ReadBlocksEx failed at LBA 0x%llx\n", Status, Lba);
+            Result = BL_STATUS_READ_ERROR;
+            Size   = 0;
+            continue;
+        }
+
+        BlTraceCount(BlCounterBlockRead, Transfer);
+        Count++;
+        Lba    += Transfer / File->BlockSize;
+        Buffer += Transfer;
+        Size   -= Transfer;
+    }
+
+    return Result;
+}
+
+/**
+* Reads any byte range of the partition. Partial blocks and destinations that do not meet
+* IoAlign go through the bounce page, which doubles as a one block cache for FAT lookups.
+*/
+static
+BL_STATUS
+BlpFatReadBytes(
+    _Inout_ PBL_FAT_FILE File,
+    _In_    UINT64 DiskOffset,
+    _Out_   VOID* Buffer,
+    _In_    UINT64 Size
+)
+{
+    UINT8* Out = Buffer;
+
+    while (Size)
+    {
+        EFI_LBA Lba    = DiskOffset / File->BlockSize;
+        UINT64  Within = DiskOffset % File->BlockSize;
+        UINT64  Taken;
+
+        if (Within || Size < File->BlockSize || ((UINTN)Out & (File->IoAlign - 1)))
+        {
+            if (Lba != File->BounceLba)
+            {
+                EFI_STATUS Status = File->BlockIo->ReadBlocks(File->BlockIo, File->MediaId, Lba, File->BlockSize, File->Bounce);
+                if (EFI_ERROR(Status))
+                {
+                    BlPrint(L"[ %r ] - ReadBlocks failed at LBA 0x%llx\n", Status, Lba);
+                    File->BounceLba = MAX_UINT64;
+                    return BL_STATUS_READ_ERROR;
+                }
+
+                File->BounceLba = Lba;
+            }
+
+            Taken = MIN(File->BlockSize - Within, Size);
+            CopyMem(Out, File->Bounce + Within, Taken);
+        }
+        else
+        {
+            Taken = Size - (Size % File->BlockSize);
+
+            BL_STATUS Result = BlpFatReadBlocks(File, Lba, Out, Taken);
+            if (!BL_SUCCESS(Result))
+            {
+                return Result;
+            }
+        }
+
+        DiskOffset += Taken;
+        Out        += Taken;
+        Size       -= Taken;
+    }
+
+    return BL_STATUS_OK;
+}
+
+static
+BOOLEAN
+BlpFatIsValidCluster(
+    _In_ CONST BL_FAT_VOLUME* Volume,
+    _In_ UINT32 Cluster
+)
+{
+    return Cluster >= 2 && Cluster < Volume->ClusterCount + 2;
+}
+
+static
+BOOLEAN
+BlpFatIsEndOfChain(
+    _In_ CONST BL_FAT_VOLUME* Volume,
+    _In_ UINT32 Cluster
+)
+{
+    switch (Volume->Type)
+    {
+    case BlFat12: return Cluster >= 0xFF8;
+    case BlFat16: return Cluster >= 0xFFF8;
+    default:      return Cluster >= 0x0FFFFFF8;
+    }
+}
+
+static
+BL_STATUS
+BlpFatNextCluster(
+    _Inout_ PBL_FAT_FILE File,
+    _In_    UINT32 Cluster,
+    _Out_   UINT32* Next
+)
+{
+    UINT8     Entry[4] = { 0 };
+    BL_STATUS Result;
+
+    switch (File->Volume.Type)
+    {
+    case BlFat12:
+        Result = BlpFatReadBytes(File, File->Volume.FatOffset + Cluster + Cluster / 2, Entry, 2);
+        *Next  = (Cluster & 1) ? (BlpLe16(Entry) >> 4) : (BlpLe16(Entry) & 0xFFF);
+        break;
+    case BlFat16:
+        Result = BlpFatReadBytes(File, File->Volume.FatOffset + (UINT64)Cluster * 2, Entry, 2);
+        *Next  = BlpLe16(Entry);
+        break;
+    default:
+        Result = BlpFatReadBytes(File, File->Volume.FatOffset + (UINT64)Cluster * 4, Entry, 4);
+        *Next  = BlpLe32(Entry) & 0x0FFFFFFF;
+        break;
+    }
+
+    return Result;
+}
+
+static
+CHAR16
+BlpFatUpcase(
+    _In_ CHAR16 c
+)
+{
+    return (c >= L'a' && c <= L'z') ? (CHAR16)(c - L'a' + L'A') : c;
+}
+
+/**
+* Builds the padded 8.3 form of a path component, FALSE if it has no 8.3 form.
+*/
+static
+BOOLEAN
+BlpFatShortName(
+    _In_  CONST CHAR16* Name,
+    _In_  UINTN Length,
+    _Out_ UINT8 Short[11]
+)
+{
+    SetMem(Short, 11, ' ');
+
+    UINTN Dot = Length;
+    for (UINTN i = 0; i < Length; i++)
+    {
+        if (Name[i] == L'.')
+        {
+            Dot = i;
+        }
+    }
+
+    if (!Dot || Dot > 8 || (Dot < Length && Length - Dot - 1 > 3))
+    {
+        return FALSE;
+    }
+
+    for (UINTN i = 0; i < Length; i++)
+    {
+        if (i == Dot)
+        {
+            continue;
+        }
+
+        CHAR16 c = BlpFatUpcase(Name[i]);
+        if (c <= L' ' || c >= 0x7F || c == L'.')
+        {
+            return FALSE;
+        }
+
+        Short[i < Dot ? i : 8 + (i - Dot - 1)] = (UINT8)c;
+    }
+
+    return TRUE;
+}
+
+static
+UINT8
+BlpFatShortChecksum(
+    _In_ CONST UINT8* Short
+)
+{
+    UINT8 Sum = 0;
+    for (UINTN i = 0; i < 11; i++)
+    {
+        Sum = (UINT8)(((Sum & 1) << 7) + (Sum >> 1) + Short[i]);
+    }
+
+    return Sum;
+}
+
+/**
+* Looks a single path component up in a directory. DirectoryCluster 0 means the fixed
+* FAT12/16 root directory.
+*/
+static
+BL_STATUS
+BlpFatFindEntry(
+    _Inout_ PBL_FAT_FILE File,
+    _In_    UINT32 DirectoryCluster,
+    _In_    CONST CHAR16* Name,
+    _In_    UINTN Length,
+    _Out_   UINT8 Found[FAT_ENTRY_SIZE]
+)
+{
+    BL_FAT_VOLUME* Volume = &File->Volume;
+
+    UINT8   Short[11];
+    BOOLEAN HasShort = BlpFatShortName(Name, Length, Short);
+
+    UINT8* Chunk = AllocatePool(Volume->ClusterSize);
+    if (!Chunk)
+    {
+        return BL_STATUS_OUT_OF_RESOURCES;
+    }
+
+    CHAR16    LongName[FAT_LFN_MAX * FAT_LFN_CHARS + 1];
+    UINT8     LongChecksum = 0;
+    BOOLEAN   LongValid    = FALSE;
+    UINT64    FixedOffset  = 0;
+    UINT64    FixedSize    = (UINT64)Volume->RootEntries * FAT_ENTRY_SIZE;
+    UINT32    Cluster      = DirectoryCluster;
+    BL_STATUS Result       = BL_STATUS_NOT_FOUND;
+
+    while (TRUE)
+    {
+        UINT64 Bytes;
+        UINT64 Offset;
+
+        if (!DirectoryCluster)
+        {
+            if (FixedOffset >= FixedSize)
+            {
+                break;
+            }
+
+            Bytes  = MIN((UINT64)Volume->ClusterSize, FixedSize - FixedOffset);
+            Offset = Volume->RootOffset + FixedOffset;
+        }
+        else
+        {
+            if (!BlpFatIsValidCluster(Volume, Cluster))
+            {
+                break;
+            }
+
+            Bytes  = Volume->ClusterSize;
+            Offset = Volume->DataOffset + (UINT64)(Cluster - 2) * Volume->ClusterSize;
+        }
+
+        if (!BL_SUCCESS(BlpFatReadBytes(File, Offset, Chunk, Bytes)))
+        {
+            Result = BL_STATUS_READ_ERROR;
+            break;
+        }
+
+        for (UINT64 i = 0; i + FAT_ENTRY_SIZE <= Bytes; i += FAT_ENTRY_SIZE)
+        {
+            UINT8* Entry = Chunk + i;
+
+            if (Entry[0] == 0x00)
+            {
+                // end of directory marker
+                goto Done;
+            }
+
+            if (Entry[0] == 0xE5)
+            {
+                LongValid = FALSE;
+                continue;
+            }
+
+            if ((Entry[11] & 0x3F) == FAT_ATTR_LONG_NAME)
+            {
+                UINT8 Sequence = Entry[0] & 0x1F;
+                if (!Sequence || Sequence > FAT_LFN_MAX)
+                {
+                    LongValid = FALSE;
+                    continue;
+                }
+
+                if (Entry[0] & FAT_LFN_LAST)
+                {
+                    SetMem(LongName, sizeof(LongName), 0);
+                    LongChecksum = Entry[13];
+                    LongValid    = TRUE;
+                }
+
+                // 13 UCS-2 characters spread over three runs of the entry
+                static CONST UINT8 CharOffsets[FAT_LFN_CHARS] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+                for (UINTN c = 0; c < FAT_LFN_CHARS; c++)
+                {
+                    CHAR16 Char = BlpLe16(Entry + CharOffsets[c]);
+                    LongName[(Sequence - 1) * FAT_LFN_CHARS + c] = (Char == 0xFFFF) ? 0 : Char;
+                }
+
+                continue;
+            }
+
+            if (Entry[11] & FAT_ATTR_VOLUME_ID)
+            {
+                LongValid = FALSE;
+                continue;
+            }
+
+            BOOLEAN Match = HasShort && CompareMem(Entry, Short, 11) == 0;
+
+            if (!Match && LongValid && BlpFatShortChecksum(Entry) == LongChecksum)
+            {
+                UINTN c = 0;
+                while (c < Length && LongName[c] && BlpFatUpcase(LongName[c]) == BlpFatUpcase(Name[c]))
+                {
+                    c++;
+                }
+
+                Match = (c == Length && LongName[c] == 0);
+            }
+
+            LongValid = FALSE;
+
+            if (Match)
+            {
+                CopyMem(Found, Entry, FAT_ENTRY_SIZE);
+                Result = BL_STATUS_OK;
+                goto Done;
+            }
+        }
+
+        if (!DirectoryCluster)
+        {
+            FixedOffset += Bytes;
+        }
+        else if (!BL_SUCCESS(BlpFatNextCluster(File, Cluster, &Cluster)) || BlpFatIsEndOfChain(Volume, Cluster))
+        {
+            break;
+        }
+    }
+
+Done:
+    FreePool(Chunk);
+    return Result;
+}
+
+/**
+* Parses the BPB of the partition and fills in the volume geometry.
+*/
+static
+BL_STATUS
+BlpFatMountVolume(
+    _Inout_ PBL_FAT_FILE File
+)
+{
+    UINT8 Bpb[512];
+
+    if (!BL_SUCCESS(BlpFatReadBytes(File, 0, Bpb, sizeof(Bpb))))
+    {
+        return BL_STATUS_READ_ERROR;
+    }
+
+    UINT32 BytesPerSector    = BlpLe16(Bpb + 11);
+    UINT32 SectorsPerCluster = Bpb[13];
+    UINT32 ReservedSectors   = BlpLe16(Bpb + 14);
+    UINT32 FatCount          = Bpb[16];
+    UINT32 RootEntries       = BlpLe16(Bpb + 17);
+    UINT32 TotalSectors      = BlpLe16(Bpb + 19) ? BlpLe16(Bpb + 19) : BlpLe32(Bpb + 32);
+    UINT32 FatSectors        = BlpLe16(Bpb + 22) ? BlpLe16(Bpb + 22) : BlpLe32(Bpb + 36);
+
+    if (Bpb[510] != 0x55 || Bpb[511] != 0xAA ||
+        (BytesPerSector != 512 && BytesPerSector != 1024 && BytesPerSector != 2048 && BytesPerSector != 4096) ||
+        !SectorsPerCluster || (SectorsPerCluster & (SectorsPerCluster - 1)) ||
+        !ReservedSectors || !FatCount || !TotalSectors || !FatSectors)
+    {
+        return BL_STATUS_UNSUPPORTED;
+    }
+
+    UINT32 RootSectors = (RootEntries * FAT_ENTRY_SIZE + BytesPerSector - 1) / BytesPerSector;
+    UINT64 DataSector  = (UINT64)ReservedSectors + (UINT64)FatCount * FatSectors + RootSectors;
+    if (DataSector >= TotalSectors)
+    {
+        return BL_STATUS_UNSUPPORTED;
+    }
+
+    BL_FAT_VOLUME* Volume = &File->Volume;
+    Volume->ClusterSize   = BytesPerSector * SectorsPerCluster;
+    Volume->ClusterCount  = (UINT32)((TotalSectors - DataSector) / SectorsPerCluster);
+    Volume->FatOffset     = (UINT64)ReservedSectors * BytesPerSector;
+    Volume->RootOffset    = Volume->FatOffset + (UINT64)FatCount * FatSectors * BytesPerSector;
+    Volume->DataOffset    = DataSector * BytesPerSector;
+
+    // the cluster count alone decides the FAT type
+    if (Volume->ClusterCount < 4085)
+    {
+        Volume->Type = BlFat12;
+    }
+    else if (Volume->ClusterCount < 65525)
+    {
+        Volume->Type = BlFat16;
+    }
+    else
+    {
+        Volume->Type = BlFat32;
+    }
+
+    if (Volume->Type == BlFat32)
+    {
+        Volume->RootCluster = BlpLe32(Bpb + 44);
+        if (!BlpFatIsValidCluster(Volume, Volume->RootCluster))
+        {
+            return BL_STATUS_UNSUPPORTED;
+        }
+    }
+    else
+    {
+        Volume->RootEntries = RootEntries;
+    }
+
+    return BL_STATUS_OK;
+}
+
+/**
+* Walks the cluster chain of a file and coalesces it into extents.
+*/
+static
+BL_STATUS
+BlpFatBuildExtents(
+    _Inout_ PBL_FAT_FILE File,
+    _In_    UINT32 FirstCluster
+)
+{
+    BL_FAT_VOLUME* Volume  = &File->Volume;
+    UINT32         Cluster = FirstCluster;
+
+    for (UINT64 FileOffset = 0; FileOffset < File->FileSize; FileOffset += Volume->ClusterSize)
+    {
+        if (!BlpFatIsValidCluster(Volume, Cluster))
+        {
+            return BL_STATUS_INVALID_IMAGE;
+        }
+
+        UINT64 DiskOffset = Volume->DataOffset + (UINT64)(Cluster - 2) * Volume->ClusterSize;
+        BL_FAT_EXTENT* Last = File->ExtentCount ? &File->Extents[File->ExtentCount - 1] : NULL;
+
+        if (Last && Last->DiskOffset + Last->Length == DiskOffset)
+        {
+            Last->Length += Volume->ClusterSize;
+        }
+        else
+        {
+            if (File->ExtentCount == BL_FAT_MAX_EXTENTS)
+            {
+                // too fragmented to be worth it, the firmware driver can have it
+                return BL_STATUS_UNSUPPORTED;
+            }
+
+            BL_FAT_EXTENT* Extent = &File->Extents[File->ExtentCount++];
+            Extent->FileOffset = FileOffset;
+            Extent->DiskOffset = DiskOffset;
+            Extent->Length     = Volume->ClusterSize;
+        }
+
+        if (FileOffset + Volume->ClusterSize < File->FileSize)
+        {
+            if (!BL_SUCCESS(BlpFatNextCluster(File, Cluster, &Cluster)))
+            {
+                return BL_STATUS_READ_ERROR;
+            }
+
+            if (BlpFatIsEndOfChain(Volume, Cluster))
+            {
+                // chain is shorter than the directory entry claims
+                return BL_STATUS_INVALID_IMAGE;
+            }
+        }
+    }
+
+    return BL_STATUS_OK;
+}
+
+BL_STATUS
+BLAPI
+BlFatOpen(
+    _In_  EFI_HANDLE Device,
+    _In_  CONST CHAR16* Path,
+    _Out_ PBL_FAT_FILE File
+)
+{
+    if (!Device || !Path || !File)
+    {
+        return BL_STATUS_INVALID_PARAMETER;
+    }
+
+    ZeroMem(File, sizeof(BL_FAT_FILE));
+    File->BounceLba = MAX_UINT64;
+
+    EFI_GUID BlockIoGUID  = EFI_BLOCK_IO_PROTOCOL_GUID;
+    EFI_GUID BlockIo2GUID = EFI_BLOCK_IO2_PROTOCOL_GUID;
+
+    EFI_STATUS Status = gBS->HandleProtocol(Device, &BlockIoGUID, (VOID**)&File->BlockIo);
+    if (EFI_ERROR(Status))
+    {
+        return BL_STATUS_UNSUPPORTED;
+    }
+
+    EFI_BLOCK_IO_MEDIA* Media = File->BlockIo->Media;
+    if (!Media->MediaPresent || !Media->BlockSize || Media->BlockSize > EFI_PAGE_SIZE || Media->IoAlign > EFI_PAGE_SIZE)
+    {
+        return BL_STATUS_UNSUPPORTED;
+    }
+
+    File->MediaId   = Media->MediaId;
+    File->BlockSize = Media->BlockSize;
+    File->IoAlign   = Media->IoAlign > 1 ? Media->IoAlign : 1;
+
+    File->Bounce = AllocatePages(1);
+    if (!File->Bounce)
+    {
+        return BL_STATUS_OUT_OF_RESOURCES;
+    }
+
+    // BlockIo2 is optional, without it transfers are simply issued one after the other
+    if (!EFI_ERROR(gBS->HandleProtocol(Device, &BlockIo2GUID, (VOID**)&File->BlockIo2)))
+    {
+        for (UINT32 i = 0; i < BL_FAT_DEPTH; i++)
+        {
+            if (EFI_ERROR(gBS->CreateEvent(0, TPL_CALLBACK, NULL, NULL, &File->Tokens[i].Event)))
+            {
+                File->BlockIo2 = NULL;
+                break;
+            }
+        }
+    }
+    else
+    {
+        File->BlockIo2 = NULL;
+    }
+
+    BL_STATUS Result = BlpFatMountVolume(File);
+    if (!BL_SUCCESS(Result))
+    {
+        BlFatClose(File);
+        return Result;
+    }
+
+    UINT32 Directory = File->Volume.Type == BlFat32 ? File->Volume.RootCluster : 0;
+    UINT8  Entry[FAT_ENTRY_SIZE];
+
+    while (*Path)
+    {
+        while (*Path == L'\\')
+        {
+            Path++;
+        }
+
+        UINTN Length = 0;
+        while (Path[Length] && Path[Length] != L'\\')
+        {
+            Length++;
+        }
+
+        if (!Length)
+        {
+            break;
+        }
+
+        Result = BlpFatFindEntry(File, Directory, Path, Length, Entry);
+        if (!BL_SUCCESS(Result))
+        {
+            BlFatClose(File);
+            return Result;
+        }
+
+        Path += Length;
+
+        UINT32 Cluster = ((UINT32)BlpLe16(Entry + 20) << 16) | BlpLe16(Entry + 26);
+        BOOLEAN IsDirectory = (Entry[11] & FAT_ATTR_DIRECTORY) != 0;
+
+        // more components to go, this one has to be a directory
+        if (*Path)
+        {
+            if (!IsDirectory || !BlpFatIsValidCluster(&File->Volume, Cluster))
+            {
+                BlFatClose(File);
+                return BL_STATUS_NOT_FOUND;
+            }
+
+            Directory = Cluster;
+            continue;
+        }
+
+        if (IsDirectory)
+        {
+            BlFatClose(File);
+            return BL_STATUS_NOT_FOUND;
+        }
+
+        File->FileSize = BlpLe32(Entry + 28);
+
+        Result = BlpFatBuildExtents(File, Cluster);
+        if (!BL_SUCCESS(Result))
+        {
+            BlFatClose(File);
+            return Result;
+        }
+
+        return BL_STATUS_OK;
+    }
+
+    // path was empty or only separators
+    BlFatClose(File);
+    return BL_STATUS_NOT_FOUND;
+}
+
+BL_STATUS
+BLAPI
+BlFatRead(
+    _Inout_ PBL_FAT_FILE File,
+    _In_    UINT64 Offset,
+    _Out_   VOID* Buffer,
+    _In_    UINT64 Size
+)
+{
+    if (!File || !File->BlockIo || !Buffer)
+    {
+        return BL_STATUS_INVALID_PARAMETER;
+    }
+
+    if (Offset > File->FileSize || Size > File->FileSize - Offset)
+    {
+        return BL_STATUS_READ_ERROR;
+    }
+
+    UINT64 Start = Offset;
+    UINT64 End   = Offset + Size;
+
+    for (UINT32 i = 0; i < File->ExtentCount && Offset < End; i++)
+    {
+        BL_FAT_EXTENT* Extent    = &File->Extents[i];
+        UINT64         ExtentEnd = Extent->FileOffset + Extent->Length;
+
+        if (Offset >= ExtentEnd)
+        {
+            continue;
+        }
+
+        // extents are in file order so Offset is always inside this one now
+        UINT64 Run = MIN(End, ExtentEnd) - Offset;
+
+        BL_STATUS Result = BlpFatReadBytes(File, Extent->DiskOffset + (Offset - Extent->FileOffset), (UINT8*)Buffer + (Offset - Start), Run);
+        if (!BL_SUCCESS(Result))
+        {
+            return Result;
+        }
+
+        Offset += Run;
+    }
+
+    return Offset == End ? BL_STATUS_OK : BL_STATUS_READ_ERROR;
+}
+
+VOID
+BLAPI
+BlFatClose(
+    _Inout_ PBL_FAT_FILE File
+)
+{
+    if (!File)
+    {
+        return;
+    }
+
+    for (UINT32 i = 0; i < BL_FAT_DEPTH; i++)
+    {
+        if (File->Tokens[i].Event)
+        {
+            gBS->CloseEvent(File->Tokens[i].Event);
+        }
+    }
+
+    if (File->Bounce)
+    {
+        FreePages(File->Bounce, 1);
+    }
+
+    ZeroMem(File, sizeof(BL_FAT_FILE));
+}
\ No newline at end of file
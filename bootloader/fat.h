@@ -0,0 +1,104 @@
+#ifndef _FAT_H
+#define _FAT_H
+
+#include "boot.h"
+#include <Protocol/BlockIo.h>
+#include <Protocol/BlockIo2.h>
+
+//
+//
+// Raw FAT reader for boot images. A file's cluster chain is resolved once into a short list
+// of contiguous extents, after which reads go straight to the partition's block device in
+// large aligned transfers instead of through the firmware FAT driver.
+//
+//
+
+#define BL_FAT_MAX_EXTENTS  32
+#define BL_FAT_DEPTH        4
+#define BL_FAT_MAX_TRANSFER 0x400000
+
+typedef enum _BL_FAT_TYPE
+{
+    BlFat12 = 12,
+    BlFat16 = 16,
+    BlFat32 = 32
+} BL_FAT_TYPE;
+
+typedef struct _BL_FAT_EXTENT
+{
+    UINT64 FileOffset; // where in the file this run starts
+    UINT64 DiskOffset; // byte offset of the run from the start of the partition
+    UINT64 Length;     // bytes in the run
+} BL_FAT_EXTENT;
+
+typedef struct _BL_FAT_VOLUME
+{
+    BL_FAT_TYPE Type;
+    UINT32      ClusterSize;  // bytes per cluster
+    UINT32      ClusterCount; // data clusters, valid cluster numbers are 2..ClusterCount+1
+    UINT32      RootCluster;  // FAT32 only
+    UINT32      RootEntries;  // FAT12/16 only, size of the fixed root directory
+    UINT64      FatOffset;    // byte offset of the first FAT
+    UINT64      RootOffset;   // FAT12/16 only, byte offset of the fixed root directory
+    UINT64      DataOffset;   // byte offset of cluster 2
+} BL_FAT_VOLUME;
+
+typedef struct _BL_FAT_FILE
+{
+    EFI_BLOCK_IO_PROTOCOL*  BlockIo;
+    EFI_BLOCK_IO2_PROTOCOL* BlockIo2;    // optional, lets several transfers be in flight
+    UINT32                  MediaId;
+    UINT32                  BlockSize;
+    UINT32                  IoAlign;
+    UINT8*                  Bounce;      // one page for unaligned heads and tails
+    EFI_LBA                 BounceLba;   // block held in Bounce, MAX_UINT64 when empty
+    EFI_BLOCK_IO2_TOKEN     Tokens[BL_FAT_DEPTH];
+    BL_FAT_VOLUME           Volume;
+    UINT64                  FileSize;
+    UINT32                  ExtentCount;
+    BL_FAT_EXTENT           Extents[BL_FAT_MAX_EXTENTS];
+} BL_FAT_FILE, *PBL_FAT_FILE;
+
+/**
+* Resolves a file on a FAT formatted partition to its extents.
+*
+* @param Device The partition handle, must carry EFI_BLOCK_IO_PROTOCOL.
+* @param Path   Path from the root of the volume, etc... L"\\kernel.exe".
+* @param File   Receives the block device and extent list.
+*
+* @return BL_STATUS_OK on success. Any failure (not FAT, not found, too fragmented) means
+*         the caller should use the EFI_FILE_PROTOCOL path instead.
+*/
+BL_STATUS
+BLAPI
+BlFatOpen(
+    _In_  EFI_HANDLE Device,
+    _In_  CONST CHAR16* Path,
+    _Out_ PBL_FAT_FILE File
+);
+
+/**
+* Reads Size bytes at Offset of a resolved file.
+*
+* @return BL_STATUS_OK on success, BL_STATUS_READ_ERROR if the device failed or the range
+*         runs past the end of the file.
+*/
+BL_STATUS
+BLAPI
+BlFatRead(
+    _Inout_ PBL_FAT_FILE File,
+    _In_    UINT64 Offset,
+    _Out_   VOID* Buffer,
+    _In_    UINT64 Size
+);
+
+/**
+* Frees what BlFatOpen allocated.
+*/
+VOID
+BLAPI
+BlFatClose(
+    _Inout_ PBL_FAT_FILE File
+);
+
+#endif // !_FAT_H
\ No newline at end of file
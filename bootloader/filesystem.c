@@ -1,4 +1,44 @@
 #include "filesystem.h"
+#include "log.h"
+#include "trace.h"
+
+static BL_VOLUME Volumes[BL_MAX_VOLUMES];
+static UINT32    VolumeCount;
+
+static PBL_DIRECTORY_INDEX ActiveIndex;
+
+//
+// Index of BL_LOADER_DIRECTORY on each volume, built by BlOpenVolumeFile and dropped
+// whenever the volume's root is.
+//
+typedef struct _BL_LOADER_INDEX
+{
+    BOOLEAN            Tried;     // Index is only valid when Directory is set
+    EFI_FILE_PROTOCOL* Directory; // BL_LOADER_DIRECTORY, kept open for the index
+    BL_DIRECTORY_INDEX Index;
+} BL_LOADER_INDEX;
+
+static BL_LOADER_INDEX LoaderIndexes[BL_MAX_VOLUMES];
+
+/**
+* Drops the loader directory index of a volume, before its root is closed.
+*/
+static
+VOID
+BlpDropLoaderIndex(
+    _In_ UINT32 Volume
+)
+{
+    BL_LOADER_INDEX* Loader = &LoaderIndexes[Volume];
+
+    if (Loader->Directory)
+    {
+        BlFreeDirectoryIndex(&Loader->Index);
+        Loader->Directory->Close(Loader->Directory);
+    }
+
+    ZeroMem(Loader, sizeof(BL_LOADER_INDEX));
+}
 
 BOOLEAN 
 BLAPI
@@ -11,103 +51,288 @@ BlInitFileSystem(
 
     if( EFI_ERROR( FILE_SYSTEM_STATUS ) )
     {
-        Print(L"[ %r ] - Failed to get loaded image protocol in BlInitFileSystem", FILE_SYSTEM_STATUS);
+        BlPrint(L"[ %r ] - Failed to get loaded image protocol in BlInitFileSystem", FILE_SYSTEM_STATUS);
         return FALSE;
     }
 
+    // not fatal, every lookup below just finds nothing
+    if (!BlRefreshVolumes())
+    {
+        BlPrint(L"[ %r ] - Failed to enumerate volumes in BlInitFileSystem\n", FILE_SYSTEM_STATUS);
+    }
+
     return TRUE;
 }
 
+/**
+* Opens the root of a volume entry and caches everything boot device selection needs.
+*/
+static
 BOOLEAN
-BLAPI
-BlGetRootDirectory(
-    _Out_opt_ EFI_FILE_PROTOCOL** Directory
+BlpOpenVolume(
+    _Inout_ PBL_VOLUME Volume
 )
 {
-    if (!LoadedImage)
+    EFI_GUID BlockIoGUID        = EFI_BLOCK_IO_PROTOCOL_GUID;
+    EFI_GUID FileSystemInfoGUID = EFI_FILE_SYSTEM_INFO_ID;
+
+    EFI_HANDLE Handle = Volume->Handle;
+    ZeroMem(Volume, sizeof(BL_VOLUME));
+    Volume->Handle       = Handle;
+    Volume->IsBootDevice = LoadedImage && LoadedImage->DeviceHandle == Handle;
+
+    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL* FileProtocol;
+    FILE_SYSTEM_STATUS = gBS->HandleProtocol(Handle, &__FileSystemProtoclGUID__, (VOID**)&FileProtocol);
+    if (EFI_ERROR(FILE_SYSTEM_STATUS))
     {
-        Print(L"[ %r ] - Loaded image was null, maybe failed to get it?", BlGetLastFileError( ) );
         return FALSE;
     }
 
-    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL* FileProtocol;
-    FILE_SYSTEM_STATUS = gBS->HandleProtocol(LoadedImage->DeviceHandle, &__FileSystemProtoclGUID__, (VOID**)&FileProtocol);
-
-    if ( EFI_ERROR( FILE_SYSTEM_STATUS ) )
+    FILE_SYSTEM_STATUS = FileProtocol->OpenVolume(FileProtocol, &Volume->Root);
+    if (EFI_ERROR(FILE_SYSTEM_STATUS))
     {
-        Print(L"[ %r ] - Could not get file protocol in BlGetRootDirectory", FILE_SYSTEM_STATUS);
+        Volume->Root = NULL;
         return FALSE;
     }
 
-    EFI_FILE_PROTOCOL* Root;
-    FILE_SYSTEM_STATUS = FileProtocol->OpenVolume(FileProtocol, &Root );
-
-    if( EFI_ERROR( FILE_SYSTEM_STATUS )  )
+    // media id is what tells us the cached root went stale
+    if (!EFI_ERROR(gBS->HandleProtocol(Handle, &BlockIoGUID, (VOID**)&Volume->BlockIo)))
     {
-        Print(L"[ %r ] - Could not open the root directory in BlGetRootDirectory", FILE_SYSTEM_STATUS);
-        return FALSE;
+        Volume->MediaId = Volume->BlockIo->Media->MediaId;
+    }
+    else
+    {
+        Volume->BlockIo = NULL;
     }
 
-    CurrentDirectory = Root;
+    // room for any label FAT or ISO9660 can carry, only the first BL_VOLUME_LABEL_LENGTH are kept
+    UINT8 InfoBuffer[SIZE_OF_EFI_FILE_SYSTEM_INFO + 256 * sizeof(CHAR16)];
+    UINTN InfoSize = sizeof(InfoBuffer);
+    EFI_FILE_SYSTEM_INFO* Info = (EFI_FILE_SYSTEM_INFO*)InfoBuffer;
+
+    if (!EFI_ERROR(Volume->Root->GetInfo(Volume->Root, &FileSystemInfoGUID, &InfoSize, Info)))
+    {
+        Volume->VolumeSize = Info->VolumeSize;
+        Volume->FreeSpace  = Info->FreeSpace;
+        Volume->ReadOnly   = Info->ReadOnly;
+        StrnCpyS(Volume->Label, BL_VOLUME_LABEL_LENGTH, Info->VolumeLabel, BL_VOLUME_LABEL_LENGTH - 1);
+    }
 
-    if (Directory)
+    EFI_FILE_PROTOCOL* Kernel;
+    if (!EFI_ERROR(Volume->Root->Open(Volume->Root, &Kernel, BL_KERNEL_PATH, EFI_FILE_MODE_READ, 0)))
     {
-        *Directory = Root;
+        Volume->HasKernel = TRUE;
+        Kernel->Close(Kernel);
     }
 
+    FILE_SYSTEM_STATUS = EFI_SUCCESS;
     return TRUE;
 }
 
 BOOLEAN
 BLAPI
-BlGetRootDirectoryByIndex(
-    _In_ FILE_SYSTEM Index,
-    _Out_opt_ EFI_FILE_PROTOCOL** Directory
+BlRefreshVolumes(
+    VOID
 )
 {
+    for (UINT32 i = 0; i < VolumeCount; i++)
+    {
+        BlpDropLoaderIndex(i);
+        if (Volumes[i].Root)
+        {
+            Volumes[i].Root->Close(Volumes[i].Root);
+        }
+    }
+
+    ZeroMem(Volumes, sizeof(Volumes));
+    VolumeCount = 0;
+
     EFI_HANDLE* FileSystemHandles;
-    ULONG64 HandleCount = 0;
+    UINTN HandleCount = 0;
 
     // Get all handles to all file systems on this system
     FILE_SYSTEM_STATUS = gBS->LocateHandleBuffer(ByProtocol, &__FileSystemProtoclGUID__, NULL, &HandleCount, &FileSystemHandles);
-
-    if( EFI_ERROR( FILE_SYSTEM_STATUS ) || !HandleCount )
+    if (EFI_ERROR(FILE_SYSTEM_STATUS))
     {
         return FALSE;
     }
 
-    // well this just shouldn't happen!
-    if( (ULONG64)Index > HandleCount )
+    // opening waits on the media, BlGetVolume does it for the volumes that are actually used
+    for (UINTN i = 0; i < HandleCount && VolumeCount < BL_MAX_VOLUMES; i++)
     {
-        FreePool( FileSystemHandles );
-        return FALSE;
+        Volumes[VolumeCount].Handle       = FileSystemHandles[i];
+        Volumes[VolumeCount].IsBootDevice = LoadedImage && LoadedImage->DeviceHandle == FileSystemHandles[i];
+        VolumeCount++;
     }
 
-    // open the file system by handle index
-    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL* FileProtocol;
-    FILE_SYSTEM_STATUS = gBS->OpenProtocol( FileSystemHandles[ Index ], &__FileSystemProtoclGUID__, (VOID**)&FileProtocol, gImageHandle, NULL, EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL );
-    
-    if( EFI_ERROR( FILE_SYSTEM_STATUS ) || !FileProtocol )
+    FreePool(FileSystemHandles);
+
+    FILE_SYSTEM_STATUS = EFI_SUCCESS;
+    return TRUE;
+}
+
+UINT32
+BLAPI
+BlGetVolumeCount(
+    VOID
+)
+{
+    return VolumeCount;
+}
+
+CONST BL_VOLUME*
+BLAPI
+BlGetVolume(
+    _In_ UINT32 Index
+)
+{
+    if (Index >= VolumeCount)
+    {
+        FILE_SYSTEM_STATUS = EFI_NOT_FOUND;
+        return NULL;
+    }
+
+    PBL_VOLUME Volume = &Volumes[Index];
+
+    BOOLEAN MediaChanged = Volume->BlockIo &&
+        (!Volume->BlockIo->Media->MediaPresent || Volume->BlockIo->Media->MediaId != Volume->MediaId);
+
+    if (MediaChanged || !Volume->Root)
+    {
+        BlpDropLoaderIndex(Index);
+        if (Volume->Root)
+        {
+            Volume->Root->Close(Volume->Root);
+            Volume->Root = NULL;
+        }
+
+        BlTraceBegin("volume.open");
+        BOOLEAN Opened = BlpOpenVolume(Volume);
+        BlTraceEnd("volume.open");
+
+        if (!Opened)
+        {
+            return NULL;
+        }
+    }
+
+    return Volume;
+}
+
+UINT32
+BLAPI
+BlGetBootVolumeIndex(
+    VOID
+)
+{
+    for (UINT32 i = 0; i < VolumeCount; i++)
+    {
+        if (Volumes[i].IsBootDevice)
+        {
+            return i;
+        }
+    }
+
+    return MAX_UINT32;
+}
+
+BOOLEAN
+BLAPI
+BlFindVolumeIndex(
+    _In_  EFI_HANDLE Handle,
+    _Out_ UINT32* Index
+)
+{
+    for (UINT32 i = 0; i < VolumeCount; i++)
+    {
+        if (Volumes[i].Handle == Handle)
+        {
+            *Index = i;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+CONST BL_VOLUME*
+BLAPI
+BlFindKernelVolume(
+    _Out_opt_ UINT32* Index
+)
+{
+    // the boot device first, the others are only opened when it has no kernel
+    UINT32 Boot = BlGetBootVolumeIndex();
+
+    for (UINT32 Pass = 0; Pass < 2; Pass++)
+    {
+        for (UINT32 i = 0; i < VolumeCount; i++)
+        {
+            if ((i == Boot) != (Pass == 0))
+            {
+                continue;
+            }
+
+            CONST BL_VOLUME* Volume = BlGetVolume(i);
+            if (Volume && Volume->HasKernel)
+            {
+                if (Index)
+                {
+                    *Index = i;
+                }
+                return Volume;
+            }
+        }
+    }
+
+    FILE_SYSTEM_STATUS = EFI_NOT_FOUND;
+    return NULL;
+}
+
+BOOLEAN
+BLAPI
+BlGetRootDirectory(
+    _Out_opt_ EFI_FILE_PROTOCOL** Directory
+)
+{
+    if (!LoadedImage)
     {
-        FreePool( FileSystemHandles );
+        BlPrint(L"[ %r ] - Loaded image was null, maybe failed to get it?", BlGetLastFileError( ) );
         return FALSE;
     }
 
-    // now actually get the directory!
-    EFI_FILE_PROTOCOL* Root;
-    FILE_SYSTEM_STATUS = FileProtocol->OpenVolume(FileProtocol, &Root);
+    for (UINT32 i = 0; i < VolumeCount; i++)
+    {
+        if (Volumes[i].IsBootDevice)
+        {
+            return BlGetRootDirectoryByIndex((FILE_SYSTEM)i, Directory);
+        }
+    }
+
+    BlPrint(L"[ %r ] - Boot device has no file system in BlGetRootDirectory", EFI_NOT_FOUND);
+    FILE_SYSTEM_STATUS = EFI_NOT_FOUND;
+    return FALSE;
+}
 
-    if (EFI_ERROR(FILE_SYSTEM_STATUS))
+BOOLEAN
+BLAPI
+BlGetRootDirectoryByIndex(
+    _In_ FILE_SYSTEM Index,
+    _Out_opt_ EFI_FILE_PROTOCOL** Directory
+)
+{
+    CONST BL_VOLUME* Volume = BlGetVolume((UINT32)Index);
+    if (!Volume)
     {
         return FALSE;
     }
 
-    CurrentFileSystemHandle = FileSystemHandles[ Index ];
-    CurrentDirectory = Root;
+    CurrentFileSystemHandle = Volume->Handle;
+    CurrentDirectory = Volume->Root;
 
     if ( Directory )
     {
-        *Directory = Root;
+        *Directory = Volume->Root;
     }
 
     return TRUE;
@@ -141,7 +366,7 @@ BlOpenSubDirectory(
     // this is not a directory!
     if (FILE_SYSTEM_STATUS != EFI_FILE_DIRECTORY)
     {
-        Print(L"[ %r ] - Passed in path '%s' is not a directory to open!!!!", FILE_SYSTEM_STATUS, Path );
+        BlPrint(L"[ %r ] - Passed in path '%s' is not a directory to open!!!!", FILE_SYSTEM_STATUS, Path );
         FILE_SYSTEM_STATUS = EFI_INVALID_PARAMETER;
         return FALSE;
     }
@@ -157,7 +382,7 @@ BlOpenSubDirectory(
     
     if( EFI_ERROR( FILE_SYSTEM_STATUS ) )
     {
-        Print(L"[ %r ] - Failed to open '%s' as directory in BlOpenSubDirectory");
+        BlPrint(L"[ %r ] - Failed to open '%s' as directory in BlOpenSubDirectory");
         return FALSE;
     }
 
@@ -168,7 +393,7 @@ BlOpenSubDirectory(
 BOOLEAN
 BLAPI
 BlFindFile(
-    _In_ LPCSTR File,
+    _In_ CONST CHAR16* File,
     _Out_ EFI_FILE_PROTOCOL** OutFile
 )
 {
@@ -190,18 +415,36 @@ BlFindFile(
         }
     }
 
+    // the index knows everything below this directory unless the walk left entries out,
+    // only then is a miss worth asking the volume about
+    if (ActiveIndex && ActiveIndex->Directory == CurrentDirectory)
+    {
+        CONST BL_INDEX_ENTRY* Entry = BlIndexLookup(ActiveIndex, File);
+        if (Entry)
+        {
+            return BlIndexOpen(ActiveIndex, Entry, OutFile);
+        }
+
+        if (!ActiveIndex->Incomplete)
+        {
+            FILE_SYSTEM_STATUS = EFI_NOT_FOUND;
+            BlPrint(L"[ %r ] - Failed to open file '%s' in BlFindFile\n", FILE_SYSTEM_STATUS, File );
+            return FALSE;
+        }
+    }
+
     EFI_FILE_PROTOCOL* OpenedFile = NULL;
     FILE_SYSTEM_STATUS = CurrentDirectory->Open(
         CurrentDirectory,
         &OpenedFile,
-        File,
+        (CHAR16*)File,
         EFI_FILE_MODE_READ,
         0
     );
 
     if (EFI_ERROR(FILE_SYSTEM_STATUS))
     {
-        Print(L"[ %r ] - Failed to open file '%s' in BlFindFile\n", FILE_SYSTEM_STATUS, File );
+        BlPrint(L"[ %r ] - Failed to open file '%s' in BlFindFile\n", FILE_SYSTEM_STATUS, File );
         return FALSE;
     }
 
@@ -209,6 +452,35 @@ BlFindFile(
     return TRUE;
 }
 
+/**
+* Walk visitor for directory listings, one Print per entry. Context holds the
+* indentation of the walked directory.
+*/
+static
+BL_WALK_ACTION
+BLAPI
+BlpListVisit(
+    _In_     CONST EFI_FILE_INFO* Info,
+    _In_     CONST CHAR16* Path,
+    _In_     UINT32 PathLength,
+    _In_     UINT32 Depth,
+    _In_opt_ VOID* Context
+)
+{
+    UINTN Indent = (UINTN)(*(CONST ULONG64*)Context + Depth) * 2;
+
+    if (Info->Attribute & EFI_FILE_DIRECTORY)
+    {
+        BlPrint(L"%*s<DIR> %s\n", Indent, L"", Info->FileName);
+    }
+    else
+    {
+        BlPrint(L"%*s%-6lu  %s\n", Indent, L"", Info->FileSize, Info->FileName);
+    }
+
+    return BlWalkContinue;
+}
+
 BOOLEAN
 BLAPI
 BlListDirectoryRecursive(
@@ -221,90 +493,12 @@ BlListDirectoryRecursive(
         return FALSE;
     }
 
-    // reset position so we read from the start
-    FILE_SYSTEM_STATUS = Directory->SetPosition(Directory, 0);
-    if (EFI_ERROR(FILE_SYSTEM_STATUS)) 
-    {
-        Print(L"[ %r ] - Failed to SetPosition on directory\n", FILE_SYSTEM_STATUS);
-        return FALSE;
-    }
-
-    // allocate a buffer for EFI_FILE_INFO. Sketchy as won't work for longer names.
-    ULONG64 BufferSize = 0x128;
-    EFI_FILE_INFO* FileInfo = AllocateZeroPool(BufferSize);
-    if (!FileInfo) 
+    if (!BlWalkDirectory(Directory, NULL, BlpListVisit, &Depth, NULL))
     {
-        //probably out of resources?
-        FILE_SYSTEM_STATUS = EFI_OUT_OF_RESOURCES;
+        BlPrint(L"[ %r ] - Failed to list directory\n", FILE_SYSTEM_STATUS);
         return FALSE;
     }
 
-    // Keep reading entries until we reach the end of the directory
-    while (TRUE) 
-    {
-        ULONG64 Size = BufferSize;
-        FILE_SYSTEM_STATUS = Directory->Read(Directory, &Size, FileInfo);
-        if (EFI_ERROR(FILE_SYSTEM_STATUS))
-        {
-            Print(L"[ %r ] - Failed to read directory\n", FILE_SYSTEM_STATUS);
-            FreePool(FileInfo);
-            return FALSE;
-        }
-
-        if (Size == 0) 
-        {
-            //no more to read
-            break;
-        }
-
-        // skip the '.' and '..' at the start of directories to avoid infinite recursion
-        if ((StrCmp(FileInfo->FileName, L".") == 0) ||
-            (StrCmp(FileInfo->FileName, L"..") == 0)) 
-        {
-            continue;
-        }
-
-        // just add indentation
-        for (ULONG64 i = 0; i < Depth; i++) 
-        {
-            Print(L"  ");
-        }
-
-        //check if its directory and list its contents
-        if (FileInfo->Attribute & EFI_FILE_DIRECTORY) 
-        {
-            Print(L"<DIR> %s\n", FileInfo->FileName);
-
-            // try to open the subdirectory
-            EFI_FILE_PROTOCOL* SubDirectory = NULL;
-            FILE_SYSTEM_STATUS = Directory->Open(
-                Directory,
-                &SubDirectory,
-                FileInfo->FileName,
-                EFI_FILE_MODE_READ,
-                0
-            );
-
-            if (EFI_ERROR(FILE_SYSTEM_STATUS) && !SubDirectory)
-            {
-                Print(L"  [ %r ] Cannot open subdirectory %s\n", FILE_SYSTEM_STATUS, FileInfo->FileName);
-                FreePool(FileInfo);
-                return FALSE;
-            }
-
-            // recursive call
-            BlListDirectoryRecursive(SubDirectory, Depth + 1);
-            // make sure to close
-            SubDirectory->Close(SubDirectory);
-        }
-        else 
-        {
-            //if its a file then display contents
-            Print(L"%-6d  %s\n", FileInfo->FileSize, FileInfo->FileName);
-        }
-    }
-
-    FreePool(FileInfo);
     return TRUE;
 }
 
@@ -327,10 +521,19 @@ BlListAllFiles(
         }
     }
 
-    Print(L"\nDirectory listing -> \n");
+    BlPrint(L"\nDirectory listing -> \n");
     return BlListDirectoryRecursive(CurrentDirectory, 0);
 }
 
+EFI_HANDLE
+BLAPI
+BlGetCurrentFileSystemHandle(
+    VOID
+)
+{
+    return CurrentFileSystemHandle;
+}
+
 EFI_STATUS 
 BLAPI
 BlGetLastFileError(
@@ -343,7 +546,7 @@ BlGetLastFileError(
 BOOLEAN
 BLAPI
 BlSetWorkingDirectory(
-    _In_ LPCSTR Directory
+    _In_ CONST CHAR16* Directory
 )
 {
     if (Directory == NULL || Directory[0] == '\0')
@@ -359,7 +562,7 @@ BlSetWorkingDirectory(
         {
             if (EFI_ERROR(FILE_SYSTEM_STATUS))
             {
-                Print( L"[% r] - Failed to get root directory of fs0\n", FILE_SYSTEM_STATUS );
+                BlPrint( L"[% r] - Failed to get root directory of fs0\n", FILE_SYSTEM_STATUS );
                 return FALSE;
             }
         }
@@ -369,54 +572,1207 @@ BlSetWorkingDirectory(
     {
         EFI_FILE_PROTOCOL* NewDirectory = NULL;
 
-        if ( BlOpenSubDirectory(CurrentDirectory, Directory, &NewDirectory) && NewDirectory )
+        if ( BlOpenSubDirectory(CurrentDirectory, (CHAR16*)Directory, &NewDirectory) && NewDirectory )
         {
             // we got new direectory!
             CurrentDirectory = NewDirectory;
             return TRUE;
         }
  
-        Print(L"[ %r ] - Failed to get new directory '%s' in BlSetWorkingDirectory\n", BlGetLastFileError(), Directory );
+        BlPrint(L"[ %r ] - Failed to get new directory '%s' in BlSetWorkingDirectory\n", BlGetLastFileError(), Directory );
     }
 
     return FALSE;
 }
 
 BOOLEAN
-BlGetFileName(
-    _In_ EFI_FILE_PROTOCOL* FileProtocol,
-    _Out_ CHAR16** Out 
+BLAPI
+BlGetFileInfo(
+    _In_    EFI_FILE_PROTOCOL* FileProtocol,
+    _Out_   EFI_FILE_INFO* Info,
+    _Inout_ UINTN* InfoSize
 )
 {
-    if (FileProtocol == NULL) 
+    if (!FileProtocol || !Info || !InfoSize)
     {
         FILE_SYSTEM_STATUS = EFI_INVALID_PARAMETER;
         return FALSE;
     }
 
-    ULONG64        InfoSize = 0x128;
-    EFI_FILE_INFO* FileInfo = AllocateZeroPool(InfoSize);
-    if ( !FileInfo ) 
+    FILE_SYSTEM_STATUS = FileProtocol->GetInfo(
+        FileProtocol,
+        &gEfiFileInfoGuid,
+        InfoSize,
+        Info
+    );
+
+    return !EFI_ERROR(FILE_SYSTEM_STATUS);
+}
+
+/**
+* Gets file info into the caller's stack buffer, or into the scratch arena when the driver
+* says it needs more. The caller rewinds the arena once done with the info.
+*/
+static
+EFI_FILE_INFO*
+BlpQueryFileInfo(
+    _In_ EFI_FILE_PROTOCOL* FileProtocol,
+    _In_ EFI_FILE_INFO* Stack,
+    _In_ UINTN StackSize
+)
+{
+    UINTN Size = StackSize;
+    if (BlGetFileInfo(FileProtocol, Stack, &Size))
+    {
+        return Stack;
+    }
+
+    if (FILE_SYSTEM_STATUS != EFI_BUFFER_TOO_SMALL)
+    {
+        return NULL;
+    }
+
+    EFI_FILE_INFO* Info = BlArenaAlloc(BlGetLoaderArena(), Size, sizeof(UINT64));
+    if (!Info)
     {
         FILE_SYSTEM_STATUS = EFI_OUT_OF_RESOURCES;
+        return NULL;
+    }
+
+    return BlGetFileInfo(FileProtocol, Info, &Size) ? Info : NULL;
+}
+
+BOOLEAN
+BLAPI
+BlGetFileNameEx(
+    _In_  EFI_FILE_PROTOCOL* FileProtocol,
+    _Out_ CHAR16* Name,
+    _In_  UINTN NameLength
+)
+{
+    if (FileProtocol == NULL || Name == NULL || !NameLength)
+    {
+        FILE_SYSTEM_STATUS = EFI_INVALID_PARAMETER;
         return FALSE;
     }
 
-    FILE_SYSTEM_STATUS = FileProtocol->GetInfo(
-        FileProtocol,
-        &gEfiFileInfoGuid,
-        &InfoSize,
-        FileInfo
-    );
+    UINT64 Stack[BL_FILE_INFO_SIZE / sizeof(UINT64) + 1];
+    UINT64 Mark = BlArenaMark(BlGetLoaderArena());
 
-    if (EFI_ERROR(FILE_SYSTEM_STATUS))
+    EFI_FILE_INFO* FileInfo = BlpQueryFileInfo(FileProtocol, (EFI_FILE_INFO*)Stack, sizeof(Stack));
+    BOOLEAN        Fits     = FileInfo && StrLen(FileInfo->FileName) < NameLength;
+
+    if (Fits)
+    {
+        StrCpyS(Name, NameLength, FileInfo->FileName);
+    }
+    else if (FileInfo)
+    {
+        FILE_SYSTEM_STATUS = EFI_BUFFER_TOO_SMALL;
+    }
+
+    BlArenaReset(BlGetLoaderArena(), Mark);
+    return Fits;
+}
+
+BOOLEAN
+BlGetFileName(
+    _In_ EFI_FILE_PROTOCOL* FileProtocol,
+    _Out_ CHAR16** Out 
+)
+{
+    if (FileProtocol == NULL || Out == NULL) 
     {
-        FreePool(FileInfo);
+        FILE_SYSTEM_STATUS = EFI_INVALID_PARAMETER;
         return FALSE;
     }
 
-    strfmt(Out, L"%s", FileInfo->FileName);
+    UINT64 Stack[BL_FILE_INFO_SIZE / sizeof(UINT64) + 1];
+    UINT64 Mark = BlArenaMark(BlGetLoaderArena());
 
-    FreePool(FileInfo);
-    return TRUE;
+    EFI_FILE_INFO* FileInfo = BlpQueryFileInfo(FileProtocol, (EFI_FILE_INFO*)Stack, sizeof(Stack));
+    if (!FileInfo)
+    {
+        BlArenaReset(BlGetLoaderArena(), Mark);
+        return FALSE;
+    }
+
+    // exactly one pool allocation, sized to the name
+    *Out = AllocateCopyPool(StrSize(FileInfo->FileName), FileInfo->FileName);
+    BlArenaReset(BlGetLoaderArena(), Mark);
+
+    if (!*Out)
+    {
+        FILE_SYSTEM_STATUS = EFI_OUT_OF_RESOURCES;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+CHAR16
+BlpFoldCase(
+    _In_ CHAR16 c
+)
+{
+    return (c >= L'a' && c <= L'z') ? (CHAR16)(c - L'a' + L'A') : c;
+}
+
+BOOLEAN
+BLAPI
+BlMatchPattern(
+    _In_ CONST CHAR16* Pattern,
+    _In_ CONST CHAR16* Name
+)
+{
+    // greedy match, on a mismatch the last '*' takes one more character and we go again
+    CONST CHAR16* Star  = NULL;
+    CONST CHAR16* Retry = NULL;
+
+    while (*Name)
+    {
+        if (*Pattern == L'*')
+        {
+            Star  = ++Pattern;
+            Retry = Name;
+        }
+        else if (*Pattern == L'?' || (*Pattern && BlpFoldCase(*Pattern) == BlpFoldCase(*Name)))
+        {
+            Pattern++;
+            Name++;
+        }
+        else if (Star)
+        {
+            Pattern = Star;
+            Name    = ++Retry;
+        }
+        else
+        {
+            return FALSE;
+        }
+    }
+
+    while (*Pattern == L'*')
+    {
+        Pattern++;
+    }
+
+    return !*Pattern;
+}
+
+/**
+* Checks an entry against the walk filters. Directories only ever go through the pattern,
+* an extension filter is meant for files.
+*/
+static
+BOOLEAN
+BlpWalkFilter(
+    _In_ CONST BL_WALK_OPTIONS* Options,
+    _In_ CONST EFI_FILE_INFO* Info
+)
+{
+    BOOLEAN IsDirectory = (Info->Attribute & EFI_FILE_DIRECTORY) != 0;
+    UINT32  Flags       = Options->Flags ? Options->Flags : BL_WALK_FILES | BL_WALK_DIRECTORIES;
+
+    if (!(Flags & (IsDirectory ? BL_WALK_DIRECTORIES : BL_WALK_FILES)))
+    {
+        return FALSE;
+    }
+
+    if (Options->Pattern && !BlMatchPattern(Options->Pattern, Info->FileName))
+    {
+        return FALSE;
+    }
+
+    if (Options->Extension && !IsDirectory)
+    {
+        CONST CHAR16* Dot = NULL;
+        for (CONST CHAR16* c = Info->FileName; *c; c++)
+        {
+            if (*c == L'.')
+            {
+                Dot = c;
+            }
+        }
+
+        if (!Dot)
+        {
+            return FALSE;
+        }
+
+        CONST CHAR16* Extension = Options->Extension;
+        for (Dot++; *Dot && BlpFoldCase(*Dot) == BlpFoldCase(*Extension); Dot++, Extension++);
+
+        if (*Dot || *Extension)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+BOOLEAN
+BLAPI
+BlWalkDirectory(
+    _In_      EFI_FILE_PROTOCOL* Directory,
+    _In_opt_  CONST BL_WALK_OPTIONS* Options,
+    _In_      PBL_WALK_VISITOR Visitor,
+    _In_opt_  VOID* Context,
+    _Out_opt_ UINT32* Skipped
+)
+{
+    if (Skipped)
+    {
+        *Skipped = 0;
+    }
+
+    if (!Directory || !Visitor)
+    {
+        FILE_SYSTEM_STATUS = EFI_INVALID_PARAMETER;
+        return FALSE;
+    }
+
+    BL_WALK_OPTIONS Defaults;
+    ZeroMem(&Defaults, sizeof(BL_WALK_OPTIONS));
+    if (!Options)
+    {
+        Options = &Defaults;
+    }
+
+    UINT32 MaxDepth = Options->MaxDepth && Options->MaxDepth < BL_WALK_MAX_DEPTH ? Options->MaxDepth : BL_WALK_MAX_DEPTH;
+
+    FILE_SYSTEM_STATUS = Directory->SetPosition(Directory, 0);
+    if (EFI_ERROR(FILE_SYSTEM_STATUS))
+    {
+        return FALSE;
+    }
+
+    // one info buffer and one path buffer for the whole walk, both scratch
+    PBL_ARENA      Scratch  = BlGetLoaderArena();
+    UINT64         Mark     = BlArenaMark(Scratch);
+    UINTN          InfoSize = BL_FILE_INFO_SIZE;
+    EFI_FILE_INFO* Info     = BlArenaAlloc(Scratch, InfoSize, sizeof(UINT64));
+    CHAR16*        Path     = BlArenaAlloc(Scratch, BL_WALK_MAX_PATH * sizeof(CHAR16), sizeof(CHAR16));
+
+    if (!Info || !Path)
+    {
+        BlArenaReset(Scratch, Mark);
+        FILE_SYSTEM_STATUS = EFI_OUT_OF_RESOURCES;
+        return FALSE;
+    }
+
+    // Stack[i] is the open directory at depth i, Lengths[i] the length of its path
+    EFI_FILE_PROTOCOL* Stack[BL_WALK_MAX_DEPTH];
+    UINT32             Lengths[BL_WALK_MAX_DEPTH];
+    UINT32             Top    = 0;
+    UINT32             Missed = 0;
+    BOOLEAN            Walked = TRUE;
+
+    Stack[0]   = Directory;
+    Lengths[0] = 0;
+    Path[0]    = 0;
+
+    while (TRUE)
+    {
+        EFI_FILE_PROTOCOL* Current = Stack[Top];
+
+        UINTN Size = InfoSize;
+        FILE_SYSTEM_STATUS = Current->Read(Current, &Size, Info);
+        if (FILE_SYSTEM_STATUS == EFI_BUFFER_TOO_SMALL)
+        {
+            // the entry is not consumed, grow to what the driver asked for and read it again
+            Info = BlArenaAlloc(Scratch, Size, sizeof(UINT64));
+            if (!Info)
+            {
+                FILE_SYSTEM_STATUS = EFI_OUT_OF_RESOURCES;
+                Walked = FALSE;
+                break;
+            }
+
+            InfoSize = Size;
+            continue;
+        }
+
+        if (EFI_ERROR(FILE_SYSTEM_STATUS))
+        {
+            Walked = FALSE;
+            break;
+        }
+
+        if (Size == 0)
+        {
+            // end of this directory, back to the parent
+            if (!Top)
+            {
+                break;
+            }
+
+            Current->Close(Current);
+            Top--;
+            Path[Lengths[Top]] = 0;
+            continue;
+        }
+
+        if ((StrCmp(Info->FileName, L".") == 0) || (StrCmp(Info->FileName, L"..") == 0))
+        {
+            continue;
+        }
+
+        UINT32 ParentLength = Lengths[Top];
+        UINT32 NameLength   = (UINT32)StrLen(Info->FileName);
+        UINT32 Length       = ParentLength + (ParentLength ? 1 : 0) + NameLength;
+        if (Length >= BL_WALK_MAX_PATH)
+        {
+            // skip rather than hand out a truncated, wrong path
+            Missed++;
+            continue;
+        }
+
+        if (ParentLength)
+        {
+            Path[ParentLength] = L'\\';
+        }
+
+        CopyMem(Path + Length - NameLength, Info->FileName, NameLength * sizeof(CHAR16));
+        Path[Length] = 0;
+
+        BL_WALK_ACTION Action = BlWalkContinue;
+        if (BlpWalkFilter(Options, Info))
+        {
+            Action = Visitor(Info, Path, Length, Top, Context);
+        }
+
+        if (Action == BlWalkStop || Action == BlWalkAbort)
+        {
+            Walked = Action == BlWalkStop;
+            break;
+        }
+
+        EFI_FILE_PROTOCOL* Child = NULL;
+        if (Action == BlWalkContinue && (Info->Attribute & EFI_FILE_DIRECTORY))
+        {
+            if (Top + 1 < MaxDepth && !EFI_ERROR(Current->Open(Current, &Child, Info->FileName, EFI_FILE_MODE_READ, 0)))
+            {
+                Top++;
+                Stack[Top]   = Child;
+                Lengths[Top] = Length;
+                continue;
+            }
+
+            Missed++;
+        }
+
+        Path[ParentLength] = 0;
+    }
+
+    if (Skipped)
+    {
+        *Skipped = Missed;
+    }
+
+    // only the caller's directory stays open
+    for (; Top; Top--)
+    {
+        Stack[Top]->Close(Stack[Top]);
+    }
+
+    BlArenaReset(Scratch, Mark);
+    return Walked;
+}
+
+/**
+* FNV-1a over the case folded path, never 0 so 0 can mark empty slots.
+*/
+static
+UINT32
+BlpHashPath(
+    _In_ CONST CHAR16* Path,
+    _In_ UINT32 Length
+)
+{
+    UINT32 Hash = 0x811C9DC5;
+    for (UINT32 i = 0; i < Length; i++)
+    {
+        Hash = (Hash ^ BlpFoldCase(Path[i])) * 0x01000193;
+    }
+
+    return Hash ? Hash : 1;
+}
+
+static
+BOOLEAN
+BlpIndexGrow(
+    _Inout_ PBL_DIRECTORY_INDEX Index
+)
+{
+    UINT32          Capacity = Index->Capacity ? Index->Capacity * 2 : 64;
+    BL_INDEX_ENTRY* Entries  = AllocateZeroPool(Capacity * sizeof(BL_INDEX_ENTRY));
+    if (!Entries)
+    {
+        return FALSE;
+    }
+
+    for (UINT32 i = 0; i < Index->Capacity; i++)
+    {
+        if (!Index->Entries[i].Hash)
+        {
+            continue;
+        }
+
+        UINT32 Slot = Index->Entries[i].Hash & (Capacity - 1);
+        while (Entries[Slot].Hash)
+        {
+            Slot = (Slot + 1) & (Capacity - 1);
+        }
+
+        Entries[Slot] = Index->Entries[i];
+    }
+
+    if (Index->Entries)
+    {
+        FreePool(Index->Entries);
+    }
+
+    Index->Entries  = Entries;
+    Index->Capacity = Capacity;
+    return TRUE;
+}
+
+static
+BOOLEAN
+BlpIndexInsert(
+    _Inout_ PBL_DIRECTORY_INDEX Index,
+    _In_    CONST CHAR16* Path,
+    _In_    UINT32 Length,
+    _In_    CONST EFI_FILE_INFO* Info
+)
+{
+    // keep the load factor under 3/4 so probe runs stay short
+    if ((Index->Count + 1) * 4 > Index->Capacity * 3 && !BlpIndexGrow(Index))
+    {
+        return FALSE;
+    }
+
+    if (Index->PathsUsed + Length + 1 > Index->PathsSize)
+    {
+        UINT32  Size  = MAX(Index->PathsSize * 2, Index->PathsUsed + Length + 1);
+        CHAR16* Paths = ReallocatePool(Index->PathsSize * sizeof(CHAR16), Size * sizeof(CHAR16), Index->Paths);
+        if (!Paths)
+        {
+            return FALSE;
+        }
+
+        Index->Paths     = Paths;
+        Index->PathsSize = Size;
+    }
+
+    UINT32 Hash = BlpHashPath(Path, Length);
+    UINT32 Slot = Hash & (Index->Capacity - 1);
+    while (Index->Entries[Slot].Hash)
+    {
+        Slot = (Slot + 1) & (Index->Capacity - 1);
+    }
+
+    BL_INDEX_ENTRY* Entry = &Index->Entries[Slot];
+    Entry->Hash       = Hash;
+    Entry->PathOffset = Index->PathsUsed;
+    Entry->PathLength = Length;
+    Entry->Attribute  = Info->Attribute;
+    Entry->FileSize   = Info->FileSize;
+    Entry->Handle     = NULL;
+
+    CopyMem(Index->Paths + Index->PathsUsed, Path, Length * sizeof(CHAR16));
+    Index->Paths[Index->PathsUsed + Length] = 0;
+    Index->PathsUsed += Length + 1;
+    Index->Count++;
+
+    return TRUE;
+}
+
+/**
+* Walk visitor that records every entry in the index.
+*/
+static
+BL_WALK_ACTION
+BLAPI
+BlpIndexVisit(
+    _In_     CONST EFI_FILE_INFO* Info,
+    _In_     CONST CHAR16* Path,
+    _In_     UINT32 PathLength,
+    _In_     UINT32 Depth,
+    _In_opt_ VOID* Context
+)
+{
+    if (!BlpIndexInsert((PBL_DIRECTORY_INDEX)Context, Path, PathLength, Info))
+    {
+        FILE_SYSTEM_STATUS = EFI_OUT_OF_RESOURCES;
+        return BlWalkAbort;
+    }
+
+    return BlWalkContinue;
+}
+
+BOOLEAN
+BLAPI
+BlBuildDirectoryIndex(
+    _In_  EFI_FILE_PROTOCOL* Directory,
+    _Out_ PBL_DIRECTORY_INDEX Index
+)
+{
+    if (!Directory || !Index)
+    {
+        FILE_SYSTEM_STATUS = EFI_INVALID_PARAMETER;
+        return FALSE;
+    }
+
+    ZeroMem(Index, sizeof(BL_DIRECTORY_INDEX));
+    Index->Directory = Directory;
+
+    BL_WALK_OPTIONS Options;
+    ZeroMem(&Options, sizeof(BL_WALK_OPTIONS));
+    Options.MaxDepth = BL_INDEX_MAX_DEPTH;
+
+    BOOLEAN Built = BlpIndexGrow(Index);
+    if (!Built)
+    {
+        FILE_SYSTEM_STATUS = EFI_OUT_OF_RESOURCES;
+    }
+
+    UINT32 Skipped = 0;
+    Built = Built && BlWalkDirectory(Directory, &Options, BlpIndexVisit, Index, &Skipped);
+
+    if (!Built)
+    {
+        EFI_STATUS Status = FILE_SYSTEM_STATUS;
+        BlFreeDirectoryIndex(Index);
+        FILE_SYSTEM_STATUS = Status;
+        return FALSE;
+    }
+
+    Index->Incomplete = Skipped != 0;
+    return TRUE;
+}
+
+/**
+* @return The entry for the first Length characters of Path, NULL if there is none.
+*/
+static
+BL_INDEX_ENTRY*
+BlpIndexFind(
+    _In_ PBL_DIRECTORY_INDEX Index,
+    _In_ CONST CHAR16* Path,
+    _In_ UINT32 Length
+)
+{
+    UINT32 Hash = BlpHashPath(Path, Length);
+
+    for (UINT32 Slot = Hash & (Index->Capacity - 1); Index->Entries[Slot].Hash; Slot = (Slot + 1) & (Index->Capacity - 1))
+    {
+        BL_INDEX_ENTRY* Entry = &Index->Entries[Slot];
+        if (Entry->Hash != Hash || Entry->PathLength != Length)
+        {
+            continue;
+        }
+
+        CONST CHAR16* Candidate = Index->Paths + Entry->PathOffset;
+        UINT32 i = 0;
+        while (i < Length && BlpFoldCase(Candidate[i]) == BlpFoldCase(Path[i]))
+        {
+            i++;
+        }
+
+        if (i == Length)
+        {
+            return Entry;
+        }
+    }
+
+    return NULL;
+}
+
+CONST BL_INDEX_ENTRY*
+BLAPI
+BlIndexLookup(
+    _In_ PBL_DIRECTORY_INDEX Index,
+    _In_ CONST CHAR16* Path
+)
+{
+    if (!Index || !Index->Capacity || !Path)
+    {
+        return NULL;
+    }
+
+    while (*Path == L'\\')
+    {
+        Path++;
+    }
+
+    return BlpIndexFind(Index, Path, (UINT32)StrLen(Path));
+}
+
+/**
+* Opens an entry from its parent directory, opening and keeping the parents first.
+*/
+static
+BOOLEAN
+BlpIndexOpenEntry(
+    _In_  PBL_DIRECTORY_INDEX Index,
+    _In_  CONST BL_INDEX_ENTRY* Entry,
+    _Out_ EFI_FILE_PROTOCOL** Out
+)
+{
+    CONST CHAR16* Path = Index->Paths + Entry->PathOffset;
+    UINT32        Name = Entry->PathLength;
+
+    while (Name && Path[Name - 1] != L'\\')
+    {
+        Name--;
+    }
+
+    EFI_FILE_PROTOCOL* Parent = Index->Directory;
+    if (Name)
+    {
+        // the walk records a directory before anything below it
+        BL_INDEX_ENTRY* Directory = BlpIndexFind(Index, Path, Name - 1);
+        if (!Directory || !(Directory->Attribute & EFI_FILE_DIRECTORY))
+        {
+            FILE_SYSTEM_STATUS = EFI_NOT_FOUND;
+            return FALSE;
+        }
+
+        if (!Directory->Handle && !BlpIndexOpenEntry(Index, Directory, &Directory->Handle))
+        {
+            return FALSE;
+        }
+
+        Parent = Directory->Handle;
+    }
+
+    FILE_SYSTEM_STATUS = Parent->Open(Parent, Out, (CHAR16*)Path + Name, EFI_FILE_MODE_READ, 0);
+    if (EFI_ERROR(FILE_SYSTEM_STATUS))
+    {
+        *Out = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+BOOLEAN
+BLAPI
+BlIndexOpen(
+    _In_  PBL_DIRECTORY_INDEX Index,
+    _In_  CONST BL_INDEX_ENTRY* Entry,
+    _Out_ EFI_FILE_PROTOCOL** Out
+)
+{
+    if (!Index || !Entry || !Out)
+    {
+        FILE_SYSTEM_STATUS = EFI_INVALID_PARAMETER;
+        return FALSE;
+    }
+
+    return BlpIndexOpenEntry(Index, Entry, Out);
+}
+
+VOID
+BLAPI
+BlUseDirectoryIndex(
+    _In_opt_ PBL_DIRECTORY_INDEX Index
+)
+{
+    ActiveIndex = Index;
+}
+
+VOID
+BLAPI
+BlFreeDirectoryIndex(
+    _Inout_ PBL_DIRECTORY_INDEX Index
+)
+{
+    if (!Index)
+    {
+        return;
+    }
+
+    if (ActiveIndex == Index)
+    {
+        ActiveIndex = NULL;
+    }
+
+    for (UINT32 i = 0; i < Index->Capacity; i++)
+    {
+        if (Index->Entries[i].Hash && Index->Entries[i].Handle)
+        {
+            Index->Entries[i].Handle->Close(Index->Entries[i].Handle);
+        }
+    }
+
+    if (Index->Entries)
+    {
+        FreePool(Index->Entries);
+    }
+
+    if (Index->Paths)
+    {
+        FreePool(Index->Paths);
+    }
+
+    ZeroMem(Index, sizeof(BL_DIRECTORY_INDEX));
+}
+
+BOOLEAN
+BLAPI
+BlOpenVolumeFile(
+    _In_  UINT32 Index,
+    _In_  CONST CHAR16* Path,
+    _Out_ EFI_FILE_PROTOCOL** Out
+)
+{
+    CONST BL_VOLUME* Volume = BlGetVolume(Index);
+    if (!Volume || !Volume->Root || !Path || !Out)
+    {
+        FILE_SYSTEM_STATUS = Volume ? EFI_INVALID_PARAMETER : EFI_NOT_FOUND;
+        return FALSE;
+    }
+
+    while (*Path == L'\\')
+    {
+        Path++;
+    }
+
+    // anything below the loader directory, compared the way FAT compares names
+    CONST CHAR16* Prefix = BL_LOADER_DIRECTORY;
+    CONST CHAR16* Rest   = Path;
+    while (*Prefix && BlpFoldCase(*Prefix) == BlpFoldCase(*Rest))
+    {
+        Prefix++;
+        Rest++;
+    }
+
+    if (*Prefix || *Rest != L'\\')
+    {
+        FILE_SYSTEM_STATUS = Volume->Root->Open(Volume->Root, Out, (CHAR16*)Path, EFI_FILE_MODE_READ, 0);
+        return !EFI_ERROR(FILE_SYSTEM_STATUS);
+    }
+
+    BL_LOADER_INDEX* Loader = &LoaderIndexes[Index];
+    if (!Loader->Tried)
+    {
+        Loader->Tried = TRUE;
+
+        BlTraceBegin("index.build");
+        if (EFI_ERROR(Volume->Root->Open(Volume->Root, &Loader->Directory, BL_LOADER_DIRECTORY, EFI_FILE_MODE_READ, 0)))
+        {
+            Loader->Directory = NULL;
+        }
+        else if (!BlBuildDirectoryIndex(Loader->Directory, &Loader->Index))
+        {
+            // a partial walk cannot tell a missing file from one it never reached
+            Loader->Directory->Close(Loader->Directory);
+            Loader->Directory = NULL;
+        }
+        BlTraceEnd("index.build");
+    }
+
+    if (!Loader->Directory)
+    {
+        FILE_SYSTEM_STATUS = Volume->Root->Open(Volume->Root, Out, (CHAR16*)Path, EFI_FILE_MODE_READ, 0);
+        return !EFI_ERROR(FILE_SYSTEM_STATUS);
+    }
+
+    CONST BL_INDEX_ENTRY* Entry = BlIndexLookup(&Loader->Index, Rest);
+    if (Entry)
+    {
+        return BlIndexOpen(&Loader->Index, Entry, Out);
+    }
+
+    if (Loader->Index.Incomplete)
+    {
+        FILE_SYSTEM_STATUS = Volume->Root->Open(Volume->Root, Out, (CHAR16*)Path, EFI_FILE_MODE_READ, 0);
+        return !EFI_ERROR(FILE_SYSTEM_STATUS);
+    }
+
+    FILE_SYSTEM_STATUS = EFI_NOT_FOUND;
+    return FALSE;
+}
+
+BOOLEAN
+BLAPI
+BlStreamOpen(
+    _In_  EFI_FILE_PROTOCOL* File,
+    _In_  UINT64 Offset,
+    _Out_ PBL_FILE_STREAM Stream
+)
+{
+    if (!File || !Stream)
+    {
+        FILE_SYSTEM_STATUS = EFI_INVALID_PARAMETER;
+        return FALSE;
+    }
+
+    ZeroMem(Stream, sizeof(BL_FILE_STREAM));
+    Stream->File     = File;
+    Stream->Position = Offset;
+
+    FILE_SYSTEM_STATUS = File->SetPosition(File, Offset);
+    if (EFI_ERROR(FILE_SYSTEM_STATUS))
+    {
+        BlPrint(L"[ %r ] - Failed to set stream position in BlStreamOpen\n", FILE_SYSTEM_STATUS);
+        return FALSE;
+    }
+
+    // revision 1 volumes have no ReadEx, queued reads just complete synchronously
+    if (File->Revision < EFI_FILE_PROTOCOL_REVISION2)
+    {
+        return TRUE;
+    }
+
+    for (UINT32 i = 0; i < BL_STREAM_DEPTH; i++)
+    {
+        FILE_SYSTEM_STATUS = gBS->CreateEvent(0, TPL_CALLBACK, NULL, NULL, &Stream->Requests[i].Token.Event);
+        if (EFI_ERROR(FILE_SYSTEM_STATUS))
+        {
+            // not fatal, fall back to synchronous reads
+            BlStreamClose(Stream);
+            Stream->File     = File;
+            Stream->Position = Offset;
+            return TRUE;
+        }
+    }
+
+    Stream->Overlapped = TRUE;
+    return TRUE;
+}
+
+BOOLEAN
+BLAPI
+BlStreamQueue(
+    _Inout_ PBL_FILE_STREAM Stream,
+    _Out_   VOID* Buffer,
+    _In_    UINTN Size
+)
+{
+    if (!Stream || !Stream->File || !Buffer)
+    {
+        FILE_SYSTEM_STATUS = EFI_INVALID_PARAMETER;
+        return FALSE;
+    }
+
+    if (Stream->Count == BL_STREAM_DEPTH)
+    {
+        FILE_SYSTEM_STATUS = EFI_NOT_READY;
+        return FALSE;
+    }
+
+    BL_STREAM_REQUEST* Request = &Stream->Requests[(Stream->Head + Stream->Count) % BL_STREAM_DEPTH];
+    Request->Requested         = Size;
+    Request->Token.Buffer      = Buffer;
+    Request->Token.BufferSize  = Size;
+    Request->Token.Status      = EFI_SUCCESS;
+    Request->Completed         = FALSE;
+
+    BlTraceCount(BlCounterFileRead, Size);
+
+    if (Stream->Overlapped)
+    {
+        // ReadEx continues from where the previously queued read ends
+        FILE_SYSTEM_STATUS = Stream->File->ReadEx(Stream->File, &Request->Token);
+
+        if (FILE_SYSTEM_STATUS == EFI_UNSUPPORTED && !Stream->Count)
+        {
+            // some firmware reports revision 2 without implementing it, nothing is in flight
+            // so it is safe to just switch to synchronous reads from here on
+            Stream->Overlapped = FALSE;
+        }
+        else if (EFI_ERROR(FILE_SYSTEM_STATUS))
+        {
+            BlPrint(L"[ %r ] - Failed to queue read in BlStreamQueue\n", FILE_SYSTEM_STATUS);
+            return FALSE;
+        }
+    }
+
+    if (!Stream->Overlapped)
+    {
+        UINT64 Start = AsmReadTsc();
+        Request->Token.Status = Stream->File->Read(Stream->File, &Request->Token.BufferSize, Buffer);
+        BlTraceWait(BlCounterFileRead, AsmReadTsc() - Start);
+    }
+
+    Stream->Position += Size;
+    Stream->Count++;
+
+    return TRUE;
+}
+
+BOOLEAN
+BLAPI
+BlStreamWait(
+    _Inout_   PBL_FILE_STREAM Stream,
+    _Out_opt_ VOID** Buffer,
+    _Out_opt_ UINTN* Size
+)
+{
+    if (!Stream || !Stream->Count)
+    {
+        FILE_SYSTEM_STATUS = EFI_INVALID_PARAMETER;
+        return FALSE;
+    }
+
+    BL_STREAM_REQUEST* Request = &Stream->Requests[Stream->Head];
+
+    if (Stream->Overlapped && !Request->Completed)
+    {
+        UINTN  Index;
+        UINT64 Start = AsmReadTsc();
+        FILE_SYSTEM_STATUS = gBS->WaitForEvent(1, &Request->Token.Event, &Index);
+        BlTraceWait(BlCounterFileRead, AsmReadTsc() - Start);
+        if (EFI_ERROR(FILE_SYSTEM_STATUS))
+        {
+            // file reads cannot be cancelled, the request is given up on so BlStreamClose
+            // does not wait for it forever
+            Stream->Head = (Stream->Head + 1) % BL_STREAM_DEPTH;
+            Stream->Count--;
+            BlPrint(L"[ %r ] - Failed to wait for read in BlStreamWait\n", FILE_SYSTEM_STATUS);
+            return FALSE;
+        }
+    }
+
+    Stream->Head = (Stream->Head + 1) % BL_STREAM_DEPTH;
+    Stream->Count--;
+
+    if (Buffer)
+    {
+        *Buffer = Request->Token.Buffer;
+    }
+
+    if (Size)
+    {
+        *Size = Request->Token.BufferSize;
+    }
+
+    FILE_SYSTEM_STATUS = Request->Token.Status;
+    if (EFI_ERROR(FILE_SYSTEM_STATUS))
+    {
+        BlPrint(L"[ %r ] - Queued read failed in BlStreamWait\n", FILE_SYSTEM_STATUS);
+        return FALSE;
+    }
+
+    if (Request->Token.BufferSize != Request->Requested)
+    {
+        FILE_SYSTEM_STATUS = EFI_END_OF_FILE;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+BOOLEAN
+BLAPI
+BlStreamReady(
+    _Inout_ PBL_FILE_STREAM Stream
+)
+{
+    if (!Stream || !Stream->Count)
+    {
+        return FALSE;
+    }
+
+    BL_STREAM_REQUEST* Request = &Stream->Requests[Stream->Head];
+    if (!Stream->Overlapped || Request->Completed)
+    {
+        return TRUE;
+    }
+
+    // CheckEvent clears the signal, BlStreamWait must not wait for it a second time
+    Request->Completed = gBS->CheckEvent(Request->Token.Event) == EFI_SUCCESS;
+    return Request->Completed;
+}
+
+BOOLEAN
+BLAPI
+BlStreamSeek(
+    _Inout_ PBL_FILE_STREAM Stream,
+    _In_    UINT64 Offset
+)
+{
+    if (!Stream || !Stream->File)
+    {
+        FILE_SYSTEM_STATUS = EFI_INVALID_PARAMETER;
+        return FALSE;
+    }
+
+    if (Stream->Position == Offset)
+    {
+        return TRUE;
+    }
+
+    // the file position is only meaningful once nothing is in flight
+    BOOLEAN Drained = TRUE;
+    while (Stream->Count)
+    {
+        Drained &= BlStreamWait(Stream, NULL, NULL);
+    }
+
+    if (!Drained)
+    {
+        return FALSE;
+    }
+
+    FILE_SYSTEM_STATUS = Stream->File->SetPosition(Stream->File, Offset);
+    if (EFI_ERROR(FILE_SYSTEM_STATUS))
+    {
+        BlPrint(L"[ %r ] - Failed to seek to 0x%llx in BlStreamSeek\n", FILE_SYSTEM_STATUS, Offset);
+        return FALSE;
+    }
+
+    Stream->Position = Offset;
+    return TRUE;
+}
+
+VOID
+BLAPI
+BlStreamClose(
+    _Inout_ PBL_FILE_STREAM Stream
+)
+{
+    if (!Stream)
+    {
+        return;
+    }
+
+    while (Stream->Count)
+    {
+        BlStreamWait(Stream, NULL, NULL);
+    }
+
+    for (UINT32 i = 0; i < BL_STREAM_DEPTH; i++)
+    {
+        if (Stream->Requests[i].Token.Event)
+        {
+            gBS->CloseEvent(Stream->Requests[i].Token.Event);
+        }
+    }
+
+    ZeroMem(Stream, sizeof(BL_FILE_STREAM));
+}
+
+BOOLEAN
+BLAPI
+BlReaderOpen(
+    _In_     EFI_FILE_PROTOCOL* File,
+    _In_opt_ PBL_FAT_FILE Raw,
+    _Out_    PBL_FILE_READER Reader
+)
+{
+    if (!File || !Reader)
+    {
+        FILE_SYSTEM_STATUS = EFI_INVALID_PARAMETER;
+        return FALSE;
+    }
+
+    ZeroMem(Reader, sizeof(BL_FILE_READER));
+    Reader->File = File;
+    Reader->Raw  = Raw;
+
+    if (Raw)
+    {
+        Reader->Size = Raw->FileSize;
+        return TRUE;
+    }
+
+    UINT64 InfoBuffer[BL_FILE_INFO_SIZE / sizeof(UINT64) + 1];
+    UINTN  InfoSize = sizeof(InfoBuffer);
+    if (!BlGetFileInfo(File, (EFI_FILE_INFO*)InfoBuffer, &InfoSize))
+    {
+        return FALSE;
+    }
+
+    Reader->Size = ((EFI_FILE_INFO*)InfoBuffer)->FileSize;
+    return TRUE;
+}
+
+BOOLEAN
+BLAPI
+BlReaderStep(
+    _Inout_ PBL_FILE_READER Reader,
+    _In_    BOOLEAN Wait,
+    _Out_   UINT64* Start,
+    _Out_   UINT64* End
+)
+{
+    *Start = Reader->Done;
+    *End   = Reader->Done;
+
+    if (Reader->Done == Reader->Size)
+    {
+        return TRUE;
+    }
+
+    if (Reader->Raw)
+    {
+        // the block reads underneath keep their own transfers in flight within the chunk
+        UINT64 Chunk = MIN(Reader->Size - Reader->Done, (UINT64)BL_STREAM_CHUNK_SIZE);
+        if (BL_SUCCESS(BlFatRead(Reader->Raw, Reader->Done, Reader->Buffer + Reader->Done, Chunk)))
+        {
+            Reader->Done += Chunk;
+            *End          = Reader->Done;
+            return TRUE;
+        }
+
+        BlPrint(L"Raw read failed at 0x%llx, using the file system\n", Reader->Done);
+        Reader->Raw = NULL;
+    }
+
+    if (!Reader->Streaming)
+    {
+        if (!BlStreamOpen(Reader->File, Reader->Done, &Reader->Stream))
+        {
+            return FALSE;
+        }
+
+        Reader->Streaming = TRUE;
+        Reader->Queued    = Reader->Done;
+    }
+
+    while (Reader->Queued < Reader->Size && Reader->Stream.Count < BL_STREAM_DEPTH)
+    {
+        UINTN Chunk = (UINTN)MIN(Reader->Size - Reader->Queued, (UINT64)BL_STREAM_CHUNK_SIZE);
+        if (!BlStreamQueue(&Reader->Stream, Reader->Buffer + Reader->Queued, Chunk))
+        {
+            return FALSE;
+        }
+
+        Reader->Queued += Chunk;
+    }
+
+    if (!Wait && !BlStreamReady(&Reader->Stream))
+    {
+        return TRUE;
+    }
+
+    UINTN Size;
+    if (!BlStreamWait(&Reader->Stream, NULL, &Size))
+    {
+        return FALSE;
+    }
+
+    Reader->Done += Size;
+    *End          = Reader->Done;
+    return TRUE;
+}
+
+VOID
+BLAPI
+BlReaderClose(
+    _Inout_ PBL_FILE_READER Reader
+)
+{
+    if (Reader && Reader->Streaming)
+    {
+        BlStreamClose(&Reader->Stream);
+        Reader->Streaming = FALSE;
+    }
 }
\ No newline at end of file
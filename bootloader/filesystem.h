@@ -3,6 +3,10 @@
 
 #include "boot.h"
 #include "util.h"
+#include "arena.h"
+#include "fat.h"
+#include <Guid/FileSystemInfo.h>
+#include <Protocol/BlockIo.h>
 
 //
 //
@@ -15,7 +19,7 @@ static EFI_GUID __FileSystemProtoclGUID__ = SIMPLE_FILE_SYSTEM_PROTOCOL;
 
 static LPCSTR             CurrentDirectoryString;
 static EFI_FILE_PROTOCOL* CurrentDirectory;
-static EFI_HANDLE*        CurrentFileSystemHandle;
+static EFI_HANDLE         CurrentFileSystemHandle;
 static EFI_STATUS         FILE_SYSTEM_STATUS;
 
 static EFI_LOADED_IMAGE_PROTOCOL* LoadedImage;
@@ -28,6 +32,30 @@ typedef enum _FILE_SYSTEM
     FS3 = 3
 } FILE_SYSTEM;
 
+#define BL_MAX_VOLUMES         16
+#define BL_VOLUME_LABEL_LENGTH 32
+#define BL_KERNEL_PATH         L"kernel.exe"
+#define BL_LOADER_DIRECTORY    L"EFI\\OpliOS" // drivers, modules and configuration, indexed on first use
+
+//
+// One entry per simple file system handle, listed by BlRefreshVolumes and opened the first
+// time BlGetVolume hands it out, so a boot that knows its volume never touches the others.
+// An entry is only re-opened when its block device reports a different media id.
+//
+typedef struct _BL_VOLUME
+{
+    EFI_HANDLE             Handle;
+    EFI_FILE_PROTOCOL*     Root;
+    EFI_BLOCK_IO_PROTOCOL* BlockIo;    // NULL if the handle has no block device
+    UINT32                 MediaId;
+    UINT64                 VolumeSize;
+    UINT64                 FreeSpace;
+    BOOLEAN                ReadOnly;
+    BOOLEAN                HasKernel;  // BL_KERNEL_PATH exists in the root
+    BOOLEAN                IsBootDevice;
+    CHAR16                 Label[BL_VOLUME_LABEL_LENGTH];
+} BL_VOLUME, *PBL_VOLUME;
+
 /**
 * Initialises some global variables used by filesystem.
 * 
@@ -39,6 +67,79 @@ BlInitFileSystem(
     VOID
 );
 
+/**
+* Lists every simple file system once, volumes are only opened on first use.
+* Called by BlInitFileSystem, call again only to pick up newly connected devices.
+* 
+* @return TRUE on success, FALSE on error. Get error through BlGetLastFileError() if needed.
+*/
+BOOLEAN
+BLAPI
+BlRefreshVolumes(
+    VOID
+);
+
+/**
+* Gets the number of volumes in the volume table.
+*/
+UINT32
+BLAPI
+BlGetVolumeCount(
+    VOID
+);
+
+/**
+* Gets a volume from the volume table, re-opening it first if its media changed.
+* 
+* @param Index A file system index, the same numbering as FS0, FS1...
+* 
+* @return The volume, NULL if there is no such volume or it could not be re-opened.
+*/
+CONST BL_VOLUME*
+BLAPI
+BlGetVolume(
+    _In_ UINT32 Index
+);
+
+/**
+* @return Index of the volume the loader was started from without opening it, MAX_UINT32
+*         if it has no file system.
+*/
+UINT32
+BLAPI
+BlGetBootVolumeIndex(
+    VOID
+);
+
+/**
+* Finds the volume entry of a simple file system handle without opening it.
+*
+* @param Handle The handle carrying EFI_SIMPLE_FILE_SYSTEM_PROTOCOL.
+* @param Index  Receives the index of the volume.
+*
+* @return TRUE if the handle is in the volume table.
+*/
+BOOLEAN
+BLAPI
+BlFindVolumeIndex(
+    _In_  EFI_HANDLE Handle,
+    _Out_ UINT32* Index
+);
+
+/**
+* Picks the volume to boot from, the device this loader was started from if it has the
+* kernel and otherwise the first volume that does.
+* 
+* @param Index Optional, receives the index of the volume.
+* 
+* @return The volume, NULL if no volume has the kernel.
+*/
+CONST BL_VOLUME*
+BLAPI
+BlFindKernelVolume(
+    _Out_opt_ UINT32* Index
+);
+
 /**
 * Basically gets root or '\\' of the current file system, usually fs0.
 * 
@@ -75,14 +176,14 @@ BlGetRootDirectoryByIndex(
 BOOLEAN
 BLAPI
 BlSetWorkingDirectory(
-    _In_ LPCSTR Directory
+    _In_ CONST CHAR16* Directory
 );
 
 /**
-* Recursively list files from a given directory.
+* Lists every file below a given directory, one line per entry.
 *
 * @param Directory An open EFI_FILE_PROTOCOL* for the directory to list.
-* @param Depth     Recursion depth for indentation or other tracking.
+* @param Depth     Indentation level of the directory itself.
 *
 * @return TRUE on success, FALSE on error. Get error through BlGetLastFileError() if needed.
 */
@@ -123,7 +224,8 @@ BlOpenSubDirectory(
 
 
 /**
-* Finds a specfic file within this file system
+* Finds a specfic file within this file system. When an index is in use for the current
+* directory the lookup is answered from it, the file is Closed by the caller either way.
 *
 * @param Path, A string for the file name to look for.
 * @param Out, A pointer to the file found.
@@ -133,7 +235,7 @@ BlOpenSubDirectory(
 BOOLEAN
 BLAPI
 BlFindFile(
-    _In_ LPCSTR File,
+    _In_ CONST CHAR16* File,
     _Out_ EFI_FILE_PROTOCOL** Out
 );
 
@@ -148,6 +250,17 @@ BlGetLastFileError(
     VOID
 );
 
+/**
+* Gets the device handle of the file system the current directory belongs to.
+* 
+* @return The handle, NULL if no root directory has been opened yet.
+*/
+EFI_HANDLE
+BLAPI
+BlGetCurrentFileSystemHandle(
+    VOID
+);
+
 /**
 * Gets the name of the specified file. !!!MAKE SURE TO FREE STRING BUFFER AFTER USE!!!
 * 
@@ -162,6 +275,419 @@ BlGetFileName(
     _Out_ CHAR16** Out
 );
 
+// Fits any FAT long name, GetInfo into a buffer this size only fails on exotic file systems.
+#define BL_FILE_INFO_SIZE ( SIZE_OF_EFI_FILE_INFO + 256 * sizeof(CHAR16) )
+
+/**
+* Gets the EFI_FILE_INFO of a file into a caller provided buffer.
+* 
+* @param FileProtocol The file.
+* @param Info         The buffer to fill in.
+* @param InfoSize     In, the size of Info. Out, the size needed, also on EFI_BUFFER_TOO_SMALL.
+* 
+* @return TRUE on success, FALSE on error. Get error through BlGetLastFileError() if needed.
+*/
+BOOLEAN
+BLAPI
+BlGetFileInfo(
+    _In_    EFI_FILE_PROTOCOL* FileProtocol,
+    _Out_   EFI_FILE_INFO* Info,
+    _Inout_ UINTN* InfoSize
+);
+
+/**
+* Gets the name of the specified file into a caller provided buffer, nothing is allocated
+* unless the name does not fit BL_FILE_INFO_SIZE.
+* 
+* @param FileProtocol A  EFI_FILE_PROTOCOL pointer to the file.
+* @param Name         Receives the NUL terminated name.
+* @param NameLength   Size of Name in characters, EFI_BUFFER_TOO_SMALL if the name does not fit.
+* 
+* @return TRUE on success, FALSE on error. Get error through BlGetLastFileError() if needed.
+*/
+BOOLEAN
+BLAPI
+BlGetFileNameEx(
+    _In_  EFI_FILE_PROTOCOL* FileProtocol,
+    _Out_ CHAR16* Name,
+    _In_  UINTN NameLength
+);
+
+//
+//
+// Directory tree walker. Directories are walked with an explicit stack of open handles
+// and one EFI_FILE_INFO buffer shared by every level, so a walk of any size takes bounded
+// memory and prints nothing unless the visitor does.
+//
+//
+
+#define BL_WALK_MAX_PATH  260
+#define BL_WALK_MAX_DEPTH 16
+
+#define BL_WALK_FILES       0x1 // visit files
+#define BL_WALK_DIRECTORIES 0x2 // visit directories, they are descended into either way
+
+typedef enum _BL_WALK_ACTION
+{
+    BlWalkContinue, // keep going, descending into this entry if it is a directory
+    BlWalkSkip,     // keep going, but not into this directory
+    BlWalkStop,     // end the walk, BlWalkDirectory still succeeds
+    BlWalkAbort     // end the walk and fail it, FILE_SYSTEM_STATUS is left to the visitor
+} BL_WALK_ACTION;
+
+/**
+* Called for every entry that passes the walk filters.
+*
+* @param Info       The entry. Only valid during the call.
+* @param Path       Path of the entry relative to the walked directory, etc... L"EFI\\BOOT".
+* @param PathLength Characters in Path.
+* @param Depth      0 for entries directly in the walked directory.
+* @param Context    Whatever was passed to BlWalkDirectory.
+*/
+typedef
+BL_WALK_ACTION
+(BLAPI *PBL_WALK_VISITOR)(
+    _In_     CONST EFI_FILE_INFO* Info,
+    _In_     CONST CHAR16* Path,
+    _In_     UINT32 PathLength,
+    _In_     UINT32 Depth,
+    _In_opt_ VOID* Context
+);
+
+typedef struct _BL_WALK_OPTIONS
+{
+    UINT32        Flags;     // BL_WALK_FILES and/or BL_WALK_DIRECTORIES, 0 visits both
+    UINT32        MaxDepth;  // levels to walk, 1 is the directory alone, 0 is BL_WALK_MAX_DEPTH
+    CONST CHAR16* Pattern;   // optional case insensitive glob on the entry name, '*' and '?'
+    CONST CHAR16* Extension; // optional case insensitive extension without the dot, L"efi"
+} BL_WALK_OPTIONS, *PBL_WALK_OPTIONS;
+
+/**
+* Walks every entry below Directory.
+*
+* @param Directory The directory to walk, it is left open.
+* @param Options   Optional filters and depth limit, NULL visits everything.
+* @param Visitor   Called for every entry that passes the filters.
+* @param Context   Passed through to Visitor.
+* @param Skipped   Optional, receives how many entries the walk left out on its own: paths
+*                  of BL_WALK_MAX_PATH characters or more, and directories it did not descend
+*                  into because of the depth limit or because they would not open.
+*
+* @return TRUE on success, FALSE on error. Get error through BlGetLastFileError() if needed.
+*/
+BOOLEAN
+BLAPI
+BlWalkDirectory(
+    _In_      EFI_FILE_PROTOCOL* Directory,
+    _In_opt_  CONST BL_WALK_OPTIONS* Options,
+    _In_      PBL_WALK_VISITOR Visitor,
+    _In_opt_  VOID* Context,
+    _Out_opt_ UINT32* Skipped
+);
+
+/**
+* Matches a file name against a glob, case insensitive for ASCII like FAT itself.
+*
+* @return TRUE if Name matches Pattern.
+*/
+BOOLEAN
+BLAPI
+BlMatchPattern(
+    _In_ CONST CHAR16* Pattern,
+    _In_ CONST CHAR16* Name
+);
+
+//
+//
+// Optional in-memory index of a directory tree. One walk records every entry under a case
+// folded path in a flat open addressing table, after which lookups never touch the volume
+// and files are only opened when first asked for.
+//
+//
+
+#define BL_INDEX_MAX_PATH  BL_WALK_MAX_PATH
+#define BL_INDEX_MAX_DEPTH BL_WALK_MAX_DEPTH
+
+typedef struct _BL_INDEX_ENTRY
+{
+    UINT32             Hash;       // 0 marks an empty slot
+    UINT32             PathOffset; // into BL_DIRECTORY_INDEX.Paths, relative to the indexed directory
+    UINT32             PathLength;
+    UINT64             Attribute;
+    UINT64             FileSize;
+    EFI_FILE_PROTOCOL* Handle;     // directories only, opened as the parent of the first entry
+                                   // below them that is opened, owned by the index
+} BL_INDEX_ENTRY, *PBL_INDEX_ENTRY;
+
+typedef struct _BL_DIRECTORY_INDEX
+{
+    EFI_FILE_PROTOCOL* Directory;  // the directory that was walked
+    BL_INDEX_ENTRY*    Entries;
+    UINT32             Capacity;   // always a power of two
+    UINT32             Count;
+    CHAR16*            Paths;      // NUL terminated paths as found on the volume
+    UINT32             PathsUsed;  // in characters
+    UINT32             PathsSize;  // in characters
+    BOOLEAN            Incomplete; // the walk left entries out, a miss has to be asked of the volume
+} BL_DIRECTORY_INDEX, *PBL_DIRECTORY_INDEX;
+
+/**
+* Walks Directory once and indexes every file and directory below it. Entries deeper than
+* BL_INDEX_MAX_DEPTH or with paths of BL_INDEX_MAX_PATH characters or more are left out and
+* mark the index Incomplete.
+* 
+* @param Directory The directory to index, usually a volume root.
+* @param Index     The index to fill in, free with BlFreeDirectoryIndex.
+* 
+* @return TRUE on success, FALSE on error. Get error through BlGetLastFileError() if needed.
+*/
+BOOLEAN
+BLAPI
+BlBuildDirectoryIndex(
+    _In_  EFI_FILE_PROTOCOL* Directory,
+    _Out_ PBL_DIRECTORY_INDEX Index
+);
+
+/**
+* Looks a path up in an index. Case insensitive, leading '\\' is optional.
+* 
+* @return The entry, NULL if the path was not seen during the walk. That only means the file
+*         does not exist when the index is not Incomplete.
+*/
+CONST BL_INDEX_ENTRY*
+BLAPI
+BlIndexLookup(
+    _In_ PBL_DIRECTORY_INDEX Index,
+    _In_ CONST CHAR16* Path
+);
+
+/**
+* Opens the file behind an index entry. It is opened from its parent directory, which the
+* index keeps open, so the volume only searches the one directory the file is in. The
+* handle belongs to the caller, Close it when done.
+* 
+* @return TRUE on success, FALSE on error. Get error through BlGetLastFileError() if needed.
+*/
+BOOLEAN
+BLAPI
+BlIndexOpen(
+    _In_  PBL_DIRECTORY_INDEX Index,
+    _In_  CONST BL_INDEX_ENTRY* Entry,
+    _Out_ EFI_FILE_PROTOCOL** Out
+);
+
+/**
+* Makes BlFindFile answer from Index whenever the current directory is the indexed one.
+* 
+* @param Index The index to use, NULL to go back to opening files on the volume.
+*/
+VOID
+BLAPI
+BlUseDirectoryIndex(
+    _In_opt_ PBL_DIRECTORY_INDEX Index
+);
+
+/**
+* Closes every handle the index opened and frees it.
+*/
+VOID
+BLAPI
+BlFreeDirectoryIndex(
+    _Inout_ PBL_DIRECTORY_INDEX Index
+);
+
+/**
+* Opens a file on a volume of the volume table. Paths below BL_LOADER_DIRECTORY are answered
+* from an index of that directory, built by one walk the first time one is asked for, so
+* every later driver, module or configuration lookup there is a table lookup and a missing
+* file costs no disk access, unless the walk had to leave entries out. Other paths are opened on the root directory.
+*
+* @param Index The volume table index.
+* @param Path  Path from the volume root, leading '\' optional.
+* @param Out   Receives the file, Close it when done.
+*
+* @return TRUE on success, FALSE on error. Get error through BlGetLastFileError() if needed.
+*/
+BOOLEAN
+BLAPI
+BlOpenVolumeFile(
+    _In_  UINT32 Index,
+    _In_  CONST CHAR16* Path,
+    _Out_ EFI_FILE_PROTOCOL** Out
+);
+
+//
+//
+// Overlapped sequential reads. On EFI_FILE_PROTOCOL_REVISION2 volumes reads are queued with
+// ReadEx so several chunks are in flight while the caller works on completed ones, on older
+// volumes every queued read completes synchronously and the same calling pattern still works.
+//
+//
+
+#define BL_STREAM_DEPTH      4
+#define BL_STREAM_CHUNK_SIZE 0x100000
+
+typedef struct _BL_STREAM_REQUEST
+{
+    EFI_FILE_IO_TOKEN Token;
+    UINTN             Requested;
+    BOOLEAN           Completed; // BlStreamReady already took the event's signal
+} BL_STREAM_REQUEST;
+
+typedef struct _BL_FILE_STREAM
+{
+    EFI_FILE_PROTOCOL* File;
+    BOOLEAN            Overlapped; // reads are queued with ReadEx
+    UINT64             Position;   // file offset the next queued read starts at
+    UINT32             Head;       // oldest request not yet handed back by BlStreamWait
+    UINT32             Count;      // requests between Head and the next free slot
+    BL_STREAM_REQUEST  Requests[BL_STREAM_DEPTH];
+} BL_FILE_STREAM, *PBL_FILE_STREAM;
+
+/**
+* Prepares a stream over an open file, starting at Offset.
+*
+* @param File   The open file to read from, the stream does not take ownership of it.
+* @param Offset Where the first queued read starts.
+* @param Stream The stream to initialise.
+*
+* @return TRUE on success, FALSE on error. Get error through BlGetLastFileError() if needed.
+*/
+BOOLEAN
+BLAPI
+BlStreamOpen(
+    _In_  EFI_FILE_PROTOCOL* File,
+    _In_  UINT64 Offset,
+    _Out_ PBL_FILE_STREAM Stream
+);
+
+/**
+* Queues a read of the next Size bytes into Buffer. Fails with EFI_NOT_READY when
+* BL_STREAM_DEPTH reads are already queued, call BlStreamWait to retire one first.
+*
+* @return TRUE on success, FALSE on error. Get error through BlGetLastFileError() if needed.
+*/
+BOOLEAN
+BLAPI
+BlStreamQueue(
+    _Inout_ PBL_FILE_STREAM Stream,
+    _Out_   VOID* Buffer,
+    _In_    UINTN Size
+);
+
+/**
+* Waits for the oldest queued read and hands it back.
+*
+* @param Buffer Optional, the buffer the read went into.
+* @param Size   Optional, the number of bytes read.
+*
+* @return TRUE on success, FALSE on error or short read. Get error through BlGetLastFileError() if needed.
+*/
+BOOLEAN
+BLAPI
+BlStreamWait(
+    _Inout_   PBL_FILE_STREAM Stream,
+    _Out_opt_ VOID** Buffer,
+    _Out_opt_ UINTN* Size
+);
+
+/**
+* @return TRUE if the oldest queued read completed, so BlStreamWait hands it back without
+*         waiting. FALSE while it is in flight or when nothing is queued.
+*/
+BOOLEAN
+BLAPI
+BlStreamReady(
+    _Inout_ PBL_FILE_STREAM Stream
+);
+
+/**
+* Retires every queued read and moves the stream to Offset.
+*
+* @return TRUE on success, FALSE on error. Get error through BlGetLastFileError() if needed.
+*/
+BOOLEAN
+BLAPI
+BlStreamSeek(
+    _Inout_ PBL_FILE_STREAM Stream,
+    _In_    UINT64 Offset
+);
+
+/**
+* Retires every queued read and frees the stream's events. The file stays open.
+*/
+VOID
+BLAPI
+BlStreamClose(
+    _Inout_ PBL_FILE_STREAM Stream
+);
+
+//
+//
+// Whole file reads in steps. A reader pulls a file into one buffer front to back a chunk
+// per BlReaderStep, through the raw FAT extents when there are any and through a stream of
+// BL_STREAM_DEPTH overlapped reads otherwise, so a caller with an event loop can service
+// its other events between chunks. A raw read that fails moves the rest of the file over to
+// the stream, what already landed stays.
+//
+//
+
+typedef struct _BL_FILE_READER
+{
+    EFI_FILE_PROTOCOL* File;
+    PBL_FAT_FILE       Raw;       // NULL without extents or once a raw read failed
+    UINT8*             Buffer;    // set by the caller before the first step, Size bytes
+    UINT64             Size;      // the file size
+    UINT64             Queued;    // bytes handed to the stream
+    UINT64             Done;      // bytes in Buffer, front to back
+    BOOLEAN            Streaming; // Stream is open
+    BL_FILE_STREAM     Stream;
+} BL_FILE_READER, *PBL_FILE_READER;
+
+/**
+* Prepares a reader and finds the size of the file. Nothing is read yet.
+*
+* @param File   The open file, the reader does not take ownership of it.
+* @param Raw    Optional, the same file resolved by BlFatOpen.
+* @param Reader Receives the reader, point Reader->Buffer at Reader->Size bytes next.
+*
+* @return TRUE on success, FALSE if the size cannot be found. Get error through BlGetLastFileError() if needed.
+*/
+BOOLEAN
+BLAPI
+BlReaderOpen(
+    _In_     EFI_FILE_PROTOCOL* File,
+    _In_opt_ PBL_FAT_FILE Raw,
+    _Out_    PBL_FILE_READER Reader
+);
+
+/**
+* Moves the read on by one chunk.
+*
+* @param Wait  FALSE to return at once when the next chunk is still in flight.
+* @param Start Receives the offset of the chunk that landed.
+* @param End   Receives where it ends, Start when nothing landed.
+*
+* @return TRUE on success, FALSE on a read error. Get error through BlGetLastFileError() if needed.
+*/
+BOOLEAN
+BLAPI
+BlReaderStep(
+    _Inout_ PBL_FILE_READER Reader,
+    _In_    BOOLEAN Wait,
+    _Out_   UINT64* Start,
+    _Out_   UINT64* End
+);
+
+/**
+* Retires the reads still in flight. The file stays open.
+*/
+VOID
+BLAPI
+BlReaderClose(
+    _Inout_ PBL_FILE_READER Reader
+);
+
 //  ------------------------------ //
 //       NOT IMPLEMENTED YET       //
 //  ------------------------------ //
@@ -174,7 +700,7 @@ BlGetFileName(
 VOID
 BLAPI
 BlFindFileDirectory(
-    _In_ LPCSTR File
+    _In_ CONST CHAR16* File
 );
 
 #endif // !_FILESYSTEM_H
@@ -0,0 +1,438 @@
+#include "handoff.h"
+#include "log.h"
+#include "trace.h"
+#include "config.h"
+
+#define BL_MEMORY_OS_TYPE 0x80000000
+
+// the layout the kernel was built against
+STATIC_ASSERT(sizeof(BOOT_MEMORY_RANGE) == 16, "memory ranges are 16 bytes");
+STATIC_ASSERT(sizeof(BOOT_INFO) % BOOT_INFO_ALIGNMENT == 0, "BOOT_INFO is whole cache lines");
+
+/**
+* @return The physical address of the ACPI RSDP, the 2.0 one when the firmware has both.
+*/
+static
+UINT64
+BlpFindRsdp(
+    VOID
+)
+{
+    EFI_GUID Acpi20 = EFI_ACPI_20_TABLE_GUID;
+    EFI_GUID Acpi10 = ACPI_10_TABLE_GUID;
+    UINT64   Rsdp   = 0;
+
+    for (UINTN i = 0; i < gST->NumberOfTableEntries; i++)
+    {
+        EFI_CONFIGURATION_TABLE* Table = &gST->ConfigurationTable[i];
+        if (CompareGuid(&Table->VendorGuid, &Acpi20))
+        {
+            return (UINT64)(UINTN)Table->VendorTable;
+        }
+
+        if (!Rsdp && CompareGuid(&Table->VendorGuid, &Acpi10))
+        {
+            Rsdp = (UINT64)(UINTN)Table->VendorTable;
+        }
+    }
+
+    return Rsdp;
+}
+
+/**
+* @return What an EFI memory type is to the kernel once boot services are gone.
+*/
+static
+UINT16
+BlpTranslateType(
+    _In_ UINT32 Type
+)
+{
+    // tagged by the loader with BL_MEMORY_TYPE
+    if (Type & BL_MEMORY_OS_TYPE)
+    {
+        Type &= ~BL_MEMORY_OS_TYPE;
+        return Type && Type < BootMemoryTypeCount ? (UINT16)Type : BootMemoryReserved;
+    }
+
+    switch (Type)
+    {
+    case EfiConventionalMemory:
+    case EfiBootServicesCode:
+    case EfiBootServicesData:
+        return BootMemoryFree;
+    case EfiLoaderCode:
+    case EfiLoaderData:
+        return BootMemoryLoader;
+    case EfiRuntimeServicesCode:
+    case EfiRuntimeServicesData:
+        return BootMemoryRuntime;
+    case EfiACPIReclaimMemory:
+        return BootMemoryAcpiReclaim;
+    case EfiACPIMemoryNVS:
+        return BootMemoryAcpiNvs;
+    case EfiMemoryMappedIO:
+    case EfiMemoryMappedIOPortSpace:
+        return BootMemoryMmio;
+    case EfiUnusableMemory:
+        return BootMemoryUnusable;
+    case EfiPersistentMemory:
+        return BootMemoryPersistent;
+    default:
+        // reserved, PAL code and memory that still has to be accepted
+        return BootMemoryReserved;
+    }
+}
+
+/**
+* @return The BOOT_MEMORY_* flags for an EFI attribute mask.
+*/
+static
+UINT16
+BlpTranslateAttributes(
+    _In_ UINT64 Attribute
+)
+{
+    UINT16 Flags = 0;
+    if (Attribute & EFI_MEMORY_UC)
+    {
+        Flags |= BOOT_MEMORY_UC;
+    }
+    if (Attribute & EFI_MEMORY_WC)
+    {
+        Flags |= BOOT_MEMORY_WC;
+    }
+    if (Attribute & EFI_MEMORY_WB)
+    {
+        Flags |= BOOT_MEMORY_WB;
+    }
+    if (Attribute & EFI_MEMORY_NV)
+    {
+        Flags |= BOOT_MEMORY_NV;
+    }
+    if (Attribute & EFI_MEMORY_RUNTIME)
+    {
+        Flags |= BOOT_MEMORY_RUNTIME;
+    }
+
+    return Flags;
+}
+
+/**
+* Translates the firmware memory map into Ranges, sorted by address with touching ranges
+* of the same type and flags merged. Firmware maps come nearly sorted, so the insertion
+* sort barely moves anything. Runs after ExitBootServices, it must not call the firmware.
+*
+* @return The number of ranges written. Truncated is set when Capacity ran out.
+*/
+static
+UINT32
+BlpTranslateMap(
+    _In_  CONST UINT8* Map,
+    _In_  UINTN MapSize,
+    _In_  UINTN DescriptorSize,
+    _Out_ BOOT_MEMORY_RANGE* Ranges,
+    _In_  UINT32 Capacity,
+    _Out_ BOOLEAN* Truncated
+)
+{
+    UINT32 Count = 0;
+    *Truncated = FALSE;
+
+    for (UINTN Offset = 0; Offset + DescriptorSize <= MapSize; Offset += DescriptorSize)
+    {
+        CONST EFI_MEMORY_DESCRIPTOR* Descriptor = (CONST EFI_MEMORY_DESCRIPTOR*)(Map + Offset);
+        UINT64 Base  = Descriptor->PhysicalStart;
+        UINT64 Pages = Descriptor->NumberOfPages;
+        UINT16 Type  = BlpTranslateType(Descriptor->Type);
+        UINT16 Flags = BlpTranslateAttributes(Descriptor->Attribute);
+
+        // Pages is 32 bits wide, anything past 16 TiB takes more than one range
+        while (Pages)
+        {
+            if (Count == Capacity)
+            {
+                *Truncated = TRUE;
+                break;
+            }
+
+            UINT32 Chunk = (UINT32)MIN(Pages, (UINT64)MAX_UINT32);
+            UINT32 i     = Count++;
+            while (i && Ranges[i - 1].Base > Base)
+            {
+                Ranges[i] = Ranges[i - 1];
+                i--;
+            }
+
+            Ranges[i].Base  = Base;
+            Ranges[i].Pages = Chunk;
+            Ranges[i].Type  = Type;
+            Ranges[i].Flags = Flags;
+
+            Base  += EFI_PAGES_TO_SIZE((UINT64)Chunk);
+            Pages -= Chunk;
+        }
+    }
+
+    UINT32 Merged = 0;
+    for (UINT32 i = 0; i < Count; i++)
+    {
+        BOOT_MEMORY_RANGE* Last = Merged ? &Ranges[Merged - 1] : NULL;
+        if (Last &&
+            Last->Type == Ranges[i].Type &&
+            Last->Flags == Ranges[i].Flags &&
+            Last->Base + EFI_PAGES_TO_SIZE((UINT64)Last->Pages) == Ranges[i].Base &&
+            (UINT64)Last->Pages + Ranges[i].Pages <= MAX_UINT32)
+        {
+            Last->Pages += Ranges[i].Pages;
+            continue;
+        }
+
+        Ranges[Merged++] = Ranges[i];
+    }
+
+    return Merged;
+}
+
+/**
+* @return TRUE if the bundle entry is described to the kernel as a module.
+*/
+static
+BOOLEAN
+BlpIsHandedModule(
+    _In_ CONST BL_BUNDLE_ENTRY* Entry
+)
+{
+    return Entry->Type != BlBundleKernel && BlConfigWantsModule(Entry->Name);
+}
+
+/**
+* Describes the bundle payloads other than the kernel to the kernel, the ones the boot
+* configuration asked for when it names any.
+*/
+static
+VOID
+BlpDescribeModules(
+    _In_  CONST BL_BOOT_BUNDLE* Bundle,
+    _Out_ BOOT_MODULE* Modules
+)
+{
+    UINT32 Count = 0;
+    for (UINT32 i = 0; i < Bundle->Header->EntryCount; i++)
+    {
+        CONST BL_BUNDLE_ENTRY* Entry = &Bundle->Entries[i];
+        if (!BlpIsHandedModule(Entry))
+        {
+            continue;
+        }
+
+        BOOT_MODULE* Module = &Modules[Count++];
+        CopyMem(Module->Name, Entry->Name, sizeof(Module->Name));
+        CopyMem(Module->Digest, Entry->Digest, sizeof(Module->Digest));
+        Module->Base  = (UINT64)(UINTN)BlBundlePayload(Bundle, Entry);
+        Module->Size  = Entry->Size;
+        Module->Type  = Entry->Type;
+
+        // BlLoadBundle rejects a bundle unless every payload matched its digest
+        Module->Flags = BOOT_MODULE_VERIFIED;
+    }
+}
+
+BL_STATUS
+BLAPI
+BlPrepareHandoff(
+    _In_  CONST BL_PRELOAD* Preload,
+    _In_  CONST BL_PAGE_TABLES* PageTables,
+    _Out_ PBL_HANDOFF Handoff
+)
+{
+    if (!Preload || !PageTables || !PageTables->Root || !Handoff)
+    {
+        return BL_STATUS_INVALID_PARAMETER;
+    }
+
+    ZeroMem(Handoff, sizeof(BL_HANDOFF));
+
+    UINTN      MapSize = 0;
+    UINTN      MapKey;
+    UINTN      DescriptorSize;
+    UINT32     DescriptorVersion;
+    EFI_STATUS Status = gBS->GetMemoryMap(&MapSize, NULL, &MapKey, &DescriptorSize, &DescriptorVersion);
+    if (Status != EFI_BUFFER_TOO_SMALL)
+    {
+        BlPrint(L"[ %r ] - Failed to size the memory map\n", Status);
+        return BL_STATUS_GENERIC_ERROR;
+    }
+
+    // the map only grows by the few descriptors the allocations here split off, a range
+    // only splits when it is longer than 16 TiB
+    UINTN Descriptors = MapSize / DescriptorSize + BL_HANDOFF_MAP_SLACK;
+    Handoff->MapCapacity   = Descriptors * DescriptorSize;
+    Handoff->RangeCapacity = (UINT32)(Descriptors * 2);
+
+    UINT32 ModuleCount = 0;
+    if (Preload->FromBundle)
+    {
+        for (UINT32 i = 0; i < Preload->Bundle.Header->EntryCount; i++)
+        {
+            ModuleCount += BlpIsHandedModule(&Preload->Bundle.Entries[i]);
+        }
+    }
+
+    UINT64 RangesOffset  = ALIGN_VALUE(sizeof(BOOT_INFO), BOOT_INFO_ALIGNMENT);
+    UINT64 ModulesOffset = ALIGN_VALUE(RangesOffset + (UINT64)Handoff->RangeCapacity * sizeof(BOOT_MEMORY_RANGE), BOOT_INFO_ALIGNMENT);
+    UINT64 Size          = ModulesOffset + (UINT64)ModuleCount * sizeof(BOOT_MODULE);
+
+    EFI_PHYSICAL_ADDRESS Base = 0;
+    Handoff->BootInfoPages = EFI_SIZE_TO_PAGES(Size);
+    Handoff->Map           = AllocatePool(Handoff->MapCapacity);
+
+    if (!Handoff->Map ||
+        EFI_ERROR(gBS->AllocatePages(AllocateAnyPages, BL_MEMORY_TYPE(BootMemoryBootInfo), Handoff->BootInfoPages, &Base)))
+    {
+        BlPrint(L"Failed to allocate the boot information\n");
+        if (Handoff->Map)
+        {
+            FreePool(Handoff->Map);
+        }
+        ZeroMem(Handoff, sizeof(BL_HANDOFF));
+        return BL_STATUS_OUT_OF_RESOURCES;
+    }
+
+    if (EFI_ERROR(gBS->AllocatePages(AllocateAnyPages, BL_MEMORY_TYPE(BootMemoryKernelStack), EFI_SIZE_TO_PAGES(BOOT_STACK_SIZE), &Handoff->Stack)))
+    {
+        BlPrint(L"Failed to allocate the kernel boot stack\n");
+        gBS->FreePages(Base, Handoff->BootInfoPages);
+        FreePool(Handoff->Map);
+        ZeroMem(Handoff, sizeof(BL_HANDOFF));
+        return BL_STATUS_OUT_OF_RESOURCES;
+    }
+
+    ZeroMem((VOID*)(UINTN)Base, EFI_PAGES_TO_SIZE(Handoff->BootInfoPages));
+
+    BOOT_INFO* Info = (BOOT_INFO*)(UINTN)Base;
+    Info->Signature       = BOOT_INFO_SIGNATURE;
+    Info->Version         = BOOT_INFO_VERSION;
+    Info->HeaderSize      = sizeof(BOOT_INFO);
+    Info->Base            = Base;
+    Info->Size            = Size;
+    Info->MemoryMap       = Base + RangesOffset;
+    Info->MemoryRangeSize = sizeof(BOOT_MEMORY_RANGE);
+    Info->Modules         = Base + ModulesOffset;
+    Info->ModuleCount     = ModuleCount;
+    Info->ModuleSize      = sizeof(BOOT_MODULE);
+
+    Info->KernelPhysicalBase = Preload->Kernel.ImageBase;
+    Info->KernelVirtualBase  = PageTables->KernelBase;
+    Info->KernelSize         = ALIGN_VALUE(Preload->Kernel.ImageSize, EFI_PAGE_SIZE);
+    Info->KernelStack        = Handoff->Stack;
+    Info->PageTableRoot      = PageTables->Root;
+    Info->PageTablePages     = PageTables->PoolPages;
+    Info->DirectMapBase      = BL_DIRECT_MAP_BASE;
+    Info->DirectMapSize      = PageTables->DirectMapSize;
+
+    if (Preload->Kernel.Verified)
+    {
+        CopyMem(Info->KernelDigest, Preload->Kernel.Digest, sizeof(Info->KernelDigest));
+        Info->Flags |= BOOT_INFO_KERNEL_VERIFIED;
+    }
+    if (PageTables->NoExecute)
+    {
+        Info->Flags |= BOOT_INFO_NO_EXECUTE;
+    }
+
+    Info->RuntimeServices = (UINT64)(UINTN)gRT;
+    Info->AcpiRsdp        = BlpFindRsdp();
+
+    // the last chance to use boot services for it, the ring itself keeps recording
+    BlTraceCalibrate();
+    Info->Trace = (UINT64)(UINTN)BlGetTrace();
+    Info->Log   = (UINT64)(UINTN)BlGetLog();
+
+    if (ModuleCount)
+    {
+        BlpDescribeModules(&Preload->Bundle, (BOOT_MODULE*)(UINTN)Info->Modules);
+    }
+
+    Handoff->BootInfo    = Info;
+    Handoff->KernelEntry = PageTables->KernelEntry;
+    return BL_STATUS_OK;
+}
+
+BL_STATUS
+BLAPI
+BlEnterKernel(
+    _In_ EFI_HANDLE ImageHandle,
+    _In_ PBL_HANDOFF Handoff,
+    _In_ CONST BL_PAGE_TABLES* PageTables
+)
+{
+    if (!Handoff || !Handoff->BootInfo || !PageTables)
+    {
+        return BL_STATUS_INVALID_PARAMETER;
+    }
+
+    UINTN      MapSize = 0;
+    UINTN      MapKey;
+    UINTN      DescriptorSize = 0;
+    UINT32     DescriptorVersion;
+    EFI_STATUS Status = EFI_SUCCESS;
+
+    // ConOut goes away with boot services, the kernel finds the rest in the ring
+    BlLogDetach();
+    BlTraceBegin("exit.boot");
+
+    // a stale key only means the map changed since it was read, read it again into the same
+    // buffer, allocating is no longer allowed once the first attempt failed
+    for (UINT32 Attempt = 0; Attempt < BL_HANDOFF_EXIT_RETRIES; Attempt++)
+    {
+        MapSize = Handoff->MapCapacity;
+        Status  = gBS->GetMemoryMap(&MapSize, Handoff->Map, &MapKey, &DescriptorSize, &DescriptorVersion);
+        if (EFI_ERROR(Status))
+        {
+            break;
+        }
+
+        Status = gBS->ExitBootServices(ImageHandle, MapKey);
+        if (Status != EFI_INVALID_PARAMETER)
+        {
+            break;
+        }
+    }
+
+    if (EFI_ERROR(Status))
+    {
+        return BL_STATUS_GENERIC_ERROR;
+    }
+
+    BlTraceEnd("exit.boot");
+
+    //
+    // boot services are gone, nothing below may call into the firmware
+    //
+
+    BOOT_INFO* Info = Handoff->BootInfo;
+    BOOLEAN    Truncated;
+    Info->MemoryRangeCount = BlpTranslateMap((CONST UINT8*)Handoff->Map, MapSize, DescriptorSize, (BOOT_MEMORY_RANGE*)(UINTN)Info->MemoryMap, Handoff->RangeCapacity, &Truncated);
+    if (Truncated)
+    {
+        Info->Flags |= BOOT_INFO_MAP_TRUNCATED;
+    }
+
+    DisableInterrupts();
+    BlActivatePageTables(PageTables);
+    BlTraceMark("kernel.enter");
+
+    // from here on only the identity map keeps the loader alive, the kernel gets the direct
+    // map addresses of its stack and boot information
+    SwitchStack(
+        (SWITCH_STACK_ENTRY_POINT)(UINTN)Handoff->KernelEntry,
+        (VOID*)(UINTN)(BL_DIRECT_MAP_BASE + Info->Base),
+        NULL,
+        (VOID*)(UINTN)(BL_DIRECT_MAP_BASE + Handoff->Stack + BOOT_STACK_SIZE)
+    );
+
+    // the kernel never returns
+    CpuDeadLoop();
+    return BL_STATUS_GENERIC_ERROR;
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef _HANDOFF_H
+#define _HANDOFF_H
+
+#include "boot.h"
+#include "paging.h"
+#include "preload.h"
+
+//
+//
+// Hands the machine to the kernel. BlPrepareHandoff makes every allocation the handoff
+// needs while boot services are still usable, the boot information, the boot stack and a
+// memory map buffer sized with room to spare. BlEnterKernel then only calls GetMemoryMap
+// and ExitBootServices, retrying into the same buffer when the map changed in between,
+// translates the final map into the boot information and jumps to the kernel.
+//
+//
+
+#define BL_HANDOFF_MAP_SLACK    32 // extra descriptors, the allocations below split free ranges
+#define BL_HANDOFF_EXIT_RETRIES 4
+
+typedef struct _BL_HANDOFF
+{
+    BOOT_INFO*             BootInfo;      // identity mapped address of the allocation
+    UINT64                 BootInfoPages;
+    UINT32                 RangeCapacity; // BOOT_MEMORY_RANGE slots after BOOT_INFO
+    EFI_MEMORY_DESCRIPTOR* Map;           // reused by every GetMemoryMap call
+    UINTN                  MapCapacity;   // bytes in Map
+    EFI_PHYSICAL_ADDRESS   Stack;         // BOOT_STACK_SIZE bytes
+    UINT64                 KernelEntry;   // virtual, through the kernel mapping
+} BL_HANDOFF, *PBL_HANDOFF;
+
+/**
+* Allocates and fills in everything the kernel is handed except the memory map. Call it
+* last, every allocation made after it still shows up in the map but eats into its slack.
+*
+* @param Preload    The finished preload, its kernel and bundle are described to the kernel.
+* @param PageTables The tables built for the kernel by BlBuildPageTables.
+* @param Handoff    Receives the prepared handoff.
+*
+* @return BL_STATUS_OK on success, BL_STATUS_OUT_OF_RESOURCES if an allocation failed.
+*/
+BL_STATUS
+BLAPI
+BlPrepareHandoff(
+    _In_  CONST BL_PRELOAD* Preload,
+    _In_  CONST BL_PAGE_TABLES* PageTables,
+    _Out_ PBL_HANDOFF Handoff
+);
+
+/**
+* Exits boot services, switches to the kernel's page tables and stack and calls the kernel.
+* Nothing may be printed or allocated once this is called.
+*
+* @param ImageHandle The loader's image handle.
+* @param Handoff     The handoff prepared by BlPrepareHandoff.
+* @param PageTables  The tables built for the kernel.
+*
+* @return Only returns when boot services could not be exited. Boot services may be partly
+*         shut down at that point, the caller can only give up.
+*/
+BL_STATUS
+BLAPI
+BlEnterKernel(
+    _In_ EFI_HANDLE ImageHandle,
+    _In_ PBL_HANDOFF Handoff,
+    _In_ CONST BL_PAGE_TABLES* PageTables
+);
+
+#endif // !_HANDOFF_H
\ No newline at end of file
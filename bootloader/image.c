@@ -1 +1,1427 @@
 #include "image.h"
+#include "log.h"
+#include "filesystem.h"
+#include "lz4.h"
+#include "paging.h"
+#include "trace.h"
+#include "mp.h"
+#include "../kernal/rtl.h"
+
+// staging slots for packed chunks read from a file, one more than can be queued so the
+// chunk an AP is still unpacking is never read over
+#define BL_UNPACK_SLOTS (BL_STREAM_DEPTH + 1)
+
+/**
+* Reads exactly Size bytes at Offset into Buffer, from the raw FAT extents when the caller
+* resolved them and from the file otherwise. Position tracks the file pointer so
+* sequential reads (the common case for section data) skip the SetPosition call.
+*/
+static
+BL_STATUS
+BlpReadAt(
+    _In_     EFI_FILE_HANDLE File,
+    _In_opt_ PBL_FAT_FILE Raw,
+    _In_     UINT64 Offset,
+    _In_     UINT64 Size,
+    _Out_    VOID* Buffer,
+    _Inout_  UINT64* Position
+)
+{
+    EFI_STATUS Status;
+
+    if (Raw && BL_SUCCESS(BlFatRead(Raw, Offset, Buffer, Size)))
+    {
+        return BL_STATUS_OK;
+    }
+
+    if (*Position != Offset)
+    {
+        Status = File->SetPosition(File, Offset);
+        if (EFI_ERROR(Status))
+        {
+            BlPrint(L"[ %r ] - Failed to seek to 0x%llx in BlLoadPEImage64\n", Status, Offset);
+            return BL_STATUS_READ_ERROR;
+        }
+
+        *Position = Offset;
+    }
+
+    UINTN  ReadSize = Size;
+    UINT64 Start    = AsmReadTsc();
+    Status = File->Read(File, &ReadSize, Buffer);
+    BlTraceCount(BlCounterFileRead, ReadSize);
+    BlTraceWait(BlCounterFileRead, AsmReadTsc() - Start);
+    if (EFI_ERROR(Status) || ReadSize != Size)
+    {
+        BlPrint(L"[ %r ] - Short read at 0x%llx (%llu of %llu bytes) in BlLoadPEImage64\n", Status, Offset, (UINT64)ReadSize, Size);
+        return BL_STATUS_READ_ERROR;
+    }
+
+    *Position += ReadSize;
+    return BL_STATUS_OK;
+}
+
+/**
+* Allocates Pages at an Alignment boundary, at or below MaxAddress. The firmware has no
+* aligned allocation, so Alignment worth of extra pages is taken and the slack on both
+* sides is handed back.
+*/
+static
+EFI_STATUS
+BlpAllocateAligned(
+    _In_  EFI_ALLOCATE_TYPE Type,
+    _In_  EFI_PHYSICAL_ADDRESS MaxAddress,
+    _In_  UINT64 Pages,
+    _In_  UINT64 Alignment,
+    _Out_ EFI_PHYSICAL_ADDRESS* Address
+)
+{
+    UINT64               Slack = EFI_SIZE_TO_PAGES(Alignment) - 1;
+    EFI_PHYSICAL_ADDRESS Base  = MaxAddress;
+    EFI_STATUS           Status = gBS->AllocatePages(Type, BL_MEMORY_TYPE(BootMemoryKernel), Pages + Slack, &Base);
+    if (EFI_ERROR(Status))
+    {
+        return Status;
+    }
+
+    EFI_PHYSICAL_ADDRESS Aligned = ALIGN_VALUE(Base, Alignment);
+    UINT64               Head    = EFI_SIZE_TO_PAGES(Aligned - Base);
+    if (Head)
+    {
+        gBS->FreePages(Base, Head);
+    }
+    if (Slack - Head)
+    {
+        gBS->FreePages(Aligned + EFI_PAGES_TO_SIZE(Pages), Slack - Head);
+    }
+
+    *Address = Aligned;
+    return EFI_SUCCESS;
+}
+
+/**
+* Places the image on a BL_IMAGE_ALIGNMENT boundary so the kernel mapping can use large
+* pages. The physical address the image was linked for is taken when that range is free,
+* for an image linked into the kernel window that is its offset into the window. Otherwise
+* the highest aligned range below 4 GiB is used, and any aligned range as a last resort.
+* PreferredBase and ImagePages must already be filled in.
+*/
+static
+BOOLEAN
+BlpAllocateImage(
+    _Inout_ PBL_LOADED_IMAGE Image
+)
+{
+    EFI_PHYSICAL_ADDRESS Preferred = Image->PreferredBase;
+    if (Preferred >= BL_KERNEL_VIRTUAL_BASE)
+    {
+        Preferred -= BL_KERNEL_VIRTUAL_BASE;
+    }
+
+    EFI_STATUS Status = EFI_NOT_FOUND;
+    if (Preferred && !(Preferred & (BL_IMAGE_ALIGNMENT - 1)))
+    {
+        Image->ImageBase = Preferred;
+        Status = gBS->AllocatePages(AllocateAddress, BL_MEMORY_TYPE(BootMemoryKernel), Image->ImagePages, &Image->ImageBase);
+    }
+
+    if (EFI_ERROR(Status))
+    {
+        Status = BlpAllocateAligned(AllocateMaxAddress, SIZE_4GB - 1, Image->ImagePages, BL_IMAGE_ALIGNMENT, &Image->ImageBase);
+    }
+
+    if (EFI_ERROR(Status))
+    {
+        Status = BlpAllocateAligned(AllocateAnyPages, 0, Image->ImagePages, BL_IMAGE_ALIGNMENT, &Image->ImageBase);
+    }
+
+    if (EFI_ERROR(Status))
+    {
+        BlPrint(L"[ %r ] - Failed to allocate %llu pages for image\n", Status, Image->ImagePages);
+        ZeroMem(Image, sizeof(BL_LOADED_IMAGE));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+* @return Bytes chunk Index of a packed image unpacks to.
+*/
+static
+UINTN
+BlpChunkSize(
+    _In_ CONST BL_PACKED_IMAGE_HEADER* Header,
+    _In_ UINT32 Index
+)
+{
+    return (UINTN)MIN((UINT64)Header->ChunkSize, Header->ImageSize - (UINT64)Index * Header->ChunkSize);
+}
+
+/**
+* Unpacks chunk Index of a packed image from Source into its place in the image. A stored
+* chunk that was read straight into place is left alone.
+*/
+static
+BOOLEAN
+BlpUnpackChunk(
+    _In_ CONST BL_PACKED_IMAGE_HEADER* Header,
+    _In_ UINT32 Index,
+    _In_ CONST VOID* Source,
+    _In_ UINTN PackedSize,
+    _In_ UINT8* Base
+)
+{
+    UINTN  Size        = BlpChunkSize(Header, Index);
+    UINT8* Destination = Base + (UINT64)Index * Header->ChunkSize;
+
+    if (PackedSize == Size)
+    {
+        if (Source != Destination)
+        {
+            RtlCopyMemory(Destination, Source, Size);
+        }
+
+        return TRUE;
+    }
+
+    UINTN Written;
+    return Header->Method == BlPackLz4 &&
+           BlLz4Decompress(Source, PackedSize, Destination, Size, &Written) &&
+           Written == Size;
+}
+
+/**
+* BL_MP_ROUTINE unpacking chunk Index of a packed image that is in memory.
+*/
+static
+BOOLEAN
+BLAPI
+BlpUnpackIndexed(
+    _In_ VOID* Context,
+    _In_ UINT32 Index
+)
+{
+    BL_UNPACK* Unpack = (BL_UNPACK*)Context;
+
+    if (!BlpUnpackChunk(Unpack->Header, Index, Unpack->Data + Unpack->Offsets[Index], Unpack->Sizes[Index], Unpack->Base))
+    {
+        Unpack->Corrupt = Index;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+* BL_MP_ROUTINE unpacking the one chunk a file read just delivered.
+*/
+static
+BOOLEAN
+BLAPI
+BlpUnpackRead(
+    _In_ VOID* Context,
+    _In_ UINT32 Index
+)
+{
+    BL_UNPACK* Unpack = (BL_UNPACK*)Context;
+
+    (VOID)Index; // a job of one chunk, Unpack says which
+    if (!BlpUnpackChunk(Unpack->Header, Unpack->First, Unpack->Source, Unpack->Sizes[Unpack->First], Unpack->Base))
+    {
+        Unpack->Corrupt = Unpack->First;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+* Waits for the chunk unpacking in Job and hands the one that just landed at Source to
+* the next job. Chunks read straight into place have nothing left to do.
+*
+* @return FALSE if the previous chunk was corrupt, Job is finished either way.
+*/
+static
+BOOLEAN
+BlpUnpackNext(
+    _Inout_ PBL_MP_JOB Job,
+    _Inout_ BL_UNPACK* Unpack,
+    _In_    UINT32 Index,
+    _In_    CONST VOID* Source
+)
+{
+    if (!BlMpFinish(Job))
+    {
+        return FALSE;
+    }
+
+    Unpack->First  = Index;
+    Unpack->Source = Source;
+
+    BlMpPrepare(Job, BlpUnpackRead, Unpack, Source == Unpack->Base + (UINT64)Index * Unpack->Header->ChunkSize ? 0 : 1);
+    BlMpStart(Job);
+    return TRUE;
+}
+
+/**
+* Checks a packed image header before anything is allocated for it.
+*/
+static
+BL_STATUS
+BlpCheckPackedHeader(
+    _In_ CONST BL_PACKED_IMAGE_HEADER* Packed
+)
+{
+    if (Packed->Version != BL_PACKED_IMAGE_VERSION || Packed->Method > BlPackLz4 ||
+        !Packed->ImageSize || !Packed->ChunkSize || Packed->ChunkCount > BL_PACKED_IMAGE_MAX_CHUNKS ||
+        Packed->ChunkCount != DivU64x32(Packed->ImageSize + Packed->ChunkSize - 1, Packed->ChunkSize))
+    {
+        BlPrint(L"Packed image has a malformed header\n");
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    return BL_STATUS_OK;
+}
+
+/**
+* Checks the chunk size table, every chunk must end up no bigger than it started and
+* stored ones are exactly their size.
+*
+* @param DataSize Receives the size of all chunks together.
+*/
+static
+BL_STATUS
+BlpCheckChunkSizes(
+    _In_  CONST BL_PACKED_IMAGE_HEADER* Packed,
+    _In_  CONST UINT32* Sizes,
+    _Out_ UINT64* DataSize
+)
+{
+    *DataSize = 0;
+    for (UINT32 i = 0; i < Packed->ChunkCount; i++)
+    {
+        UINTN Size = BlpChunkSize(Packed, i);
+        if (!Sizes[i] || Sizes[i] > Size || (Packed->Method == BlPackStored && Sizes[i] != Size))
+        {
+            BlPrint(L"Packed image chunk %u has a bad size\n", i);
+            return BL_STATUS_INVALID_IMAGE;
+        }
+
+        *DataSize += Sizes[i];
+    }
+
+    return BL_STATUS_OK;
+}
+
+/**
+* Checks the headers a packed image unpacked to and relocates it. The image is unloaded
+* on failure.
+*/
+static
+BL_STATUS
+BlpFinishPackedImage64(
+    _Inout_ PBL_LOADED_IMAGE Image,
+    _In_    CONST BL_PACKED_IMAGE_HEADER* Packed,
+    _In_    UINT64 BytesRead
+)
+{
+    // the unpacked image is laid out already, only its headers need checking
+    UINT8*                  Base      = (UINT8*)(UINTN)Image->ImageBase;
+    EFI_IMAGE_DOS_HEADER*   DosHeader = (EFI_IMAGE_DOS_HEADER*)Base;
+    EFI_IMAGE_NT_HEADERS64* NtHeaders = (EFI_IMAGE_NT_HEADERS64*)(Base + DosHeader->e_lfanew);
+    if (DosHeader->e_magic != EFI_IMAGE_DOS_SIGNATURE ||
+        (UINT64)DosHeader->e_lfanew + sizeof(EFI_IMAGE_NT_HEADERS64) > Packed->ImageSize ||
+        NtHeaders->Signature != EFI_IMAGE_NT_SIGNATURE ||
+        NtHeaders->FileHeader.Machine != IMAGE_FILE_MACHINE_X64 ||
+        NtHeaders->OptionalHeader.Magic != EFI_IMAGE_NT_OPTIONAL_HDR64_MAGIC ||
+        NtHeaders->OptionalHeader.SizeOfImage != Packed->ImageSize ||
+        NtHeaders->OptionalHeader.AddressOfEntryPoint >= Packed->ImageSize)
+    {
+        BlPrint(L"Packed image does not unpack to a PE32+ x64 image\n");
+        BlUnloadPEImage64(Image);
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    Image->BytesRead = BytesRead;
+    Image->NtHeaders = DosHeader->e_lfanew;
+
+    BL_STATUS Result = BlRelocatePEImage64(Image);
+    if (!BL_SUCCESS(Result))
+    {
+        BlUnloadPEImage64(Image);
+        return Result;
+    }
+
+    return BL_STATUS_OK;
+}
+
+/**
+* Loads a packed image that is in memory. Every chunk's start is known up front, so they
+* are spread over every processor and unpack straight into the image allocation.
+*/
+static
+BL_STATUS
+BlpLoadPackedImage64(
+    _In_  CONST UINT8* Memory,
+    _In_  UINT64 MemorySize,
+    _Out_ PBL_LOADED_IMAGE Image
+)
+{
+    // copied, the header need not be aligned in the caller's buffer
+    BL_PACKED_IMAGE_HEADER Packed;
+    CopyMem(&Packed, Memory, sizeof(BL_PACKED_IMAGE_HEADER));
+
+    BL_STATUS Result = BlpCheckPackedHeader(&Packed);
+    if (!BL_SUCCESS(Result))
+    {
+        return Result;
+    }
+
+    UINT64 TableOffset = sizeof(BL_PACKED_IMAGE_HEADER);
+    UINT64 DataOffset  = TableOffset + (UINT64)Packed.ChunkCount * sizeof(UINT32);
+    UINT64 DataSize    = 0;
+
+    if (DataOffset > MemorySize)
+    {
+        BlPrint(L"Packed image is truncated\n");
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    CONST UINT32* Sizes = (CONST UINT32*)(Memory + TableOffset);
+    Result = BlpCheckChunkSizes(&Packed, Sizes, &DataSize);
+    if (!BL_SUCCESS(Result))
+    {
+        return Result;
+    }
+
+    if (DataSize > MemorySize - DataOffset)
+    {
+        BlPrint(L"Packed image is truncated\n");
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    Image->PreferredBase = Packed.PreferredBase;
+    Image->ImageSize     = Packed.ImageSize;
+    Image->ImagePages    = EFI_SIZE_TO_PAGES(Packed.ImageSize);
+
+    if (!BlpAllocateImage(Image))
+    {
+        return BL_STATUS_OUT_OF_RESOURCES;
+    }
+
+    PBL_ARENA Scratch = BlGetLoaderArena();
+    UINT64    Mark    = BlArenaMark(Scratch);
+    UINT64*   Offsets = BlArenaAlloc(Scratch, (UINT64)Packed.ChunkCount * sizeof(UINT64), sizeof(UINT64));
+    BL_UNPACK Unpack;
+
+    if (!Offsets)
+    {
+        Result = BL_STATUS_OUT_OF_RESOURCES;
+    }
+    else
+    {
+        UINT64 Offset = 0;
+        for (UINT32 i = 0; i < Packed.ChunkCount; Offset += Sizes[i], i++)
+        {
+            Offsets[i] = Offset;
+        }
+
+        ZeroMem(&Unpack, sizeof(BL_UNPACK));
+        Unpack.Header  = &Packed;
+        Unpack.Base    = (UINT8*)(UINTN)Image->ImageBase;
+        Unpack.Sizes   = Sizes;
+        Unpack.Data    = Memory + DataOffset;
+        Unpack.Offsets = Offsets;
+        if (!BlMpRun(BlpUnpackIndexed, &Unpack, Packed.ChunkCount))
+        {
+            BlPrint(L"Packed image chunk %u is corrupt\n", Unpack.Corrupt);
+            Result = BL_STATUS_INVALID_IMAGE;
+        }
+    }
+
+    BlArenaReset(Scratch, Mark);
+
+    if (!BL_SUCCESS(Result))
+    {
+        BlUnloadPEImage64(Image);
+        return Result;
+    }
+
+    return BlpFinishPackedImage64(Image, &Packed, DataOffset + DataSize);
+}
+
+/**
+* Parses the PE headers at the start of the file and fills in what BlpAllocateImage needs.
+*
+* @param Probe         The start of the file.
+* @param ProbeSize     Bytes in Probe.
+* @param SectionTable  Receives the offset of the section table from the start of the file.
+* @param SectionCount  Receives the number of sections.
+* @param SizeOfHeaders Receives the bytes of headers that are part of the image.
+*/
+static
+BL_STATUS
+BlpParseHeaders(
+    _In_  CONST UINT8* Probe,
+    _In_  UINTN ProbeSize,
+    _Out_ PBL_LOADED_IMAGE Image,
+    _Out_ UINT64* SectionTable,
+    _Out_ UINT32* SectionCount,
+    _Out_ UINT64* SizeOfHeaders
+)
+{
+    CONST EFI_IMAGE_DOS_HEADER* DosHeader = (CONST EFI_IMAGE_DOS_HEADER*)Probe;
+    if (ProbeSize < sizeof(EFI_IMAGE_DOS_HEADER) || DosHeader->e_magic != EFI_IMAGE_DOS_SIGNATURE)
+    {
+        BlPrint(L"Image has no DOS header\n");
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    if ((UINT64)DosHeader->e_lfanew + sizeof(EFI_IMAGE_NT_HEADERS64) > ProbeSize)
+    {
+        BlPrint(L"Image NT headers at 0x%x are outside of the header probe\n", DosHeader->e_lfanew);
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    CONST EFI_IMAGE_NT_HEADERS64* NtHeaders = (CONST EFI_IMAGE_NT_HEADERS64*)(Probe + DosHeader->e_lfanew);
+    if (NtHeaders->Signature != EFI_IMAGE_NT_SIGNATURE ||
+        NtHeaders->FileHeader.Machine != IMAGE_FILE_MACHINE_X64 ||
+        NtHeaders->OptionalHeader.Magic != EFI_IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+    {
+        BlPrint(L"Image is not a PE32+ x64 image\n");
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    UINT64 SizeOfImage = NtHeaders->OptionalHeader.SizeOfImage;
+
+    *SizeOfHeaders = NtHeaders->OptionalHeader.SizeOfHeaders;
+    *SectionCount  = NtHeaders->FileHeader.NumberOfSections;
+    *SectionTable  = (UINT64)DosHeader->e_lfanew
+                   + offsetof(EFI_IMAGE_NT_HEADERS64, OptionalHeader)
+                   + NtHeaders->FileHeader.SizeOfOptionalHeader;
+
+    if (!SizeOfImage || *SizeOfHeaders > SizeOfImage ||
+        *SectionTable + (UINT64)*SectionCount * sizeof(EFI_IMAGE_SECTION_HEADER) > *SizeOfHeaders)
+    {
+        BlPrint(L"Image has malformed header sizes\n");
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    Image->PreferredBase = NtHeaders->OptionalHeader.ImageBase;
+    Image->ImageSize     = SizeOfImage;
+    Image->ImagePages    = EFI_SIZE_TO_PAGES(SizeOfImage);
+    Image->NtHeaders     = DosHeader->e_lfanew;
+    return BL_STATUS_OK;
+}
+
+/**
+* @return The part of a section's raw data that belongs to the image. Raw data is padded to
+*         FileAlignment, only what is inside VirtualSize counts.
+*/
+static
+UINT64
+BlpSectionRawSize(
+    _In_ CONST EFI_IMAGE_SECTION_HEADER* Section
+)
+{
+    UINT64 VirtualSize = Section->Misc.VirtualSize;
+    UINT64 RawSize     = Section->SizeOfRawData;
+
+    return VirtualSize && RawSize > VirtualSize ? VirtualSize : RawSize;
+}
+
+/**
+* Checks that every section lies inside the image, before any of them is read.
+*/
+static
+BL_STATUS
+BlpCheckSections(
+    _In_ CONST EFI_IMAGE_SECTION_HEADER* Sections,
+    _In_ UINT32 SectionCount,
+    _In_ UINT64 SizeOfImage
+)
+{
+    for (UINT32 i = 0; i < SectionCount; i++)
+    {
+        UINT64 RawSize = BlpSectionRawSize(&Sections[i]);
+        UINT64 Span    = MAX((UINT64)Sections[i].Misc.VirtualSize, RawSize);
+        if ((UINT64)Sections[i].VirtualAddress + Span > SizeOfImage)
+        {
+            BlPrint(L"Section %u lies outside of the image\n", i);
+            return BL_STATUS_INVALID_IMAGE;
+        }
+    }
+
+    return BL_STATUS_OK;
+}
+
+/**
+* Zeroes .bss and the uninitialised tail of a data section, spread over the APs when large.
+*/
+static
+VOID
+BlpZeroSectionTail(
+    _In_ UINT8* Base,
+    _In_ CONST EFI_IMAGE_SECTION_HEADER* Section
+)
+{
+    UINT64 RawSize = BlpSectionRawSize(Section);
+    if (Section->Misc.VirtualSize > RawSize)
+    {
+        BlMpZeroMemory(Base + Section->VirtualAddress + RawSize, (UINTN)(Section->Misc.VirtualSize - RawSize));
+    }
+}
+
+/**
+* Loads an image that is already in memory, every section is copied out of it.
+*/
+static
+BL_STATUS
+BlpLoadPEImage64(
+    _In_  CONST UINT8* Memory,
+    _In_  UINT64 MemorySize,
+    _Out_ PBL_LOADED_IMAGE Image
+)
+{
+    ZeroMem(Image, sizeof(BL_LOADED_IMAGE));
+
+    if (MemorySize >= sizeof(BL_PACKED_IMAGE_HEADER) &&
+        ((CONST BL_PACKED_IMAGE_HEADER*)Memory)->Signature == BL_PACKED_IMAGE_SIGNATURE)
+    {
+        return BlpLoadPackedImage64(Memory, MemorySize, Image);
+    }
+
+    UINT64    SectionTable;
+    UINT32    SectionCount;
+    UINT64    SizeOfHeaders;
+    BL_STATUS Result = BlpParseHeaders(Memory, (UINTN)MemorySize, Image, &SectionTable, &SectionCount, &SizeOfHeaders);
+    if (!BL_SUCCESS(Result))
+    {
+        return Result;
+    }
+
+    if (SizeOfHeaders > MemorySize)
+    {
+        BlPrint(L"Image headers run past the end of the image\n");
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    if (!BlpAllocateImage(Image))
+    {
+        return BL_STATUS_OUT_OF_RESOURCES;
+    }
+
+    UINT8*                          Base     = (UINT8*)(UINTN)Image->ImageBase;
+    CONST EFI_IMAGE_SECTION_HEADER* Sections = (CONST EFI_IMAGE_SECTION_HEADER*)(Base + SectionTable);
+
+    CopyMem(Base, Memory, SizeOfHeaders);
+    Result = BlpCheckSections(Sections, SectionCount, Image->ImageSize);
+
+    for (UINT32 i = 0; BL_SUCCESS(Result) && i < SectionCount; i++)
+    {
+        UINT64 RawSize = BlpSectionRawSize(&Sections[i]);
+        if (RawSize && (Sections[i].PointerToRawData > MemorySize || RawSize > MemorySize - Sections[i].PointerToRawData))
+        {
+            BlPrint(L"Section %u data runs past the end of the image\n", i);
+            Result = BL_STATUS_INVALID_IMAGE;
+            break;
+        }
+
+        if (RawSize)
+        {
+            BlMpCopyMemory(Base + Sections[i].VirtualAddress, Memory + Sections[i].PointerToRawData, (UINTN)RawSize);
+        }
+
+        BlpZeroSectionTail(Base, &Sections[i]);
+    }
+
+    // only costs anything when the preferred base was taken, sets the entry point
+    if (BL_SUCCESS(Result))
+    {
+        Image->BytesRead = MemorySize;
+        Result = BlRelocatePEImage64(Image);
+    }
+
+    if (!BL_SUCCESS(Result))
+    {
+        BlUnloadPEImage64(Image);
+        return Result;
+    }
+
+    return BL_STATUS_OK;
+}
+
+/**
+* Starts on the section under the cursor: zeroes its tail and takes the part of its data
+* the header probe already holds, small images can have section data in there.
+*
+* @return The bytes of its data that are in place.
+*/
+static
+UINT64
+BlpEnterSection(
+    _Inout_ PBL_IMAGE_LOAD Load
+)
+{
+    UINT8*                          Base    = (UINT8*)(UINTN)Load->Image->ImageBase;
+    CONST EFI_IMAGE_SECTION_HEADER* Section = &Load->Sections[Load->Section];
+    UINT64                          RawSize = BlpSectionRawSize(Section);
+    UINT64                          Probed  = 0;
+
+    BlpZeroSectionTail(Base, Section);
+
+    if (RawSize && Section->PointerToRawData < Load->ProbeSize)
+    {
+        Probed = MIN(RawSize, (UINT64)Load->ProbeSize - Section->PointerToRawData);
+        BlMpCopyMemory(Base + Section->VirtualAddress, Load->Probe + Section->PointerToRawData, (UINTN)Probed);
+    }
+
+    return Probed;
+}
+
+/**
+* Moves the cursor on to the next section data that still has to be read.
+*/
+static
+VOID
+BlpNextSectionData(
+    _Inout_ PBL_IMAGE_LOAD Load
+)
+{
+    while (Load->Section < Load->SectionCount && Load->Offset >= BlpSectionRawSize(&Load->Sections[Load->Section]))
+    {
+        Load->Section++;
+        Load->Offset = Load->Section < Load->SectionCount ? BlpEnterSection(Load) : 0;
+    }
+}
+
+/**
+* Reads the headers of a plain image into the image allocation and points the cursor at
+* the first section data to read.
+*/
+static
+BL_STATUS
+BlpBeginSections(
+    _Inout_ PBL_IMAGE_LOAD Load
+)
+{
+    PBL_LOADED_IMAGE Image = Load->Image;
+    UINT64           SectionTable;
+    UINT32           SectionCount;
+    UINT64           SizeOfHeaders;
+
+    BL_STATUS Result = BlpParseHeaders(Load->Probe, Load->ProbeSize, Image, &SectionTable, &SectionCount, &SizeOfHeaders);
+    if (!BL_SUCCESS(Result))
+    {
+        return Result;
+    }
+
+    // one allocation for the whole image, sections are read straight into it
+    if (!BlpAllocateImage(Image))
+    {
+        return BL_STATUS_OUT_OF_RESOURCES;
+    }
+
+    UINT8* Base = (UINT8*)(UINTN)Image->ImageBase;
+
+    // headers are part of the mapped image, take what the probe already has and read the rest
+    UINT64 HeaderBytes = MIN(SizeOfHeaders, (UINT64)Load->ProbeSize);
+    CopyMem(Base, Load->Probe, HeaderBytes);
+    if (SizeOfHeaders > HeaderBytes)
+    {
+        Result = BlpReadAt(Load->File, Load->Raw, HeaderBytes, SizeOfHeaders - HeaderBytes, Base + HeaderBytes, &Load->Position);
+        if (!BL_SUCCESS(Result))
+        {
+            return Result;
+        }
+    }
+
+    Image->BytesRead   = Load->ProbeSize + (SizeOfHeaders - HeaderBytes);
+    Load->Sections     = (CONST EFI_IMAGE_SECTION_HEADER*)(Base + SectionTable);
+    Load->SectionCount = SectionCount;
+
+    Result = BlpCheckSections(Load->Sections, SectionCount, Image->ImageSize);
+    if (BL_SUCCESS(Result) && SectionCount)
+    {
+        Load->Offset = BlpEnterSection(Load);
+        BlpNextSectionData(Load);
+    }
+
+    return Result;
+}
+
+/**
+* Reads the next chunk of section data. Through the raw extents that is one block device
+* read, or the rest of the section when the caller waits anyway. Without them the chunks
+* are queued on a stream so the firmware keeps reading while .bss tails are zeroed.
+*/
+static
+BL_STATUS
+BlpSectionStep(
+    _Inout_ PBL_IMAGE_LOAD Load,
+    _In_    BOOLEAN Wait
+)
+{
+    UINT8* Base = (UINT8*)(UINTN)Load->Image->ImageBase;
+
+    if (Load->Raw && Load->Section < Load->SectionCount)
+    {
+        CONST EFI_IMAGE_SECTION_HEADER* Section = &Load->Sections[Load->Section];
+        UINT64                          Left    = BlpSectionRawSize(Section) - Load->Offset;
+        UINT64                          Chunk   = Wait ? Left : MIN(Left, (UINT64)BL_STREAM_CHUNK_SIZE);
+
+        if (BL_SUCCESS(BlFatRead(Load->Raw, Section->PointerToRawData + Load->Offset, Base + Section->VirtualAddress + Load->Offset, Chunk)))
+        {
+            Load->Offset           += Chunk;
+            Load->Image->BytesRead += Chunk;
+            BlpNextSectionData(Load);
+            return BL_STATUS_OK;
+        }
+
+        BlPrint(L"Raw read of section %u failed, using the file system\n", Load->Section);
+        Load->Raw = NULL;
+    }
+
+    if (!Load->Streaming && Load->Section < Load->SectionCount)
+    {
+        CONST EFI_IMAGE_SECTION_HEADER* Section = &Load->Sections[Load->Section];
+        if (!BlStreamOpen(Load->File, Section->PointerToRawData + Load->Offset, &Load->Stream))
+        {
+            return BL_STATUS_READ_ERROR;
+        }
+
+        Load->Streaming = TRUE;
+    }
+
+    // keep the queue full, a seek to the next section only once it drained
+    while (Load->Section < Load->SectionCount && Load->Stream.Count < BL_STREAM_DEPTH)
+    {
+        CONST EFI_IMAGE_SECTION_HEADER* Section = &Load->Sections[Load->Section];
+        UINT64                          At      = Section->PointerToRawData + Load->Offset;
+
+        if (At != Load->Stream.Position && Load->Stream.Count)
+        {
+            break;
+        }
+
+        UINTN Chunk = (UINTN)MIN(BlpSectionRawSize(Section) - Load->Offset, (UINT64)BL_STREAM_CHUNK_SIZE);
+        if (!BlStreamSeek(&Load->Stream, At) || !BlStreamQueue(&Load->Stream, Base + Section->VirtualAddress + Load->Offset, Chunk))
+        {
+            BlPrint(L"[ %r ] - Failed to read section %u\n", BlGetLastFileError(), Load->Section);
+            return BL_STATUS_READ_ERROR;
+        }
+
+        Load->Offset           += Chunk;
+        Load->Image->BytesRead += Chunk;
+        BlpNextSectionData(Load);
+    }
+
+    if (!Load->Stream.Count || (!Wait && !BlStreamReady(&Load->Stream)))
+    {
+        return BL_STATUS_OK;
+    }
+
+    if (!BlStreamWait(&Load->Stream, NULL, NULL))
+    {
+        BlPrint(L"[ %r ] - Failed to read image sections\n", BlGetLastFileError());
+        return BL_STATUS_READ_ERROR;
+    }
+
+    return BL_STATUS_OK;
+}
+
+/**
+* Reads the chunk size table of a packed image and sets up the staging slots. Chunks
+* unpack straight into the image allocation, so there is never a staging copy of the
+* whole image.
+*/
+static
+BL_STATUS
+BlpBeginPacked(
+    _Inout_ PBL_IMAGE_LOAD Load
+)
+{
+    PBL_LOADED_IMAGE Image = Load->Image;
+
+    Load->Packed = TRUE;
+    CopyMem(&Load->Header, Load->Probe, sizeof(BL_PACKED_IMAGE_HEADER));
+
+    BL_STATUS Result = BlpCheckPackedHeader(&Load->Header);
+    if (!BL_SUCCESS(Result))
+    {
+        return Result;
+    }
+
+    Image->PreferredBase = Load->Header.PreferredBase;
+    Image->ImageSize     = Load->Header.ImageSize;
+    Image->ImagePages    = EFI_SIZE_TO_PAGES(Load->Header.ImageSize);
+
+    if (!BlpAllocateImage(Image))
+    {
+        return BL_STATUS_OUT_OF_RESOURCES;
+    }
+
+    UINT64 TableOffset = sizeof(BL_PACKED_IMAGE_HEADER);
+    UINT64 TableSize   = (UINT64)Load->Header.ChunkCount * sizeof(UINT32);
+
+    // pool rather than the scratch arena, the load outlives any one step
+    Load->Sizes = AllocatePool((UINTN)TableSize);
+    if (!Load->Sizes)
+    {
+        return BL_STATUS_OUT_OF_RESOURCES;
+    }
+
+    Result = BlpReadAt(Load->File, Load->Raw, TableOffset, TableSize, Load->Sizes, &Load->Position);
+    if (BL_SUCCESS(Result))
+    {
+        Result = BlpCheckChunkSizes(&Load->Header, Load->Sizes, &Load->DataSize);
+    }
+
+    if (!BL_SUCCESS(Result))
+    {
+        return Result;
+    }
+
+    // one chunk sized slot per read that can be in flight, and one for the chunk being unpacked
+    if (Load->Header.Method != BlPackStored)
+    {
+        Load->Staging = AllocatePool((UINTN)Load->Header.ChunkSize * BL_UNPACK_SLOTS);
+        if (!Load->Staging)
+        {
+            return BL_STATUS_OUT_OF_RESOURCES;
+        }
+    }
+
+    Load->Unpack.Header = &Load->Header;
+    Load->Unpack.Base   = (UINT8*)(UINTN)Image->ImageBase;
+    Load->Unpack.Sizes  = Load->Sizes;
+    Load->NextOffset    = TableOffset + TableSize;
+    return BL_STATUS_OK;
+}
+
+/**
+* @return Where chunk Index of a packed image is read to: stored chunks straight into
+*         place, the others into a staging slot.
+*/
+static
+UINT8*
+BlpChunkTarget(
+    _In_ PBL_IMAGE_LOAD Load,
+    _In_ UINT32 Index
+)
+{
+    if (Load->Sizes[Index] == BlpChunkSize(&Load->Header, Index))
+    {
+        return Load->Unpack.Base + (UINT64)Index * Load->Header.ChunkSize;
+    }
+
+    return Load->Staging + (UINT64)(Index % BL_UNPACK_SLOTS) * Load->Header.ChunkSize;
+}
+
+/**
+* Hands the chunk that just landed at Source to an AP, once the one before it unpacked.
+*/
+static
+BL_STATUS
+BlpChunkArrived(
+    _Inout_ PBL_IMAGE_LOAD Load,
+    _In_    CONST VOID* Source
+)
+{
+    if (!BlpUnpackNext(&Load->Job, &Load->Unpack, Load->Done, Source))
+    {
+        BlPrint(L"Packed image chunk %u is corrupt\n", Load->Unpack.Corrupt);
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    Load->Done++;
+    return BL_STATUS_OK;
+}
+
+/**
+* Reads the next chunk of a packed image. Block device reads are one large synchronous
+* transfer each. Without raw extents BL_STREAM_DEPTH chunk reads stay queued, so the
+* firmware keeps reading while the loader decompresses.
+*/
+static
+BL_STATUS
+BlpPackedStep(
+    _Inout_ PBL_IMAGE_LOAD Load,
+    _In_    BOOLEAN Wait
+)
+{
+    if (Load->Raw)
+    {
+        UINT8*    Target = BlpChunkTarget(Load, Load->Issued);
+        BL_STATUS Result = BlpReadAt(Load->File, Load->Raw, Load->NextOffset, Load->Sizes[Load->Issued], Target, &Load->Position);
+        if (!BL_SUCCESS(Result))
+        {
+            return Result;
+        }
+
+        Load->NextOffset += Load->Sizes[Load->Issued];
+        Load->Issued++;
+        return BlpChunkArrived(Load, Target);
+    }
+
+    if (!Load->Streaming)
+    {
+        if (!BlStreamOpen(Load->File, Load->NextOffset, &Load->Stream))
+        {
+            return BL_STATUS_READ_ERROR;
+        }
+
+        Load->Streaming = TRUE;
+    }
+
+    while (Load->Issued < Load->Header.ChunkCount && Load->Stream.Count < BL_STREAM_DEPTH)
+    {
+        if (!BlStreamQueue(&Load->Stream, BlpChunkTarget(Load, Load->Issued), Load->Sizes[Load->Issued]))
+        {
+            BlPrint(L"[ %r ] - Failed to queue packed image chunk %u\n", BlGetLastFileError(), Load->Issued);
+            return BL_STATUS_READ_ERROR;
+        }
+
+        Load->NextOffset += Load->Sizes[Load->Issued];
+        Load->Issued++;
+    }
+
+    if (!Wait && !BlStreamReady(&Load->Stream))
+    {
+        return BL_STATUS_OK;
+    }
+
+    VOID* Buffer;
+    UINTN Size;
+    if (!BlStreamWait(&Load->Stream, &Buffer, &Size))
+    {
+        BlPrint(L"[ %r ] - Failed to read packed image chunk %u\n", BlGetLastFileError(), Load->Done);
+        return BL_STATUS_READ_ERROR;
+    }
+
+    if (Size != Load->Sizes[Load->Done])
+    {
+        BlPrint(L"Packed image chunk %u is corrupt\n", Load->Done);
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    return BlpChunkArrived(Load, Buffer);
+}
+
+/**
+* Retires the reads in flight, waits for the last chunk to unpack and frees the staging.
+*
+* @return FALSE if a chunk failed to unpack.
+*/
+static
+BOOLEAN
+BlpImageRelease(
+    _Inout_ PBL_IMAGE_LOAD Load
+)
+{
+    if (Load->Streaming)
+    {
+        BlStreamClose(&Load->Stream);
+        Load->Streaming = FALSE;
+    }
+
+    // the last chunk read may still be unpacking out of the staging slots freed below
+    BOOLEAN Unpacked = BlMpFinish(&Load->Job);
+
+    if (Load->Staging)
+    {
+        FreePool(Load->Staging);
+        Load->Staging = NULL;
+    }
+
+    if (Load->Sizes)
+    {
+        FreePool(Load->Sizes);
+        Load->Sizes = NULL;
+    }
+
+    return Unpacked;
+}
+
+BL_STATUS
+BLAPI
+BlImageBegin(
+    _In_     EFI_FILE_HANDLE ImageHandle,
+    _In_opt_ PBL_FAT_FILE Raw,
+    _Out_    PBL_LOADED_IMAGE Image,
+    _Out_    PBL_IMAGE_LOAD Load
+)
+{
+    if (!ImageHandle || !Image || !Load)
+    {
+        return BL_STATUS_INVALID_PARAMETER;
+    }
+
+    ZeroMem(Image, sizeof(BL_LOADED_IMAGE));
+    ZeroMem(Load, sizeof(BL_IMAGE_LOAD));
+
+    Load->Image     = Image;
+    Load->File      = ImageHandle;
+    Load->Raw       = Raw;
+    Load->ProbeSize = sizeof(Load->Probe);
+    Load->Position  = MAX_UINT64;
+    BlMpPrepare(&Load->Job, BlpUnpackRead, &Load->Unpack, 0);
+
+    // read the start of the file once, everything header related is parsed from here
+    if (Raw)
+    {
+        Load->ProbeSize = (UINTN)MIN((UINT64)Load->ProbeSize, Raw->FileSize);
+        if (!BL_SUCCESS(BlFatRead(Raw, 0, Load->Probe, Load->ProbeSize)))
+        {
+            BlPrint(L"Raw read of image headers failed, using the file system\n");
+            Load->Raw       = NULL;
+            Load->ProbeSize = sizeof(Load->Probe);
+        }
+    }
+
+    if (!Load->Raw)
+    {
+        EFI_STATUS Status = ImageHandle->SetPosition(ImageHandle, 0);
+        if (!EFI_ERROR(Status))
+        {
+            Status = ImageHandle->Read(ImageHandle, &Load->ProbeSize, Load->Probe);
+        }
+
+        if (EFI_ERROR(Status))
+        {
+            BlPrint(L"[ %r ] - Failed to read image headers in BlLoadPEImage64\n", Status);
+            return BL_STATUS_READ_ERROR;
+        }
+
+        Load->Position = Load->ProbeSize;
+    }
+
+    BL_STATUS Result;
+    if (Load->ProbeSize >= sizeof(BL_PACKED_IMAGE_HEADER) &&
+        ((CONST BL_PACKED_IMAGE_HEADER*)Load->Probe)->Signature == BL_PACKED_IMAGE_SIGNATURE)
+    {
+        Result = BlpBeginPacked(Load);
+    }
+    else
+    {
+        Result = BlpBeginSections(Load);
+    }
+
+    if (!BL_SUCCESS(Result))
+    {
+        BlpImageRelease(Load);
+        BlUnloadPEImage64(Image);
+        return Result;
+    }
+
+    Load->Result = BL_STATUS_OK;
+    return BL_STATUS_OK;
+}
+
+BL_STATUS
+BLAPI
+BlImageStep(
+    _Inout_ PBL_IMAGE_LOAD Load,
+    _In_    BOOLEAN Wait
+)
+{
+    if (Load->Finished)
+    {
+        return Load->Result;
+    }
+
+    if (Load->Packed)
+    {
+        Load->Result   = BlpPackedStep(Load, Wait);
+        Load->Finished = Load->Done == Load->Header.ChunkCount;
+    }
+    else
+    {
+        Load->Result   = BlpSectionStep(Load, Wait);
+        Load->Finished = Load->Section == Load->SectionCount && !Load->Stream.Count;
+    }
+
+    Load->Finished |= !BL_SUCCESS(Load->Result);
+    return Load->Result;
+}
+
+BL_STATUS
+BLAPI
+BlImageEnd(
+    _Inout_ PBL_IMAGE_LOAD Load
+)
+{
+    BOOLEAN   Unpacked = BlpImageRelease(Load);
+    BL_STATUS Result   = Load->Result;
+
+    if (BL_SUCCESS(Result) && !Unpacked)
+    {
+        BlPrint(L"Packed image chunk %u is corrupt\n", Load->Unpack.Corrupt);
+        Result = BL_STATUS_INVALID_IMAGE;
+    }
+
+    if (BL_SUCCESS(Result) && !Load->Finished)
+    {
+        // given up on before the last chunk
+        Result = BL_STATUS_GENERIC_ERROR;
+    }
+
+    if (!BL_SUCCESS(Result))
+    {
+        BlUnloadPEImage64(Load->Image);
+        return Result;
+    }
+
+    if (Load->Packed)
+    {
+        return BlpFinishPackedImage64(Load->Image, &Load->Header, Load->NextOffset);
+    }
+
+    // only costs anything when the preferred base was taken, sets the entry point
+    Result = BlRelocatePEImage64(Load->Image);
+    if (!BL_SUCCESS(Result))
+    {
+        BlUnloadPEImage64(Load->Image);
+        return Result;
+    }
+
+    return BL_STATUS_OK;
+}
+
+BL_STATUS
+BLAPI
+BlLoadPEImage64(
+    _In_     EFI_FILE_HANDLE ImageHandle,
+    _In_opt_ PBL_FAT_FILE Raw,
+    _Out_    PBL_LOADED_IMAGE Image
+)
+{
+    BL_IMAGE_LOAD Load;
+    BL_STATUS     Result = BlImageBegin(ImageHandle, Raw, Image, &Load);
+    if (!BL_SUCCESS(Result))
+    {
+        return Result;
+    }
+
+    while (!Load.Finished)
+    {
+        BlImageStep(&Load, TRUE);
+    }
+
+    return BlImageEnd(&Load);
+}
+
+BL_STATUS
+BLAPI
+BlLoadPEImage64FromMemory(
+    _In_  CONST VOID* Buffer,
+    _In_  UINT64 Size,
+    _Out_ PBL_LOADED_IMAGE Image
+)
+{
+    if (!Buffer || !Size || !Image)
+    {
+        return BL_STATUS_INVALID_PARAMETER;
+    }
+
+    return BlpLoadPEImage64((CONST UINT8*)Buffer, Size, Image);
+}
+
+// four DIR64 entries packed in one 64 bit load, type lives in the top nibble of each entry
+#define BL_RELOC_DIR64_MASK  0xF000F000F000F000ULL
+#define BL_RELOC_DIR64_QUAD  0xA000A000A000A000ULL
+
+/**
+* Applies a single relocation entry. Used for odd types and for blocks near the end
+* of the image where every entry needs a bounds check.
+*/
+static
+BOOLEAN
+BlpApplyRelocation(
+    _In_ UINT8* Base,
+    _In_ UINT64 SizeOfImage,
+    _In_ UINT64 PageRva,
+    _In_ UINT16 Entry,
+    _In_ UINT64 Delta
+)
+{
+    UINT64 Rva = PageRva + (Entry & 0xFFF);
+
+    switch (Entry >> 12)
+    {
+    case EFI_IMAGE_REL_BASED_ABSOLUTE:
+        // padding to keep blocks 32 bit aligned
+        return TRUE;
+    case EFI_IMAGE_REL_BASED_DIR64:
+        if (Rva + sizeof(UINT64) > SizeOfImage)
+        {
+            return FALSE;
+        }
+        *(UINT64*)(Base + Rva) += Delta;
+        return TRUE;
+    case EFI_IMAGE_REL_BASED_HIGHLOW:
+        if (Rva + sizeof(UINT32) > SizeOfImage)
+        {
+            return FALSE;
+        }
+        *(UINT32*)(Base + Rva) += (UINT32)Delta;
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+BL_STATUS
+BLAPI
+BlRelocatePEImage64(
+    _Inout_ PBL_LOADED_IMAGE Image
+)
+{
+    if (!Image || !Image->ImageBase)
+    {
+        return BL_STATUS_INVALID_PARAMETER;
+    }
+
+    // an image linked into the kernel window only ever runs through the kernel mapping
+    return BlRebasePEImage64(Image, Image->PreferredBase >= BL_KERNEL_VIRTUAL_BASE ? Image->PreferredBase : Image->ImageBase);
+}
+
+/**
+* The relocation pass behind BlRebasePEImage64.
+*/
+static
+BL_STATUS
+BlpRebasePEImage64(
+    _Inout_ PBL_LOADED_IMAGE Image,
+    _In_    UINT64 VirtualBase
+)
+{
+    if (!Image || !Image->ImageBase)
+    {
+        return BL_STATUS_INVALID_PARAMETER;
+    }
+
+    UINT8* Base                     = (UINT8*)(UINTN)Image->ImageBase;
+    EFI_IMAGE_NT_HEADERS64* Headers = (EFI_IMAGE_NT_HEADERS64*)(Base + Image->NtHeaders);
+
+    // the headers remember the base the image is currently fixed up for
+    UINT64 Delta = VirtualBase - Headers->OptionalHeader.ImageBase;
+
+    Image->Relocations = 0;
+    if (!Delta)
+    {
+        Image->VirtualBase = VirtualBase;
+        Image->EntryPoint  = VirtualBase + Headers->OptionalHeader.AddressOfEntryPoint;
+        return BL_STATUS_OK;
+    }
+
+    if ((Headers->FileHeader.Characteristics & EFI_IMAGE_FILE_RELOCS_STRIPPED) ||
+        Headers->OptionalHeader.NumberOfRvaAndSizes <= EFI_IMAGE_DIRECTORY_ENTRY_BASERELOC)
+    {
+        BlPrint(L"Image cannot move from 0x%llx, it has no relocations\n", Headers->OptionalHeader.ImageBase);
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    EFI_IMAGE_DATA_DIRECTORY* Directory = &Headers->OptionalHeader.DataDirectory[EFI_IMAGE_DIRECTORY_ENTRY_BASERELOC];
+    if ((UINT64)Directory->VirtualAddress + Directory->Size > Image->ImageSize)
+    {
+        BlPrint(L"Image relocation directory lies outside of the image\n");
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    UINT8* Block    = Base + Directory->VirtualAddress;
+    UINT8* BlockEnd = Block + Directory->Size;
+
+    while (Block + sizeof(EFI_IMAGE_BASE_RELOCATION) <= BlockEnd)
+    {
+        EFI_IMAGE_BASE_RELOCATION* Relocation = (EFI_IMAGE_BASE_RELOCATION*)Block;
+
+        if (Relocation->SizeOfBlock < sizeof(EFI_IMAGE_BASE_RELOCATION) ||
+            Relocation->SizeOfBlock > (UINT64)(BlockEnd - Block))
+        {
+            BlPrint(L"Malformed relocation block at RVA 0x%x\n", Relocation->VirtualAddress);
+            return BL_STATUS_INVALID_IMAGE;
+        }
+
+        UINT64  PageRva = Relocation->VirtualAddress;
+        UINT16* Entry   = (UINT16*)(Block + sizeof(EFI_IMAGE_BASE_RELOCATION));
+        UINT64  Count   = (Relocation->SizeOfBlock - sizeof(EFI_IMAGE_BASE_RELOCATION)) / sizeof(UINT16);
+        UINT64  i       = 0;
+
+        // a block covers one 4K page, if the whole page plus a qword is inside the image
+        // no entry in it needs its own bounds check
+        if (PageRva + EFI_PAGE_SIZE + sizeof(UINT64) <= Image->ImageSize)
+        {
+            UINT8* Page = Base + PageRva;
+
+            // hot path, nearly every fixup in an x64 image is DIR64 so take them four at a time
+            for (; i + 4 <= Count; i += 4)
+            {
+                UINT64 Quad = *(UINT64*)(Entry + i);
+                if ((Quad & BL_RELOC_DIR64_MASK) != BL_RELOC_DIR64_QUAD)
+                {
+                    break;
+                }
+
+                *(UINT64*)(Page + (Entry[i + 0] & 0xFFF)) += Delta;
+                *(UINT64*)(Page + (Entry[i + 1] & 0xFFF)) += Delta;
+                *(UINT64*)(Page + (Entry[i + 2] & 0xFFF)) += Delta;
+                *(UINT64*)(Page + (Entry[i + 3] & 0xFFF)) += Delta;
+            }
+
+            Image->Relocations += (UINT32)i;
+        }
+
+        // mixed quads, the padding entry at the end of a block and blocks at the image tail
+        for (; i < Count; i++)
+        {
+            if (!BlpApplyRelocation(Base, Image->ImageSize, PageRva, Entry[i], Delta))
+            {
+                BlPrint(L"Bad relocation 0x%04x in block at RVA 0x%llx\n", Entry[i], PageRva);
+                return BL_STATUS_INVALID_IMAGE;
+            }
+
+            if (Entry[i] >> 12 != EFI_IMAGE_REL_BASED_ABSOLUTE)
+            {
+                Image->Relocations++;
+            }
+        }
+
+        Block += Relocation->SizeOfBlock;
+    }
+
+    Headers->OptionalHeader.ImageBase = VirtualBase;
+    Image->VirtualBase = VirtualBase;
+    Image->EntryPoint  = VirtualBase + Headers->OptionalHeader.AddressOfEntryPoint;
+
+    return BL_STATUS_OK;
+}
+
+BL_STATUS
+BLAPI
+BlRebasePEImage64(
+    _Inout_ PBL_LOADED_IMAGE Image,
+    _In_    UINT64 VirtualBase
+)
+{
+    BlTraceBegin("image.rebase");
+    BL_STATUS Status = BlpRebasePEImage64(Image, VirtualBase);
+    BlTraceEnd("image.rebase");
+    return Status;
+}
+
+VOID
+BLAPI
+BlUnloadPEImage64(
+    _In_ PBL_LOADED_IMAGE Image
+)
+{
+    if (!Image || !Image->ImageBase || !Image->ImagePages)
+    {
+        return;
+    }
+
+    gBS->FreePages(Image->ImageBase, Image->ImagePages);
+    ZeroMem(Image, sizeof(BL_LOADED_IMAGE));
+}
\ No newline at end of file
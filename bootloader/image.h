@@ -1,9 +1,247 @@
 #pragma once
 
 #include "boot.h"
+#include "fat.h"
+#include "sha256.h"
+#include "filesystem.h"
+#include "mp.h"
 
+//
+//
+// PE32+ loader for the kernel image. Headers are parsed once and every section is read
+// from the file straight into its final place in the image allocation, all at once or a
+// chunk per step.
+//
+//
+
+// images are placed on a large page boundary so the kernel mapping can use 2 MiB pages
+#define BL_IMAGE_ALIGNMENT SIZE_2MB
+
+// Large enough for the DOS stub, NT headers and section table of a typical image, so the
+// whole header block is normally pulled in with a single read.
+#define BL_HEADER_PROBE_SIZE 0x400
+
+//
+//
+// Packed kernel images. PackImage.py lays the PE image out exactly as it sits in memory
+// and compresses it in fixed size chunks, so every chunk unpacks straight into its final
+// place in the image allocation while the next chunks are still being read.
+//
+//   BL_PACKED_IMAGE_HEADER
+//   UINT32 PackedSize[ChunkCount]
+//   chunks back to back, a chunk whose PackedSize equals its unpacked size is stored
+//
+//
+
+#define BL_PACKED_IMAGE_SIGNATURE  SIGNATURE_64('O', 'P', 'L', 'I', 'P', 'A', 'C', 'K')
+#define BL_PACKED_IMAGE_VERSION    1
+#define BL_PACKED_IMAGE_MAX_CHUNKS 4096
+
+typedef enum _BL_PACK_METHOD
+{
+	BlPackStored = 0,
+	BlPackLz4    = 1
+} BL_PACK_METHOD;
+
+typedef struct _BL_PACKED_IMAGE_HEADER
+{
+	UINT64 Signature;     // BL_PACKED_IMAGE_SIGNATURE
+	UINT32 Version;       // BL_PACKED_IMAGE_VERSION
+	UINT32 Method;        // BL_PACK_METHOD
+	UINT64 ImageSize;     // SizeOfImage, bytes once unpacked
+	UINT64 PreferredBase; // OptionalHeader.ImageBase
+	UINT32 ChunkSize;     // unpacked bytes per chunk, the last one may be shorter
+	UINT32 ChunkCount;
+} BL_PACKED_IMAGE_HEADER;
+
+typedef struct _BL_LOADED_IMAGE
+{
+	EFI_PHYSICAL_ADDRESS ImageBase;     // where the image was actually placed
+	UINT64               PreferredBase; // OptionalHeader.ImageBase the image was linked at
+	UINT64               ImageSize;     // OptionalHeader.SizeOfImage
+	UINT64               ImagePages;    // pages backing ImageBase
+	UINT64               VirtualBase;   // address the image is fixed up to run at
+	UINT64               EntryPoint;    // AddressOfEntryPoint at VirtualBase
+	UINT64               BytesRead;     // total bytes pulled from the file
+	UINT32               NtHeaders;     // offset of the NT headers from ImageBase
+	UINT32               Relocations;   // fixups applied, 0 when loaded at PreferredBase
+	BOOLEAN              Verified;      // Digest was checked while the image file was read
+	UINT8                Digest[BL_SHA256_DIGEST_SIZE]; // SHA-256 of the image file, when Verified
+} BL_LOADED_IMAGE, *PBL_LOADED_IMAGE;
+
+//
+// A packed image being unpacked, shared with the processors that unpack its chunks. In
+// memory every chunk is an index of one job. Read from a file each chunk is a job of its
+// own, unpacked on an AP while the BSP reads the next one.
+//
+typedef struct _BL_UNPACK
+{
+	CONST BL_PACKED_IMAGE_HEADER* Header;
+	UINT8*                        Base;
+	CONST UINT32*                 Sizes;
+	CONST UINT8*                  Data;    // memory loads, the chunks back to back
+	CONST UINT64*                 Offsets; // memory loads, where each chunk starts in Data
+	CONST VOID*                   Source;  // file loads, where chunk First landed
+	UINT32                        First;   // file loads, the chunk this job unpacks
+	volatile UINT32               Corrupt; // a chunk that failed to unpack
+} BL_UNPACK;
+
+//
+// An image being loaded from a file in steps, for callers that service other events
+// between chunks. The headers are read and the image allocated up front, every step then
+// reads the next chunk of section data into its final place, or the next packed chunk
+// which is unpacked there on an AP while the step after it reads on.
+//
+typedef struct _BL_IMAGE_LOAD
+{
+	PBL_LOADED_IMAGE                Image;
+	EFI_FILE_HANDLE                 File;
+	PBL_FAT_FILE                    Raw;        // NULL without extents or once a raw read failed
+	UINT8                           Probe[BL_HEADER_PROBE_SIZE]; // the start of the file
+	UINTN                           ProbeSize;
+	UINT64                          Position;   // file pointer for synchronous reads, MAX_UINT64 when unknown
+	BOOLEAN                         Packed;
+	CONST EFI_IMAGE_SECTION_HEADER* Sections;   // plain images, in the image headers
+	UINT32                          SectionCount;
+	UINT32                          Section;    // plain images, the section being read
+	UINT64                          Offset;     // bytes of its data read or queued
+	BL_PACKED_IMAGE_HEADER          Header;     // packed images
+	UINT32*                         Sizes;      // packed size of every chunk
+	UINT8*                          Staging;    // a chunk per read in flight and one unpacking, NULL when stored
+	UINT64                          DataSize;   // all chunks together
+	UINT64                          NextOffset; // file offset of chunk Issued
+	UINT32                          Issued;     // chunks read or queued
+	UINT32                          Done;       // chunks handed to Unpack
+	BL_UNPACK                       Unpack;
+	BL_MP_JOB                       Job;        // unpacks the last chunk while the next one is read
+	BOOLEAN                         Streaming;  // Stream is open
+	BL_FILE_STREAM                  Stream;
+	BL_STATUS                       Result;
+	BOOLEAN                         Finished;   // everything is in or the load failed, call BlImageEnd
+} BL_IMAGE_LOAD, *PBL_IMAGE_LOAD;
+
+/**
+* Loads a PE32+ image from an open file into freshly allocated pages. Packed images
+* (BL_PACKED_IMAGE_SIGNATURE) are recognised and unpacked on the fly.
+*
+* @param ImageHandle The opened image file, "kernel.exe".
+* @param Raw         Optional, the same file resolved by BlFatOpen. Reads go to the block
+*                    device and fall back to ImageHandle if that ever fails.
+* @param Image       Receives where the image was placed and its entry point.
+*
+* @return BL_STATUS_OK on success, else the reason the image could not be loaded.
+*/
 BL_STATUS
 BLAPI
 BlLoadPEImage64(
-	_In_ EFI_FILE_HANDLE ImageHandle
+	_In_ EFI_FILE_HANDLE ImageHandle,
+	_In_opt_ PBL_FAT_FILE Raw,
+	_Out_ PBL_LOADED_IMAGE Image
+);
+
+/**
+* Loads a PE32+ image that is already in memory, etc... a boot bundle payload. Sections are
+* copied (or a packed image unpacked) out of Buffer into their own page aligned image allocation.
+*
+* @param Buffer The raw image file.
+* @param Size   Bytes in Buffer.
+* @param Image  Receives where the image was placed and its entry point.
+*
+* @return BL_STATUS_OK on success, else the reason the image could not be loaded.
+*/
+BL_STATUS
+BLAPI
+BlLoadPEImage64FromMemory(
+	_In_ CONST VOID* Buffer,
+	_In_ UINT64 Size,
+	_Out_ PBL_LOADED_IMAGE Image
+);
+
+/**
+* Starts loading an image from a file in steps: reads and checks the headers and allocates
+* the image. The file and Raw must stay open until BlImageEnd.
+*
+* @param ImageHandle The opened image file.
+* @param Raw         Optional, the same file resolved by BlFatOpen.
+* @param Image       Receives the image once BlImageEnd succeeded.
+* @param Load        Receives the load state, must not move until BlImageEnd.
+*
+* @return BL_STATUS_OK if the load started, BlImageStep and BlImageEnd follow. On any
+*         other status nothing is left to clean up.
+*/
+BL_STATUS
+BLAPI
+BlImageBegin(
+	_In_     EFI_FILE_HANDLE ImageHandle,
+	_In_opt_ PBL_FAT_FILE Raw,
+	_Out_    PBL_LOADED_IMAGE Image,
+	_Out_    PBL_IMAGE_LOAD Load
+);
+
+/**
+* Reads the next chunk of the image, sets Load->Finished after the last one.
+*
+* @param Wait FALSE to return at once when the next chunk is still in flight.
+*
+* @return BL_STATUS_OK while the load is going well, else why it failed.
+*/
+BL_STATUS
+BLAPI
+BlImageStep(
+	_Inout_ PBL_IMAGE_LOAD Load,
+	_In_    BOOLEAN Wait
+);
+
+/**
+* Ends a stepped load, finished or not, and relocates the image.
+*
+* @return What BlLoadPEImage64 would have returned. The image is unloaded unless it is BL_STATUS_OK.
+*/
+BL_STATUS
+BLAPI
+BlImageEnd(
+	_Inout_ PBL_IMAGE_LOAD Load
+);
+
+/**
+* Applies base relocations so a loaded image can run at ImageBase instead of PreferredBase.
+* Nothing is touched when the image already sits on its preferred base, or when it was
+* linked into the kernel window (BL_KERNEL_VIRTUAL_BASE), such an image keeps its link
+* address and only runs once the kernel mapping is live.
+*
+* @param Image The image filled in by BlLoadPEImage64.
+*
+* @return BL_STATUS_OK on success, BL_STATUS_INVALID_IMAGE if the image cannot be relocated.
+*/
+BL_STATUS
+BLAPI
+BlRelocatePEImage64(
+	_Inout_ PBL_LOADED_IMAGE Image
+);
+
+/**
+* Fixes a loaded image up to run at VirtualBase, whatever base it is currently fixed up for.
+* The page table builder uses it to move an image linked low into the kernel window.
+*
+* @param Image       The image filled in by BlLoadPEImage64.
+* @param VirtualBase The address the image will be mapped at.
+*
+* @return BL_STATUS_OK on success, BL_STATUS_INVALID_IMAGE if the image cannot be relocated.
+*/
+BL_STATUS
+BLAPI
+BlRebasePEImage64(
+	_Inout_ PBL_LOADED_IMAGE Image,
+	_In_ UINT64 VirtualBase
+);
+
+/**
+* Releases the pages of a loaded image.
+*
+* @param Image The image filled in by BlLoadPEImage64.
+*/
+VOID
+BLAPI
+BlUnloadPEImage64(
+	_In_ PBL_LOADED_IMAGE Image
 );
\ No newline at end of file
@@ -0,0 +1,164 @@
+#include "log.h"
+
+STATIC_ASSERT((BL_LOG_RING_SIZE & (BL_LOG_RING_SIZE - 1)) == 0, "the log ring is a power of two");
+STATIC_ASSERT(BL_LOG_FLUSH_SIZE < BL_LOG_RING_SIZE, "a flush has to catch up before the ring wraps");
+
+static BOOT_LOG* Log;
+static CHAR8*    Text;
+static UINT64    Flushed;  // Head as of the last flush
+static BOOLEAN   Detached; // ConOut is gone
+static CHAR16    Wide[BL_LOG_FLUSH_SIZE + 1];
+
+VOID
+BLAPI
+BlLogInit(
+    VOID
+)
+{
+    EFI_PHYSICAL_ADDRESS Base;
+    if (EFI_ERROR(gBS->AllocatePages(AllocateAnyPages, BL_MEMORY_TYPE(BootMemoryBootInfo), EFI_SIZE_TO_PAGES(sizeof(BOOT_LOG) + BL_LOG_RING_SIZE), &Base)))
+    {
+        return;
+    }
+
+    Log = (BOOT_LOG*)(UINTN)Base;
+    ZeroMem(Log, sizeof(BOOT_LOG));
+    Log->Signature  = BOOT_LOG_SIGNATURE;
+    Log->Size       = BL_LOG_RING_SIZE;
+    Log->HeaderSize = sizeof(BOOT_LOG);
+
+    Text    = (CHAR8*)(Log + 1);
+    Flushed = 0;
+}
+
+/**
+* Appends a formatted message, anything outside of printable ASCII is kept as '?' except
+* the line and tab controls.
+*/
+static
+VOID
+BlpLogAppend(
+    _In_ CONST CHAR16* Message,
+    _In_ UINTN Length
+)
+{
+    UINT64 Head = Log->Head;
+
+    for (UINTN i = 0; i < Length; i++)
+    {
+        CHAR16 Character = Message[i];
+        if ((Character < L' ' || Character > L'~') && Character != L'\n' && Character != L'\r' && Character != L'\t')
+        {
+            Character = L'?';
+        }
+
+        Text[Head++ & (BL_LOG_RING_SIZE - 1)] = (CHAR8)Character;
+    }
+
+    Log->Head = Head;
+}
+
+VOID
+BLAPI
+BlLog(
+    _In_ UINT32 Level,
+    _In_ CONST CHAR16* Format,
+    ...
+)
+{
+    VA_LIST Args;
+    CHAR16  Line[BL_LOG_LINE_SIZE];
+    CHAR16* Message = Line;
+
+    // one pass in the common case, the length is only measured for a line that did not fit
+    VA_START(Args, Format);
+    UINTN Length = UnicodeVSPrint(Line, sizeof(Line), Format, Args);
+    VA_END(Args);
+
+    if (Length >= BL_LOG_LINE_SIZE - 1)
+    {
+        VA_START(Args, Format);
+        UINTN Needed = SPrintLength(Format, Args);
+        VA_END(Args);
+
+        CHAR16* Long = AllocatePool((Needed + 1) * sizeof(CHAR16));
+        if (Long)
+        {
+            VA_START(Args, Format);
+            Length = UnicodeVSPrint(Long, (Needed + 1) * sizeof(CHAR16), Format, Args);
+            VA_END(Args);
+            Message = Long;
+        }
+    }
+
+    if (!Log)
+    {
+        if (!Detached)
+        {
+            gST->ConOut->OutputString(gST->ConOut, Message);
+        }
+    }
+    else
+    {
+        BlpLogAppend(Message, Length);
+
+        if (Level == BL_LOG_ERROR || Log->Head - Flushed >= BL_LOG_FLUSH_SIZE)
+        {
+            BlLogFlush();
+        }
+    }
+
+    if (Message != Line)
+    {
+        FreePool(Message);
+    }
+}
+
+VOID
+BLAPI
+BlLogFlush(
+    VOID
+)
+{
+    if (!Log || Detached)
+    {
+        return;
+    }
+
+    // ConOut wants UCS-2, a whole batch is widened and written with one call
+    UINT64 Head  = Log->Head;
+    UINT64 Start = Head - Flushed > BL_LOG_RING_SIZE ? Head - BL_LOG_RING_SIZE : Flushed;
+
+    while (Start < Head)
+    {
+        UINTN Count = 0;
+        while (Start < Head && Count < BL_LOG_FLUSH_SIZE)
+        {
+            Wide[Count++] = (CHAR8)Text[Start++ & (BL_LOG_RING_SIZE - 1)];
+        }
+
+        Wide[Count] = L'\0';
+        gST->ConOut->OutputString(gST->ConOut, Wide);
+    }
+
+    Flushed = Head;
+}
+
+VOID
+BLAPI
+BlLogDetach(
+    VOID
+)
+{
+    BlLogFlush();
+    Detached = TRUE;
+}
+
+BOOT_LOG*
+BLAPI
+BlGetLog(
+    VOID
+)
+{
+    return Log;
+}
\ No newline at end of file
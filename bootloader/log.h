@@ -0,0 +1,95 @@
+#ifndef _LOG_H
+#define _LOG_H
+
+#include "boot.h"
+
+//
+//
+// Buffered console output. Messages are formatted on the stack and appended to a ring
+// that goes to ConOut in batches, on serial redirected firmware every OutputString call is
+// a slow synchronous write no matter how short. The batch is written out once it grows
+// past BL_LOG_FLUSH_SIZE, on errors and whenever the loader is about to wait, getc and the
+// countdown flush first. The ring is a BOOT_LOG (bootinfo.h) and is handed to the kernel
+// as its early dmesg.
+//
+// BL_LOG drops messages above BL_LOG_LEVEL at compile time, BlPrint is the plain
+// replacement for Print and is never filtered.
+//
+//
+
+#define BL_LOG_ERROR   0 // flushed at once
+#define BL_LOG_WARNING 1
+#define BL_LOG_INFO    2
+#define BL_LOG_DEBUG   3
+
+#ifndef BL_LOG_LEVEL
+#define BL_LOG_LEVEL BL_LOG_INFO
+#endif
+
+#define BL_LOG_RING_SIZE  SIZE_64KB // power of two
+#define BL_LOG_LINE_SIZE  256       // characters formatted on the stack, longer ones go to pool
+#define BL_LOG_FLUSH_SIZE 2048      // pending bytes that force a flush
+
+#define BL_LOG(Level, ...)                      \
+    do                                          \
+    {                                           \
+        if ((Level) <= BL_LOG_LEVEL)            \
+        {                                       \
+            BlLog((Level), __VA_ARGS__);        \
+        }                                       \
+    } while (0)
+
+#define BlPrint(...) BlLog(BL_LOG_INFO, __VA_ARGS__)
+
+/**
+* Allocates the ring. Until then, or if it fails, output goes straight to ConOut.
+*/
+VOID
+BLAPI
+BlLogInit(
+    VOID
+);
+
+/**
+* Formats a message into the ring, use BL_LOG or BlPrint.
+*
+* @param Level  BL_LOG_*.
+* @param Format Print style format string.
+*/
+VOID
+BLAPI
+BlLog(
+    _In_ UINT32 Level,
+    _In_ CONST CHAR16* Format,
+    ...
+);
+
+/**
+* Writes everything pending to ConOut.
+*/
+VOID
+BLAPI
+BlLogFlush(
+    VOID
+);
+
+/**
+* Flushes one last time and stops writing to ConOut, for ExitBootServices. Messages after
+* it only go into the ring.
+*/
+VOID
+BLAPI
+BlLogDetach(
+    VOID
+);
+
+/**
+* @return The ring, NULL when it could not be allocated.
+*/
+BOOT_LOG*
+BLAPI
+BlGetLog(
+    VOID
+);
+
+#endif // !_LOG_H
\ No newline at end of file
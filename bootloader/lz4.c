@@ -0,0 +1,133 @@
+#include "lz4.h"
+#include "../kernal/rtl.h"
+
+// every match is at least this long, the token only stores the excess
+#define BL_LZ4_MIN_MATCH 4
+
+/**
+* Reads the 255-continued length extension that follows a nibble of 15.
+*/
+static
+BOOLEAN
+BlpLz4Length(
+    _Inout_ CONST UINT8** Input,
+    _In_    CONST UINT8* InputEnd,
+    _Inout_ UINTN* Length
+)
+{
+    UINT8 Byte;
+    do
+    {
+        if (*Input >= InputEnd)
+        {
+            return FALSE;
+        }
+
+        Byte     = *(*Input)++;
+        *Length += Byte;
+    } while (Byte == 0xFF);
+
+    return TRUE;
+}
+
+BOOLEAN
+BLAPI
+BlLz4Decompress(
+    _In_  CONST VOID* Source,
+    _In_  UINTN SourceSize,
+    _Out_ VOID* Destination,
+    _In_  UINTN DestinationSize,
+    _Out_ UINTN* Written
+)
+{
+    CONST UINT8* Input     = (CONST UINT8*)Source;
+    CONST UINT8* InputEnd  = Input + SourceSize;
+    UINT8*       Output    = (UINT8*)Destination;
+    UINT8*       OutputEnd = Output + DestinationSize;
+
+    *Written = 0;
+
+    while (Input < InputEnd)
+    {
+        UINT8 Token   = *Input++;
+        UINTN Literal = Token >> 4;
+
+        if (Literal == 15 && !BlpLz4Length(&Input, InputEnd, &Literal))
+        {
+            return FALSE;
+        }
+
+        if (Literal > (UINTN)(InputEnd - Input) || Literal > (UINTN)(OutputEnd - Output))
+        {
+            return FALSE;
+        }
+
+        RtlCopyMemory(Output, Input, Literal);
+        Output += Literal;
+        Input  += Literal;
+
+        // the last sequence is literals only
+        if (Input == InputEnd)
+        {
+            break;
+        }
+
+        if (InputEnd - Input < 2)
+        {
+            return FALSE;
+        }
+
+        UINTN Offset = Input[0] | ((UINTN)Input[1] << 8);
+        Input += 2;
+
+        if (!Offset || Offset > (UINTN)(Output - (UINT8*)Destination))
+        {
+            return FALSE;
+        }
+
+        UINTN Match = Token & 0xF;
+        if (Match == 15 && !BlpLz4Length(&Input, InputEnd, &Match))
+        {
+            return FALSE;
+        }
+
+        Match += BL_LZ4_MIN_MATCH;
+        if (Match > (UINTN)(OutputEnd - Output))
+        {
+            return FALSE;
+        }
+
+        CONST UINT8* From = Output - Offset;
+        if (Offset >= Match)
+        {
+            RtlCopyMemory(Output, From, Match);
+            Output += Match;
+        }
+        else if (Offset >= sizeof(UINT64))
+        {
+            // overlapping run, but each qword still reads bytes that are already final
+            for (; Match >= sizeof(UINT64); Match -= sizeof(UINT64))
+            {
+                WriteUnaligned64((UINT64*)Output, ReadUnaligned64((CONST UINT64*)From));
+                Output += sizeof(UINT64);
+                From   += sizeof(UINT64);
+            }
+
+            while (Match--)
+            {
+                *Output++ = *From++;
+            }
+        }
+        else
+        {
+            // short period repeats, etc... runs of zero padding
+            while (Match--)
+            {
+                *Output++ = *From++;
+            }
+        }
+    }
+
+    *Written = (UINTN)(Output - (UINT8*)Destination);
+    return TRUE;
+}
\ No newline at end of file
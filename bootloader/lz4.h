@@ -0,0 +1,35 @@
+#ifndef _LZ4_H
+#define _LZ4_H
+
+#include "boot.h"
+
+//
+//
+// LZ4 block decoder. Only the raw block format is handled, framing (chunk sizes, what
+// is stored and what is compressed) belongs to whoever produced the blocks. The decoder
+// never calls into the firmware, so blocks can be unpacked on application processors.
+//
+//
+
+/**
+* Decompresses one LZ4 block.
+*
+* @param Source          The compressed block.
+* @param SourceSize      Bytes in the block.
+* @param Destination     Receives the decompressed data.
+* @param DestinationSize Room in Destination, never written past.
+* @param Written         Receives the number of bytes produced.
+*
+* @return TRUE on success, FALSE if the block is malformed or does not fit.
+*/
+BOOLEAN
+BLAPI
+BlLz4Decompress(
+    _In_  CONST VOID* Source,
+    _In_  UINTN SourceSize,
+    _Out_ VOID* Destination,
+    _In_  UINTN DestinationSize,
+    _Out_ UINTN* Written
+);
+
+#endif // !_LZ4_H
\ No newline at end of file
@@ -0,0 +1,260 @@
+#include "mp.h"
+#include "config.h"
+#include "log.h"
+#include "../kernal/rtl.h"
+#include <Pi/PiMultiPhase.h>
+#include <Protocol/MpService.h>
+#include <Library/SynchronizationLib.h>
+
+#define BL_MP_MAX_PROCESSORS 64 // APs the loader uses at most, memory bandwidth runs out long before
+
+static EFI_MP_SERVICES_PROTOCOL* Mp;
+static UINT32                    ApCount;
+static UINTN                     ApNumbers[BL_MP_MAX_PROCESSORS]; // MP services processor numbers
+static EFI_EVENT                 ApDone[BL_MP_MAX_PROCESSORS];    // signalled when the AP returns
+static UINT32                    ApStarted;                       // APs working on the current job
+
+typedef struct _BL_MP_RANGE
+{
+    UINT8*       Destination;
+    CONST UINT8* Source;  // NULL to zero
+    UINTN        Length;
+} BL_MP_RANGE;
+
+/**
+* Takes indices off a job until none are left or a routine failed. Runs on the BSP and on
+* every started AP at the same time.
+*/
+static
+VOID
+BlpMpDrain(
+    _Inout_ PBL_MP_JOB Job
+)
+{
+    while (!Job->Failed)
+    {
+        UINT32 Index = InterlockedIncrement(&Job->Next) - 1;
+        if (Index >= Job->Count)
+        {
+            break;
+        }
+
+        if (!Job->Routine(Job->Context, Index))
+        {
+            Job->Failed = TRUE;
+        }
+    }
+}
+
+/**
+* The EFI_AP_PROCEDURE every AP is started on.
+*/
+static
+VOID
+EFIAPI
+BlpMpWorker(
+    _Inout_ VOID* Buffer
+)
+{
+    BlpMpDrain((PBL_MP_JOB)Buffer);
+}
+
+VOID
+BLAPI
+BlMpInit(
+    VOID
+)
+{
+    EFI_GUID MpGuid = EFI_MP_SERVICES_PROTOCOL_GUID;
+    UINTN    Total;
+    UINTN    Enabled;
+    UINT32   Limit = BlGetConfig()->Processors;
+
+    if (Limit == 1 ||
+        EFI_ERROR(gBS->LocateProtocol(&MpGuid, NULL, (VOID**)&Mp)) ||
+        EFI_ERROR(Mp->GetNumberOfProcessors(Mp, &Total, &Enabled)))
+    {
+        Mp = NULL;
+        return;
+    }
+
+    // the BSP counts against the limit, it works on every job as well
+    UINT32 Wanted = Limit ? Limit - 1 : BL_MP_MAX_PROCESSORS;
+    Wanted = MIN(Wanted, BL_MP_MAX_PROCESSORS);
+
+    for (UINTN i = 0; i < Total && ApCount < Wanted; i++)
+    {
+        EFI_PROCESSOR_INFORMATION Info;
+        if (EFI_ERROR(Mp->GetProcessorInfo(Mp, i, &Info)) ||
+            (Info.StatusFlag & PROCESSOR_AS_BSP_BIT) || !(Info.StatusFlag & PROCESSOR_ENABLED_BIT))
+        {
+            continue;
+        }
+
+        if (EFI_ERROR(gBS->CreateEvent(0, 0, NULL, NULL, &ApDone[ApCount])))
+        {
+            break;
+        }
+
+        ApNumbers[ApCount++] = i;
+    }
+
+    if (!ApCount)
+    {
+        Mp = NULL;
+    }
+
+    BL_LOG(BL_LOG_DEBUG, L"%u of %llu processors take loader work\n", ApCount + 1, (UINT64)Enabled);
+}
+
+UINT32
+BLAPI
+BlMpProcessorCount(
+    VOID
+)
+{
+    return ApCount + 1;
+}
+
+VOID
+BLAPI
+BlMpPrepare(
+    _Out_ PBL_MP_JOB Job,
+    _In_  BL_MP_ROUTINE Routine,
+    _In_  VOID* Context,
+    _In_  UINT32 Count
+)
+{
+    Job->Routine = Routine;
+    Job->Context = Context;
+    Job->Count   = Count;
+    Job->Next    = 0;
+    Job->Failed  = FALSE;
+    Job->Started = FALSE;
+}
+
+BOOLEAN
+BLAPI
+BlMpStart(
+    _Inout_ PBL_MP_JOB Job
+)
+{
+    if (!Mp || ApStarted || !Job->Count)
+    {
+        return FALSE;
+    }
+
+    // the BSP joins in BlMpFinish, a job of N indices never needs more than N APs
+    UINT32 Wanted = MIN(ApCount, Job->Count);
+    for (UINT32 i = 0; i < Wanted; i++)
+    {
+        if (EFI_ERROR(Mp->StartupThisAP(Mp, BlpMpWorker, ApNumbers[i], ApDone[i], 0, Job, NULL)))
+        {
+            break;
+        }
+
+        ApStarted++;
+    }
+
+    Job->Started = ApStarted != 0;
+    return Job->Started;
+}
+
+BOOLEAN
+BLAPI
+BlMpFinish(
+    _Inout_ PBL_MP_JOB Job
+)
+{
+    BlpMpDrain(Job);
+
+    if (Job->Started)
+    {
+        for (UINT32 i = 0; i < ApStarted; i++)
+        {
+            UINTN Index;
+            gBS->WaitForEvent(1, &ApDone[i], &Index);
+        }
+
+        ApStarted    = 0;
+        Job->Started = FALSE;
+    }
+
+    return !Job->Failed;
+}
+
+BOOLEAN
+BLAPI
+BlMpRun(
+    _In_ BL_MP_ROUTINE Routine,
+    _In_ VOID* Context,
+    _In_ UINT32 Count
+)
+{
+    BL_MP_JOB Job;
+    BlMpPrepare(&Job, Routine, Context, Count);
+    BlMpStart(&Job);
+    return BlMpFinish(&Job);
+}
+
+/**
+* Copies or zeroes slice Index of a range.
+*/
+static
+BOOLEAN
+BLAPI
+BlpMpSlice(
+    _In_ VOID* Context,
+    _In_ UINT32 Index
+)
+{
+    BL_MP_RANGE* Range  = (BL_MP_RANGE*)Context;
+    UINTN        Offset = (UINTN)Index * BL_MP_SLICE_SIZE;
+    UINTN        Length = MIN(Range->Length - Offset, (UINTN)BL_MP_SLICE_SIZE);
+
+    if (Range->Source)
+    {
+        RtlCopyMemory(Range->Destination + Offset, Range->Source + Offset, Length);
+    }
+    else
+    {
+        RtlFillMemory(Range->Destination + Offset, Length, 0);
+    }
+
+    return TRUE;
+}
+
+VOID
+BLAPI
+BlMpCopyMemory(
+    _Out_ VOID* Destination,
+    _In_  CONST VOID* Source,
+    _In_  UINTN Length
+)
+{
+    if (!Mp || Length < BL_MP_SPLIT_SIZE)
+    {
+        CopyMem(Destination, Source, Length);
+        return;
+    }
+
+    BL_MP_RANGE Range = { (UINT8*)Destination, (CONST UINT8*)Source, Length };
+    BlMpRun(BlpMpSlice, &Range, (UINT32)((Length + BL_MP_SLICE_SIZE - 1) / BL_MP_SLICE_SIZE));
+}
+
+VOID
+BLAPI
+BlMpZeroMemory(
+    _Out_ VOID* Buffer,
+    _In_  UINTN Length
+)
+{
+    if (!Mp || Length < BL_MP_SPLIT_SIZE)
+    {
+        ZeroMem(Buffer, Length);
+        return;
+    }
+
+    BL_MP_RANGE Range = { (UINT8*)Buffer, NULL, Length };
+    BlMpRun(BlpMpSlice, &Range, (UINT32)((Length + BL_MP_SLICE_SIZE - 1) / BL_MP_SLICE_SIZE));
+}
\ No newline at end of file
@@ -0,0 +1,136 @@
+#ifndef _MP_H
+#define _MP_H
+
+#include "boot.h"
+
+//
+//
+// Fans loader work out to the application processors through EFI_MP_SERVICES_PROTOCOL. A
+// job runs its routine once for every index below Count. BlMpStart hands a job to the APs
+// and returns at once, so the BSP keeps driving disk reads, BlMpFinish has the BSP take
+// whatever indices are still left and then waits for the APs. Without the protocol, with
+// no enabled APs or with "cpus = 1" in the configuration BlMpStart does nothing and
+// BlMpFinish runs the whole job on the BSP, so callers never need a single core path.
+//
+// Routines run on APs, which must not call boot services: no allocations, no printing and
+// no CopyMem or ZeroMem, UefiMemoryLib goes through gBS. rtl.h, lz4.h and sha256.h are
+// safe. Only one job runs at a time and only the BSP starts and finishes jobs.
+//
+//
+
+#define BL_MP_SLICE_SIZE  SIZE_256KB // bytes per index of BlMpCopyMemory and BlMpZeroMemory
+#define BL_MP_SPLIT_SIZE  SIZE_1MB   // smaller ranges are not worth waking the APs for
+
+/**
+* A job routine, called once per index on whichever processor took it.
+*
+* @return FALSE to fail the job, indices no processor took yet are then skipped.
+*/
+typedef
+BOOLEAN
+(BLAPI *BL_MP_ROUTINE)(
+    _In_ VOID* Context,
+    _In_ UINT32 Index
+);
+
+typedef struct _BL_MP_JOB
+{
+    BL_MP_ROUTINE   Routine;
+    VOID*           Context;
+    UINT32          Count;
+    volatile UINT32 Next;    // indices handed out so far, may run past Count
+    volatile UINT32 Failed;  // a routine returned FALSE
+    BOOLEAN         Started; // the APs were started on it
+} BL_MP_JOB, *PBL_MP_JOB;
+
+/**
+* Finds the MP services and the APs the loader may use. Reads the configuration, call it
+* after BlLoadConfig. Every call here works, single core, when this was never called.
+*/
+VOID
+BLAPI
+BlMpInit(
+    VOID
+);
+
+/**
+* @return Processors that take part in jobs, the BSP included, at least 1.
+*/
+UINT32
+BLAPI
+BlMpProcessorCount(
+    VOID
+);
+
+/**
+* Fills in a job, ready for BlMpStart or BlMpRun.
+*/
+VOID
+BLAPI
+BlMpPrepare(
+    _Out_ PBL_MP_JOB Job,
+    _In_  BL_MP_ROUTINE Routine,
+    _In_  VOID* Context,
+    _In_  UINT32 Count
+);
+
+/**
+* Starts the APs on a job without waiting for them. A job of one index goes to a single AP,
+* so a routine the BSP would otherwise run between two reads overlaps with the next one.
+*
+* @return TRUE if APs were started, FALSE if BlMpFinish will run the job on the BSP.
+*/
+BOOLEAN
+BLAPI
+BlMpStart(
+    _Inout_ PBL_MP_JOB Job
+);
+
+/**
+* Runs what is left of a job on the BSP and waits until the APs are done with it. Must be
+* called for every prepared job, started or not, before the next one is started.
+*
+* @return TRUE if every routine succeeded.
+*/
+BOOLEAN
+BLAPI
+BlMpFinish(
+    _Inout_ PBL_MP_JOB Job
+);
+
+/**
+* Starts a job and finishes it, the BSP working alongside the APs.
+*
+* @return TRUE if every routine succeeded.
+*/
+BOOLEAN
+BLAPI
+BlMpRun(
+    _In_ BL_MP_ROUTINE Routine,
+    _In_ VOID* Context,
+    _In_ UINT32 Count
+);
+
+/**
+* Copies memory in BL_MP_SLICE_SIZE slices spread over every processor. The ranges must
+* not overlap.
+*/
+VOID
+BLAPI
+BlMpCopyMemory(
+    _Out_ VOID* Destination,
+    _In_  CONST VOID* Source,
+    _In_  UINTN Length
+);
+
+/**
+* Zeroes memory in BL_MP_SLICE_SIZE slices spread over every processor.
+*/
+VOID
+BLAPI
+BlMpZeroMemory(
+    _Out_ VOID* Buffer,
+    _In_  UINTN Length
+);
+
+#endif // !_MP_H
\ No newline at end of file
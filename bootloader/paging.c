@@ -0,0 +1,359 @@
+#include "paging.h"
+#include "log.h"
+#include "mp.h"
+
+#define BL_MSR_EFER 0xC0000080
+#define BL_EFER_NXE BIT11
+
+#define BL_CPUID_EXTENDED_MAX  0x80000000
+#define BL_CPUID_EXTENDED_INFO 0x80000001
+#define BL_CPUID_ADDRESS_SIZE  0x80000008
+#define BL_CPUID_NX            BIT20 // EDX of BL_CPUID_EXTENDED_INFO
+#define BL_CPUID_PAGE_1GB      BIT26
+
+// index of Address in the table at Level, 0 is the page table and 3 the PML4
+#define BL_TABLE_INDEX(Address, Level) ((UINTN)(((Address) >> (12 + 9 * (Level))) & 0x1FF))
+
+/**
+* @return The end of the highest range in the firmware memory map, never below 4 GiB so
+*         the MMIO hole is always covered.
+*/
+static
+UINT64
+BlpPhysicalTop(
+    VOID
+)
+{
+    UINTN  MapSize = 0;
+    UINTN  MapKey;
+    UINTN  DescriptorSize;
+    UINT32 DescriptorVersion;
+    UINT64 Top = SIZE_4GB;
+
+    gBS->GetMemoryMap(&MapSize, NULL, &MapKey, &DescriptorSize, &DescriptorVersion);
+
+    // allocating the buffer can split a free range, leave room for that
+    MapSize += 4 * DescriptorSize;
+    UINT8* Map = AllocatePool(MapSize);
+    if (!Map)
+    {
+        return Top;
+    }
+
+    if (!EFI_ERROR(gBS->GetMemoryMap(&MapSize, (EFI_MEMORY_DESCRIPTOR*)Map, &MapKey, &DescriptorSize, &DescriptorVersion)))
+    {
+        for (UINTN Offset = 0; Offset + DescriptorSize <= MapSize; Offset += DescriptorSize)
+        {
+            EFI_MEMORY_DESCRIPTOR* Descriptor = (EFI_MEMORY_DESCRIPTOR*)(Map + Offset);
+            Top = MAX(Top, Descriptor->PhysicalStart + EFI_PAGES_TO_SIZE(Descriptor->NumberOfPages));
+        }
+    }
+
+    FreePool(Map);
+    return Top;
+}
+
+/**
+* Hands out the next table from the pool, the pool is zeroed when it is allocated.
+*/
+static
+UINT64*
+BlpAllocateTable(
+    _Inout_ PBL_PAGE_TABLES Tables
+)
+{
+    if (Tables->TablesUsed >= Tables->PoolPages)
+    {
+        return NULL;
+    }
+
+    return (UINT64*)(UINTN)(Tables->Pool + EFI_PAGES_TO_SIZE(Tables->TablesUsed++));
+}
+
+/**
+* @return The table Entry points to, created when the slot is still empty. NULL if the
+*         pool ran dry or Entry already maps a large page.
+*/
+static
+UINT64*
+BlpNextTable(
+    _Inout_ PBL_PAGE_TABLES Tables,
+    _Inout_ UINT64* Entry
+)
+{
+    if (!(*Entry & BL_PTE_PRESENT))
+    {
+        UINT64* Table = BlpAllocateTable(Tables);
+        if (!Table)
+        {
+            return NULL;
+        }
+
+        // permissions are decided by the leaf entries alone
+        *Entry = (UINT64)(UINTN)Table | BL_PTE_PRESENT | BL_PTE_WRITABLE;
+    }
+    else if (*Entry & BL_PTE_LARGE)
+    {
+        return NULL;
+    }
+
+    return (UINT64*)(UINTN)(*Entry & BL_PTE_ADDRESS);
+}
+
+/**
+* Maps Size bytes at Virtual to Physical, always with the largest page, up to LargestPage,
+* that both addresses are aligned for and that still fits in what is left.
+*/
+static
+BOOLEAN
+BlpMapRange(
+    _Inout_ PBL_PAGE_TABLES Tables,
+    _In_    UINT64 Virtual,
+    _In_    UINT64 Physical,
+    _In_    UINT64 Size,
+    _In_    UINT64 Flags,
+    _In_    UINT64 LargestPage
+)
+{
+    UINT64* Root = (UINT64*)(UINTN)Tables->Root;
+
+    while (Size)
+    {
+        UINT64 PageSize = EFI_PAGE_SIZE;
+        UINT32 Level    = 0;
+        if (LargestPage >= SIZE_1GB && Size >= SIZE_1GB && !((Virtual | Physical) & (SIZE_1GB - 1)))
+        {
+            PageSize = SIZE_1GB;
+            Level    = 2;
+        }
+        else if (LargestPage >= SIZE_2MB && Size >= SIZE_2MB && !((Virtual | Physical) & (SIZE_2MB - 1)))
+        {
+            PageSize = SIZE_2MB;
+            Level    = 1;
+        }
+
+        UINT64* Table = Root;
+        for (UINT32 i = 3; i > Level; i--)
+        {
+            Table = BlpNextTable(Tables, &Table[BL_TABLE_INDEX(Virtual, i)]);
+            if (!Table)
+            {
+                return FALSE;
+            }
+        }
+
+        Table[BL_TABLE_INDEX(Virtual, Level)] = Physical | Flags | (Level ? BL_PTE_LARGE : 0);
+        Tables->PageCount[Level]++;
+
+        Virtual  += PageSize;
+        Physical += PageSize;
+        Size     -= PageSize;
+    }
+
+    return TRUE;
+}
+
+/**
+* Maps the kernel image at its VirtualBase. The headers and any gap before the first
+* section are read only, each section gets its own permissions up to the next section,
+* so 2 MiB aligned sections come out as whole 2 MiB pages.
+*/
+static
+BL_STATUS
+BlpMapKernel(
+    _Inout_ PBL_PAGE_TABLES Tables,
+    _In_    CONST BL_LOADED_IMAGE* Kernel
+)
+{
+    UINT8*                    Base     = (UINT8*)(UINTN)Kernel->ImageBase;
+    EFI_IMAGE_NT_HEADERS64*   Headers  = (EFI_IMAGE_NT_HEADERS64*)(Base + Kernel->NtHeaders);
+    EFI_IMAGE_SECTION_HEADER* Sections = (EFI_IMAGE_SECTION_HEADER*)((UINT8*)&Headers->OptionalHeader + Headers->FileHeader.SizeOfOptionalHeader);
+    UINT16                    Count    = Headers->FileHeader.NumberOfSections;
+    UINT64                    Size     = ALIGN_VALUE(Kernel->ImageSize, EFI_PAGE_SIZE);
+    UINT64                    Nx       = Tables->NoExecute ? BL_PTE_NX : 0;
+
+    if (Headers->OptionalHeader.SectionAlignment < EFI_PAGE_SIZE)
+    {
+        BlPrint(L"Kernel sections share pages, they cannot get permissions of their own\n");
+        return BL_STATUS_UNSUPPORTED;
+    }
+
+    UINT64 Start = 0;
+    UINT64 Flags = BL_PTE_PRESENT | BL_PTE_GLOBAL | Nx;
+    for (UINT16 i = 0; i <= Count; i++)
+    {
+        UINT64 End = i < Count ? Sections[i].VirtualAddress : Size;
+        if (End < Start || End > Size || (End & (EFI_PAGE_SIZE - 1)))
+        {
+            BlPrint(L"Kernel section %u is out of order or not page aligned\n", i);
+            return BL_STATUS_INVALID_IMAGE;
+        }
+
+        if (End > Start && !BlpMapRange(Tables, Kernel->VirtualBase + Start, Kernel->ImageBase + Start, End - Start, Flags, SIZE_2MB))
+        {
+            return BL_STATUS_OUT_OF_RESOURCES;
+        }
+
+        if (i == Count)
+        {
+            break;
+        }
+
+        UINT32 Characteristics = Sections[i].Characteristics;
+        if ((Characteristics & EFI_IMAGE_SCN_MEM_WRITE) && (Characteristics & EFI_IMAGE_SCN_MEM_EXECUTE))
+        {
+            BlPrint(L"Kernel section '%.8a' is both writable and executable\n", Sections[i].Name);
+            return BL_STATUS_INVALID_IMAGE;
+        }
+
+        Flags = BL_PTE_PRESENT | BL_PTE_GLOBAL;
+        if (Characteristics & EFI_IMAGE_SCN_MEM_WRITE)
+        {
+            Flags |= BL_PTE_WRITABLE;
+        }
+        if (!(Characteristics & EFI_IMAGE_SCN_MEM_EXECUTE))
+        {
+            Flags |= Nx;
+        }
+
+        Start = End;
+    }
+
+    return BL_STATUS_OK;
+}
+
+BL_STATUS
+BLAPI
+BlBuildPageTables(
+    _Inout_ PBL_LOADED_IMAGE Kernel,
+    _Out_   PBL_PAGE_TABLES Tables
+)
+{
+    if (!Kernel || !Kernel->ImageBase || !Tables)
+    {
+        return BL_STATUS_INVALID_PARAMETER;
+    }
+
+    ZeroMem(Tables, sizeof(BL_PAGE_TABLES));
+
+    // a kernel linked low is moved into the kernel window, one linked there stays put
+    if (Kernel->VirtualBase < BL_KERNEL_VIRTUAL_BASE)
+    {
+        BL_STATUS Result = BlRebasePEImage64(Kernel, BL_KERNEL_VIRTUAL_BASE);
+        if (!BL_SUCCESS(Result))
+        {
+            return Result;
+        }
+    }
+
+    UINT64 ImageSize = ALIGN_VALUE(Kernel->ImageSize, EFI_PAGE_SIZE);
+    if ((Kernel->VirtualBase & (EFI_PAGE_SIZE - 1)) || Kernel->VirtualBase + ImageSize - 1 < Kernel->VirtualBase)
+    {
+        BlPrint(L"Kernel does not fit at 0x%llx\n", Kernel->VirtualBase);
+        return BL_STATUS_INVALID_IMAGE;
+    }
+
+    UINT32 MaxLeaf;
+    UINT32 Features     = 0;
+    UINT32 AddressSizes = 36;
+    AsmCpuid(BL_CPUID_EXTENDED_MAX, &MaxLeaf, NULL, NULL, NULL);
+    if (MaxLeaf >= BL_CPUID_EXTENDED_INFO)
+    {
+        AsmCpuid(BL_CPUID_EXTENDED_INFO, NULL, NULL, NULL, &Features);
+    }
+    if (MaxLeaf >= BL_CPUID_ADDRESS_SIZE)
+    {
+        AsmCpuid(BL_CPUID_ADDRESS_SIZE, &AddressSizes, NULL, NULL, NULL);
+    }
+
+    Tables->NoExecute     = (Features & BL_CPUID_NX) != 0;
+    Tables->LargePageSize = (Features & BL_CPUID_PAGE_1GB) ? SIZE_1GB : SIZE_2MB;
+
+    // whole gigabytes, nothing past what the CPU can address or the direct map window holds
+    UINT64 Top = ALIGN_VALUE(BlpPhysicalTop(), SIZE_1GB);
+    Top = MIN(Top, LShiftU64(1, AddressSizes & 0xFF));
+    Top = MIN(Top, BL_DIRECT_MAP_MAX);
+    Tables->DirectMapSize = Top;
+
+    // worst case table count: a PDPT per 512 GiB of each physical map plus a PD per GiB
+    // without 1 GiB pages, and for the kernel a PDPT, the PDs it straddles and a page
+    // table for every 2 MiB it covers
+    UINT64 Pdpts     = DivU64x64Remainder(Top + SIZE_512GB - 1, SIZE_512GB, NULL);
+    UINT64 Pds       = Tables->LargePageSize == SIZE_1GB ? 0 : DivU64x64Remainder(Top, SIZE_1GB, NULL);
+    UINT64 KernelPts = DivU64x64Remainder(ImageSize + SIZE_2MB - 1, SIZE_2MB, NULL) + 1;
+    Tables->PoolPages = 1 + 2 * (Pdpts + Pds) + 1 + 2 + KernelPts;
+
+    EFI_STATUS Status = gBS->AllocatePages(AllocateAnyPages, BL_MEMORY_TYPE(BootMemoryPageTables), Tables->PoolPages, &Tables->Pool);
+    if (EFI_ERROR(Status))
+    {
+        BlPrint(L"[ %r ] - Failed to allocate %llu pages for page tables\n", Status, Tables->PoolPages);
+        ZeroMem(Tables, sizeof(BL_PAGE_TABLES));
+        return BL_STATUS_OUT_OF_RESOURCES;
+    }
+
+    // megabytes of directories on large machines without 1 GiB pages, zeroed on every processor
+    BlMpZeroMemory((VOID*)(UINTN)Tables->Pool, EFI_PAGES_TO_SIZE(Tables->PoolPages));
+    Tables->Root = (EFI_PHYSICAL_ADDRESS)(UINTN)BlpAllocateTable(Tables);
+
+    // the identity map stays executable, it is what the loader runs on after the switch
+    UINT64    Nx     = Tables->NoExecute ? BL_PTE_NX : 0;
+    BL_STATUS Result = BL_STATUS_OUT_OF_RESOURCES;
+    if (BlpMapRange(Tables, 0, 0, Top, BL_PTE_PRESENT | BL_PTE_WRITABLE, Tables->LargePageSize) &&
+        BlpMapRange(Tables, BL_DIRECT_MAP_BASE, 0, Top, BL_PTE_PRESENT | BL_PTE_WRITABLE | BL_PTE_GLOBAL | Nx, Tables->LargePageSize))
+    {
+        Result = BlpMapKernel(Tables, Kernel);
+    }
+
+    if (!BL_SUCCESS(Result))
+    {
+        if (Result == BL_STATUS_OUT_OF_RESOURCES)
+        {
+            BlPrint(L"Page table pool of %llu pages is too small\n", Tables->PoolPages);
+        }
+
+        BlFreePageTables(Tables);
+        return Result;
+    }
+
+    Tables->KernelBase  = Kernel->VirtualBase;
+    Tables->KernelEntry = Kernel->EntryPoint;
+    return BL_STATUS_OK;
+}
+
+VOID
+BLAPI
+BlActivatePageTables(
+    _In_ CONST BL_PAGE_TABLES* Tables
+)
+{
+    if (!Tables || !Tables->Root)
+    {
+        return;
+    }
+
+    // NX is a reserved bit until EFER.NXE is on, the first fetch through the new tables
+    // would fault otherwise
+    if (Tables->NoExecute)
+    {
+        AsmWriteMsr64(BL_MSR_EFER, AsmReadMsr64(BL_MSR_EFER) | BL_EFER_NXE);
+    }
+
+    AsmWriteCr3((UINTN)Tables->Root);
+}
+
+VOID
+BLAPI
+BlFreePageTables(
+    _Inout_ PBL_PAGE_TABLES Tables
+)
+{
+    if (Tables && Tables->Pool)
+    {
+        gBS->FreePages(Tables->Pool, Tables->PoolPages);
+    }
+
+    if (Tables)
+    {
+        ZeroMem(Tables, sizeof(BL_PAGE_TABLES));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#ifndef _PAGING_H
+#define _PAGING_H
+
+#include "boot.h"
+#include "image.h"
+
+//
+//
+// Early x86-64 page tables the loader builds for the kernel before ExitBootServices.
+// Everything is mapped with the largest pages the layout allows:
+//
+//   0                        identity map of physical memory, only so the loader keeps
+//                            running across the CR3 switch until it jumps to the kernel
+//   BL_DIRECT_MAP_BASE       the same physical memory again, the kernel's direct map
+//   BL_KERNEL_VIRTUAL_BASE   the kernel image, section by section with W^X permissions
+//
+// Both physical maps use 1 GiB pages when the CPU has them and 2 MiB pages otherwise.
+// Kernel sections use 2 MiB pages wherever the section and its physical backing are both
+// 2 MiB aligned (kernal.vcxproj links with 2 MiB section alignment), 4 KiB pages fill in
+// the rest. Every table comes out of one page allocation sized up front.
+//
+//
+
+#define BL_HIGHER_HALF_BASE    0xFFFF800000000000ULL
+#define BL_DIRECT_MAP_BASE     BL_HIGHER_HALF_BASE
+#define BL_DIRECT_MAP_MAX      0x0000400000000000ULL // 64 TiB, half of the upper half
+#define BL_KERNEL_VIRTUAL_BASE 0xFFFFFFFF80000000ULL // the top 2 GiB
+
+#define BL_PTE_PRESENT  BIT0
+#define BL_PTE_WRITABLE BIT1
+#define BL_PTE_LARGE    BIT7  // PS, the entry maps a 2 MiB or 1 GiB page
+#define BL_PTE_GLOBAL   BIT8
+#define BL_PTE_NX       BIT63
+#define BL_PTE_ADDRESS  0x000FFFFFFFFFF000ULL
+
+typedef struct _BL_PAGE_TABLES
+{
+    EFI_PHYSICAL_ADDRESS Root;          // the PML4, what goes into CR3
+    EFI_PHYSICAL_ADDRESS Pool;          // pages backing every table
+    UINT64               PoolPages;
+    UINT64               TablesUsed;    // tables handed out of Pool, the PML4 included
+    UINT64               DirectMapSize; // physical bytes mapped at 0 and at BL_DIRECT_MAP_BASE
+    UINT64               LargePageSize; // SIZE_1GB or SIZE_2MB, used for both physical maps
+    UINT64               PageCount[3];  // leaf entries written, 4 KiB, 2 MiB and 1 GiB
+    UINT64               KernelBase;    // where the kernel image is mapped
+    UINT64               KernelEntry;   // its entry point in that mapping
+    BOOLEAN              NoExecute;     // NX is used, EFER.NXE must be set before CR3 loads
+} BL_PAGE_TABLES, *PBL_PAGE_TABLES;
+
+/**
+* Builds the kernel's initial page tables. A kernel linked below BL_KERNEL_VIRTUAL_BASE is
+* rebased there first, one linked inside the kernel window keeps its link address.
+*
+* @param Kernel The loaded kernel image, its VirtualBase and EntryPoint are updated.
+* @param Tables Receives the tables.
+*
+* @return BL_STATUS_OK on success, BL_STATUS_INVALID_IMAGE if a kernel section is both
+*         writable and executable or the image cannot be moved into the kernel window.
+*/
+BL_STATUS
+BLAPI
+BlBuildPageTables(
+    _Inout_ PBL_LOADED_IMAGE Kernel,
+    _Out_   PBL_PAGE_TABLES Tables
+);
+
+/**
+* Switches the CPU to Tables. Only call it after ExitBootServices, the firmware expects its
+* own tables while boot services are up.
+*/
+VOID
+BLAPI
+BlActivatePageTables(
+    _In_ CONST BL_PAGE_TABLES* Tables
+);
+
+/**
+* Releases the pages backing Tables. Never call it once the tables are live.
+*/
+VOID
+BLAPI
+BlFreePageTables(
+    _Inout_ PBL_PAGE_TABLES Tables
+);
+
+#endif // !_PAGING_H
\ No newline at end of file
@@ -0,0 +1,509 @@
+#include "preload.h"
+#include "log.h"
+#include "filesystem.h"
+#include "config.h"
+#include "trace.h"
+
+/**
+* Opens Path on volume Index and resolves its FAT extents when the volume allows it.
+*/
+static
+BOOLEAN
+BlpPreloadOpen(
+    _Inout_ PBL_PRELOAD Preload,
+    _In_    UINT32 Index,
+    _In_    CONST CHAR16* Path
+)
+{
+    // a kernel or bundle configured under the loader directory comes out of its index
+    EFI_FILE_PROTOCOL* File = NULL;
+    if (!BlOpenVolumeFile(Index, Path, &File))
+    {
+        return FALSE;
+    }
+
+    CONST BL_VOLUME* Volume = BlGetVolume(Index);
+
+    Preload->File   = File;
+    Preload->Volume = Index;
+
+    // what the next boot checks the stored target against
+    UINT8          InfoBuffer[SIZE_OF_EFI_FILE_INFO + BL_CONFIG_MAX_PATH * sizeof(CHAR16)];
+    UINTN          InfoSize = sizeof(InfoBuffer);
+    EFI_FILE_INFO* Info     = (EFI_FILE_INFO*)InfoBuffer;
+
+    ZeroMem(&Preload->Target, sizeof(BL_BOOT_TARGET));
+    if (BlGetFileInfo(File, Info, &InfoSize))
+    {
+        StrCpyS(Preload->Target.Path, BL_CONFIG_MAX_PATH, Path);
+        Preload->Target.FileSize         = Info->FileSize;
+        Preload->Target.ModificationTime = Info->ModificationTime;
+    }
+
+    if (BL_SUCCESS(BlFatOpen(Volume->Handle, Path, &Preload->RawFile)))
+    {
+        Preload->Raw = &Preload->RawFile;
+    }
+
+    return TRUE;
+}
+
+/**
+* Ends the read of the file, finished or given up on. A bundle or kernel given up on is freed.
+*/
+static
+BL_STATUS
+BlpPreloadEndRead(
+    _Inout_ PBL_PRELOAD Preload
+)
+{
+    BL_STATUS Status;
+
+    if (Preload->FromBundle)
+    {
+        Status = BlBundleEnd(&Preload->BundleLoad);
+    }
+    else
+    {
+        Status = BlImageEnd(&Preload->ImageLoad);
+    }
+
+    Preload->Reading = FALSE;
+    BlTraceEnd("preload.read");
+    return Status;
+}
+
+static
+VOID
+BlpPreloadCloseFiles(
+    _Inout_ PBL_PRELOAD Preload
+)
+{
+    if (Preload->Raw)
+    {
+        BlFatClose(Preload->Raw);
+        Preload->Raw = NULL;
+    }
+
+    if (Preload->File)
+    {
+        Preload->File->Close(Preload->File);
+        Preload->File = NULL;
+    }
+}
+
+/**
+* Gives up on whatever is still open or half read. The loaded kernel and bundle stay.
+*/
+static
+VOID
+BlpPreloadRelease(
+    _Inout_ PBL_PRELOAD Preload
+)
+{
+    if (Preload->Reading)
+    {
+        BlpPreloadEndRead(Preload);
+    }
+
+    BlpPreloadCloseFiles(Preload);
+}
+
+/**
+* Opens the target the last boot stored, if it still fits the configuration and the file
+* did not change. Only the target's own volume is opened.
+*/
+static
+BOOLEAN
+BlpPreloadCached(
+    _Inout_ PBL_PRELOAD Preload
+)
+{
+    CONST BL_CONFIG* Config = BlGetConfig();
+    BL_BOOT_TARGET   Cached;
+    UINT32           Index;
+
+    if (!BlFindBootTarget(&Cached, &Index) ||
+        (Config->Volume != BL_CONFIG_ANY_VOLUME && Config->Volume != Index))
+    {
+        return FALSE;
+    }
+
+    BOOLEAN Bundle = (Cached.Flags & BL_BOOT_TARGET_BUNDLE) != 0;
+    if (StrCmp(Cached.Path, Bundle ? Config->BundlePath : Config->KernelPath))
+    {
+        return FALSE;
+    }
+
+    // discovery prefers a bundle on the same volume, one that showed up since wins here too
+    if (!Bundle && Config->BundlePath[0] && BlpPreloadOpen(Preload, Index, Config->BundlePath))
+    {
+        Preload->Target.Flags = BL_BOOT_TARGET_BUNDLE;
+        Preload->FromBundle   = TRUE;
+        return TRUE;
+    }
+
+    if (!BlpPreloadOpen(Preload, Index, Cached.Path))
+    {
+        return FALSE;
+    }
+
+    if (Preload->Target.FileSize != Cached.FileSize ||
+        CompareMem(&Preload->Target.ModificationTime, &Cached.ModificationTime, sizeof(EFI_TIME)))
+    {
+        BlpPreloadRelease(Preload);
+        return FALSE;
+    }
+
+    Preload->Target.Flags = Cached.Flags;
+    Preload->FromBundle   = Bundle;
+    Preload->Cached       = TRUE;
+    return TRUE;
+}
+
+/**
+* Picks where to boot from, the configured volume or else the boot device first, and on
+* every volume a bundle wins over a bare kernel.
+*/
+static
+BOOLEAN
+BlpPreloadLocate(
+    _Inout_ PBL_PRELOAD Preload
+)
+{
+    if (BlpPreloadCached(Preload))
+    {
+        return TRUE;
+    }
+
+    CONST BL_CONFIG* Config = BlGetConfig();
+    UINT32           Count  = BlGetVolumeCount();
+    UINT32           Boot   = BlGetBootVolumeIndex();
+
+    // volumes only remember whether the default kernel is there
+    BOOLEAN DefaultKernel = !StrCmp(Config->KernelPath, L"\\" BL_KERNEL_PATH);
+
+    for (UINT32 Pass = 0; Pass < 2; Pass++)
+    {
+        for (UINT32 i = 0; i < Count; i++)
+        {
+            // decided before BlGetVolume, which opens the volume
+            if (Config->Volume != BL_CONFIG_ANY_VOLUME ? (Pass || i != Config->Volume) : (i == Boot) != (Pass == 0))
+            {
+                continue;
+            }
+
+            CONST BL_VOLUME* Volume = BlGetVolume(i);
+            if (!Volume)
+            {
+                continue;
+            }
+
+            if (Config->BundlePath[0] && BlpPreloadOpen(Preload, i, Config->BundlePath))
+            {
+                Preload->Target.Flags = BL_BOOT_TARGET_BUNDLE;
+                Preload->FromBundle   = TRUE;
+                return TRUE;
+            }
+
+            if ((Volume->HasKernel || !DefaultKernel) && BlpPreloadOpen(Preload, i, Config->KernelPath))
+            {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+static
+VOID
+BlpPreloadFinish(
+    _Inout_ PBL_PRELOAD Preload,
+    _In_    BL_STATUS Status
+)
+{
+    BlpPreloadRelease(Preload);
+
+    Preload->Status = Status;
+    Preload->State  = BL_SUCCESS(Status) ? BlPreloadDone : BlPreloadFailed;
+}
+
+/**
+* Sets up the read of the file that was located, a bare kernel has its headers read and
+* its image allocated.
+*/
+static
+BL_STATUS
+BlpPreloadBeginRead(
+    _Inout_ PBL_PRELOAD Preload
+)
+{
+    BL_STATUS Status;
+
+    if (Preload->FromBundle)
+    {
+        Status = BlBundleBegin(Preload->File, Preload->Raw, &Preload->Bundle, &Preload->BundleLoad);
+    }
+    else
+    {
+        Status = BlImageBegin(Preload->File, Preload->Raw, &Preload->Kernel, &Preload->ImageLoad);
+    }
+
+    if (!BL_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    // one slice for the whole read, the countdown runs between its chunks
+    Preload->Reading = TRUE;
+    BlTraceBegin("preload.read");
+    return BL_STATUS_OK;
+}
+
+/**
+* Reads the next chunk of the file, or only checks on it when Wait is FALSE.
+*
+* @return BL_STATUS_OK while the read goes well.
+*/
+static
+BL_STATUS
+BlpPreloadReadStep(
+    _Inout_ PBL_PRELOAD Preload,
+    _In_    BOOLEAN Wait
+)
+{
+    if (Preload->FromBundle)
+    {
+        BlBundleStep(&Preload->BundleLoad, Wait);
+        return Preload->BundleLoad.Finished ? BlpPreloadEndRead(Preload) : BL_STATUS_OK;
+    }
+
+    BlImageStep(&Preload->ImageLoad, Wait);
+    return Preload->ImageLoad.Finished ? BlpPreloadEndRead(Preload) : BL_STATUS_OK;
+}
+
+/**
+* Runs one step of the preload. Every step is short, reads go a chunk at a time.
+*
+* @param Wait FALSE when the menu is still counting down, a read step then returns at once
+*             if its chunk is still in flight.
+*/
+static
+VOID
+BlpPreloadAdvance(
+    _Inout_ PBL_PRELOAD Preload,
+    _In_    BOOLEAN Wait
+)
+{
+    BL_STATUS Status;
+
+    switch (Preload->State)
+    {
+    case BlPreloadLocate:
+        if (!BlpPreloadLocate(Preload))
+        {
+            BlpPreloadFinish(Preload, BL_STATUS_NOT_FOUND);
+            return;
+        }
+
+        Status = BlpPreloadBeginRead(Preload);
+        if (!BL_SUCCESS(Status))
+        {
+            BlpPreloadFinish(Preload, Status);
+            return;
+        }
+
+        Preload->State = BlPreloadRead;
+        return;
+
+    case BlPreloadRead:
+        Status = BlpPreloadReadStep(Preload, Wait);
+        if (!BL_SUCCESS(Status))
+        {
+            BlpPreloadFinish(Preload, Status);
+            return;
+        }
+
+        if (!Preload->Reading && !Preload->FromBundle)
+        {
+            // the kernel was loaded as it was read
+            BlpPreloadFinish(Preload, BL_STATUS_OK);
+        }
+        else if (!Preload->Reading)
+        {
+            // everything needed is in memory now
+            BlpPreloadCloseFiles(Preload);
+            Preload->State = BlPreloadKernel;
+        }
+        return;
+
+    case BlPreloadKernel:
+        {
+            CONST BL_BUNDLE_ENTRY* Entry = BlBundleFind(&Preload->Bundle, BlBundleKernel, NULL);
+            if (!Entry)
+            {
+                BlPrint(L"Boot bundle has no kernel\n");
+                BlpPreloadFinish(Preload, BL_STATUS_NOT_FOUND);
+                return;
+            }
+
+            BL_STATUS Result = BlLoadPEImage64FromMemory(BlBundlePayload(&Preload->Bundle, Entry), Entry->Size, &Preload->Kernel);
+            if (BL_SUCCESS(Result))
+            {
+                // BlBundleEnd rejects the bundle unless every payload matched its digest
+                CopyMem(Preload->Kernel.Digest, Entry->Digest, BL_SHA256_DIGEST_SIZE);
+                Preload->Kernel.Verified = TRUE;
+            }
+
+            BlpPreloadFinish(Preload, Result);
+            return;
+        }
+
+    default:
+        return;
+    }
+}
+
+/**
+* Runs one step of the preload as a slice of the boot trace named after the step.
+*/
+static
+VOID
+BlpPreloadRun(
+    _Inout_ PBL_PRELOAD Preload,
+    _In_    BOOLEAN Wait
+)
+{
+    static CONST CHAR8* CONST StepNames[] = { "preload.idle", "preload.locate", NULL, "preload.kernel" };
+
+    if (Preload->State > BlPreloadKernel)
+    {
+        return;
+    }
+
+    // the read is one slice from its first chunk to its last, not one per poll
+    CONST CHAR8* Name = StepNames[Preload->State];
+    if (Name)
+    {
+        BlTraceBegin(Name);
+    }
+
+    BlpPreloadAdvance(Preload, Wait);
+
+    if (Name)
+    {
+        BlTraceEnd(Name);
+    }
+}
+
+BL_STATUS
+BLAPI
+BlStartPreload(
+    _Out_ PBL_PRELOAD Preload
+)
+{
+    if (!Preload)
+    {
+        return BL_STATUS_INVALID_PARAMETER;
+    }
+
+    ZeroMem(Preload, sizeof(BL_PRELOAD));
+    Preload->State = BlPreloadLocate;
+
+    // first step on the next timer tick, so whatever the caller draws first shows up first
+    EFI_STATUS Status = gBS->CreateEvent(EVT_TIMER, TPL_CALLBACK, NULL, NULL, &Preload->StepEvent);
+    if (!EFI_ERROR(Status))
+    {
+        Status = gBS->SetTimer(Preload->StepEvent, TimerRelative, 0);
+    }
+
+    if (EFI_ERROR(Status))
+    {
+        // not fatal, BlWaitPreload does the whole load in the foreground
+        BlPrint(L"[ %r ] - Cannot preload during the countdown\n", Status);
+
+        if (Preload->StepEvent)
+        {
+            gBS->CloseEvent(Preload->StepEvent);
+            Preload->StepEvent = NULL;
+        }
+    }
+
+    return BL_STATUS_OK;
+}
+
+VOID
+BLAPI
+BlPreloadStep(
+    _Inout_ PBL_PRELOAD Preload
+)
+{
+    if (!Preload || BlPreloadFinished(Preload))
+    {
+        return;
+    }
+
+    BlpPreloadRun(Preload, FALSE);
+
+    // signal again on the next tick, whatever else the caller waits on gets to run in between
+    if (!BlPreloadFinished(Preload) && Preload->StepEvent)
+    {
+        gBS->SetTimer(Preload->StepEvent, TimerRelative, 0);
+    }
+}
+
+BOOLEAN
+BLAPI
+BlPreloadFinished(
+    _In_ CONST BL_PRELOAD* Preload
+)
+{
+    return Preload->State == BlPreloadDone || Preload->State == BlPreloadFailed;
+}
+
+BL_STATUS
+BLAPI
+BlWaitPreload(
+    _Inout_ PBL_PRELOAD Preload
+)
+{
+    if (!Preload || Preload->State == BlPreloadIdle)
+    {
+        return BL_STATUS_INVALID_PARAMETER;
+    }
+
+    // no point waiting for the step timer any more, run what is left back to back
+    while (!BlPreloadFinished(Preload))
+    {
+        BlpPreloadRun(Preload, TRUE);
+    }
+
+    return Preload->State == BlPreloadDone ? BL_STATUS_OK : Preload->Status;
+}
+
+VOID
+BLAPI
+BlClosePreload(
+    _Inout_ PBL_PRELOAD Preload
+)
+{
+    if (!Preload)
+    {
+        return;
+    }
+
+    if (Preload->StepEvent)
+    {
+        gBS->CloseEvent(Preload->StepEvent);
+        Preload->StepEvent = NULL;
+    }
+
+    if (!BlPreloadFinished(Preload))
+    {
+        Preload->Status = BL_STATUS_GENERIC_ERROR;
+        Preload->State  = BlPreloadFailed;
+    }
+
+    BlpPreloadRelease(Preload);
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+#ifndef _PRELOAD_H
+#define _PRELOAD_H
+
+#include "boot.h"
+#include "bundle.h"
+#include "image.h"
+#include "bootvar.h"
+
+//
+//
+// Loads the kernel (from boot.bnd when there is one, kernel.exe otherwise) while the boot
+// menu counts down. Work is split into steps. StepEvent is a timer that is signalled
+// whenever a step is ready to run, the menu waits on it next to its key and countdown
+// events and calls BlPreloadStep when it fires. Steps run at TPL_APPLICATION because the
+// stream and block reads underneath wait on their completion events, which a timer
+// notify function is not allowed to do.
+//
+// The file is read one chunk per step. A step over the file system queues the next reads
+// and only retires one whose event already fired, a step over the raw FAT extents reads
+// one chunk, so the menu gets to its key and countdown events between every chunk. A bundle
+// lands in memory whole and the kernel is loaded out of it afterwards. A bare kernel is
+// loaded as it is read: its headers come first and the image is allocated, then every step
+// reads section data, or unpacks a packed chunk, straight into its place in the image.
+//
+// The file system module keeps global state (current directory, last error), nothing
+// else may call into it until the preload is done.
+//
+//
+
+typedef enum _BL_PRELOAD_STATE
+{
+    BlPreloadIdle,
+    BlPreloadLocate,  // find a volume carrying the bundle or the kernel
+    BlPreloadRead,    // read the bundle, or load the kernel when there is no bundle
+    BlPreloadKernel,  // load the kernel out of the bundle
+    BlPreloadDone,
+    BlPreloadFailed
+} BL_PRELOAD_STATE;
+
+typedef struct _BL_PRELOAD
+{
+    EFI_EVENT                   StepEvent;  // signalled when the next step is ready to run
+    BL_PRELOAD_STATE            State;
+    BL_STATUS                   Status;     // why the preload failed
+    UINT32                      Volume;     // volume table index the files came from
+    EFI_FILE_PROTOCOL*          File;
+    BL_FAT_FILE                 RawFile;
+    PBL_FAT_FILE                Raw;        // &RawFile when the FAT extents resolved
+    BOOLEAN                     FromBundle;
+    BOOLEAN                     Cached;     // found through the stored boot target
+    BL_BOOT_TARGET              Target;     // the file that was opened, stored after the handoff
+    BOOLEAN                     Reading;    // BundleLoad or ImageLoad is in use
+    BL_BUNDLE_LOAD              BundleLoad; // the bundle while it is read
+    BL_IMAGE_LOAD               ImageLoad;  // the bare kernel while it is loaded
+    BL_BOOT_BUNDLE              Bundle;     // only when FromBundle
+    BL_LOADED_IMAGE             Kernel;
+} BL_PRELOAD, *PBL_PRELOAD;
+
+/**
+* Starts loading the kernel. The file system must be initialised. If the step timer
+* cannot be created the whole preload runs in BlWaitPreload instead.
+*
+* @param Preload Receives the preload state, must stay alive until BlClosePreload.
+*
+* @return BL_STATUS_OK if the preload was started.
+*/
+BL_STATUS
+BLAPI
+BlStartPreload(
+    _Out_ PBL_PRELOAD Preload
+);
+
+/**
+* Runs the next step of the preload, call it whenever StepEvent is signalled.
+*/
+VOID
+BLAPI
+BlPreloadStep(
+    _Inout_ PBL_PRELOAD Preload
+);
+
+/**
+* @return TRUE once the preload finished, successfully or not.
+*/
+BOOLEAN
+BLAPI
+BlPreloadFinished(
+    _In_ CONST BL_PRELOAD* Preload
+);
+
+/**
+* Waits for the preload to finish. Only blocks for whatever is left of the load, the
+* rest already happened behind the countdown.
+*
+* @return BL_STATUS_OK when Preload->Kernel is loaded, else the reason it is not.
+*/
+BL_STATUS
+BLAPI
+BlWaitPreload(
+    _Inout_ PBL_PRELOAD Preload
+);
+
+/**
+* Closes the step timer and the files the preload opened. The loaded kernel and
+* bundle are left in memory for the caller.
+*/
+VOID
+BLAPI
+BlClosePreload(
+    _Inout_ PBL_PRELOAD Preload
+);
+
+#endif // !_PRELOAD_H
\ No newline at end of file
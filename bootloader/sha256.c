@@ -0,0 +1,296 @@
+#include "sha256.h"
+#include "../kernal/rtl.h"
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#define BL_SHA_NI_TARGET
+#else
+#define BL_SHA_NI_TARGET __attribute__((target("sha,sse4.1")))
+#endif
+
+static CONST UINT32 BlpSha256K[64] =
+{
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+typedef
+VOID
+(*PBL_SHA256_BLOCKS)(
+    _Inout_ UINT32* State,
+    _In_    CONST UINT8* Data,
+    _In_    UINTN Blocks
+);
+
+#define BL_ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static
+VOID
+BlpSha256BlocksPortable(
+    _Inout_ UINT32* State,
+    _In_    CONST UINT8* Data,
+    _In_    UINTN Blocks
+)
+{
+    UINT32 W[64];
+
+    for (; Blocks; Blocks--, Data += BL_SHA256_BLOCK_SIZE)
+    {
+        for (UINT32 t = 0; t < 16; t++)
+        {
+            W[t] = ((UINT32)Data[t * 4] << 24) | ((UINT32)Data[t * 4 + 1] << 16) |
+                   ((UINT32)Data[t * 4 + 2] << 8) | Data[t * 4 + 3];
+        }
+
+        for (UINT32 t = 16; t < 64; t++)
+        {
+            UINT32 S0 = BL_ROR32(W[t - 15], 7) ^ BL_ROR32(W[t - 15], 18) ^ (W[t - 15] >> 3);
+            UINT32 S1 = BL_ROR32(W[t - 2], 17) ^ BL_ROR32(W[t - 2], 19) ^ (W[t - 2] >> 10);
+            W[t] = W[t - 16] + S0 + W[t - 7] + S1;
+        }
+
+        UINT32 a = State[0], b = State[1], c = State[2], d = State[3];
+        UINT32 e = State[4], f = State[5], g = State[6], h = State[7];
+
+        for (UINT32 t = 0; t < 64; t++)
+        {
+            UINT32 T1 = h + (BL_ROR32(e, 6) ^ BL_ROR32(e, 11) ^ BL_ROR32(e, 25)) + ((e & f) ^ (~e & g)) + BlpSha256K[t] + W[t];
+            UINT32 T2 = (BL_ROR32(a, 2) ^ BL_ROR32(a, 13) ^ BL_ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + T1;
+            d = c;
+            c = b;
+            b = a;
+            a = T1 + T2;
+        }
+
+        State[0] += a;
+        State[1] += b;
+        State[2] += c;
+        State[3] += d;
+        State[4] += e;
+        State[5] += f;
+        State[6] += g;
+        State[7] += h;
+    }
+}
+
+/**
+* Block compression with SHA-NI. The state is kept as the ABEF/CDGH register pair the
+* sha256rnds2 instruction works on, each loop iteration does four rounds and, from the
+* fifth on, the matching four message schedule words.
+*/
+BL_SHA_NI_TARGET
+static
+VOID
+BlpSha256BlocksShaNi(
+    _Inout_ UINT32* State,
+    _In_    CONST UINT8* Data,
+    _In_    UINTN Blocks
+)
+{
+    CONST __m128i Swap = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+
+    __m128i Tmp     = _mm_shuffle_epi32(_mm_loadu_si128((CONST __m128i*)&State[0]), 0xB1); // CDAB
+    __m128i State1  = _mm_shuffle_epi32(_mm_loadu_si128((CONST __m128i*)&State[4]), 0x1B); // EFGH
+    __m128i State0  = _mm_alignr_epi8(Tmp, State1, 8);                                      // ABEF
+    State1          = _mm_blend_epi16(State1, Tmp, 0xF0);                                   // CDGH
+
+    for (; Blocks; Blocks--, Data += BL_SHA256_BLOCK_SIZE)
+    {
+        __m128i Abef = State0;
+        __m128i Cdgh = State1;
+        __m128i Message[4];
+
+        for (UINT32 i = 0; i < 16; i++)
+        {
+            if (i < 4)
+            {
+                Message[i] = _mm_shuffle_epi8(_mm_loadu_si128((CONST __m128i*)(Data + i * 16)), Swap);
+            }
+            else
+            {
+                // W[i] from W[i-4] .. W[i-1], all groups of four words
+                Message[i & 3] = _mm_sha256msg2_epu32(
+                    _mm_add_epi32(
+                        _mm_sha256msg1_epu32(Message[i & 3], Message[(i + 1) & 3]),
+                        _mm_alignr_epi8(Message[(i + 3) & 3], Message[(i + 2) & 3], 4)
+                    ),
+                    Message[(i + 3) & 3]
+                );
+            }
+
+            Tmp    = _mm_add_epi32(Message[i & 3], _mm_loadu_si128((CONST __m128i*)&BlpSha256K[i * 4]));
+            State1 = _mm_sha256rnds2_epu32(State1, State0, Tmp);
+            State0 = _mm_sha256rnds2_epu32(State0, State1, _mm_shuffle_epi32(Tmp, 0x0E));
+        }
+
+        State0 = _mm_add_epi32(State0, Abef);
+        State1 = _mm_add_epi32(State1, Cdgh);
+    }
+
+    Tmp    = _mm_shuffle_epi32(State0, 0x1B);        // FEBA
+    State1 = _mm_shuffle_epi32(State1, 0xB1);        // DCHG
+    State0 = _mm_blend_epi16(Tmp, State1, 0xF0);     // DCBA
+    State1 = _mm_alignr_epi8(State1, Tmp, 8);        // HGFE
+
+    _mm_storeu_si128((__m128i*)&State[0], State0);
+    _mm_storeu_si128((__m128i*)&State[4], State1);
+}
+
+static PBL_SHA256_BLOCKS BlpSha256Blocks = NULL;
+static BOOLEAN           BlpSha256PortableOnly = FALSE;
+
+/**
+* Picks the block function once. SHA-NI needs the SHA extensions (CPUID.7.0:EBX[29]) and
+* SSE4.1 for the blend (CPUID.1:ECX[19]), SSSE3 comes with both.
+*/
+static
+PBL_SHA256_BLOCKS
+BlpSha256Select(
+    VOID
+)
+{
+    if (BlpSha256Blocks)
+    {
+        return BlpSha256Blocks;
+    }
+
+    UINT32 MaxLeaf = 0;
+    UINT32 Ecx     = 0;
+    UINT32 Ebx     = 0;
+
+    AsmCpuid(0, &MaxLeaf, NULL, NULL, NULL);
+    AsmCpuid(1, NULL, NULL, &Ecx, NULL);
+    if (MaxLeaf >= 7)
+    {
+        AsmCpuidEx(7, 0, NULL, &Ebx, NULL, NULL);
+    }
+
+    BOOLEAN ShaNi = (Ebx & BIT29) && (Ecx & BIT19) && !BlpSha256PortableOnly;
+
+    BlpSha256Blocks = ShaNi ? BlpSha256BlocksShaNi : BlpSha256BlocksPortable;
+    return BlpSha256Blocks;
+}
+
+BOOLEAN
+BLAPI
+BlSha256Accelerated(
+    VOID
+)
+{
+    return BlpSha256Select() == BlpSha256BlocksShaNi;
+}
+
+VOID
+BLAPI
+BlSha256AllowAcceleration(
+    _In_ BOOLEAN Allow
+)
+{
+    BlpSha256PortableOnly = !Allow;
+    BlpSha256Blocks       = NULL;
+}
+
+VOID
+BLAPI
+BlSha256Init(
+    _Out_ PBL_SHA256 Hash
+)
+{
+    static CONST UINT32 Initial[8] =
+    {
+        0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+    };
+
+    RtlCopyMemory(Hash->State, Initial, sizeof(Initial));
+    Hash->Length   = 0;
+    Hash->Buffered = 0;
+
+    BlpSha256Select();
+}
+
+VOID
+BLAPI
+BlSha256Update(
+    _Inout_ PBL_SHA256 Hash,
+    _In_    CONST VOID* Data,
+    _In_    UINTN Size
+)
+{
+    CONST UINT8* Bytes = (CONST UINT8*)Data;
+
+    Hash->Length += Size;
+
+    // top up a partial block first
+    if (Hash->Buffered)
+    {
+        UINTN Take = MIN(Size, (UINTN)(BL_SHA256_BLOCK_SIZE - Hash->Buffered));
+        RtlCopyMemory(Hash->Buffer + Hash->Buffered, Bytes, Take);
+        Hash->Buffered += (UINT32)Take;
+        Bytes          += Take;
+        Size           -= Take;
+
+        if (Hash->Buffered < BL_SHA256_BLOCK_SIZE)
+        {
+            return;
+        }
+
+        BlpSha256Blocks(Hash->State, Hash->Buffer, 1);
+        Hash->Buffered = 0;
+    }
+
+    // whole blocks straight from the caller's buffer
+    UINTN Blocks = Size / BL_SHA256_BLOCK_SIZE;
+    if (Blocks)
+    {
+        BlpSha256Blocks(Hash->State, Bytes, Blocks);
+        Bytes += Blocks * BL_SHA256_BLOCK_SIZE;
+        Size  -= Blocks * BL_SHA256_BLOCK_SIZE;
+    }
+
+    RtlCopyMemory(Hash->Buffer, Bytes, Size);
+    Hash->Buffered = (UINT32)Size;
+}
+
+VOID
+BLAPI
+BlSha256Final(
+    _Inout_ PBL_SHA256 Hash,
+    _Out_   UINT8* Digest
+)
+{
+    UINT64 Bits = Hash->Length * 8;
+
+    Hash->Buffer[Hash->Buffered++] = 0x80;
+    if (Hash->Buffered > BL_SHA256_BLOCK_SIZE - sizeof(UINT64))
+    {
+        RtlFillMemory(Hash->Buffer + Hash->Buffered, BL_SHA256_BLOCK_SIZE - Hash->Buffered, 0);
+        BlpSha256Blocks(Hash->State, Hash->Buffer, 1);
+        Hash->Buffered = 0;
+    }
+
+    RtlFillMemory(Hash->Buffer + Hash->Buffered, BL_SHA256_BLOCK_SIZE - sizeof(UINT64) - Hash->Buffered, 0);
+    for (UINT32 i = 0; i < sizeof(UINT64); i++)
+    {
+        Hash->Buffer[BL_SHA256_BLOCK_SIZE - 1 - i] = (UINT8)(Bits >> (i * 8));
+    }
+
+    BlpSha256Blocks(Hash->State, Hash->Buffer, 1);
+
+    for (UINT32 i = 0; i < 8; i++)
+    {
+        Digest[i * 4 + 0] = (UINT8)(Hash->State[i] >> 24);
+        Digest[i * 4 + 1] = (UINT8)(Hash->State[i] >> 16);
+        Digest[i * 4 + 2] = (UINT8)(Hash->State[i] >> 8);
+        Digest[i * 4 + 3] = (UINT8)(Hash->State[i]);
+    }
+}
\ No newline at end of file
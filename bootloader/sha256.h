@@ -0,0 +1,75 @@
+#ifndef _SHA256_H
+#define _SHA256_H
+
+#include "boot.h"
+
+//
+//
+// Streaming SHA-256 for boot image integrity checks. Data is fed in as it arrives from the
+// disk, so verifying a payload never costs a second pass over it. Blocks are compressed
+// with the SHA extensions when the CPU has them and in plain C otherwise. Nothing here
+// calls into the firmware, so hashing can run on an application processor.
+//
+//
+
+#define BL_SHA256_DIGEST_SIZE 32
+#define BL_SHA256_BLOCK_SIZE  64
+
+typedef struct _BL_SHA256
+{
+    UINT32 State[8];
+    UINT64 Length;                        // bytes hashed so far
+    UINT32 Buffered;                      // bytes waiting in Buffer for a full block
+    UINT8  Buffer[BL_SHA256_BLOCK_SIZE];
+} BL_SHA256, *PBL_SHA256;
+
+/**
+* Starts a new hash.
+*/
+VOID
+BLAPI
+BlSha256Init(
+    _Out_ PBL_SHA256 Hash
+);
+
+/**
+* Hashes the next Size bytes.
+*/
+VOID
+BLAPI
+BlSha256Update(
+    _Inout_ PBL_SHA256 Hash,
+    _In_    CONST VOID* Data,
+    _In_    UINTN Size
+);
+
+/**
+* Pads the message and writes out the digest. Hash must be re-initialised to be reused.
+*/
+VOID
+BLAPI
+BlSha256Final(
+    _Inout_ PBL_SHA256 Hash,
+    _Out_   UINT8* Digest
+);
+
+/**
+* @return TRUE if blocks are compressed with the SHA extensions.
+*/
+BOOLEAN
+BLAPI
+BlSha256Accelerated(
+    VOID
+);
+
+/**
+* Allows the SHA extensions (the default) or restricts hashing to plain C, so the portable
+* path can be checked on a CPU that would never take it. Applies to hashes started afterwards.
+*/
+VOID
+BLAPI
+BlSha256AllowAcceleration(
+    _In_ BOOLEAN Allow
+);
+
+#endif // !_SHA256_H
\ No newline at end of file
@@ -9,6 +9,13 @@ typedef LONG BL_STATUS;
 
 #define BL_STATUS_OK ( LONG )0
 #define BL_STATUS_GENERIC_ERROR ( LONG )BL_STATUS_ERROR_BASE
+#define BL_STATUS_INVALID_PARAMETER ( LONG )( BL_STATUS_ERROR_BASE + 1 )
+#define BL_STATUS_INVALID_IMAGE ( LONG )( BL_STATUS_ERROR_BASE + 2 )
+#define BL_STATUS_OUT_OF_RESOURCES ( LONG )( BL_STATUS_ERROR_BASE + 3 )
+#define BL_STATUS_READ_ERROR ( LONG )( BL_STATUS_ERROR_BASE + 4 )
+#define BL_STATUS_NOT_FOUND ( LONG )( BL_STATUS_ERROR_BASE + 5 )
+#define BL_STATUS_UNSUPPORTED ( LONG )( BL_STATUS_ERROR_BASE + 6 )
+#define BL_STATUS_INTEGRITY_ERROR ( LONG )( BL_STATUS_ERROR_BASE + 7 )
 
 #define BL_SUCCESS( Status ) ( Status == BL_STATUS_OK )
 #define BL_WARNING( Status ) ( ((Status) & 0xF0000000) == BL_STATUS_WARNING_BASE )
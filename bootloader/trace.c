@@ -0,0 +1,232 @@
+#include "trace.h"
+#include "log.h"
+#include <Protocol/Timestamp.h>
+#include <intrin.h>
+
+STATIC_ASSERT(sizeof(BOOT_TRACE_EVENT) == 32, "trace events are 32 bytes");
+STATIC_ASSERT((BOOT_TRACE_CAPACITY & (BOOT_TRACE_CAPACITY - 1)) == 0, "the trace capacity is a power of two");
+
+static BOOT_TRACE*             Trace;
+static EFI_TIMESTAMP_PROTOCOL* Timestamp;      // NULL when the firmware has no timestamp counter
+static UINT64                  TimestampEnd;   // the counter's last value before it wraps
+static UINT64                  TimestampFrequency;
+static UINT64                  TimestampStart;
+static UINT64                  TscStart;
+static BOOLEAN                 Debugcon;       // events are echoed to BOOT_DEBUGCON_PORT
+
+typedef struct _BL_COUNTER
+{
+    UINT64 Calls;
+    UINT64 Bytes;
+    UINT64 Ticks;
+} BL_COUNTER;
+
+static BL_COUNTER Counters[BlCounterMax];
+
+/**
+* Writes one marker line to the debug console, see bootinfo.h for the format.
+*/
+static
+VOID
+BlpTraceEmit(
+    _In_ CHAR8 Kind,
+    _In_ UINT64 Value,
+    _In_ CONST CHAR8* Name
+)
+{
+    CHAR8 Line[64];
+    UINTN Length = AsciiSPrint(Line, sizeof(Line), "@opli L %c %lx %a\n", Kind, Value, Name);
+
+    for (UINTN i = 0; i < Length; i++)
+    {
+        __outbyte(BOOT_DEBUGCON_PORT, (UINT8)Line[i]);
+    }
+}
+
+/**
+* Records a loader event and echoes it to the debug console.
+*/
+static
+VOID
+BlpTraceRecord(
+    _In_ CONST CHAR8* Name,
+    _In_ UINT8 Kind
+)
+{
+    static CONST CHAR8 Kinds[] = { '?', 'B', 'E', 'M' };
+
+    if (Trace)
+    {
+        UINT64 Tsc = AsmReadTsc();
+        BootTraceRecord(Trace, Tsc, Name, Kind, BootTraceLoader);
+
+        if (Debugcon)
+        {
+            BlpTraceEmit(Kinds[Kind], Tsc, Name);
+        }
+    }
+}
+
+VOID
+BLAPI
+BlTraceInit(
+    VOID
+)
+{
+    EFI_PHYSICAL_ADDRESS Base;
+    if (EFI_ERROR(gBS->AllocatePages(AllocateAnyPages, BL_MEMORY_TYPE(BootMemoryBootInfo), EFI_SIZE_TO_PAGES(sizeof(BOOT_TRACE)), &Base)))
+    {
+        return;
+    }
+
+    Trace = (BOOT_TRACE*)(UINTN)Base;
+    ZeroMem(Trace, sizeof(BOOT_TRACE));
+    Trace->Signature = BOOT_TRACE_SIGNATURE;
+    Trace->Capacity  = BOOT_TRACE_CAPACITY;
+    Trace->EventSize = sizeof(BOOT_TRACE_EVENT);
+    Debugcon         = __inbyte(BOOT_DEBUGCON_PORT) == BOOT_DEBUGCON_PORT;
+
+    // calibrating across the whole boot needs a counter that cannot wrap in the meantime, at
+    // least 48 bits, and a rate below 2^32 so the arithmetic in BlTraceCalibrate fits
+    EFI_GUID                 TimestampGuid = EFI_TIMESTAMP_PROTOCOL_GUID;
+    EFI_TIMESTAMP_PROPERTIES Properties;
+    if (!EFI_ERROR(gBS->LocateProtocol(&TimestampGuid, NULL, (VOID**)&Timestamp)) &&
+        !EFI_ERROR(Timestamp->GetProperties(&Properties)) &&
+        Properties.Frequency && !(Properties.Frequency >> 32) &&
+        Properties.EndValue >= 0xFFFFFFFFFFFFULL && (Properties.EndValue & (Properties.EndValue + 1)) == 0)
+    {
+        TimestampEnd       = Properties.EndValue;
+        TimestampFrequency = Properties.Frequency;
+        TimestampStart     = Timestamp->GetTimestamp();
+        TscStart           = AsmReadTsc();
+    }
+    else
+    {
+        Timestamp = NULL;
+    }
+
+    BlTraceMark("loader.entry");
+}
+
+VOID
+BLAPI
+BlTraceBegin(
+    _In_ CONST CHAR8* Name
+)
+{
+    BlpTraceRecord(Name, BootTraceBegin);
+}
+
+VOID
+BLAPI
+BlTraceEnd(
+    _In_ CONST CHAR8* Name
+)
+{
+    BlpTraceRecord(Name, BootTraceEnd);
+}
+
+VOID
+BLAPI
+BlTraceMark(
+    _In_ CONST CHAR8* Name
+)
+{
+    BlpTraceRecord(Name, BootTraceMark);
+}
+
+VOID
+BLAPI
+BlTraceCalibrate(
+    VOID
+)
+{
+    if (!Trace || Trace->TscFrequency)
+    {
+        return;
+    }
+
+    if (Timestamp)
+    {
+        UINT64 Tsc   = AsmReadTsc() - TscStart;
+        UINT64 Ticks = (Timestamp->GetTimestamp() - TimestampStart) & TimestampEnd;
+
+        // Tsc * Frequency / Ticks in two steps, shifting Ticks below 2^32 first keeps the
+        // remainder product within 64 bits and only drops bits far below the result
+        while (Ticks >> 32)
+        {
+            Ticks >>= 1;
+            Tsc   >>= 1;
+        }
+
+        if (Ticks)
+        {
+            Trace->TscFrequency = (Tsc / Ticks) * TimestampFrequency + (Tsc % Ticks) * TimestampFrequency / Ticks;
+        }
+    }
+
+    if (!Trace->TscFrequency)
+    {
+        UINT64 Start = AsmReadTsc();
+        gBS->Stall(BL_TRACE_CALIBRATION_US);
+        Trace->TscFrequency = (AsmReadTsc() - Start) * (1000000 / BL_TRACE_CALIBRATION_US);
+    }
+
+    if (Debugcon)
+    {
+        BlpTraceEmit('F', Trace->TscFrequency, "tsc");
+    }
+}
+
+VOID
+BLAPI
+BlTraceCount(
+    _In_ BL_TRACE_COUNTER Counter,
+    _In_ UINT64 Bytes
+)
+{
+    Counters[Counter].Calls++;
+    Counters[Counter].Bytes += Bytes;
+}
+
+VOID
+BLAPI
+BlTraceWait(
+    _In_ BL_TRACE_COUNTER Counter,
+    _In_ UINT64 Ticks
+)
+{
+    Counters[Counter].Ticks += Ticks;
+}
+
+VOID
+BLAPI
+BlTracePrintCounters(
+    VOID
+)
+{
+    static CONST CHAR16* CONST Names[BlCounterMax] = { L"File reads", L"Block reads", L"Arena allocations" };
+
+    UINT64 Frequency = Trace ? Trace->TscFrequency : 0;
+
+    for (UINT32 i = 0; i < BlCounterMax; i++)
+    {
+        if (Frequency)
+        {
+            BlPrint(L"   %-18s %8llu calls %10llu bytes %10llu us waiting\r\n", Names[i], Counters[i].Calls, Counters[i].Bytes, Counters[i].Ticks * 1000000 / Frequency);
+        }
+        else
+        {
+            BlPrint(L"   %-18s %8llu calls %10llu bytes %10llu ticks waiting\r\n", Names[i], Counters[i].Calls, Counters[i].Bytes, Counters[i].Ticks);
+        }
+    }
+}
+
+BOOT_TRACE*
+BLAPI
+BlGetTrace(
+    VOID
+)
+{
+    return Trace;
+}
\ No newline at end of file
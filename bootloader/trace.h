@@ -0,0 +1,124 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "boot.h"
+
+//
+//
+// Boot stage tracing. Stages record TSC stamped Begin/End events into the BOOT_TRACE ring
+// shared with the kernel (bootinfo.h), recording is a plain memory write so it keeps
+// working after ExitBootServices. The TSC rate is measured once, right before the handoff:
+// against the firmware's timestamp counter over the whole boot when it has one, with a
+// short stall otherwise. Until BlTraceInit succeeded every call here does nothing. Under
+// QEMU with a debug console every event is echoed there as well, see bootinfo.h.
+//
+// Next to the stages the loader keeps a few counters of what it asked the firmware for,
+// how many calls, how many bytes and how long it was kept waiting, so a change in its I/O
+// pattern shows up without stepping through the firmware.
+//
+//
+
+#define BL_TRACE_CALIBRATION_US 5000 // stall used when there is no timestamp counter
+
+typedef enum _BL_TRACE_COUNTER
+{
+    BlCounterFileRead,  // EFI_FILE_PROTOCOL reads, queued or not
+    BlCounterBlockRead, // runs of whole blocks the FAT reader transfers
+    BlCounterArena,     // loader arena allocations
+    BlCounterMax
+} BL_TRACE_COUNTER;
+
+/**
+* Allocates the ring and starts the TSC calibration. Call it first thing so the early
+* stages are covered.
+*/
+VOID
+BLAPI
+BlTraceInit(
+    VOID
+);
+
+/**
+* Records the start of a stage.
+*
+* @param Name Stage name, at most BOOT_TRACE_NAME_LENGTH - 1 characters are kept.
+*/
+VOID
+BLAPI
+BlTraceBegin(
+    _In_ CONST CHAR8* Name
+);
+
+/**
+* Records the end of a stage started with BlTraceBegin under the same name.
+*/
+VOID
+BLAPI
+BlTraceEnd(
+    _In_ CONST CHAR8* Name
+);
+
+/**
+* Records a point in time without a duration.
+*/
+VOID
+BLAPI
+BlTraceMark(
+    _In_ CONST CHAR8* Name
+);
+
+/**
+* Adds one operation to a counter.
+*
+* @param Counter The counter.
+* @param Bytes   Bytes the operation moved or allocated.
+*/
+VOID
+BLAPI
+BlTraceCount(
+    _In_ BL_TRACE_COUNTER Counter,
+    _In_ UINT64 Bytes
+);
+
+/**
+* Adds time the loader spent blocked on a counter's operations, separate from BlTraceCount
+* because queued reads are waited for long after they were issued.
+*
+* @param Counter The counter.
+* @param Ticks   TSC ticks spent waiting.
+*/
+VOID
+BLAPI
+BlTraceWait(
+    _In_ BL_TRACE_COUNTER Counter,
+    _In_ UINT64 Ticks
+);
+
+/**
+* Prints every counter, times in microseconds once BlTraceCalibrate ran.
+*/
+VOID
+BLAPI
+BlTracePrintCounters(
+    VOID
+);
+
+/**
+* Measures the TSC rate into the ring. Needs boot services, the handoff calls it.
+*/
+VOID
+BLAPI
+BlTraceCalibrate(
+    VOID
+);
+
+/**
+* @return The ring, NULL when it could not be allocated.
+*/
+BOOT_TRACE*
+BLAPI
+BlGetTrace(
+    VOID
+);
+
+#endif // !_TRACE_H
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include "util.h"
+#include "log.h"
+#include "../kernal/rtl.h"
 
 EFI_INPUT_KEY
 BLAPI
@@ -9,7 +11,10 @@ getc(
     EFI_EVENT e[1];
 
     EFI_INPUT_KEY k;
-    memset(&k, 0, sizeof(EFI_INPUT_KEY));
+    ZeroMem(&k, sizeof(EFI_INPUT_KEY));
+
+    // whatever is still buffered is what the user is being asked about
+    BlLogFlush();
 
     e[0] = gST->ConIn->WaitForKey;
     UINTN index = 0;
@@ -32,11 +37,7 @@ strlength(
     if (str == NULL)
         return 0;
 
-    CHAR16* p = str;
-    while (*p != '\0')
-        p++;
-
-    return (INTN)(p - str);
+    return (INTN)RtlStringLength(str);
 }
 
 INTN
@@ -46,10 +47,7 @@ strcopy(
     _In_ CONST CHAR16* src
 )
 {
-    while (*src)
-        *(dst)++ = *(src)++;
-
-    *dst = 0;
+    RtlStringCopy(dst, src);
 
     return 0;
 }
@@ -61,18 +59,7 @@ strcompare(
     _In_ CONST CHAR16* s1
 )
 {
-    while (*s0)
-    {
-        if (*s0 != *s1)
-        {
-            break;
-        }
-
-        s0 += 1;
-        s1 += 1;
-    }
-
-    return *s0 - *s1;
+    return RtlStringCompare(s0, s1);
 }
 
 BOOLEAN
@@ -90,57 +77,35 @@ strfmt(
     }
 
     VA_LIST Args;
-    VA_LIST ArgsCopy;
-    CHAR16* Buffer = NULL;
-    UINTN   BufferSize = 256;  // random guess
-    UINTN   StringLength;
+    CHAR16  Line[BL_LOG_LINE_SIZE];
 
+    // most strings fit on the stack and are formatted once, only longer ones are measured
+    // and formatted again into a buffer of the right size
     VA_START(Args, Format);
-    VA_COPY(ArgsCopy, Args);
+    UINTN Length = UnicodeVSPrint(Line, sizeof(Line), Format, Args);
+    VA_END(Args);
 
-    // allocate buffer for buffer size
-    Buffer = AllocateZeroPool(BufferSize * sizeof(CHAR16));
-    if (Buffer == NULL)
+    if (Length < BL_LOG_LINE_SIZE - 1)
     {
-        // Out of memory
-        VA_END(ArgsCopy);
-        VA_END(Args);
-        return FALSE;
+        *Out = AllocateCopyPool((Length + 1) * sizeof(CHAR16), Line);
+        return *Out != NULL;
     }
 
-    // try make the string
-    StringLength = UnicodeVSPrint(Buffer, BufferSize * sizeof(CHAR16), Format, ArgsCopy);
-
-
+    VA_START(Args, Format);
+    UINTN Needed = SPrintLength(Format, Args);
+    VA_END(Args);
 
-    // If the printed length fits (CharCount < BufSize - 1), we're good
-    if (StringLength >= (BufferSize - 1))
+    CHAR16* Buffer = AllocatePool((Needed + 1) * sizeof(CHAR16));
+    if (Buffer == NULL)
     {
-        FreePool( Buffer );
-        BufferSize = StringLength + 1;
-
-        // allocate buffer for buffer size
-        Buffer = AllocateZeroPool( (BufferSize * sizeof(CHAR16)));
-        if (Buffer == NULL)
-        {
-            // Out of memory
-            VA_END(ArgsCopy);
-            VA_END(Args);
-            return FALSE;
-        }
-
-        VA_END(ArgsCopy);
-        VA_COPY(ArgsCopy, Args);
-
-        // if this isn't properlly made then oh well...
-        UnicodeVSPrint(Buffer, BufferSize * sizeof(CHAR16), Format, ArgsCopy);
+        // Out of memory
+        return FALSE;
     }
 
-    VA_END(ArgsCopy);
+    VA_START(Args, Format);
+    UnicodeVSPrint(Buffer, (Needed + 1) * sizeof(CHAR16), Format, Args);
     VA_END(Args);
 
-    // hopefully buffer is properly formated
     *Out = Buffer;
-
     return TRUE;
 }
\ No newline at end of file
@@ -0,0 +1,251 @@
+import argparse
+import json
+import math
+import os
+import queue
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+# Boots the loader and kernel headless under QEMU and OVMF a number of times and reports
+# how long each boot stage took to reach, median and p99 over the runs. Both sides echo
+# their boot trace events to the debug console (bootinfo.h):
+#
+#   @opli <source L|K> <kind B|E|M> <TSC> <name>
+#   @opli L F <TSC ticks per second> tsc
+#
+# QEMU starts the TSC at 0 on reset, so the loader's first event is the time the firmware
+# took to hand over and every later stage is measured from it. Begin/End pairs are also
+# reported as durations. A run ends at the --until marker, kernel.idle by default.
+#
+#   python BootBench.py x64\Release\bootloader.efi x64\Release\kernel.exe --runs 20
+#   python BootBench.py ... --json today.json --baseline yesterday.json
+#
+# With --baseline the exit code is 1 when a stage's median got slower than the baseline's
+# by more than --tolerance, so the script can gate a build.
+
+HERE     = os.path.dirname(os.path.abspath(__file__))
+MARKER   = "@opli"
+ENTRY    = "loader.entry"
+FIRMWARE = "firmware (reset to " + ENTRY + ")"
+HOST     = "host wall clock"
+
+CONFIG = "profile = fast\n"
+
+
+def default_qemu():
+    local = os.path.join(HERE, "qemu-system-x86_64.exe")
+    return local if os.path.exists(local) else "qemu-system-x86_64"
+
+
+def make_esp(root, loader, kernel, bundle):
+    boot = os.path.join(root, "EFI", "BOOT")
+    os.makedirs(boot)
+    shutil.copyfile(loader, os.path.join(boot, "BOOTX64.EFI"))
+    shutil.copyfile(kernel, os.path.join(root, "kernel.exe"))
+    if bundle:
+        shutil.copyfile(bundle, os.path.join(root, "boot.bnd"))
+    with open(os.path.join(root, "oplios.cfg"), "w") as config:
+        config.write(CONFIG)
+
+
+def qemu_command(args, esp, variables):
+    # the -need-smm firmware only runs on q35 with SMM and a secure flash
+    command = [
+        args.qemu,
+        "-machine", "q35,smm=on",
+        "-global", "driver=cfi.pflash01,property=secure,value=on",
+        "-m", str(args.memory),
+        "-drive", "if=pflash,format=raw,unit=0,readonly=on,file=" + args.code,
+        "-drive", "if=pflash,format=raw,unit=1,file=" + variables,
+        "-drive", "format=raw,file=fat:rw:" + esp,
+        "-net", "none",
+        "-display", "none",
+        "-serial", "none",
+        "-monitor", "none",
+        "-debugcon", "stdio",
+        "-no-reboot",
+    ]
+    if args.accel:
+        command += ["-accel", args.accel]
+    return command + args.qemu_args
+
+
+def boot_once(args, esp, variables):
+    """Runs one boot, returns the marker lines up to --until and the host time it took."""
+    start = time.perf_counter()
+    process = subprocess.Popen(qemu_command(args, esp, variables), stdin=subprocess.DEVNULL,
+                               stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+
+    # pipes cannot be polled on Windows, a thread hands the lines over instead
+    lines = queue.Queue()
+
+    def pump():
+        for raw in process.stdout:
+            lines.put(raw.decode("ascii", "replace"))
+        lines.put(None)
+
+    threading.Thread(target=pump, daemon=True).start()
+
+    markers = []
+    deadline = start + args.timeout
+    try:
+        while True:
+            try:
+                line = lines.get(timeout=max(0.0, deadline - time.perf_counter()))
+            except queue.Empty:
+                raise RuntimeError("no %s marker within %d seconds" % (args.until, args.timeout))
+            if line is None:
+                raise RuntimeError("QEMU exited before the %s marker" % args.until)
+
+            # the firmware writes its own messages to the same port, markers start a line
+            index = line.find(MARKER + " ")
+            if index < 0:
+                continue
+            fields = line[index:].split()
+            if len(fields) != 5:
+                continue
+            markers.append(fields[1:])
+            if fields[4] == args.until:
+                return markers, time.perf_counter() - start
+    finally:
+        process.kill()
+        process.wait()
+
+
+def measure(markers, wall):
+    """Turns one run's markers into stage name -> milliseconds."""
+    frequency = 0
+    events = []
+    for source, kind, value, name in markers:
+        if kind == "F":
+            frequency = int(value, 16)
+        else:
+            events.append((source, kind, int(value, 16), name))
+
+    if not frequency:
+        raise RuntimeError("the loader never reported its TSC rate")
+
+    def ms(ticks):
+        return ticks * 1e3 / frequency
+
+    entry = next((tsc for source, kind, tsc, name in events if name == ENTRY), None)
+    if entry is None:
+        raise RuntimeError("no %s marker" % ENTRY)
+
+    stages = {FIRMWARE: ms(entry), HOST: wall * 1e3}
+    open_slices = {}
+    for source, kind, tsc, name in events:
+        if kind in ("B", "M"):
+            stages.setdefault(name, ms(tsc - entry))
+        if kind == "B":
+            open_slices[name] = tsc
+        elif kind == "E" and name in open_slices:
+            # stages entered more than once, the preload states, add up
+            key = name + " (duration)"
+            stages[key] = stages.get(key, 0.0) + ms(tsc - open_slices.pop(name))
+    return stages
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[max(0, math.ceil(fraction * len(ordered)) - 1)]
+
+
+def summarize(runs):
+    summary = {}
+    for name in runs[0]:
+        values = [run[name] for run in runs if name in run]
+        summary[name] = {
+            "median": statistics.median(values),
+            "p99": percentile(values, 0.99),
+            "min": min(values),
+            "max": max(values),
+            "runs": len(values),
+        }
+    return summary
+
+
+def report(summary):
+    print("%-40s %10s %10s %10s %10s" % ("stage (ms)", "median", "p99", "min", "max"))
+    for name, row in summary.items():
+        print("%-40s %10.3f %10.3f %10.3f %10.3f" % (name, row["median"], row["p99"], row["min"], row["max"]))
+
+
+def regressions(summary, baseline, tolerance, slack):
+    found = []
+    for name, row in summary.items():
+        if name == HOST or name not in baseline:
+            continue
+        before = baseline[name]["median"]
+        if row["median"] > before * (1 + tolerance) + slack:
+            found.append((name, before, row["median"]))
+    return found
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Time OpliOS boots under QEMU and OVMF.")
+    parser.add_argument("loader", help="the built loader, copied to \\EFI\\BOOT\\BOOTX64.EFI")
+    parser.add_argument("kernel", help="the built kernel, copied to \\kernel.exe")
+    parser.add_argument("--bundle", help="boot bundle, copied to \\boot.bnd")
+    parser.add_argument("--runs", type=int, default=20, help="measured boots")
+    parser.add_argument("--warmup", type=int, default=1, help="boots thrown away first")
+    parser.add_argument("--cold", action="store_true",
+                        help="start every boot from pristine firmware variables, no remembered boot target")
+    parser.add_argument("--until", default="kernel.idle", help="marker that ends a boot")
+    parser.add_argument("--timeout", type=int, default=60, help="seconds a boot may take")
+    parser.add_argument("--qemu", default=default_qemu(), help="QEMU binary")
+    parser.add_argument("--accel", help="QEMU accelerator, kvm, whpx or tcg")
+    parser.add_argument("--memory", type=int, default=512, help="guest RAM in MiB")
+    parser.add_argument("--code", default=os.path.join(HERE, "OVMF_CODE-need-smm.fd"), help="OVMF code image")
+    parser.add_argument("--vars", default=os.path.join(HERE, "OVMF_VARS-need-smm.fd"), help="OVMF variable store template")
+    parser.add_argument("--json", help="write the per-run numbers and the summary here")
+    parser.add_argument("--baseline", help="an earlier --json file to compare the medians with")
+    parser.add_argument("--tolerance", type=float, default=0.10, help="allowed relative slowdown")
+    parser.add_argument("--slack", type=float, default=0.5, help="allowed absolute slowdown in ms")
+    parser.add_argument("qemu_args", nargs="*", help="extra QEMU arguments, after --")
+    args = parser.parse_args()
+
+    work = tempfile.mkdtemp(prefix="oplios-bench-")
+    try:
+        esp = os.path.join(work, "esp")
+        make_esp(esp, args.loader, args.kernel, args.bundle)
+        variables = os.path.join(work, "vars.fd")
+
+        runs = []
+        for index in range(args.warmup + args.runs):
+            if args.cold or index == 0:
+                shutil.copyfile(args.vars, variables)
+            try:
+                markers, wall = boot_once(args, esp, variables)
+                stages = measure(markers, wall)
+            except RuntimeError as error:
+                sys.exit("boot %d: %s" % (index + 1, error))
+            if index >= args.warmup:
+                runs.append(stages)
+            print("boot %d: %.3f ms from reset to %s" % (index + 1, stages[FIRMWARE] + stages[args.until], args.until), file=sys.stderr)
+    finally:
+        shutil.rmtree(work, ignore_errors=True)
+
+    summary = summarize(runs)
+    report(summary)
+
+    if args.json:
+        with open(args.json, "w") as output:
+            json.dump({"runs": runs, "summary": summary}, output, indent=1)
+
+    if args.baseline:
+        with open(args.baseline) as baseline:
+            found = regressions(summary, json.load(baseline)["summary"], args.tolerance, args.slack)
+        for name, before, after in found:
+            print("slower: %s %.3f -> %.3f ms" % (name, before, after))
+        if found:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,145 @@
+import argparse
+import random
+import struct
+import sys
+
+# Writes a synthetic PE32+ x64 image for the host benchmarks. It has what the loader cares
+# about and nothing else: .text filled with instruction-like bytes that compress about the
+# way real code does, .data holding pointers into the image, .bss, and a .reloc directory
+# with one DIR64 fixup for every pointer. Pointers are written for the preferred base, so
+# an image loaded anywhere else can be checked by relocating it back.
+
+FILE_ALIGNMENT    = 0x200
+SECTION_ALIGNMENT = 0x1000
+HEADER_SIZE       = 0x400
+NT_OFFSET         = 0x80
+
+DIR64     = 0xA
+PAGE_SIZE = 0x1000
+
+TEXT  = 0x60000020  # code, execute, read
+DATA  = 0xC0000040  # initialised data, read, write
+BSS   = 0xC0000080  # uninitialised data, read, write
+RELOC = 0x42000040  # initialised data, discardable, read
+
+
+def align(value, alignment):
+    return (value + alignment - 1) & ~(alignment - 1)
+
+
+def size(value):
+    # 1M, 512K, 0x1000
+    units = {"K": 1 << 10, "M": 1 << 20, "G": 1 << 30}
+    if value[-1:].upper() in units:
+        return int(value[:-1], 0) * units[value[-1:].upper()]
+    return int(value, 0)
+
+
+def make_code(rng, length):
+    # a few hundred short "instructions" picked with a skewed distribution, which gives
+    # LZ4 ratios in the range real .text sections get
+    phrases = [bytes(rng.randrange(256) for _ in range(rng.randrange(2, 9))) for _ in range(384)]
+    weights = [1.0 / (i + 1) for i in range(len(phrases))]
+    out = bytearray()
+    while len(out) < length:
+        out += b"".join(rng.choices(phrases, weights, k=4096))
+    return out[:length]
+
+
+def make_pointers(data, section_rva, every, base, image_size, rng):
+    # every 'every' bytes one qword slot pointing somewhere in the image, 8 byte aligned
+    fixups = []
+    for offset in range(0, len(data) - 7, every):
+        offset &= ~7
+        struct.pack_into("<Q", data, offset, base + rng.randrange(image_size))
+        fixups.append(section_rva + offset)
+    return fixups
+
+
+def make_relocations(fixups):
+    blocks = bytearray()
+    pages = {}
+    for rva in fixups:
+        pages.setdefault(rva & ~(PAGE_SIZE - 1), []).append(rva & (PAGE_SIZE - 1))
+    for page in sorted(pages):
+        entries = [(DIR64 << 12) | offset for offset in sorted(pages[page])]
+        if len(entries) & 1:
+            entries.append(0)  # IMAGE_REL_BASED_ABSOLUTE keeps the block 32 bit aligned
+        blocks += struct.pack("<II", page, 8 + 2 * len(entries))
+        blocks += struct.pack("<%dH" % len(entries), *entries)
+    return bytes(blocks)
+
+
+def section_header(name, virtual_size, rva, raw_size, raw_pointer, characteristics):
+    return struct.pack("<8sIIIIIIHHI", name, virtual_size, rva, raw_size, raw_pointer, 0, 0, 0, 0, characteristics)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Write a synthetic PE32+ image for the host benchmarks.")
+    parser.add_argument("-o", "--output", required=True, help="image to write")
+    parser.add_argument("--text", type=size, default=size("4M"), help="bytes of .text")
+    parser.add_argument("--data", type=size, default=size("1M"), help="bytes of .data")
+    parser.add_argument("--bss", type=size, default=size("1M"), help="bytes of .bss")
+    parser.add_argument("--every", type=size, default=64, help="bytes between pointers needing a fixup")
+    parser.add_argument("--base", type=lambda v: int(v, 0), default=0x140000000, help="preferred base")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    if args.every < 8 or args.base & 0xFFFF:
+        sys.exit("--every must be at least 8 and --base 64K aligned")
+
+    rng = random.Random(args.seed)
+
+    text_rva  = SECTION_ALIGNMENT
+    data_rva  = align(text_rva + args.text, SECTION_ALIGNMENT)
+    bss_rva   = align(data_rva + args.data, SECTION_ALIGNMENT)
+    reloc_rva = align(bss_rva + args.bss, SECTION_ALIGNMENT)
+
+    # pointers aim below .reloc, whose size is only known once they are all placed
+    text = bytearray(make_code(rng, args.text))
+    data = bytearray(make_code(rng, args.data))
+    fixups  = make_pointers(text, text_rva, args.every, args.base, reloc_rva, rng)
+    fixups += make_pointers(data, data_rva, args.every, args.base, reloc_rva, rng)
+    reloc = make_relocations(fixups)
+    image_size = align(reloc_rva + len(reloc), SECTION_ALIGNMENT)
+
+    sections = [
+        (b".text", bytes(text), text_rva, TEXT),
+        (b".data", bytes(data), data_rva, DATA),
+        (b".bss", b"", bss_rva, BSS),
+        (b".reloc", reloc, reloc_rva, RELOC),
+    ]
+
+    headers = bytearray(HEADER_SIZE)
+    struct.pack_into("<H", headers, 0, 0x5A4D)
+    struct.pack_into("<I", headers, 0x3C, NT_OFFSET)
+    struct.pack_into("<I", headers, NT_OFFSET, 0x4550)
+
+    # file header: AMD64, executable, large address aware
+    struct.pack_into("<HHIIIHH", headers, NT_OFFSET + 4, 0x8664, len(sections), 0, 0, 0, 240, 0x22)
+
+    optional = NT_OFFSET + 24
+    struct.pack_into("<HBBIIIII", headers, optional, 0x20B, 14, 0, len(text), len(data), args.bss, text_rva, text_rva)
+    struct.pack_into("<QIIHHHHHHIIIIHH", headers, optional + 24, args.base, SECTION_ALIGNMENT, FILE_ALIGNMENT,
+                     6, 0, 0, 0, 6, 0, 0, image_size, HEADER_SIZE, 0, 10, 0x160)
+    struct.pack_into("<QQQQII", headers, optional + 72, 0x100000, 0x1000, 0x100000, 0x1000, 0, 16)
+    struct.pack_into("<II", headers, optional + 112 + 8 * 5, reloc_rva, len(reloc))
+
+    body = bytearray()
+    table = optional + 240
+    pointer = HEADER_SIZE
+    for i, (name, content, rva, characteristics) in enumerate(sections):
+        raw_size = align(len(content), FILE_ALIGNMENT)
+        virtual_size = args.bss if name == b".bss" else len(content)
+        headers[table + 40 * i:table + 40 * (i + 1)] = section_header(
+            name, virtual_size, rva, raw_size, pointer if raw_size else 0, characteristics)
+        body += content + bytes(raw_size - len(content))
+        pointer += raw_size
+
+    with open(args.output, "wb") as f:
+        f.write(headers)
+        f.write(body)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,1074 @@
+#include "firmware.h"
+#include "host.h"
+#include <Library/SynchronizationLib.h>
+
+//
+//
+// The parts of the EDK2 BaseLib, BaseMemoryLib, MemoryAllocationLib, DevicePathLib and PrintLib
+// the loader links against, written for the host. Behaviour follows the EDK2 documentation of each
+// function, the ASSERTs of the debug builds are left out.
+//
+//
+
+//
+//
+// BaseMemoryLib
+//
+//
+
+VOID*
+EFIAPI
+CopyMem(
+    OUT VOID* DestinationBuffer,
+    IN  CONST VOID* SourceBuffer,
+    IN  UINTN Length
+)
+{
+    return __builtin_memmove(DestinationBuffer, SourceBuffer, Length);
+}
+
+VOID*
+EFIAPI
+SetMem(
+    OUT VOID* Buffer,
+    IN  UINTN Length,
+    IN  UINT8 Value
+)
+{
+    return __builtin_memset(Buffer, Value, Length);
+}
+
+VOID*
+EFIAPI
+ZeroMem(
+    OUT VOID* Buffer,
+    IN  UINTN Length
+)
+{
+    return __builtin_memset(Buffer, 0, Length);
+}
+
+INTN
+EFIAPI
+CompareMem(
+    IN CONST VOID* DestinationBuffer,
+    IN CONST VOID* SourceBuffer,
+    IN UINTN Length
+)
+{
+    CONST UINT8* First  = DestinationBuffer;
+    CONST UINT8* Second = SourceBuffer;
+
+    for (UINTN i = 0; i < Length; i++)
+    {
+        if (First[i] != Second[i])
+        {
+            return (INTN)First[i] - (INTN)Second[i];
+        }
+    }
+
+    return 0;
+}
+
+//
+//
+// BaseLib
+//
+//
+
+UINTN
+EFIAPI
+StrLen(
+    IN CONST CHAR16* String
+)
+{
+    UINTN Length = 0;
+    while (String[Length])
+    {
+        Length++;
+    }
+
+    return Length;
+}
+
+UINTN
+EFIAPI
+StrSize(
+    IN CONST CHAR16* String
+)
+{
+    return (StrLen(String) + 1) * sizeof(CHAR16);
+}
+
+INTN
+EFIAPI
+StrCmp(
+    IN CONST CHAR16* FirstString,
+    IN CONST CHAR16* SecondString
+)
+{
+    while (*FirstString && *FirstString == *SecondString)
+    {
+        FirstString++;
+        SecondString++;
+    }
+
+    return (INTN)*FirstString - (INTN)*SecondString;
+}
+
+INTN
+EFIAPI
+StrnCmp(
+    IN CONST CHAR16* FirstString,
+    IN CONST CHAR16* SecondString,
+    IN UINTN Length
+)
+{
+    if (!Length)
+    {
+        return 0;
+    }
+
+    while (*FirstString && *FirstString == *SecondString && Length > 1)
+    {
+        FirstString++;
+        SecondString++;
+        Length--;
+    }
+
+    return (INTN)*FirstString - (INTN)*SecondString;
+}
+
+RETURN_STATUS
+EFIAPI
+StrnCpyS(
+    OUT CHAR16* Destination,
+    IN  UINTN DestMax,
+    IN  CONST CHAR16* Source,
+    IN  UINTN Length
+)
+{
+    if (!Destination || !Source || !DestMax)
+    {
+        return RETURN_INVALID_PARAMETER;
+    }
+
+    UINTN SourceLength = 0;
+    while (SourceLength < Length && Source[SourceLength])
+    {
+        SourceLength++;
+    }
+
+    if (SourceLength >= DestMax)
+    {
+        return RETURN_BUFFER_TOO_SMALL;
+    }
+
+    CopyMem(Destination, Source, SourceLength * sizeof(CHAR16));
+    Destination[SourceLength] = L'\0';
+    return RETURN_SUCCESS;
+}
+
+RETURN_STATUS
+EFIAPI
+StrCpyS(
+    OUT CHAR16* Destination,
+    IN  UINTN DestMax,
+    IN  CONST CHAR16* Source
+)
+{
+    return StrnCpyS(Destination, DestMax, Source, MAX_UINTN);
+}
+
+UINTN
+EFIAPI
+AsciiStrLen(
+    IN CONST CHAR8* String
+)
+{
+    UINTN Length = 0;
+    while (String[Length])
+    {
+        Length++;
+    }
+
+    return Length;
+}
+
+static
+CHAR8
+HostpAsciiUpper(
+    _In_ CHAR8 Char
+)
+{
+    return (Char >= 'a' && Char <= 'z') ? (CHAR8)(Char - 'a' + 'A') : Char;
+}
+
+INTN
+EFIAPI
+AsciiStriCmp(
+    IN CONST CHAR8* FirstString,
+    IN CONST CHAR8* SecondString
+)
+{
+    while (*FirstString && HostpAsciiUpper(*FirstString) == HostpAsciiUpper(*SecondString))
+    {
+        FirstString++;
+        SecondString++;
+    }
+
+    return (INTN)(UINT8)HostpAsciiUpper(*FirstString) - (INTN)(UINT8)HostpAsciiUpper(*SecondString);
+}
+
+INTN
+EFIAPI
+AsciiStrnCmp(
+    IN CONST CHAR8* FirstString,
+    IN CONST CHAR8* SecondString,
+    IN UINTN Length
+)
+{
+    if (!Length)
+    {
+        return 0;
+    }
+
+    while (*FirstString && *FirstString == *SecondString && Length > 1)
+    {
+        FirstString++;
+        SecondString++;
+        Length--;
+    }
+
+    return (INTN)(UINT8)*FirstString - (INTN)(UINT8)*SecondString;
+}
+
+UINT64
+EFIAPI
+DivU64x32(
+    IN UINT64 Dividend,
+    IN UINT32 Divisor
+)
+{
+    return Dividend / Divisor;
+}
+
+UINT64
+EFIAPI
+DivU64x64Remainder(
+    IN  UINT64 Dividend,
+    IN  UINT64 Divisor,
+    OUT UINT64* Remainder OPTIONAL
+)
+{
+    if (Remainder)
+    {
+        *Remainder = Dividend % Divisor;
+    }
+
+    return Dividend / Divisor;
+}
+
+UINT64
+EFIAPI
+LShiftU64(
+    IN UINT64 Operand,
+    IN UINTN Count
+)
+{
+    return Operand << Count;
+}
+
+UINT64
+EFIAPI
+ReadUnaligned64(
+    IN CONST UINT64* Buffer
+)
+{
+    UINT64 Value;
+    __builtin_memcpy(&Value, Buffer, sizeof(Value));
+    return Value;
+}
+
+UINT64
+EFIAPI
+WriteUnaligned64(
+    OUT UINT64* Buffer,
+    IN  UINT64 Value
+)
+{
+    __builtin_memcpy(Buffer, &Value, sizeof(Value));
+    return Value;
+}
+
+UINT32
+EFIAPI
+InterlockedIncrement(
+    IN volatile UINT32* Value
+)
+{
+    return __atomic_add_fetch(Value, 1, __ATOMIC_SEQ_CST);
+}
+
+UINT64
+EFIAPI
+AsmReadTsc(
+    VOID
+)
+{
+    return __builtin_ia32_rdtsc();
+}
+
+UINT32
+EFIAPI
+AsmCpuidEx(
+    IN  UINT32 Index,
+    IN  UINT32 SubIndex,
+    OUT UINT32* RegisterEax OPTIONAL,
+    OUT UINT32* RegisterEbx OPTIONAL,
+    OUT UINT32* RegisterEcx OPTIONAL,
+    OUT UINT32* RegisterEdx OPTIONAL
+)
+{
+    UINT32 Eax;
+    UINT32 Ebx;
+    UINT32 Ecx;
+    UINT32 Edx;
+
+    __asm__ __volatile__("cpuid" : "=a"(Eax), "=b"(Ebx), "=c"(Ecx), "=d"(Edx) : "a"(Index), "c"(SubIndex));
+
+    if (RegisterEax)
+    {
+        *RegisterEax = Eax;
+    }
+    if (RegisterEbx)
+    {
+        *RegisterEbx = Ebx;
+    }
+    if (RegisterEcx)
+    {
+        *RegisterEcx = Ecx;
+    }
+    if (RegisterEdx)
+    {
+        *RegisterEdx = Edx;
+    }
+
+    return Index;
+}
+
+UINT32
+EFIAPI
+AsmCpuid(
+    IN  UINT32 Index,
+    OUT UINT32* RegisterEax OPTIONAL,
+    OUT UINT32* RegisterEbx OPTIONAL,
+    OUT UINT32* RegisterEcx OPTIONAL,
+    OUT UINT32* RegisterEdx OPTIONAL
+)
+{
+    return AsmCpuidEx(Index, 0, RegisterEax, RegisterEbx, RegisterEcx, RegisterEdx);
+}
+
+UINT64
+EFIAPI
+AsmReadMsr64(
+    IN UINT32 Index
+)
+{
+    (VOID)Index;
+    HostFatal("AsmReadMsr64 is privileged");
+    return 0;
+}
+
+UINT64
+EFIAPI
+AsmWriteMsr64(
+    IN UINT32 Index,
+    IN UINT64 Value
+)
+{
+    (VOID)Index;
+    (VOID)Value;
+    HostFatal("AsmWriteMsr64 is privileged");
+    return 0;
+}
+
+UINTN
+EFIAPI
+AsmWriteCr3(
+    UINTN Cr3
+)
+{
+    (VOID)Cr3;
+    HostFatal("AsmWriteCr3 is privileged");
+    return 0;
+}
+
+//
+//
+// MemoryAllocationLib, on top of the host boot services like UefiMemoryAllocationLib
+//
+//
+
+VOID*
+EFIAPI
+AllocatePages(
+    IN UINTN Pages
+)
+{
+    EFI_PHYSICAL_ADDRESS Memory;
+    if (!Pages || EFI_ERROR(gBS->AllocatePages(AllocateAnyPages, EfiBootServicesData, Pages, &Memory)))
+    {
+        return NULL;
+    }
+
+    return (VOID*)(UINTN)Memory;
+}
+
+VOID
+EFIAPI
+FreePages(
+    IN VOID* Buffer,
+    IN UINTN Pages
+)
+{
+    gBS->FreePages((EFI_PHYSICAL_ADDRESS)(UINTN)Buffer, Pages);
+}
+
+VOID*
+EFIAPI
+AllocatePool(
+    IN UINTN AllocationSize
+)
+{
+    VOID* Buffer;
+    return EFI_ERROR(gBS->AllocatePool(EfiBootServicesData, AllocationSize, &Buffer)) ? NULL : Buffer;
+}
+
+VOID*
+EFIAPI
+AllocateZeroPool(
+    IN UINTN AllocationSize
+)
+{
+    // host pool memory always comes zeroed, clear it anyway so that never matters
+    VOID* Buffer = AllocatePool(AllocationSize);
+    return Buffer ? ZeroMem(Buffer, AllocationSize) : NULL;
+}
+
+VOID*
+EFIAPI
+AllocateCopyPool(
+    IN UINTN AllocationSize,
+    IN CONST VOID* Buffer
+)
+{
+    VOID* Copy = AllocatePool(AllocationSize);
+    return Copy ? CopyMem(Copy, Buffer, AllocationSize) : NULL;
+}
+
+VOID*
+EFIAPI
+ReallocatePool(
+    IN UINTN OldSize,
+    IN UINTN NewSize,
+    IN VOID* OldBuffer OPTIONAL
+)
+{
+    VOID* NewBuffer = AllocateZeroPool(NewSize);
+    if (NewBuffer && OldBuffer)
+    {
+        CopyMem(NewBuffer, OldBuffer, MIN(OldSize, NewSize));
+        FreePool(OldBuffer);
+    }
+
+    return NewBuffer;
+}
+
+VOID
+EFIAPI
+FreePool(
+    IN VOID* Buffer
+)
+{
+    gBS->FreePool(Buffer);
+}
+
+//
+//
+// DevicePathLib
+//
+//
+
+BOOLEAN
+EFIAPI
+IsDevicePathEnd(
+    IN CONST VOID* Node
+)
+{
+    CONST EFI_DEVICE_PATH_PROTOCOL* Path = (CONST EFI_DEVICE_PATH_PROTOCOL*)Node;
+    return Path->Type == END_DEVICE_PATH_TYPE && Path->SubType == END_ENTIRE_DEVICE_PATH_SUBTYPE;
+}
+
+BOOLEAN
+EFIAPI
+IsDevicePathValid(
+    IN CONST EFI_DEVICE_PATH_PROTOCOL* DevicePath,
+    IN       UINTN MaxSize
+)
+{
+    // MaxSize 0 leaves the size unchecked, every node has to fit in what is left of it
+    UINTN Size = 0;
+    for (;;)
+    {
+        if (MaxSize && MaxSize - Size < sizeof(EFI_DEVICE_PATH_PROTOCOL))
+        {
+            return FALSE;
+        }
+
+        CONST EFI_DEVICE_PATH_PROTOCOL* Node = (CONST EFI_DEVICE_PATH_PROTOCOL*)((CONST UINT8*)DevicePath + Size);
+        UINTN                           Length = Node->Length[0] | Node->Length[1] << 8;
+        if (Length < sizeof(EFI_DEVICE_PATH_PROTOCOL) || (MaxSize && Length > MaxSize - Size))
+        {
+            return FALSE;
+        }
+
+        Size += Length;
+        if (IsDevicePathEnd(Node))
+        {
+            return Length == sizeof(EFI_DEVICE_PATH_PROTOCOL);
+        }
+    }
+}
+
+UINTN
+EFIAPI
+GetDevicePathSize(
+    IN CONST EFI_DEVICE_PATH_PROTOCOL* DevicePath
+)
+{
+    if (!DevicePath || !IsDevicePathValid(DevicePath, 0))
+    {
+        return 0;
+    }
+
+    CONST EFI_DEVICE_PATH_PROTOCOL* Node = DevicePath;
+    while (!IsDevicePathEnd(Node))
+    {
+        Node = (CONST EFI_DEVICE_PATH_PROTOCOL*)((CONST UINT8*)Node + (Node->Length[0] | Node->Length[1] << 8));
+    }
+
+    return (UINTN)((CONST UINT8*)Node - (CONST UINT8*)DevicePath) + sizeof(EFI_DEVICE_PATH_PROTOCOL);
+}
+
+EFI_DEVICE_PATH_PROTOCOL*
+EFIAPI
+DevicePathFromHandle(
+    IN EFI_HANDLE Handle
+)
+{
+    EFI_DEVICE_PATH_PROTOCOL* DevicePath;
+    return EFI_ERROR(gBS->HandleProtocol(Handle, &gEfiDevicePathProtocolGuid, (VOID**)&DevicePath)) ? NULL : DevicePath;
+}
+
+//
+//
+// PrintLib
+//
+//
+
+typedef struct _HOST_PRINT
+{
+    VOID*   Buffer;  // NULL when only counting
+    BOOLEAN Wide;    // Buffer holds CHAR16
+    UINTN   Limit;   // characters that fit, the terminator included
+    UINTN   Length;  // characters produced so far
+} HOST_PRINT;
+
+static
+VOID
+HostpPut(
+    _Inout_ HOST_PRINT* Print,
+    _In_    CHAR16 Char
+)
+{
+    if (Print->Buffer && Print->Length + 1 < Print->Limit)
+    {
+        if (Print->Wide)
+        {
+            ((CHAR16*)Print->Buffer)[Print->Length] = Char;
+        }
+        else
+        {
+            ((CHAR8*)Print->Buffer)[Print->Length] = (CHAR8)Char;
+        }
+    }
+    else if (Print->Buffer)
+    {
+        return;
+    }
+
+    Print->Length++;
+}
+
+static
+VOID
+HostpPad(
+    _Inout_ HOST_PRINT* Print,
+    _In_    CHAR16 Char,
+    _In_    UINTN Count
+)
+{
+    while (Count--)
+    {
+        HostpPut(Print, Char);
+    }
+}
+
+static
+CONST CHAR8*
+HostpStatusString(
+    _In_ RETURN_STATUS Status
+)
+{
+    static CONST CHAR8* CONST Errors[] =
+    {
+        "Success", "Load Error", "Invalid Parameter", "Unsupported", "Bad Buffer Size",
+        "Buffer Too Small", "Not Ready", "Device Error", "Write Protected", "Out of Resources",
+        "Volume Corrupt", "Volume Full", "No Media", "Media changed", "Not Found",
+        "Access Denied", "No Response", "No mapping", "Time out", "Not started",
+        "Already started", "Aborted", "ICMP Error", "TFTP Error", "Protocol Error",
+        "Incompatible Version", "Security Violation", "CRC Error", "End of Media", NULL,
+        NULL, "End of File", "Invalid Language", "Compromised Data"
+    };
+
+    static CONST CHAR8* CONST Warnings[] =
+    {
+        "Success", "Warning Unknown Glyph", "Warning Delete Failure", "Warning Write Failure",
+        "Warning Buffer Too Small", "Warning Stale Data"
+    };
+
+    UINTN Code = (UINTN)(Status & ~MAX_BIT);
+    if (Status & MAX_BIT)
+    {
+        return Code < ARRAY_SIZE(Errors) ? Errors[Code] : NULL;
+    }
+
+    return Code < ARRAY_SIZE(Warnings) ? Warnings[Code] : NULL;
+}
+
+/**
+* The formatter behind every PrintLib entry point. Format is CHAR16 when FormatWide is set.
+*/
+static
+UINTN
+HostpFormat(
+    _Inout_ HOST_PRINT* Print,
+    _In_    CONST VOID* Format,
+    _In_    BOOLEAN FormatWide,
+    _In_    VA_LIST Marker
+)
+{
+    CONST CHAR8*  Narrow = Format;
+    CONST CHAR16* Wide   = Format;
+    UINTN         At     = 0;
+
+#define NEXT() (FormatWide ? Wide[At] : (CHAR16)(UINT8)Narrow[At])
+
+    while (NEXT())
+    {
+        CHAR16 Char = NEXT();
+        At++;
+
+        if (Char != L'%')
+        {
+            HostpPut(Print, Char);
+            continue;
+        }
+
+        BOOLEAN Left      = FALSE;
+        BOOLEAN Zero      = FALSE;
+        BOOLEAN Plus      = FALSE;
+        BOOLEAN Space     = FALSE;
+        BOOLEAN Comma     = FALSE;
+        BOOLEAN Long      = FALSE;
+        UINTN   Width     = 0;
+        UINTN   Precision = 0;
+        BOOLEAN Precise   = FALSE;
+
+        for (;; At++)
+        {
+            Char = NEXT();
+            if (Char == L'-')
+            {
+                Left = TRUE;
+            }
+            else if (Char == L'0' && !Width)
+            {
+                Zero = TRUE;
+            }
+            else if (Char == L'+')
+            {
+                Plus = TRUE;
+            }
+            else if (Char == L' ')
+            {
+                Space = TRUE;
+            }
+            else if (Char == L',')
+            {
+                Comma = TRUE;
+            }
+            else if (Char == L'l' || Char == L'L')
+            {
+                Long = TRUE;
+            }
+            else if (Char == L'*')
+            {
+                if (Precise)
+                {
+                    Precision = VA_ARG(Marker, UINTN);
+                }
+                else
+                {
+                    Width = VA_ARG(Marker, UINTN);
+                }
+            }
+            else if (Char == L'.')
+            {
+                Precise = TRUE;
+            }
+            else if (Char >= L'0' && Char <= L'9')
+            {
+                if (Precise)
+                {
+                    Precision = Precision * 10 + (Char - L'0');
+                }
+                else
+                {
+                    Width = Width * 10 + (Char - L'0');
+                }
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if (!Char)
+        {
+            break;
+        }
+
+        At++;
+
+        CHAR8        Digits[32];
+        UINTN        DigitCount = 0;
+        CHAR8        Sign       = 0;
+        CONST CHAR8* Ascii      = NULL;
+        CONST CHAR16* Unicode   = NULL;
+        UINT64       Value;
+        UINTN        Base       = 10;
+
+        switch (Char)
+        {
+        case L'%':
+            HostpPut(Print, L'%');
+            continue;
+
+        case L'c':
+            {
+                CHAR16 Single = (CHAR16)VA_ARG(Marker, UINTN);
+                if (!Left && Width > 1)
+                {
+                    HostpPad(Print, L' ', Width - 1);
+                }
+                HostpPut(Print, Single);
+                if (Left && Width > 1)
+                {
+                    HostpPad(Print, L' ', Width - 1);
+                }
+                continue;
+            }
+
+        case L'a':
+            Ascii = VA_ARG(Marker, CONST CHAR8*);
+            if (!Ascii)
+            {
+                Ascii = "<null string>";
+            }
+            break;
+
+        case L's':
+        case L'S':
+            Unicode = VA_ARG(Marker, CONST CHAR16*);
+            if (!Unicode)
+            {
+                Ascii = "<null string>";
+            }
+            break;
+
+        case L'r':
+            {
+                RETURN_STATUS Status = VA_ARG(Marker, RETURN_STATUS);
+                Ascii = HostpStatusString(Status);
+                if (!Ascii)
+                {
+                    Value = Status;
+                    Base  = 16;
+                    Zero  = TRUE;
+                    Width = 16;
+                    goto Number;
+                }
+                break;
+            }
+
+        case L'g':
+            {
+                CONST EFI_GUID* Guid = VA_ARG(Marker, CONST EFI_GUID*);
+                CHAR8 Text[40];
+                if (!Guid)
+                {
+                    Ascii = "<null guid>";
+                    break;
+                }
+
+                AsciiSPrint(Text, sizeof(Text), "%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+                            Guid->Data1, Guid->Data2, Guid->Data3, Guid->Data4[0], Guid->Data4[1], Guid->Data4[2],
+                            Guid->Data4[3], Guid->Data4[4], Guid->Data4[5], Guid->Data4[6], Guid->Data4[7]);
+                for (UINTN i = 0; Text[i]; i++)
+                {
+                    HostpPut(Print, Text[i]);
+                }
+                continue;
+            }
+
+        case L't':
+            {
+                CONST EFI_TIME* Time = VA_ARG(Marker, CONST EFI_TIME*);
+                CHAR8 Text[24];
+                if (!Time)
+                {
+                    Ascii = "<null time>";
+                    break;
+                }
+
+                AsciiSPrint(Text, sizeof(Text), "%02d/%02d/%04d  %02d:%02d", Time->Month, Time->Day, Time->Year, Time->Hour, Time->Minute);
+                for (UINTN i = 0; Text[i]; i++)
+                {
+                    HostpPut(Print, Text[i]);
+                }
+                continue;
+            }
+
+        case L'p':
+            Value = (UINT64)(UINTN)VA_ARG(Marker, VOID*);
+            Base  = 16;
+            Zero  = TRUE;
+            Width = MAX(Width, (UINTN)16);
+            goto Number;
+
+        case L'X':
+            Zero = TRUE;
+            // fall through
+        case L'x':
+            Value = Long ? VA_ARG(Marker, UINT64) : (UINT64)(UINT32)VA_ARG(Marker, UINT32);
+            Base  = 16;
+            goto Number;
+
+        case L'u':
+            Value = Long ? VA_ARG(Marker, UINT64) : (UINT64)(UINT32)VA_ARG(Marker, UINT32);
+            goto Number;
+
+        case L'd':
+        case L'i':
+            {
+                INT64 Signed = Long ? VA_ARG(Marker, INT64) : (INT64)VA_ARG(Marker, INT32);
+                if (Signed < 0)
+                {
+                    Sign  = '-';
+                    Value = 0 - (UINT64)Signed;
+                }
+                else
+                {
+                    Sign  = Plus ? '+' : (Space ? ' ' : 0);
+                    Value = (UINT64)Signed;
+                }
+                goto Number;
+            }
+
+        default:
+            // unknown types are printed as they are
+            HostpPut(Print, Char);
+            continue;
+        }
+
+        // strings, Precision caps how much of them is printed
+        {
+            UINTN Length = 0;
+            while ((Ascii ? Ascii[Length] : Unicode[Length]) && (!Precise || Length < Precision))
+            {
+                Length++;
+            }
+
+            if (!Left && Width > Length)
+            {
+                HostpPad(Print, L' ', Width - Length);
+            }
+            for (UINTN i = 0; i < Length; i++)
+            {
+                HostpPut(Print, Ascii ? (CHAR16)(UINT8)Ascii[i] : Unicode[i]);
+            }
+            if (Left && Width > Length)
+            {
+                HostpPad(Print, L' ', Width - Length);
+            }
+            continue;
+        }
+
+Number:
+        {
+            UINTN Group = 0;
+            do
+            {
+                if (Comma && Base == 10 && Group == 3)
+                {
+                    Digits[DigitCount++] = ',';
+                    Group = 0;
+                }
+
+                Digits[DigitCount++] = "0123456789ABCDEF"[Value % Base];
+                Value /= Base;
+                Group++;
+            } while (Value);
+
+            while (Precise && DigitCount < Precision)
+            {
+                Digits[DigitCount++] = '0';
+            }
+
+            UINTN Length = DigitCount + (Sign ? 1 : 0);
+            if (Zero && !Left && !Comma)
+            {
+                if (Sign)
+                {
+                    HostpPut(Print, (CHAR16)Sign);
+                }
+                if (Width > Length)
+                {
+                    HostpPad(Print, L'0', Width - Length);
+                }
+            }
+            else
+            {
+                if (!Left && Width > Length)
+                {
+                    HostpPad(Print, L' ', Width - Length);
+                }
+                if (Sign)
+                {
+                    HostpPut(Print, (CHAR16)Sign);
+                }
+            }
+
+            while (DigitCount)
+            {
+                HostpPut(Print, (CHAR16)Digits[--DigitCount]);
+            }
+
+            if (Left && Width > Length)
+            {
+                HostpPad(Print, L' ', Width - Length);
+            }
+        }
+    }
+
+#undef NEXT
+
+    if (Print->Buffer && Print->Limit)
+    {
+        UINTN End = MIN(Print->Length, Print->Limit - 1);
+        if (Print->Wide)
+        {
+            ((CHAR16*)Print->Buffer)[End] = L'\0';
+        }
+        else
+        {
+            ((CHAR8*)Print->Buffer)[End] = '\0';
+        }
+
+        return End;
+    }
+
+    return Print->Length;
+}
+
+UINTN
+EFIAPI
+UnicodeVSPrint(
+    OUT CHAR16* StartOfBuffer,
+    IN  UINTN BufferSize,
+    IN  CONST CHAR16* FormatString,
+    IN  VA_LIST Marker
+)
+{
+    HOST_PRINT Print = { StartOfBuffer, TRUE, BufferSize / sizeof(CHAR16), 0 };
+    return HostpFormat(&Print, FormatString, TRUE, Marker);
+}
+
+UINTN
+EFIAPI
+UnicodeSPrint(
+    OUT CHAR16* StartOfBuffer,
+    IN  UINTN BufferSize,
+    IN  CONST CHAR16* FormatString,
+    ...
+)
+{
+    VA_LIST Marker;
+    VA_START(Marker, FormatString);
+    UINTN Length = UnicodeVSPrint(StartOfBuffer, BufferSize, FormatString, Marker);
+    VA_END(Marker);
+    return Length;
+}
+
+UINTN
+EFIAPI
+AsciiVSPrint(
+    OUT CHAR8* StartOfBuffer,
+    IN  UINTN BufferSize,
+    IN  CONST CHAR8* FormatString,
+    IN  VA_LIST Marker
+)
+{
+    HOST_PRINT Print = { StartOfBuffer, FALSE, BufferSize, 0 };
+    return HostpFormat(&Print, FormatString, FALSE, Marker);
+}
+
+UINTN
+EFIAPI
+AsciiSPrint(
+    OUT CHAR8* StartOfBuffer,
+    IN  UINTN BufferSize,
+    IN  CONST CHAR8* FormatString,
+    ...
+)
+{
+    VA_LIST Marker;
+    VA_START(Marker, FormatString);
+    UINTN Length = AsciiVSPrint(StartOfBuffer, BufferSize, FormatString, Marker);
+    VA_END(Marker);
+    return Length;
+}
+
+UINTN
+EFIAPI
+SPrintLength(
+    IN CONST CHAR16* FormatString,
+    IN VA_LIST Marker
+)
+{
+    HOST_PRINT Print = { NULL, TRUE, 0, 0 };
+    return HostpFormat(&Print, FormatString, TRUE, Marker);
+}
\ No newline at end of file
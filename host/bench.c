@@ -0,0 +1,378 @@
+#include "volume.h"
+#include "host.h"
+#include "../bootloader/filesystem.h"
+#include "../bootloader/fat.h"
+#include "../bootloader/image.h"
+#include "../bootloader/bundle.h"
+#include "../bootloader/trace.h"
+#include "../bootloader/log.h"
+#include "../bootloader/config.h"
+
+//
+//
+// Times the loader's read paths against a mock volume. Every case runs the real loader
+// code on a host directory, with device latency, bandwidth, block size and the queued
+// read protocols set from the command line:
+//
+//   bench [-d dir] [-l latency us] [-b bandwidth MB/s] [-B block size] [-c file chunk]
+//         [-x 0|1 ReadEx] [-2 0|1 BlockIo2] [-r runs] [-v]
+//
+// Numbers accept K and M suffixes. Each case prints the best and the median run, the
+// throughput of the median and the device requests one run took.
+//
+//
+
+#define BENCH_MAX_RUNS 64
+
+typedef enum _BENCH_KIND
+{
+    BenchImage,     // BlLoadPEImage64
+    BenchBundle,    // BlLoadBundle
+    BenchOpenRoot,  // EFI_FILE_PROTOCOL.Open from the root, one directory per component
+    BenchOpenIndex  // BlOpenVolumeFile, answered from the loader directory index
+} BENCH_KIND;
+
+typedef struct _BENCH_CASE
+{
+    CONST CHAR8*  Name;
+    CONST CHAR16* Path;
+    BENCH_KIND    Kind;
+    BOOLEAN       Raw; // read through BlFatOpen and BlockIo instead of the file protocol
+} BENCH_CASE;
+
+static CONST BENCH_CASE Cases[] =
+{
+    { "image",         L"kernel.exe",            BenchImage,     FALSE },
+    { "image raw",     L"kernel.exe",            BenchImage,     TRUE  },
+    { "packed",        L"kernel.lz4",            BenchImage,     FALSE },
+    { "packed raw",    L"kernel.lz4",            BenchImage,     TRUE  },
+    { "bundle",        L"boot.bnd",              BenchBundle,    FALSE },
+    { "bundle raw",    L"boot.bnd",              BenchBundle,    TRUE  },
+    { "open root",     L"EFI\\OpliOS\\oplios.cfg", BenchOpenRoot,  FALSE },
+    { "open index",    L"EFI\\OpliOS\\oplios.cfg", BenchOpenIndex, FALSE },
+};
+
+static BOOLEAN Verbose;
+
+static
+VOID
+BenchPrint(
+    _In_ CONST CHAR8* Format,
+    ...
+)
+{
+    CHAR8   Line[512];
+    VA_LIST Marker;
+
+    VA_START(Marker, Format);
+    UINTN Length = AsciiVSPrint(Line, sizeof(Line), Format, Marker);
+    VA_END(Marker);
+
+    HostWrite(Line, Length);
+}
+
+static
+VOID
+BenchUsage(
+    VOID
+)
+{
+    BenchPrint("usage: bench [-d dir] [-l latency us] [-b bandwidth MB/s] [-B block size] [-c file chunk]\n"
+               "             [-x 0|1 ReadEx] [-2 0|1 BlockIo2] [-r runs] [-v]\n");
+}
+
+/**
+* Parses a decimal or 0x number with an optional K or M suffix.
+*/
+static
+BOOLEAN
+BenchNumber(
+    _In_  CONST CHAR8* Text,
+    _Out_ UINT64* Value
+)
+{
+    UINT64 Base = 10;
+    *Value = 0;
+
+    if (Text[0] == '0' && (Text[1] == 'x' || Text[1] == 'X'))
+    {
+        Base  = 16;
+        Text += 2;
+    }
+
+    if (!*Text)
+    {
+        return FALSE;
+    }
+
+    for (; *Text; Text++)
+    {
+        UINT64 Digit;
+        if (*Text >= '0' && *Text <= '9')
+        {
+            Digit = *Text - '0';
+        }
+        else if (Base == 16 && (*Text | 0x20) >= 'a' && (*Text | 0x20) <= 'f')
+        {
+            Digit = (*Text | 0x20) - 'a' + 10;
+        }
+        else
+        {
+            break;
+        }
+
+        *Value = *Value * Base + Digit;
+    }
+
+    switch (*Text)
+    {
+    case 'K': case 'k': *Value <<= 10; Text++; break;
+    case 'M': case 'm': *Value <<= 20; Text++; break;
+    }
+
+    return !*Text;
+}
+
+/**
+* Runs one case once.
+*
+* @param Bytes    Receives the bytes the case read.
+* @param Requests Receives the device requests it took.
+*
+* @return The run time in nanoseconds, 0 if the case failed.
+*/
+static
+UINT64
+BenchRun(
+    _In_  CONST BENCH_CASE* Case,
+    _In_  UINT32 Volume,
+    _Out_ UINT64* Bytes,
+    _Out_ UINT64* Requests
+)
+{
+    CONST BL_VOLUME*       Entry = BlGetVolume(Volume);
+    HOST_VOLUME_STATISTICS Statistics;
+    EFI_FILE_PROTOCOL*     File = NULL;
+    BL_FAT_FILE            Raw;
+    BL_STATUS              Status = BL_STATUS_OK;
+
+    HostResetVolumeStatistics(Entry->Handle);
+    UINT64 Start = HostNow();
+
+    if (Case->Kind == BenchOpenRoot)
+    {
+        if (EFI_ERROR(Entry->Root->Open(Entry->Root, &File, (CHAR16*)Case->Path, EFI_FILE_MODE_READ, 0)))
+        {
+            Status = BL_STATUS_NOT_FOUND;
+        }
+    }
+    else if (!BlOpenVolumeFile(Volume, Case->Path, &File))
+    {
+        Status = BL_STATUS_NOT_FOUND;
+    }
+
+    if (BL_SUCCESS(Status) && Case->Raw)
+    {
+        CHAR16 Path[BL_CONFIG_MAX_PATH];
+        UnicodeSPrint(Path, sizeof(Path), L"\\%s", Case->Path);
+        Status = BlFatOpen(Entry->Handle, Path, &Raw);
+    }
+
+    *Bytes = 0;
+    if (BL_SUCCESS(Status) && Case->Kind == BenchImage)
+    {
+        BL_LOADED_IMAGE Image;
+        Status = BlLoadPEImage64(File, Case->Raw ? &Raw : NULL, &Image);
+        if (BL_SUCCESS(Status))
+        {
+            *Bytes = Image.BytesRead;
+            BlUnloadPEImage64(&Image);
+        }
+    }
+    else if (BL_SUCCESS(Status) && Case->Kind == BenchBundle)
+    {
+        BL_BOOT_BUNDLE Bundle;
+        Status = BlLoadBundle(File, Case->Raw ? &Raw : NULL, &Bundle);
+        if (BL_SUCCESS(Status))
+        {
+            *Bytes = Bundle.Header->BundleSize;
+            BlFreeBundle(&Bundle);
+        }
+    }
+
+    UINT64 Time = HostNow() - Start;
+
+    if (Case->Raw && BL_SUCCESS(Status))
+    {
+        BlFatClose(&Raw);
+    }
+
+    if (File)
+    {
+        File->Close(File);
+    }
+
+    HostGetVolumeStatistics(Entry->Handle, &Statistics);
+    *Requests = Statistics.FileRequests + Statistics.BlockRequests + Statistics.Lookups;
+
+    if (!BL_SUCCESS(Status))
+    {
+        BenchPrint("%-12a failed with 0x%x\n", Case->Name, Status);
+        return 0;
+    }
+
+    return Time;
+}
+
+static
+VOID
+BenchSort(
+    _Inout_ UINT64* Values,
+    _In_    UINT32 Count
+)
+{
+    for (UINT32 i = 1; i < Count; i++)
+    {
+        UINT64 Value = Values[i];
+        UINT32 j     = i;
+        for (; j && Values[j - 1] > Value; j--)
+        {
+            Values[j] = Values[j - 1];
+        }
+        Values[j] = Value;
+    }
+}
+
+INT32
+main(
+    INT32 Argc,
+    CHAR8** Argv
+)
+{
+    HOST_VOLUME_CONFIG Config;
+    UINT64             Runs = 5;
+
+    ZeroMem(&Config, sizeof(Config));
+    Config.Directory = "out/volume";
+    Config.Latency   = 100000;
+    Config.Bandwidth = 500ULL << 20;
+    Config.FileChunk = 0x10000;
+    Config.BlockSize = 512;
+    Config.ReadEx    = TRUE;
+    Config.BlockIo2  = TRUE;
+    Config.Boot      = TRUE;
+
+    for (INT32 i = 1; i < Argc; i++)
+    {
+        UINT64 Value = 0;
+
+        if (!AsciiStrnCmp(Argv[i], "-v", 3))
+        {
+            Verbose = TRUE;
+            continue;
+        }
+
+        if (Argv[i][0] != '-' || !Argv[i][1] || Argv[i][2] || i + 1 == Argc ||
+            (Argv[i][1] != 'd' && !BenchNumber(Argv[i + 1], &Value)))
+        {
+            BenchUsage();
+            return 2;
+        }
+
+        switch (Argv[i++][1])
+        {
+        case 'd': Config.Directory = Argv[i];                   break;
+        case 'l': Config.Latency   = Value * 1000;              break;
+        case 'b': Config.Bandwidth = Value << 20;               break;
+        case 'B': Config.BlockSize = (UINT32)Value;             break;
+        case 'c': Config.FileChunk = (UINT32)Value;             break;
+        case 'x': Config.ReadEx    = Value != 0;                break;
+        case '2': Config.BlockIo2  = Value != 0;                break;
+        case 'r': Runs             = MIN(MAX(Value, 1ULL), (UINT64)BENCH_MAX_RUNS); break;
+        default:
+            BenchUsage();
+            return 2;
+        }
+    }
+
+    HostFirmware.Quiet = !Verbose;
+    HostFirmwareInit();
+    BlLogInit();
+    BlTraceInit();
+
+    UINT32     Volume;
+    EFI_HANDLE Handle = HostMountVolume(&Config);
+    if (!Handle || !BlInitFileSystem() || !BlFindVolumeIndex(Handle, &Volume))
+    {
+        BenchPrint("cannot mount %a\n", Config.Directory);
+        return 1;
+    }
+
+    BenchPrint("%a: latency %lu us, %lu MB/s, file chunk %u, block %u, ReadEx %a, BlockIo2 %a, %lu runs\n",
+               Config.Directory, Config.Latency / 1000, Config.Bandwidth >> 20, Config.FileChunk, Config.BlockSize,
+               Config.ReadEx ? "on" : "off", Config.BlockIo2 ? "on" : "off", Runs);
+    BenchPrint("%-12a %10a %10a %10a %9a\n", "case", "best ms", "median ms", "MB/s", "requests");
+
+    INT32 Result = 0;
+    for (UINT32 c = 0; c < ARRAY_SIZE(Cases); c++)
+    {
+        CONST BENCH_CASE* Case = &Cases[c];
+        UINT64            Times[BENCH_MAX_RUNS];
+        UINT64            Bytes    = 0;
+        UINT64            Requests = 0;
+        HOST_ENTRY        Entry;
+        CHAR8             Path[512];
+
+        AsciiSPrint(Path, sizeof(Path), "%a/%s", Config.Directory, Case->Path);
+        for (UINTN i = 0; Path[i]; i++)
+        {
+            Path[i] = Path[i] == '\\' ? '/' : Path[i];
+        }
+
+        if (HostStat(Path, &Entry) || (Case->Raw && !Config.BlockSize))
+        {
+            continue;
+        }
+
+        UINT32 Done = 0;
+        for (; Done < Runs; Done++)
+        {
+            Times[Done] = BenchRun(Case, Volume, &Bytes, &Requests);
+            if (!Times[Done])
+            {
+                Result = 1;
+                break;
+            }
+        }
+
+        if (Done < Runs)
+        {
+            continue;
+        }
+
+        BenchSort(Times, Done);
+        UINT64 Median = Times[Done / 2];
+
+        // tenths of a MB/s, PrintLib has no floating point
+        UINT64 Rate = Bytes ? Bytes * 10000000000ULL / (Median << 20) : 0;
+        BenchPrint("%-12a %6lu.%03lu %6lu.%03lu %8lu.%lu %9lu\n", Case->Name,
+                   Times[0] / 1000000, Times[0] / 1000 % 1000, Median / 1000000, Median / 1000 % 1000,
+                   Rate / 10, Rate % 10, Requests);
+    }
+
+    HOST_FIRMWARE_STATISTICS Firmware;
+    HostGetFirmwareStatistics(&Firmware);
+    BenchPrint("firmware: %lu pages at most, %lu pool allocations, %lu waits sleeping %lu us\n",
+               Firmware.PagesAllocated, Firmware.PoolAllocations, Firmware.Waits, Firmware.WaitTime / 1000);
+
+    // the loader's own counters, over every run of every case
+    BlLogFlush();
+    HostFirmware.Quiet = FALSE;
+    BlTraceCalibrate();
+    BlTracePrintCounters();
+    BlLogFlush();
+
+    HostUnmountVolumes();
+    HostFirmwareReset();
+    return Result;
+}
\ No newline at end of file
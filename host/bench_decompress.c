@@ -0,0 +1,384 @@
+#include "compress.h"
+#include "host.h"
+#include "../bootloader/image.h"
+#include "../bootloader/lz4.h"
+
+//
+//
+// Compares a kernel stored, packed with LZ4 and compressed in the UEFI format that
+// EFI_DECOMPRESS_PROTOCOL takes:
+//
+//   bench_decompress [-r runs] packed image
+//
+// The image comes from a PackImage.py LZ4 file. Unpacked it is the stored form, and each
+// of its chunks is also compressed with HostCompress and decoded through the firmware's
+// protocol (decompress.c). Every decoder has to reproduce the image exactly.
+//
+// The first table is decode throughput. The second puts it against device bandwidth: a
+// chunk's read overlaps the decoding of the one before it, the way the loader streams
+// packed images, and stored chunks are read straight into place. Device latency is left
+// out, bench covers request costs.
+//
+//
+
+#define BENCH_MAX_RUNS 64
+
+typedef enum _BENCH_FORMAT
+{
+    BenchStored,
+    BenchLz4,
+    BenchEfi,
+    BenchFormats
+} BENCH_FORMAT;
+
+static CONST CHAR8* FormatNames[BenchFormats] = { "stored", "lz4", "efi" };
+
+// device bandwidths for the load estimate, MB/s
+static CONST UINT64 Bandwidths[] = { 50, 200, 1000, 3000 };
+
+typedef struct _BENCH_CHUNKS
+{
+    UINT32  Count;
+    UINT32  ChunkSize;
+    UINT64  ImageSize;
+    UINT8*  Image;                             // the unpacked reference
+    UINT8*  Packed[BenchFormats][BL_PACKED_IMAGE_MAX_CHUNKS];
+    UINT32  PackedSize[BenchFormats][BL_PACKED_IMAGE_MAX_CHUNKS];
+    UINT64  Time[BenchFormats][BL_PACKED_IMAGE_MAX_CHUNKS]; // decode ns of the median run
+} BENCH_CHUNKS;
+
+static EFI_DECOMPRESS_PROTOCOL* Decompress;
+static VOID*                    Scratch;
+static UINT32                   ScratchSize;
+
+static
+VOID
+BenchPrint(
+    _In_ CONST CHAR8* Format,
+    ...
+)
+{
+    CHAR8   Line[512];
+    VA_LIST Marker;
+
+    VA_START(Marker, Format);
+    UINTN Length = AsciiVSPrint(Line, sizeof(Line), Format, Marker);
+    VA_END(Marker);
+
+    HostWrite(Line, Length);
+}
+
+static
+UINT32
+BenchChunkSize(
+    _In_ CONST BENCH_CHUNKS* Chunks,
+    _In_ UINT32 Index
+)
+{
+    return (UINT32)MIN((UINT64)Chunks->ChunkSize, Chunks->ImageSize - (UINT64)Index * Chunks->ChunkSize);
+}
+
+/**
+* Unpacks one chunk in the given format.
+*
+* @return FALSE if the decoder failed or produced the wrong size.
+*/
+static
+BOOLEAN
+BenchDecode(
+    _In_  CONST BENCH_CHUNKS* Chunks,
+    _In_  BENCH_FORMAT Format,
+    _In_  UINT32 Index,
+    _Out_ UINT8* Destination
+)
+{
+    UINT32 Size   = BenchChunkSize(Chunks, Index);
+    UINT8* Source = Chunks->Packed[Format][Index];
+    UINT32 Packed = Chunks->PackedSize[Format][Index];
+    UINTN  Written;
+
+    switch (Format)
+    {
+    case BenchStored:
+        CopyMem(Destination, Source, Size);
+        return TRUE;
+    case BenchLz4:
+        if (Packed == Size)
+        {
+            CopyMem(Destination, Source, Size);
+            return TRUE;
+        }
+        return BlLz4Decompress(Source, Packed, Destination, Size, &Written) && Written == Size;
+    default:
+        return !EFI_ERROR(Decompress->Decompress(Decompress, Source, Packed, Destination, Size, Scratch, ScratchSize));
+    }
+}
+
+/**
+* Splits the LZ4 file into chunks, unpacks it into the reference image and compresses that
+* again for the other formats.
+*/
+static
+BOOLEAN
+BenchPrepare(
+    _In_  CONST UINT8* File,
+    _In_  UINT64 FileSize,
+    _Out_ BENCH_CHUNKS* Chunks
+)
+{
+    CONST BL_PACKED_IMAGE_HEADER* Header = (CONST BL_PACKED_IMAGE_HEADER*)File;
+
+    if (FileSize < sizeof(*Header) || Header->Signature != BL_PACKED_IMAGE_SIGNATURE ||
+        Header->Method != BlPackLz4 || !Header->ChunkSize || Header->ChunkCount > BL_PACKED_IMAGE_MAX_CHUNKS ||
+        Header->ImageSize > (UINT64)Header->ChunkSize * Header->ChunkCount)
+    {
+        return FALSE;
+    }
+
+    CONST UINT32* Sizes  = (CONST UINT32*)(Header + 1);
+    UINT64        Offset = sizeof(*Header) + Header->ChunkCount * sizeof(UINT32);
+
+    Chunks->Count     = Header->ChunkCount;
+    Chunks->ChunkSize = Header->ChunkSize;
+    Chunks->ImageSize = Header->ImageSize;
+    Chunks->Image     = HostAlloc(Header->ImageSize);
+
+    for (UINT32 i = 0; i < Chunks->Count; i++)
+    {
+        UINT32 Size = BenchChunkSize(Chunks, i);
+        if (Offset + Sizes[i] > FileSize)
+        {
+            return FALSE;
+        }
+
+        Chunks->Packed[BenchLz4][i]     = (UINT8*)File + Offset;
+        Chunks->PackedSize[BenchLz4][i] = Sizes[i];
+        Offset += Sizes[i];
+
+        UINT8* Chunk = Chunks->Image + (UINT64)i * Chunks->ChunkSize;
+        if (!BenchDecode(Chunks, BenchLz4, i, Chunk))
+        {
+            return FALSE;
+        }
+
+        Chunks->Packed[BenchStored][i]     = Chunk;
+        Chunks->PackedSize[BenchStored][i] = Size;
+
+        // incompressible data grows by a little more than its Huffman codes, 1/8 and the tables cover it
+        UINT32 Room = Size + Size / 8 + 4096;
+        Chunks->Packed[BenchEfi][i]     = HostAlloc(Room);
+        Chunks->PackedSize[BenchEfi][i] = HostCompress(Chunk, Size, Chunks->Packed[BenchEfi][i], Room);
+
+        UINT32 Needed;
+        UINT32 Unpacked;
+        if (!Chunks->PackedSize[BenchEfi][i] ||
+            EFI_ERROR(Decompress->GetInfo(Decompress, Chunks->Packed[BenchEfi][i], Chunks->PackedSize[BenchEfi][i],
+                                          &Unpacked, &Needed)) || Unpacked != Size)
+        {
+            return FALSE;
+        }
+
+        if (Needed > ScratchSize)
+        {
+            HostFree(Scratch);
+            Scratch     = HostAlloc(Needed);
+            ScratchSize = Needed;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+* Decodes every chunk of a format Runs times and keeps the per chunk times of the median run.
+*
+* @return FALSE if a decoder failed or its output differs from the reference.
+*/
+static
+BOOLEAN
+BenchFormat(
+    _Inout_ BENCH_CHUNKS* Chunks,
+    _In_    BENCH_FORMAT Format,
+    _In_    UINT32 Runs,
+    _Out_   UINT64* Best
+)
+{
+    UINT64  Totals[BENCH_MAX_RUNS];
+    UINT8*  Output = HostAlloc(Chunks->ImageSize);
+    UINT64* Times  = HostAlloc(sizeof(UINT64) * Runs * Chunks->Count);
+    BOOLEAN Result = TRUE;
+
+    for (UINT32 Run = 0; Run < Runs && Result; Run++)
+    {
+        Totals[Run] = 0;
+        for (UINT32 i = 0; i < Chunks->Count && Result; i++)
+        {
+            UINT64 Start = HostNow();
+            Result = BenchDecode(Chunks, Format, i, Output + (UINT64)i * Chunks->ChunkSize);
+            Times[Run * Chunks->Count + i] = HostNow() - Start;
+            Totals[Run] += Times[Run * Chunks->Count + i];
+        }
+    }
+
+    Result = Result && !CompareMem(Output, Chunks->Image, Chunks->ImageSize);
+    if (Result)
+    {
+        // the run whose total is the median, by selection so Totals keeps its order
+        UINT32 Median = 0;
+        *Best = MAX_UINT64;
+        for (UINT32 Run = 0; Run < Runs; Run++)
+        {
+            UINT32 Below = 0;
+            for (UINT32 Other = 0; Other < Runs; Other++)
+            {
+                Below += Totals[Other] < Totals[Run] || (Totals[Other] == Totals[Run] && Other < Run);
+            }
+
+            Median = Below == Runs / 2 ? Run : Median;
+            *Best  = MIN(*Best, Totals[Run]);
+        }
+
+        CopyMem(Chunks->Time[Format], Times + Median * Chunks->Count, sizeof(UINT64) * Chunks->Count);
+    }
+
+    HostFree(Output);
+    HostFree(Times);
+    return Result;
+}
+
+/**
+* Reads of a chunk start once the previous read is done, its decoding once both its data
+* and the previous chunk's decoding are.
+*
+* @return Nanoseconds until the last chunk is in place.
+*/
+static
+UINT64
+BenchLoadTime(
+    _In_ CONST BENCH_CHUNKS* Chunks,
+    _In_ BENCH_FORMAT Format,
+    _In_ UINT64 Bandwidth
+)
+{
+    UINT64 Read    = 0;
+    UINT64 Decoded = 0;
+
+    for (UINT32 i = 0; i < Chunks->Count; i++)
+    {
+        Read += Chunks->PackedSize[Format][i] * 1000000000ULL / Bandwidth;
+        if (Format != BenchStored)
+        {
+            Decoded = MAX(Read, Decoded) + Chunks->Time[Format][i];
+        }
+    }
+
+    return MAX(Read, Decoded);
+}
+
+INT32
+main(
+    INT32 Argc,
+    CHAR8** Argv
+)
+{
+    static BENCH_CHUNKS Chunks;
+    HOST_ENTRY          Entry;
+    UINT32              Runs = 7;
+    INT32               Path = 1;
+
+    if (Argc > 3 && !AsciiStrnCmp(Argv[1], "-r", 3))
+    {
+        Runs = 0;
+        for (CONST CHAR8* Digit = Argv[2]; *Digit >= '0' && *Digit <= '9'; Digit++)
+        {
+            Runs = Runs * 10 + (*Digit - '0');
+        }
+        Runs = MIN(MAX(Runs, 1u), (UINT32)BENCH_MAX_RUNS);
+        Path = 3;
+    }
+
+    if (Path + 1 != Argc)
+    {
+        BenchPrint("usage: bench_decompress [-r runs] packed image\n");
+        return 2;
+    }
+
+    HostFirmware.Quiet = TRUE;
+    HostFirmwareInit();
+
+    if (EFI_ERROR(gBS->LocateProtocol(&gEfiDecompressProtocolGuid, NULL, (VOID**)&Decompress)))
+    {
+        BenchPrint("no EFI_DECOMPRESS_PROTOCOL\n");
+        return 1;
+    }
+
+    INT32  File   = HostOpenFile(Argv[Path], 0);
+    UINT8* Buffer = NULL;
+    if (File < 0 || HostStat(Argv[Path], &Entry) || !(Buffer = HostAlloc(Entry.Size)) ||
+        HostReadFile(File, 0, Buffer, Entry.Size) != (INT64)Entry.Size)
+    {
+        BenchPrint("%a: cannot read\n", Argv[Path]);
+        return 1;
+    }
+    HostCloseFile(File);
+
+    if (!BenchPrepare(Buffer, Entry.Size, &Chunks))
+    {
+        BenchPrint("%a: not an LZ4 packed image or a chunk does not round trip\n", Argv[Path]);
+        return 1;
+    }
+
+    BenchPrint("%a: %lu KB image, %u chunks of %u KB, %u runs\n", Argv[Path], Chunks.ImageSize >> 10,
+               Chunks.Count, Chunks.ChunkSize >> 10, Runs);
+    BenchPrint("%-8a %10a %7a %10a %10a %9a\n", "format", "packed KB", "ratio", "best ms", "median ms", "MB/s");
+
+    INT32 Result = 0;
+    for (UINT32 Format = 0; Format < BenchFormats; Format++)
+    {
+        UINT64 Best;
+        if (!BenchFormat(&Chunks, Format, Runs, &Best))
+        {
+            BenchPrint("%-8a decodes to something else than the image\n", FormatNames[Format]);
+            Result = 1;
+            continue;
+        }
+
+        UINT64 Packed = 0;
+        UINT64 Median = 0;
+        for (UINT32 i = 0; i < Chunks.Count; i++)
+        {
+            Packed += Chunks.PackedSize[Format][i];
+            Median += Chunks.Time[Format][i];
+        }
+
+        // fixed point, PrintLib has no floating point
+        UINT64 Ratio = Packed * 1000 / Chunks.ImageSize;
+        UINT64 Rate  = Chunks.ImageSize * 10000000000ULL / (MAX(Median, 1ULL) << 20);
+        BenchPrint("%-8a %10lu %3lu.%lu%% %6lu.%03lu %6lu.%03lu %7lu.%lu\n", FormatNames[Format], Packed >> 10,
+                   Ratio / 10, Ratio % 10, Best / 1000000, Best / 1000 % 1000, Median / 1000000, Median / 1000 % 1000,
+                   Rate / 10, Rate % 10);
+    }
+
+    if (!Result)
+    {
+        BenchPrint("\nload ms, read overlapped with decoding\n%-8a", "MB/s");
+        for (UINT32 Format = 0; Format < BenchFormats; Format++)
+        {
+            BenchPrint(" %10a", FormatNames[Format]);
+        }
+
+        for (UINT32 b = 0; b < ARRAY_SIZE(Bandwidths); b++)
+        {
+            BenchPrint("\n%-8lu", Bandwidths[b]);
+            for (UINT32 Format = 0; Format < BenchFormats; Format++)
+            {
+                UINT64 Time = BenchLoadTime(&Chunks, Format, Bandwidths[b] << 20);
+                BenchPrint(" %6lu.%03lu", Time / 1000000, Time / 1000 % 1000);
+            }
+        }
+        BenchPrint("\n");
+    }
+
+    HostFirmwareReset();
+    return Result;
+}
\ No newline at end of file
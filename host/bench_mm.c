@@ -0,0 +1,360 @@
+#include "host.h"
+#include "../kernal/mm.h"
+#include <intrin.h>
+
+//
+//
+// Times the page allocator on 1 GiB of host memory with a few holes in the map:
+//
+//   bench_mm [-r runs]
+//
+// MmInitialize over the whole map, then for each workload the best of the runs in
+// nanoseconds per allocation and free. A batch workload takes Count blocks and frees them
+// all again, so magazines fill and drain and the free lists split and merge, a hot one frees
+// each block straight after taking it, what a page fault that is undone looks like.
+//
+// The scaling workloads then run on 1 to BENCH_MAX_THREADS host threads at once, each one a
+// processor with its own magazines. Ideal scaling is the thread count as long as the host
+// has that many cores, past that the threads share them and the total cannot grow.
+//
+//
+
+#define BENCH_MEMORY   (1ULL << 30)
+#define BENCH_FRAMES   (BENCH_MEMORY >> MM_PAGE_SHIFT)
+#define BENCH_MAX_RUNS 64
+#define BENCH_CALLS    200000 // allocations per timed run, per thread
+#define BENCH_MAX_THREADS 8
+
+typedef struct _BENCH_WORKLOAD
+{
+    CONST CHAR8* Name;
+    UINT64       Pages;      // 2^Order for MmAllocatePages
+    UINT32       Order;
+    BOOLEAN      Contiguous;
+    UINT32       Count;      // blocks held at once, 1 for a hot workload
+} BENCH_WORKLOAD;
+
+typedef struct _BENCH_BOOT
+{
+    BOOT_INFO         Info;
+    BOOT_MEMORY_RANGE Ranges[4];
+} BENCH_BOOT;
+
+static CONST BENCH_WORKLOAD Workloads[] =
+{
+    { "order 0 batch",  1,    0,              FALSE, 16384 },
+    { "order 0 hot",    1,    0,              FALSE, 1     },
+    { "order 1 batch",  2,    1,              FALSE, 8192  },
+    { "order 1 hot",    2,    1,              FALSE, 1     },
+    { "order 4 batch",  16,   4,              FALSE, 1024  },
+    { "order 9 batch",  512,  MM_LARGE_ORDER, FALSE, 64    },
+    { "order 9 hot",    512,  MM_LARGE_ORDER, FALSE, 1     },
+    { "order 12 batch", 4096, 12,             FALSE, 16    },
+    { "3 pages batch",  3,    0,              TRUE,  4096  },
+    { "300 pages hot",  300,  0,              TRUE,  1     },
+};
+
+static CONST BOOT_MEMORY_RANGE Ranges[] =
+{
+    { 0x100000,  0x700,                                BootMemoryFree,     0 },
+    { 0x800000,  0x1,                                  BootMemoryBootInfo, 0 },
+    { 0x801000,  0x1FF,                                BootMemoryLoader,   0 },
+    { 0xA00000,  (UINT32)(BENCH_FRAMES - 0xA00 - 0x100), BootMemoryFree,   0 },
+};
+
+// magazine orders within what a magazine holds, and an order that takes the lock every time
+static CONST BENCH_WORKLOAD ScalingWorkloads[] =
+{
+    { "order 0 batch",  1,    0,              FALSE, 64 },
+    { "order 0 hot",    1,    0,              FALSE, 1  },
+    { "order 9 hot",    512,  MM_LARGE_ORDER, FALSE, 1  },
+    { "order 1 hot",    2,    1,              FALSE, 1  },
+};
+
+static UINT64 Blocks[16384];
+static UINT64 ThreadBlocks[BENCH_MAX_THREADS][64];
+static UINT64 ThreadBases[BENCH_MAX_THREADS]; // the gs base of processor 1 + i once it has one
+static volatile long ThreadFailed;
+
+static
+BOOT_INFO*
+BenchBootInfo(
+    VOID
+)
+{
+    UINT8* Memory = (UINT8*)(UINTN)HostMapPages(0, BENCH_FRAMES, MM_ANY_ADDRESS);
+    if (!Memory)
+    {
+        HostFatal("cannot map the bench memory");
+    }
+
+    BENCH_BOOT* Boot = (BENCH_BOOT*)(Memory + 0x800000);
+    for (UINT32 i = 0; i < sizeof(Ranges) / sizeof(Ranges[0]); i++)
+    {
+        Boot->Ranges[i] = Ranges[i];
+    }
+
+    Boot->Info.Signature        = BOOT_INFO_SIGNATURE;
+    Boot->Info.Version          = BOOT_INFO_VERSION;
+    Boot->Info.HeaderSize       = sizeof(BOOT_INFO);
+    Boot->Info.MemoryMap        = 0x800000 + __builtin_offsetof(BENCH_BOOT, Ranges);
+    Boot->Info.MemoryRangeCount = sizeof(Ranges) / sizeof(Ranges[0]);
+    Boot->Info.MemoryRangeSize  = sizeof(BOOT_MEMORY_RANGE);
+    Boot->Info.DirectMapBase    = (UINT64)(UINTN)Memory;
+    Boot->Info.DirectMapSize    = BENCH_MEMORY;
+    return &Boot->Info;
+}
+
+static
+UINT64
+BenchAllocate(
+    _In_ CONST BENCH_WORKLOAD* Workload
+)
+{
+    if (Workload->Contiguous)
+    {
+        return MmAllocateContiguous(Workload->Pages, MM_ANY_ADDRESS);
+    }
+
+    return MmAllocatePages(Workload->Order);
+}
+
+static
+VOID
+BenchFree(
+    _In_ CONST BENCH_WORKLOAD* Workload,
+    _In_ UINT64 Address
+)
+{
+    if (Workload->Contiguous)
+    {
+        MmFreeContiguous(Address, Workload->Pages);
+    }
+    else
+    {
+        MmFreePages(Address, Workload->Order);
+    }
+}
+
+/**
+* Allocates and frees BENCH_CALLS blocks, Count at a time.
+*
+* @return FALSE if an allocation failed.
+*/
+static
+BOOLEAN
+BenchRun(
+    _In_  CONST BENCH_WORKLOAD* Workload,
+    _Out_ UINT64* Held
+)
+{
+    for (UINT64 Round = 0; Round < BENCH_CALLS / Workload->Count; Round++)
+    {
+        for (UINT32 i = 0; i < Workload->Count; i++)
+        {
+            Held[i] = BenchAllocate(Workload);
+            if (!Held[i])
+            {
+                return FALSE;
+            }
+        }
+
+        for (UINT32 i = 0; i < Workload->Count; i++)
+        {
+            BenchFree(Workload, Held[i]);
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+* @return The best of Runs timed runs in picoseconds per allocation and free, 0 if an
+*         allocation failed.
+*/
+static
+UINT64
+BenchTime(
+    _In_ CONST BENCH_WORKLOAD* Workload,
+    _In_ UINT32 Runs
+)
+{
+    UINT64 Best = ~0ULL;
+
+    for (UINT32 Run = 0; Run < Runs; Run++)
+    {
+        UINT64 Start = HostNow();
+        if (!BenchRun(Workload, Blocks))
+        {
+            return 0;
+        }
+
+        UINT64 Elapsed = HostNow() - Start;
+        Best = Elapsed < Best ? Elapsed : Best;
+    }
+
+    return Best * 1000 / (BENCH_CALLS / Workload->Count * Workload->Count);
+}
+
+/**
+* A scaling run on one thread. The thread takes over processor 1 + Index, a new host thread
+* comes up with no gs base, as a processor would after a reset.
+*/
+static
+VOID
+BenchThread(
+    _In_ VOID* Context,
+    _In_ UINT32 Index
+)
+{
+    CONST BENCH_WORKLOAD* Workload = Context;
+
+    if (ThreadBases[Index])
+    {
+        __writemsr(HOST_MSR_GS_BASE, ThreadBases[Index]);
+    }
+    else if (MmInitializeProcessor(Index + 1))
+    {
+        ThreadBases[Index] = HostGsBase;
+    }
+    else
+    {
+        HostFatal("MmInitializeProcessor failed");
+    }
+
+    if (!BenchRun(Workload, ThreadBlocks[Index]))
+    {
+        _InterlockedExchange(&ThreadFailed, 1);
+    }
+}
+
+/**
+* Runs every scaling workload on 1, 2, 4 and 8 threads.
+*
+* @return FALSE if an allocation failed.
+*/
+static
+BOOLEAN
+BenchScaling(
+    _In_ UINT32 Runs
+)
+{
+    HostPrint("\n%u host processors\n", HostProcessorCount());
+    HostPrint("%-16s %7s %10s %10s %8s\n", "workload", "threads", "ns/pair", "Mpairs/s", "scaling");
+
+    for (UINT32 w = 0; w < sizeof(ScalingWorkloads) / sizeof(ScalingWorkloads[0]); w++)
+    {
+        CONST BENCH_WORKLOAD* Workload = &ScalingWorkloads[w];
+        UINT64                Single   = 0; // pairs per second on one thread
+
+        for (UINT32 Threads = 1; Threads <= BENCH_MAX_THREADS; Threads *= 2)
+        {
+            UINT64 Best = ~0ULL;
+
+            for (UINT32 Run = 0; Run < Runs; Run++)
+            {
+                UINT64 Elapsed = HostRunThreads(Threads, BenchThread, (VOID*)Workload);
+                Best = Elapsed < Best ? Elapsed : Best;
+            }
+
+            if (ThreadFailed)
+            {
+                HostPrint("%-16s ran out of memory\n", Workload->Name);
+                return FALSE;
+            }
+
+            // every thread makes BENCH_CALLS pairs, ns/pair is the wall time one of them takes
+            UINT64 Pairs   = (UINT64)BENCH_CALLS * Threads;
+            UINT64 Rate    = Pairs * 1000000000ULL / Best;
+            UINT64 Time    = Best * 1000 / BENCH_CALLS;
+            Single         = Single ? Single : Rate;
+            UINT64 Scaling = Rate * 100 / Single;
+
+            HostPrint("%-16s %7u %6llu.%03llu %6llu.%03llu %5llu.%02llux\n", Workload->Name, Threads,
+                      Time / 1000, Time % 1000, Rate / 1000000, Rate / 1000 % 1000,
+                      Scaling / 100, Scaling % 100);
+        }
+    }
+
+    return TRUE;
+}
+
+INT32
+main(
+    INT32 Argc,
+    CHAR8** Argv
+)
+{
+    UINT32 Runs = 5;
+
+    if (Argc == 3 && Argv[1][0] == '-' && Argv[1][1] == 'r' && !Argv[1][2])
+    {
+        Runs = 0;
+        for (CONST CHAR8* Digit = Argv[2]; *Digit >= '0' && *Digit <= '9'; Digit++)
+        {
+            Runs = Runs * 10 + (*Digit - '0');
+        }
+        Runs = Runs < 1 ? 1 : Runs > BENCH_MAX_RUNS ? BENCH_MAX_RUNS : Runs;
+    }
+    else if (Argc != 1)
+    {
+        HostPrint("usage: bench_mm [-r runs]\n");
+        return 2;
+    }
+
+    BOOT_INFO* BootInfo = BenchBootInfo();
+    UINT64     Start    = HostNow();
+
+    if (!MmInitialize(BootInfo) || !MmInitializeProcessor(0))
+    {
+        HostPrint("MmInitialize failed\n");
+        return 1;
+    }
+
+    MM_STATISTICS Statistics;
+    MmQueryStatistics(&Statistics);
+    HostPrint("MmInitialize %llu pages in %llu us, %llu KiB of page array\n",
+              Statistics.TotalPages, (HostNow() - Start) / 1000, Statistics.MetadataSize / 1024);
+    HostPrint("%-16s %6s %10s\n", "workload", "held", "ns/pair");
+
+    INT32 Result = 0;
+    for (UINT32 w = 0; w < sizeof(Workloads) / sizeof(Workloads[0]); w++)
+    {
+        CONST BENCH_WORKLOAD* Workload = &Workloads[w];
+        UINT64                Time     = BenchTime(Workload, Runs);
+
+        if (!Time)
+        {
+            HostPrint("%-16s ran out of memory\n", Workload->Name);
+            Result = 1;
+            continue;
+        }
+
+        HostPrint("%-16s %6u %6llu.%03llu\n", Workload->Name, Workload->Count, Time / 1000, Time % 1000);
+    }
+
+    // the counters are for processor 0, the single thread workloads above
+
+    MM_PROCESSOR_STATISTICS Processor;
+    MmQueryProcessorStatistics(0, &Processor);
+    for (UINT32 i = 0; i < MM_CACHED_ORDERS; i++)
+    {
+        CONST MM_CACHE_COUNTERS* Counters  = &Processor.Counters[i];
+        UINT64                   Allocated = Counters->AllocateHits + Counters->AllocateMisses;
+        UINT64                   Freed     = Counters->FreeHits + Counters->FreeMisses;
+
+        HostPrint("order %u magazine: %llu.%02llu%% of allocations and %llu.%02llu%% of frees took no lock\n",
+                  i ? MM_LARGE_ORDER : 0,
+                  Counters->AllocateHits * 100 / (Allocated ? Allocated : 1),
+                  Counters->AllocateHits * 10000 / (Allocated ? Allocated : 1) % 100,
+                  Counters->FreeHits * 100 / (Freed ? Freed : 1),
+                  Counters->FreeHits * 10000 / (Freed ? Freed : 1) % 100);
+    }
+
+    if (!BenchScaling(Runs))
+    {
+        Result = 1;
+    }
+
+    return Result;
+}
\ No newline at end of file
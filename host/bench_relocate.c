@@ -0,0 +1,248 @@
+#include "firmware.h"
+#include "host.h"
+#include "../bootloader/image.h"
+
+//
+//
+// Times BlRebasePEImage64 on synthetic images (SynthImage.py) against a plain loop that
+// takes one relocation entry at a time, the way EDK2's PeCoffLoaderRelocateImage does:
+//
+//   bench_relocate [-r runs] image...
+//
+// Every image is loaded once from memory, then fixed up back and forth between two bases.
+// After the timed passes the loader's copy and the reference copy must match byte for byte.
+//
+//
+
+#define BENCH_MAX_RUNS 64
+#define BENCH_SHIFT    SIZE_2MB // distance between the two bases
+
+static
+VOID
+BenchPrint(
+    _In_ CONST CHAR8* Format,
+    ...
+)
+{
+    CHAR8   Line[512];
+    VA_LIST Marker;
+
+    VA_START(Marker, Format);
+    UINTN Length = AsciiVSPrint(Line, sizeof(Line), Format, Marker);
+    VA_END(Marker);
+
+    HostWrite(Line, Length);
+}
+
+/**
+* The reference: every entry goes through the type switch with its own bounds check.
+*
+* @return Fixups applied, MAX_UINT64 on a malformed table.
+*/
+static
+UINT64
+BenchReferenceRelocate(
+    _Inout_ UINT8* Base,
+    _In_    UINT64 ImageSize,
+    _In_    UINT32 NtHeaders,
+    _In_    UINT64 VirtualBase
+)
+{
+    EFI_IMAGE_NT_HEADERS64*   Headers   = (EFI_IMAGE_NT_HEADERS64*)(Base + NtHeaders);
+    EFI_IMAGE_DATA_DIRECTORY* Directory = &Headers->OptionalHeader.DataDirectory[EFI_IMAGE_DIRECTORY_ENTRY_BASERELOC];
+    UINT64                    Delta     = VirtualBase - Headers->OptionalHeader.ImageBase;
+    UINT64                    Fixups    = 0;
+
+    UINT8* Block    = Base + Directory->VirtualAddress;
+    UINT8* BlockEnd = Block + Directory->Size;
+
+    while (Block < BlockEnd)
+    {
+        EFI_IMAGE_BASE_RELOCATION* Relocation = (EFI_IMAGE_BASE_RELOCATION*)Block;
+        UINT16*                    Entry      = (UINT16*)(Relocation + 1);
+        UINT16*                    EntryEnd   = (UINT16*)(Block + Relocation->SizeOfBlock);
+
+        if (Relocation->SizeOfBlock < sizeof(EFI_IMAGE_BASE_RELOCATION) || (UINT8*)EntryEnd > BlockEnd)
+        {
+            return MAX_UINT64;
+        }
+
+        for (; Entry < EntryEnd; Entry++)
+        {
+            UINT64 Rva = Relocation->VirtualAddress + (*Entry & 0xFFF);
+
+            switch (*Entry >> 12)
+            {
+            case EFI_IMAGE_REL_BASED_ABSOLUTE:
+                break;
+            case EFI_IMAGE_REL_BASED_HIGHLOW:
+                if (Rva + sizeof(UINT32) > ImageSize)
+                {
+                    return MAX_UINT64;
+                }
+                *(UINT32*)(Base + Rva) += (UINT32)Delta;
+                Fixups++;
+                break;
+            case EFI_IMAGE_REL_BASED_DIR64:
+                if (Rva + sizeof(UINT64) > ImageSize)
+                {
+                    return MAX_UINT64;
+                }
+                *(UINT64*)(Base + Rva) += Delta;
+                Fixups++;
+                break;
+            default:
+                return MAX_UINT64;
+            }
+        }
+
+        Block = (UINT8*)EntryEnd;
+    }
+
+    Headers->OptionalHeader.ImageBase = VirtualBase;
+    return Fixups;
+}
+
+static
+UINT64
+BenchMedian(
+    _Inout_ UINT64* Values,
+    _In_    UINT32 Count
+)
+{
+    for (UINT32 i = 1; i < Count; i++)
+    {
+        UINT64 Value = Values[i];
+        UINT32 j     = i;
+        for (; j && Values[j - 1] > Value; j--)
+        {
+            Values[j] = Values[j - 1];
+        }
+        Values[j] = Value;
+    }
+
+    return Values[Count / 2];
+}
+
+/**
+* @return FALSE if the image could not be loaded or the two copies disagree.
+*/
+static
+BOOLEAN
+BenchImage(
+    _In_ CONST CHAR8* Path,
+    _In_ UINT32 Runs
+)
+{
+    HOST_ENTRY      Entry;
+    BL_LOADED_IMAGE Image;
+    UINT64          Loader[BENCH_MAX_RUNS];
+    UINT64          Reference[BENCH_MAX_RUNS];
+
+    INT32 File = HostOpenFile(Path, 0);
+    if (File < 0 || HostStat(Path, &Entry))
+    {
+        BenchPrint("%a: cannot open\n", Path);
+        return FALSE;
+    }
+
+    UINT8* Buffer = HostAlloc(Entry.Size);
+    BOOLEAN Read  = Buffer && HostReadFile(File, 0, Buffer, Entry.Size) == (INT64)Entry.Size;
+    HostCloseFile(File);
+
+    BL_STATUS Status = Read ? BlLoadPEImage64FromMemory(Buffer, Entry.Size, &Image) : BL_STATUS_READ_ERROR;
+    HostFree(Buffer);
+    if (!BL_SUCCESS(Status))
+    {
+        BenchPrint("%a: cannot load, 0x%x\n", Path, Status);
+        return FALSE;
+    }
+
+    // the reference copy starts out fixed up for the same base as the loader's
+    UINT8* Copy = HostAlloc(Image.ImageSize);
+    UINT8* Base = (UINT8*)(UINTN)Image.ImageBase;
+    CopyMem(Copy, Base, Image.ImageSize);
+
+    UINT64  Fixups  = 0;
+    BOOLEAN Matches = TRUE;
+    for (UINT32 Run = 0; Run < Runs && Matches; Run++)
+    {
+        UINT64 Target = Image.ImageBase + ((Run & 1) ? 0 : BENCH_SHIFT);
+
+        UINT64 Start = HostNow();
+        Status = BlRebasePEImage64(&Image, Target);
+        Loader[Run] = HostNow() - Start;
+
+        Start = HostNow();
+        Fixups = BenchReferenceRelocate(Copy, Image.ImageSize, Image.NtHeaders, Target);
+        Reference[Run] = HostNow() - Start;
+
+        Matches = BL_SUCCESS(Status) && Fixups == Image.Relocations && !CompareMem(Copy, Base, Image.ImageSize);
+    }
+
+    if (!Matches)
+    {
+        BenchPrint("%a: loader and reference fixups differ\n", Path);
+    }
+    else
+    {
+        UINT64 Fast = BenchMedian(Loader, Runs);
+        UINT64 Slow = BenchMedian(Reference, Runs);
+
+        // fixed point, PrintLib has no floating point
+        UINT64 Speedup = Slow * 100 / MAX(Fast, 1ULL);
+        BenchPrint("%-28a %5lu MB %9lu %8lu.%03lu %8lu.%03lu %5lu.%02lu %6lu.%02lux\n",
+                   Path, Image.ImageSize >> 20, Fixups,
+                   Fast / 1000, Fast % 1000, Slow / 1000, Slow % 1000,
+                   Fast * 100 / MAX(Fixups, 1ULL) / 100, Fast * 100 / MAX(Fixups, 1ULL) % 100,
+                   Speedup / 100, Speedup % 100);
+    }
+
+    HostFree(Copy);
+    BlUnloadPEImage64(&Image);
+    return Matches;
+}
+
+INT32
+main(
+    INT32 Argc,
+    CHAR8** Argv
+)
+{
+    UINT32 Runs  = 21;
+    INT32  First = 1;
+
+    if (Argc > 2 && !AsciiStrnCmp(Argv[1], "-r", 3))
+    {
+        Runs  = 0;
+        for (CONST CHAR8* Digit = Argv[2]; *Digit >= '0' && *Digit <= '9'; Digit++)
+        {
+            Runs = Runs * 10 + (*Digit - '0');
+        }
+        Runs  = MIN(MAX(Runs, 2u), (UINT32)BENCH_MAX_RUNS);
+        First = 3;
+    }
+
+    if (First >= Argc)
+    {
+        BenchPrint("usage: bench_relocate [-r runs] image...\n");
+        return 2;
+    }
+
+    HostFirmware.Quiet = TRUE;
+    HostFirmwareInit();
+
+    BenchPrint("%-28a %8a %9a %12a %12a %8a %8a\n", "image", "size", "fixups", "loader us", "scalar us", "ns/fixup", "speedup");
+
+    INT32 Result = 0;
+    for (INT32 i = First; i < Argc; i++)
+    {
+        if (!BenchImage(Argv[i], Runs))
+        {
+            Result = 1;
+        }
+    }
+
+    HostFirmwareReset();
+    return Result;
+}
\ No newline at end of file
@@ -0,0 +1,264 @@
+#include "firmware.h"
+#include "host.h"
+#include "../kernal/rtl.h"
+
+//
+//
+// Times the rtl.h routines against the character at a time loops EDK2's BaseLib and
+// BaseMemoryLib use, which the host baselib.c reproduces:
+//
+//   bench_rtl [-r runs]
+//
+// Strings and buffers start one byte (ASCII, memory) or one character (UCS-2) past a 16
+// byte boundary, compared buffers are equal so the whole length is scanned. Both sides are
+// called through the same function pointer table, so call overhead is the same.
+//
+//
+
+#define BENCH_MAX_RUNS 64
+#define BENCH_BYTES    SIZE_4MB  // scanned per timed run
+#define BENCH_LONGEST  16384     // characters or bytes
+
+typedef
+UINTN
+(*BENCH_ROUTINE)(
+    _In_ CONST VOID* First,
+    _In_ CONST VOID* Second,
+    _In_ UINTN Length
+);
+
+typedef struct _BENCH_CASE
+{
+    CONST CHAR8*  Name;
+    UINTN         Unit;   // bytes per character
+    BENCH_ROUTINE Rtl;
+    BENCH_ROUTINE Scalar;
+} BENCH_CASE;
+
+static
+UINTN
+BenchRtlAscii(
+    _In_ CONST VOID* First,
+    _In_ CONST VOID* Second,
+    _In_ UINTN Length
+)
+{
+    return RtlAsciiLength(First);
+}
+
+static
+UINTN
+BenchEdkAscii(
+    _In_ CONST VOID* First,
+    _In_ CONST VOID* Second,
+    _In_ UINTN Length
+)
+{
+    return AsciiStrLen(First);
+}
+
+static
+UINTN
+BenchRtlString(
+    _In_ CONST VOID* First,
+    _In_ CONST VOID* Second,
+    _In_ UINTN Length
+)
+{
+    return RtlStringLength(First);
+}
+
+static
+UINTN
+BenchEdkString(
+    _In_ CONST VOID* First,
+    _In_ CONST VOID* Second,
+    _In_ UINTN Length
+)
+{
+    return StrLen(First);
+}
+
+static
+UINTN
+BenchRtlCompare(
+    _In_ CONST VOID* First,
+    _In_ CONST VOID* Second,
+    _In_ UINTN Length
+)
+{
+    return RtlStringCompare(First, Second);
+}
+
+static
+UINTN
+BenchEdkCompare(
+    _In_ CONST VOID* First,
+    _In_ CONST VOID* Second,
+    _In_ UINTN Length
+)
+{
+    return StrCmp(First, Second);
+}
+
+static
+UINTN
+BenchRtlMemory(
+    _In_ CONST VOID* First,
+    _In_ CONST VOID* Second,
+    _In_ UINTN Length
+)
+{
+    return RtlCompareMemory(First, Second, Length);
+}
+
+static
+UINTN
+BenchEdkMemory(
+    _In_ CONST VOID* First,
+    _In_ CONST VOID* Second,
+    _In_ UINTN Length
+)
+{
+    return CompareMem(First, Second, Length);
+}
+
+static CONST BENCH_CASE Cases[] =
+{
+    { "AsciiStrLen",   sizeof(CHAR8),  BenchRtlAscii,   BenchEdkAscii   },
+    { "StrLen",        sizeof(CHAR16), BenchRtlString,  BenchEdkString  },
+    { "StrCmp",        sizeof(CHAR16), BenchRtlCompare, BenchEdkCompare },
+    { "CompareMem",    sizeof(UINT8),  BenchRtlMemory,  BenchEdkMemory  },
+};
+
+static CONST UINTN Lengths[] = { 7, 31, 127, 1023, BENCH_LONGEST - 1 };
+
+static
+VOID
+BenchPrint(
+    _In_ CONST CHAR8* Format,
+    ...
+)
+{
+    CHAR8   Line[512];
+    VA_LIST Marker;
+
+    VA_START(Marker, Format);
+    UINTN Length = AsciiVSPrint(Line, sizeof(Line), Format, Marker);
+    VA_END(Marker);
+
+    HostWrite(Line, Length);
+}
+
+/**
+* @return The best of Runs timed runs, in picoseconds per call.
+*/
+static
+UINT64
+BenchTime(
+    _In_    BENCH_ROUTINE Routine,
+    _In_    CONST UINT8* First,
+    _In_    CONST UINT8* Second,
+    _In_    UINTN Length,
+    _In_    UINTN Bytes,
+    _In_    UINT32 Runs,
+    _Inout_ UINTN* Sink
+)
+{
+    UINT64 Calls = MAX(BENCH_BYTES / Bytes, 1ULL);
+    UINT64 Best  = MAX_UINT64;
+
+    for (UINT32 Run = 0; Run < Runs; Run++)
+    {
+        UINT64 Start = HostNow();
+        for (UINT64 i = 0; i < Calls; i++)
+        {
+            *Sink += Routine(First, Second, Length);
+        }
+        Best = MIN(Best, HostNow() - Start);
+    }
+
+    return Best * 1000 / Calls;
+}
+
+INT32
+main(
+    INT32 Argc,
+    CHAR8** Argv
+)
+{
+    UINT32 Runs = 7;
+
+    if (Argc == 3 && !AsciiStrnCmp(Argv[1], "-r", 3))
+    {
+        Runs = 0;
+        for (CONST CHAR8* Digit = Argv[2]; *Digit >= '0' && *Digit <= '9'; Digit++)
+        {
+            Runs = Runs * 10 + (*Digit - '0');
+        }
+        Runs = MIN(MAX(Runs, 1u), (UINT32)BENCH_MAX_RUNS);
+    }
+    else if (Argc != 1)
+    {
+        BenchPrint("usage: bench_rtl [-r runs]\n");
+        return 2;
+    }
+
+    // 16 byte aligned allocations, the strings start just past the alignment
+    UINT8* FirstBuffer  = HostAlloc(BENCH_LONGEST * sizeof(CHAR16) + 64);
+    UINT8* SecondBuffer = HostAlloc(BENCH_LONGEST * sizeof(CHAR16) + 64);
+    UINTN  Sink         = 0;
+    INT32  Result       = 0;
+
+    BenchPrint("%-12a %6a %10a %10a %9a %9a %8a\n", "routine", "length", "rtl ns", "edk2 ns", "rtl GB/s", "edk2 GB/s", "speedup");
+
+    for (UINT32 c = 0; c < ARRAY_SIZE(Cases); c++)
+    {
+        CONST BENCH_CASE* Case   = &Cases[c];
+        UINT8*            First  = FirstBuffer + Case->Unit;
+        UINT8*            Second = SecondBuffer + Case->Unit;
+
+        for (UINT32 l = 0; l < ARRAY_SIZE(Lengths); l++)
+        {
+            UINTN Length = Lengths[l];
+            UINTN Bytes  = Length * Case->Unit;
+
+            // non-NUL characters with a NUL after them, the same on both sides
+            for (UINTN i = 0; i < Bytes; i++)
+            {
+                First[i] = Second[i] = (UINT8)(i % 251 + 1);
+            }
+            SetMem(First + Bytes, sizeof(CHAR16), 0);
+            SetMem(Second + Bytes, sizeof(CHAR16), 0);
+
+            UINTN Expected = Case->Scalar(First, Second, Bytes);
+            if (Case->Rtl(First, Second, Bytes) != Expected)
+            {
+                BenchPrint("%-12a %6lu rtl and edk2 results differ\n", Case->Name, Length);
+                Result = 1;
+                continue;
+            }
+
+            UINT64 Fast = BenchTime(Case->Rtl, First, Second, Bytes, Bytes, Runs, &Sink);
+            UINT64 Slow = BenchTime(Case->Scalar, First, Second, Bytes, Bytes, Runs, &Sink);
+
+            // fixed point, PrintLib has no floating point. Bytes per picosecond * 1000 is GB/s.
+            UINT64 FastRate = Bytes * 100000 / MAX(Fast, 1ULL);
+            UINT64 SlowRate = Bytes * 100000 / MAX(Slow, 1ULL);
+            UINT64 Speedup  = Slow * 100 / MAX(Fast, 1ULL);
+            BenchPrint("%-12a %6lu %6lu.%03lu %6lu.%03lu %6lu.%02lu %6lu.%02lu %5lu.%02lux\n", Case->Name, Length,
+                       Fast / 1000, Fast % 1000, Slow / 1000, Slow % 1000,
+                       FastRate / 100, FastRate % 100, SlowRate / 100, SlowRate % 100, Speedup / 100, Speedup % 100);
+        }
+    }
+
+    // keeps the calls from being optimised away
+    if (Sink == 1)
+    {
+        BenchPrint("\n");
+    }
+
+    HostFree(FirstBuffer);
+    HostFree(SecondBuffer);
+    return Result;
+}
\ No newline at end of file
@@ -0,0 +1,520 @@
+#include "compress.h"
+#include "host.h"
+
+#define HOST_WINDOW      8192   // largest match distance the format's 14 position codes reach
+#define HOST_MIN_MATCH   3
+#define HOST_MAX_MATCH   256
+#define HOST_MAX_CHAIN   64     // candidates tried per position
+#define HOST_HASH_BITS   15
+#define HOST_BLOCK       0x4000 // symbols per block, each block carries its own codes
+#define HOST_MAX_CODE    16
+
+#define HOST_NC          510    // 256 chars and match lengths 3 to 256
+#define HOST_NP          14
+#define HOST_NT          19
+#define HOST_CBIT        9
+#define HOST_TBIT        5
+#define HOST_PBIT        4
+
+typedef struct _HOST_BIT_WRITER
+{
+    UINT8*  Out;
+    UINT32  Size;
+    UINT32  Used;
+    UINT64  Bits;
+    UINT32  Count;
+    BOOLEAN Full;
+} HOST_BIT_WRITER;
+
+typedef struct _HOST_CODE
+{
+    UINT8  Length[HOST_NC];
+    UINT16 Code[HOST_NC];
+    UINT16 Single; // the symbol when at most one is used, it is coded without bits
+} HOST_CODE;
+
+/**
+* Appends the low Count bits of Value, most significant first.
+*/
+static
+VOID
+HostpPutBits(
+    _Inout_ HOST_BIT_WRITER* Writer,
+    _In_    UINT32 Count,
+    _In_    UINT32 Value
+)
+{
+    if (!Count)
+    {
+        return;
+    }
+
+    Writer->Bits   = (Writer->Bits << Count) | (Value & ((1ULL << Count) - 1));
+    Writer->Count += Count;
+
+    while (Writer->Count >= 8)
+    {
+        Writer->Count -= 8;
+        if (Writer->Used < Writer->Size)
+        {
+            Writer->Out[Writer->Used++] = (UINT8)(Writer->Bits >> Writer->Count);
+        }
+        else
+        {
+            Writer->Full = TRUE;
+        }
+    }
+}
+
+/**
+* Huffman code lengths for Frequency, none over HOST_MAX_CODE bits. Codes that come out
+* too long are retried with flattened frequencies. At most one used symbol gets no code.
+*/
+static
+VOID
+HostpMakeCode(
+    _In_  CONST UINT32* Frequency,
+    _In_  UINT16 Symbols,
+    _Out_ HOST_CODE* Code
+)
+{
+    UINT32 Scaled[HOST_NC];
+    UINT32 Weight[2 * HOST_NC];
+    UINT16 Parent[2 * HOST_NC];
+    UINT8  Depth[2 * HOST_NC];
+    UINT16 Leaves[HOST_NC];
+
+    CopyMem(Scaled, Frequency, Symbols * sizeof(*Scaled));
+    ZeroMem(Code->Length, sizeof(Code->Length));
+    Code->Single = 0;
+
+    for (;;)
+    {
+        // leaves by ascending weight
+        UINT16 Count = 0;
+        for (UINT16 Symbol = 0; Symbol < Symbols; Symbol++)
+        {
+            if (!Scaled[Symbol])
+            {
+                continue;
+            }
+
+            UINT16 i = Count++;
+            for (; i && Scaled[Leaves[i - 1]] > Scaled[Symbol]; i--)
+            {
+                Leaves[i] = Leaves[i - 1];
+            }
+            Leaves[i] = Symbol;
+        }
+
+        if (Count < 2)
+        {
+            Code->Single = Count ? Leaves[0] : 0;
+            return;
+        }
+
+        // two queues: the sorted leaves and the inner nodes, which come out sorted too
+        for (UINT16 i = 0; i < Count; i++)
+        {
+            Weight[i] = Scaled[Leaves[i]];
+        }
+
+        UINT16 Leaf  = 0;
+        UINT16 Inner = Count;
+        for (UINT16 Next = Count; Next < 2 * Count - 1; Next++)
+        {
+            Weight[Next] = 0;
+            for (UINT32 Pick = 0; Pick < 2; Pick++)
+            {
+                UINT16 Node = (Leaf < Count && (Inner == Next || Weight[Leaf] <= Weight[Inner])) ? Leaf++ : Inner++;
+                Weight[Next] += Weight[Node];
+                Parent[Node]  = Next;
+            }
+        }
+
+        // parents always come after their children
+        UINT16 Root    = (UINT16)(2 * Count - 2);
+        UINT8  Longest = 0;
+        Depth[Root] = 0;
+        for (INT32 Node = Root - 1; Node >= 0; Node--)
+        {
+            Depth[Node] = (UINT8)(Depth[Parent[Node]] + 1);
+            Longest     = MAX(Longest, Depth[Node]);
+        }
+
+        if (Longest <= HOST_MAX_CODE)
+        {
+            for (UINT16 i = 0; i < Count; i++)
+            {
+                Code->Length[Leaves[i]] = Depth[i];
+            }
+            break;
+        }
+
+        for (UINT16 Symbol = 0; Symbol < Symbols; Symbol++)
+        {
+            Scaled[Symbol] = Scaled[Symbol] ? (Scaled[Symbol] >> 1) | 1 : 0;
+        }
+    }
+
+    // canonical: shorter codes first, in symbol order within a length
+    UINT32 Count[HOST_MAX_CODE + 1];
+    UINT32 Next[HOST_MAX_CODE + 2];
+
+    ZeroMem(Count, sizeof(Count));
+    for (UINT16 Symbol = 0; Symbol < Symbols; Symbol++)
+    {
+        Count[Code->Length[Symbol]]++;
+    }
+
+    Count[0] = 0;
+    Next[1]  = 0;
+    for (UINT32 Length = 1; Length <= HOST_MAX_CODE; Length++)
+    {
+        Next[Length + 1] = (Next[Length] + Count[Length]) << 1;
+    }
+
+    for (UINT16 Symbol = 0; Symbol < Symbols; Symbol++)
+    {
+        if (Code->Length[Symbol])
+        {
+            Code->Code[Symbol] = (UINT16)Next[Code->Length[Symbol]]++;
+        }
+    }
+}
+
+static
+VOID
+HostpPutSymbol(
+    _Inout_ HOST_BIT_WRITER* Writer,
+    _In_    CONST HOST_CODE* Code,
+    _In_    UINT16 Symbol
+)
+{
+    HostpPutBits(Writer, Code->Length[Symbol], Code->Code[Symbol]);
+}
+
+/**
+* Writes the lengths of the code length code or the position code.
+*
+* @param Special Index after which a 2 bit count of zero lengths follows, 0 for none.
+*/
+static
+VOID
+HostpPutPtLengths(
+    _Inout_ HOST_BIT_WRITER* Writer,
+    _In_    CONST HOST_CODE* Code,
+    _In_    UINT16 Symbols,
+    _In_    UINT32 CountBits,
+    _In_    UINT16 Special
+)
+{
+    UINT16 Count = Symbols;
+    while (Count && !Code->Length[Count - 1])
+    {
+        Count--;
+    }
+
+    if (!Count)
+    {
+        HostpPutBits(Writer, CountBits, 0);
+        HostpPutBits(Writer, CountBits, Code->Single);
+        return;
+    }
+
+    HostpPutBits(Writer, CountBits, Count);
+    for (UINT16 i = 0; i < Count;)
+    {
+        UINT32 Length = Code->Length[i++];
+        if (Length < 7)
+        {
+            HostpPutBits(Writer, 3, Length);
+        }
+        else
+        {
+            HostpPutBits(Writer, 3, 7);
+            HostpPutBits(Writer, Length - 7, (1u << (Length - 7)) - 1);
+            HostpPutBits(Writer, 1, 0);
+        }
+
+        if (i == Special)
+        {
+            UINT32 Zeroes = 0;
+            while (Zeroes < 3 && i + Zeroes < Count && !Code->Length[i + Zeroes])
+            {
+                Zeroes++;
+            }
+
+            HostpPutBits(Writer, 2, Zeroes);
+            i = (UINT16)(i + Zeroes);
+        }
+    }
+}
+
+static
+UINT32
+HostpBitLength(
+    _In_ UINT32 Value
+)
+{
+    return Value ? 32 - __builtin_clz(Value) : 0;
+}
+
+static
+VOID
+HostpPutBlock(
+    _Inout_ HOST_BIT_WRITER* Writer,
+    _In_    CONST UINT16* Symbols,
+    _In_    CONST UINT16* Positions,
+    _In_    UINT32 Count
+)
+{
+    UINT32    CFrequency[HOST_NC];
+    UINT32    PFrequency[HOST_NP];
+    UINT32    TFrequency[HOST_NT];
+    UINT16    TSymbols[HOST_NC];
+    UINT16    TExtra[HOST_NC];
+    HOST_CODE C;
+    HOST_CODE P;
+    HOST_CODE T;
+
+    ZeroMem(CFrequency, sizeof(CFrequency));
+    ZeroMem(PFrequency, sizeof(PFrequency));
+    ZeroMem(TFrequency, sizeof(TFrequency));
+
+    for (UINT32 i = 0; i < Count; i++)
+    {
+        CFrequency[Symbols[i]]++;
+        if (Symbols[i] > 0xFF)
+        {
+            PFrequency[HostpBitLength(Positions[i])]++;
+        }
+    }
+
+    HostpMakeCode(CFrequency, HOST_NC, &C);
+    HostpMakeCode(PFrequency, HOST_NP, &P);
+
+    // the char and length code lengths as code length symbols, 0 to 2 are runs of zeroes
+    UINT16 CCount = HOST_NC;
+    while (CCount && !C.Length[CCount - 1])
+    {
+        CCount--;
+    }
+
+    UINT32 TCount = 0;
+    for (UINT16 i = 0; i < CCount;)
+    {
+        if (C.Length[i])
+        {
+            TSymbols[TCount++] = (UINT16)(C.Length[i++] + 2);
+            continue;
+        }
+
+        UINT32 Zeroes = 0;
+        while (!C.Length[i + Zeroes])
+        {
+            Zeroes++;
+        }
+        i = (UINT16)(i + Zeroes);
+
+        while (Zeroes)
+        {
+            UINT32 Run = MIN(Zeroes, 531u);
+            if (Run <= 2 || Run == 19)
+            {
+                TSymbols[TCount++] = 0;
+                Run = 1;
+            }
+            else if (Run <= 18)
+            {
+                TExtra[TCount]     = (UINT16)(Run - 3);
+                TSymbols[TCount++] = 1;
+            }
+            else
+            {
+                TExtra[TCount]     = (UINT16)(Run - 20);
+                TSymbols[TCount++] = 2;
+            }
+            Zeroes -= Run;
+        }
+    }
+
+    for (UINT32 i = 0; i < TCount; i++)
+    {
+        TFrequency[TSymbols[i]]++;
+    }
+    HostpMakeCode(TFrequency, HOST_NT, &T);
+
+    HostpPutBits(Writer, 16, Count);
+    if (!CCount)
+    {
+        HostpPutPtLengths(Writer, &T, HOST_NT, HOST_TBIT, 3);
+        HostpPutBits(Writer, HOST_CBIT, 0);
+        HostpPutBits(Writer, HOST_CBIT, C.Single);
+    }
+    else
+    {
+        HostpPutPtLengths(Writer, &T, HOST_NT, HOST_TBIT, 3);
+        HostpPutBits(Writer, HOST_CBIT, CCount);
+        for (UINT32 i = 0; i < TCount; i++)
+        {
+            HostpPutSymbol(Writer, &T, TSymbols[i]);
+            if (TSymbols[i] == 1)
+            {
+                HostpPutBits(Writer, 4, TExtra[i]);
+            }
+            else if (TSymbols[i] == 2)
+            {
+                HostpPutBits(Writer, HOST_CBIT, TExtra[i]);
+            }
+        }
+    }
+    HostpPutPtLengths(Writer, &P, HOST_NP, HOST_PBIT, 0);
+
+    for (UINT32 i = 0; i < Count; i++)
+    {
+        HostpPutSymbol(Writer, &C, Symbols[i]);
+        if (Symbols[i] > 0xFF)
+        {
+            UINT32 Bits = HostpBitLength(Positions[i]);
+            HostpPutSymbol(Writer, &P, (UINT16)Bits);
+            if (Bits > 1)
+            {
+                HostpPutBits(Writer, Bits - 1, Positions[i]);
+            }
+        }
+    }
+}
+
+static
+UINT32
+HostpHash(
+    _In_ CONST UINT8* Data
+)
+{
+    return ((Data[0] << 10) ^ (Data[1] << 5) ^ Data[2]) & ((1u << HOST_HASH_BITS) - 1);
+}
+
+UINT32
+HostCompress(
+    _In_  CONST VOID* Source,
+    _In_  UINT32 SourceSize,
+    _Out_ VOID* Destination,
+    _In_  UINT32 DestinationSize
+)
+{
+    CONST UINT8*    Data = Source;
+    HOST_BIT_WRITER Writer;
+
+    if (DestinationSize < 2 * sizeof(UINT32))
+    {
+        return 0;
+    }
+
+    ZeroMem(&Writer, sizeof(Writer));
+    Writer.Out  = (UINT8*)Destination + 2 * sizeof(UINT32);
+    Writer.Size = DestinationSize - 2 * sizeof(UINT32);
+
+    INT32*  Head      = HostAlloc(sizeof(INT32) << HOST_HASH_BITS);
+    INT32*  Previous  = HostAlloc(sizeof(INT32) * HOST_WINDOW);
+    UINT16* Symbols   = HostAlloc(sizeof(UINT16) * HOST_BLOCK);
+    UINT16* Positions = HostAlloc(sizeof(UINT16) * HOST_BLOCK);
+    if (!Head || !Previous || !Symbols || !Positions)
+    {
+        HostFatal("HostCompress: out of memory");
+    }
+
+    SetMem(Head, sizeof(INT32) << HOST_HASH_BITS, 0xFF);
+
+    UINT32 Count = 0;
+    for (UINT32 Position = 0; Position < SourceSize;)
+    {
+        UINT32 Best     = 0;
+        UINT32 Distance = 0;
+        UINT32 Limit    = MIN(SourceSize - Position, (UINT32)HOST_MAX_MATCH);
+
+        if (Limit >= HOST_MIN_MATCH)
+        {
+            UINT32 Hash      = HostpHash(Data + Position);
+            INT32  Candidate = Head[Hash];
+
+            for (UINT32 Chain = 0; Chain < HOST_MAX_CHAIN && Candidate >= 0 &&
+                 Position - (UINT32)Candidate <= HOST_WINDOW; Chain++)
+            {
+                CONST UINT8* Match = Data + Candidate;
+                if (Match[Best] == Data[Position + Best])
+                {
+                    UINT32 Length = 0;
+                    while (Length < Limit && Match[Length] == Data[Position + Length])
+                    {
+                        Length++;
+                    }
+
+                    if (Length > Best)
+                    {
+                        Best     = Length;
+                        Distance = Position - Candidate;
+                        if (Best == Limit)
+                        {
+                            break;
+                        }
+                    }
+                }
+
+                Candidate = Previous[Candidate & (HOST_WINDOW - 1)];
+            }
+        }
+
+        if (Best < HOST_MIN_MATCH)
+        {
+            Best               = 1;
+            Symbols[Count++] = Data[Position];
+        }
+        else
+        {
+            Positions[Count] = (UINT16)(Distance - 1);
+            Symbols[Count++] = (UINT16)(Best + 0x100 - HOST_MIN_MATCH);
+        }
+
+        for (UINT32 End = Position + Best; Position < End; Position++)
+        {
+            if (Position + HOST_MIN_MATCH <= SourceSize)
+            {
+                UINT32 Hash = HostpHash(Data + Position);
+                Previous[Position & (HOST_WINDOW - 1)] = Head[Hash];
+                Head[Hash] = (INT32)Position;
+            }
+        }
+
+        if (Count == HOST_BLOCK)
+        {
+            HostpPutBlock(&Writer, Symbols, Positions, Count);
+            Count = 0;
+        }
+    }
+
+    if (Count)
+    {
+        HostpPutBlock(&Writer, Symbols, Positions, Count);
+    }
+
+    if (Writer.Count)
+    {
+        HostpPutBits(&Writer, 8 - Writer.Count, 0);
+    }
+
+    HostFree(Head);
+    HostFree(Previous);
+    HostFree(Symbols);
+    HostFree(Positions);
+
+    if (Writer.Full)
+    {
+        return 0;
+    }
+
+    UINT32* Header = Destination;
+    Header[0] = Writer.Used;
+    Header[1] = SourceSize;
+    return Writer.Used + 2 * sizeof(UINT32);
+}
\ No newline at end of file
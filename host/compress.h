@@ -0,0 +1,27 @@
+#ifndef _COMPRESS_H
+#define _COMPRESS_H
+
+#include "firmware.h"
+
+//
+//
+// Encoder for the UEFI specification's compression format, the one EFI_DECOMPRESS_PROTOCOL
+// takes (decompress.c). Greedy LZ77 over the format's 8 KB window with hash chains and a
+// Huffman code per block, enough to produce realistic input for the host benchmarks.
+//
+//
+
+/**
+* Compresses Source into Destination, header included.
+*
+* @return Bytes written, 0 if Destination is too small.
+*/
+UINT32
+HostCompress(
+    _In_  CONST VOID* Source,
+    _In_  UINT32 SourceSize,
+    _Out_ VOID* Destination,
+    _In_  UINT32 DestinationSize
+);
+
+#endif // !_COMPRESS_H
\ No newline at end of file
@@ -0,0 +1,503 @@
+#include "firmware.h"
+
+//
+//
+// EFI_DECOMPRESS_PROTOCOL as firmware serves it: the UEFI specification's compression
+// format (LZ77 over an 8 KB window, static Huffman codes per block), decoded the way
+// EDK2's BaseUefiDecompressLib does it. Nothing is allocated, all state lives in the
+// caller's scratch buffer.
+//
+// The compressed data is a UINT32 compressed size and a UINT32 original size followed by
+// a bit stream read most significant bit first. Each block starts with its symbol count
+// and three code length tables: one for the lengths of the char and length codes, the
+// char and length codes themselves, and the position codes.
+//
+//
+
+#define HOST_BITBUF_BITS 32
+#define HOST_MAX_MATCH   256
+#define HOST_THRESHOLD   3
+#define HOST_CODE_BIT    16
+#define HOST_NC          (0xFF + HOST_MAX_MATCH + 2 - HOST_THRESHOLD) // chars and match lengths
+#define HOST_CBIT        9
+#define HOST_MAXPBIT     5
+#define HOST_TBIT        5
+#define HOST_MAXNP       ((1u << HOST_MAXPBIT) - 1)
+#define HOST_NT          (HOST_CODE_BIT + 3)
+#define HOST_NPT         (HOST_NT > HOST_MAXNP ? HOST_NT : HOST_MAXNP)
+#define HOST_PBIT        4 // the UEFI format, Tiano compression uses 5
+
+typedef struct _HOST_DECOMPRESS_STATE
+{
+    CONST UINT8* Source;
+    UINT8*       Destination;
+    UINT32       In;
+    UINT32       Out;
+    UINT32       CompressedSize;
+    UINT32       OriginalSize;
+
+    UINT32       BitBuffer;
+    UINT32       SubBitBuffer;
+    UINT16       BitCount;
+    UINT16       BlockSize;
+    BOOLEAN      BadTable;
+
+    UINT16       Left[2 * HOST_NC - 1];
+    UINT16       Right[2 * HOST_NC - 1];
+    UINT8        CLength[HOST_NC];
+    UINT8        PtLength[HOST_NPT];
+    UINT16       CTable[4096];
+    UINT16       PtTable[256];
+} HOST_DECOMPRESS_STATE;
+
+/**
+* Shifts Bits bits out of the bit buffer and refills it from the source, past the end of
+* the source it is filled with zeroes.
+*/
+static
+VOID
+HostpFillBits(
+    _Inout_ HOST_DECOMPRESS_STATE* State,
+    _In_    UINT16 Bits
+)
+{
+    State->BitBuffer = (UINT32)((UINT64)State->BitBuffer << Bits);
+
+    while (Bits > State->BitCount)
+    {
+        Bits = (UINT16)(Bits - State->BitCount);
+        State->BitBuffer |= (UINT32)((UINT64)State->SubBitBuffer << Bits);
+
+        State->SubBitBuffer = 0;
+        if (State->CompressedSize)
+        {
+            State->CompressedSize--;
+            State->SubBitBuffer = State->Source[State->In++];
+        }
+        State->BitCount = 8;
+    }
+
+    State->BitCount = (UINT16)(State->BitCount - Bits);
+    State->BitBuffer |= State->SubBitBuffer >> State->BitCount;
+}
+
+static
+UINT32
+HostpGetBits(
+    _Inout_ HOST_DECOMPRESS_STATE* State,
+    _In_    UINT16 Bits
+)
+{
+    UINT32 Value = Bits ? State->BitBuffer >> (HOST_BITBUF_BITS - Bits) : 0;
+    HostpFillBits(State, Bits);
+    return Value;
+}
+
+/**
+* Builds the decoding table for a canonical code: codes up to TableBits long are looked up
+* directly, longer ones continue down the Left and Right tree from their table entry.
+*
+* @return FALSE if the lengths do not describe a complete code.
+*/
+static
+BOOLEAN
+HostpMakeTable(
+    _Inout_ HOST_DECOMPRESS_STATE* State,
+    _In_    UINT16 Symbols,
+    _In_    CONST UINT8* Lengths,
+    _In_    UINT16 TableBits,
+    _Out_   UINT16* Table
+)
+{
+    UINT16 Count[17];
+    UINT16 Weight[17];
+    UINT16 Start[18];
+
+    ZeroMem(Count, sizeof(Count));
+    for (UINT16 i = 0; i < Symbols; i++)
+    {
+        if (Lengths[i] > 16)
+        {
+            return FALSE;
+        }
+        Count[Lengths[i]]++;
+    }
+
+    Start[0] = 0;
+    Start[1] = 0;
+    for (UINT16 i = 1; i <= 16; i++)
+    {
+        Start[i + 1] = (UINT16)(Start[i] + (Count[i] << (16 - i)));
+    }
+
+    // a complete code wraps around to exactly 1 << 16
+    if (Start[17] != 0)
+    {
+        return FALSE;
+    }
+
+    UINT16 Shift = (UINT16)(16 - TableBits);
+    UINT16 i     = 1;
+
+    Weight[0] = 0;
+    for (; i <= TableBits; i++)
+    {
+        Start[i] >>= Shift;
+        Weight[i] = (UINT16)(1u << (TableBits - i));
+    }
+    for (; i <= 16; i++)
+    {
+        Weight[i] = (UINT16)(1u << (16 - i));
+    }
+
+    UINT32 Filled = Start[TableBits + 1] >> Shift;
+    if (Filled && Filled < (1u << TableBits))
+    {
+        SetMem(Table + Filled, ((1u << TableBits) - Filled) * sizeof(*Table), 0);
+    }
+
+    UINT16 Available = Symbols;
+    UINT16 Mask      = (UINT16)(1u << (15 - TableBits));
+
+    for (UINT16 Symbol = 0; Symbol < Symbols; Symbol++)
+    {
+        UINT16 Length = Lengths[Symbol];
+        if (!Length)
+        {
+            continue;
+        }
+
+        UINT16 Next = (UINT16)(Start[Length] + Weight[Length]);
+        if (Length <= TableBits)
+        {
+            if (Start[Length] >= Next || Next > (1u << TableBits))
+            {
+                return FALSE;
+            }
+
+            for (UINT16 j = Start[Length]; j < Next; j++)
+            {
+                Table[j] = Symbol;
+            }
+        }
+        else
+        {
+            UINT16  Code = Start[Length];
+            UINT16* Node = &Table[Code >> Shift];
+
+            for (UINT16 Depth = (UINT16)(Length - TableBits); Depth; Depth--)
+            {
+                if (!*Node && Available < 2 * HOST_NC - 1)
+                {
+                    State->Left[Available] = State->Right[Available] = 0;
+                    *Node = Available++;
+                }
+
+                if (*Node < 2 * HOST_NC - 1)
+                {
+                    Node = (Code & Mask) ? &State->Right[*Node] : &State->Left[*Node];
+                }
+
+                Code <<= 1;
+            }
+
+            *Node = Symbol;
+        }
+
+        Start[Length] = Next;
+    }
+
+    return TRUE;
+}
+
+/**
+* Walks the tree below a table entry for codes longer than the table.
+*/
+static
+UINT16
+HostpWalk(
+    _In_ CONST HOST_DECOMPRESS_STATE* State,
+    _In_ UINT16 Symbol,
+    _In_ UINT16 Symbols,
+    _In_ UINT16 TableBits
+)
+{
+    UINT32 Mask = 1u << (HOST_BITBUF_BITS - 1 - TableBits);
+
+    while (Symbol >= Symbols)
+    {
+        Symbol = (State->BitBuffer & Mask) ? State->Right[Symbol] : State->Left[Symbol];
+        Mask >>= 1;
+    }
+
+    return Symbol;
+}
+
+/**
+* Reads the lengths of the code length code or the position code.
+*
+* @param Special Index after which a 2 bit count of zero lengths follows, -1 for none.
+*/
+static
+BOOLEAN
+HostpReadPtLength(
+    _Inout_ HOST_DECOMPRESS_STATE* State,
+    _In_    UINT16 Symbols,
+    _In_    UINT16 CountBits,
+    _In_    UINT16 Special
+)
+{
+    UINT32 Count = HostpGetBits(State, CountBits);
+
+    // a single symbol: every lookup yields it and it takes no bits
+    if (!Count)
+    {
+        UINT16 Symbol = (UINT16)HostpGetBits(State, CountBits);
+        for (UINT32 i = 0; i < ARRAY_SIZE(State->PtTable); i++)
+        {
+            State->PtTable[i] = Symbol;
+        }
+
+        SetMem(State->PtLength, Symbols, 0);
+        return TRUE;
+    }
+
+    UINT32 i = 0;
+    while (i < Count && i < HOST_NPT)
+    {
+        // 0 to 6 in three bits, longer ones as 7 followed by one set bit per step above it
+        UINT16 Length = (UINT16)(State->BitBuffer >> (HOST_BITBUF_BITS - 3));
+        if (Length == 7)
+        {
+            for (UINT32 Mask = 1u << (HOST_BITBUF_BITS - 1 - 3); Mask & State->BitBuffer; Mask >>= 1)
+            {
+                Length++;
+            }
+        }
+
+        HostpFillBits(State, Length < 7 ? 3 : (UINT16)(Length - 3));
+        State->PtLength[i++] = (UINT8)Length;
+
+        if (i == Special)
+        {
+            for (UINT32 Zeroes = HostpGetBits(State, 2); Zeroes && i < HOST_NPT; Zeroes--)
+            {
+                State->PtLength[i++] = 0;
+            }
+        }
+    }
+
+    while (i < Symbols && i < HOST_NPT)
+    {
+        State->PtLength[i++] = 0;
+    }
+
+    return HostpMakeTable(State, Symbols, State->PtLength, 8, State->PtTable);
+}
+
+/**
+* Reads the char and length code lengths, themselves coded with the code length code.
+*/
+static
+BOOLEAN
+HostpReadCLength(
+    _Inout_ HOST_DECOMPRESS_STATE* State
+)
+{
+    UINT32 Count = HostpGetBits(State, HOST_CBIT);
+
+    if (!Count)
+    {
+        UINT16 Symbol = (UINT16)HostpGetBits(State, HOST_CBIT);
+        for (UINT32 i = 0; i < ARRAY_SIZE(State->CTable); i++)
+        {
+            State->CTable[i] = Symbol;
+        }
+
+        SetMem(State->CLength, HOST_NC, 0);
+        return TRUE;
+    }
+
+    UINT32 i = 0;
+    while (i < Count && i < HOST_NC)
+    {
+        UINT16 Symbol = State->PtTable[State->BitBuffer >> (HOST_BITBUF_BITS - 8)];
+        Symbol = HostpWalk(State, Symbol, HOST_NT, 8);
+        HostpFillBits(State, State->PtLength[Symbol]);
+
+        if (Symbol > 2)
+        {
+            State->CLength[i++] = (UINT8)(Symbol - 2);
+            continue;
+        }
+
+        // runs of unused symbols: one, 3 to 18, or 20 to 531
+        UINT32 Zeroes = 1;
+        if (Symbol == 1)
+        {
+            Zeroes = HostpGetBits(State, 4) + 3;
+        }
+        else if (Symbol == 2)
+        {
+            Zeroes = HostpGetBits(State, HOST_CBIT) + 20;
+        }
+
+        for (; Zeroes && i < HOST_NC; Zeroes--)
+        {
+            State->CLength[i++] = 0;
+        }
+    }
+
+    SetMem(State->CLength + i, HOST_NC - i, 0);
+    return HostpMakeTable(State, HOST_NC, State->CLength, 12, State->CTable);
+}
+
+static
+UINT16
+HostpDecodeC(
+    _Inout_ HOST_DECOMPRESS_STATE* State
+)
+{
+    if (!State->BlockSize)
+    {
+        State->BlockSize = (UINT16)HostpGetBits(State, 16);
+
+        if (!HostpReadPtLength(State, HOST_NT, HOST_TBIT, 3) || !HostpReadCLength(State) ||
+            !HostpReadPtLength(State, HOST_MAXNP, HOST_PBIT, (UINT16)-1))
+        {
+            State->BadTable = TRUE;
+            return 0;
+        }
+    }
+
+    State->BlockSize--;
+
+    UINT16 Symbol = State->CTable[State->BitBuffer >> (HOST_BITBUF_BITS - 12)];
+    Symbol = HostpWalk(State, Symbol, HOST_NC, 12);
+    HostpFillBits(State, State->CLength[Symbol]);
+    return Symbol;
+}
+
+/**
+* @return The match distance minus one.
+*/
+static
+UINT32
+HostpDecodeP(
+    _Inout_ HOST_DECOMPRESS_STATE* State
+)
+{
+    UINT16 Symbol = State->PtTable[State->BitBuffer >> (HOST_BITBUF_BITS - 8)];
+    Symbol = HostpWalk(State, Symbol, HOST_MAXNP, 8);
+    HostpFillBits(State, State->PtLength[Symbol]);
+
+    // the symbol is the bit length of the position, its bits below the top one follow
+    if (Symbol > 1)
+    {
+        return (1u << (Symbol - 1)) + HostpGetBits(State, (UINT16)(Symbol - 1));
+    }
+
+    return Symbol;
+}
+
+static
+BOOLEAN
+HostpDecode(
+    _Inout_ HOST_DECOMPRESS_STATE* State
+)
+{
+    while (State->Out < State->OriginalSize)
+    {
+        UINT16 Symbol = HostpDecodeC(State);
+        if (State->BadTable)
+        {
+            return FALSE;
+        }
+
+        if (Symbol <= 0xFF)
+        {
+            State->Destination[State->Out++] = (UINT8)Symbol;
+            continue;
+        }
+
+        UINT32 Length   = Symbol - (0x100 - HOST_THRESHOLD);
+        UINT32 Distance = HostpDecodeP(State) + 1;
+        if (Distance > State->Out)
+        {
+            return FALSE;
+        }
+
+        CONST UINT8* From = State->Destination + State->Out - Distance;
+        Length = MIN(Length, State->OriginalSize - State->Out);
+
+        // byte by byte, a match may overlap what it produces
+        for (UINT32 i = 0; i < Length; i++)
+        {
+            State->Destination[State->Out + i] = From[i];
+        }
+        State->Out += Length;
+    }
+
+    return TRUE;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpDecompressGetInfo(
+    IN  EFI_DECOMPRESS_PROTOCOL* This,
+    IN  VOID* Source,
+    IN  UINT32 SourceSize,
+    OUT UINT32* DestinationSize,
+    OUT UINT32* ScratchSize
+)
+{
+    CONST UINT32* Header = Source;
+
+    if (SourceSize < 2 * sizeof(UINT32) || Header[0] + 2 * sizeof(UINT32) != SourceSize)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    *DestinationSize = Header[1];
+    *ScratchSize     = sizeof(HOST_DECOMPRESS_STATE);
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpDecompress(
+    IN     EFI_DECOMPRESS_PROTOCOL* This,
+    IN     VOID* Source,
+    IN     UINT32 SourceSize,
+    IN OUT VOID* Destination,
+    IN     UINT32 DestinationSize,
+    IN OUT VOID* Scratch,
+    IN     UINT32 ScratchSize
+)
+{
+    CONST UINT32*          Header = Source;
+    HOST_DECOMPRESS_STATE* State  = Scratch;
+
+    if (ScratchSize < sizeof(HOST_DECOMPRESS_STATE) || SourceSize < 2 * sizeof(UINT32) ||
+        Header[0] + 2 * sizeof(UINT32) != SourceSize || Header[1] > DestinationSize)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    ZeroMem(State, sizeof(*State));
+    State->Source         = (CONST UINT8*)Source + 2 * sizeof(UINT32);
+    State->Destination    = Destination;
+    State->CompressedSize = Header[0];
+    State->OriginalSize   = Header[1];
+
+    HostpFillBits(State, HOST_BITBUF_BITS);
+    return HostpDecode(State) ? EFI_SUCCESS : EFI_INVALID_PARAMETER;
+}
+
+EFI_DECOMPRESS_PROTOCOL HostDecompress =
+{
+    HostpDecompressGetInfo,
+    HostpDecompress
+};
\ No newline at end of file
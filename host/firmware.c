@@ -0,0 +1,1198 @@
+#include "firmware.h"
+#include "host.h"
+
+HOST_FIRMWARE_CONFIG HostFirmware;
+
+EFI_HANDLE            gImageHandle;
+EFI_SYSTEM_TABLE*     gST;
+EFI_BOOT_SERVICES*    gBS;
+EFI_RUNTIME_SERVICES* gRT;
+
+EFI_GUID gEfiFileInfoGuid                 = EFI_FILE_INFO_ID;
+EFI_GUID gEfiFileSystemInfoGuid           = EFI_FILE_SYSTEM_INFO_ID;
+EFI_GUID gEfiLoadedImageProtocolGuid      = EFI_LOADED_IMAGE_PROTOCOL_GUID;
+EFI_GUID gEfiSimpleFileSystemProtocolGuid = EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID;
+EFI_GUID gEfiBlockIoProtocolGuid          = EFI_BLOCK_IO_PROTOCOL_GUID;
+EFI_GUID gEfiBlockIo2ProtocolGuid         = EFI_BLOCK_IO2_PROTOCOL_GUID;
+EFI_GUID gEfiDecompressProtocolGuid       = EFI_DECOMPRESS_PROTOCOL_GUID;
+EFI_GUID gEfiDevicePathProtocolGuid       = EFI_DEVICE_PATH_PROTOCOL_GUID;
+
+typedef struct _HOST_HANDLE
+{
+    BOOLEAN  Used;
+    UINT32   Count;
+    EFI_GUID Protocols[HOST_MAX_PROTOCOLS];
+    VOID*    Interfaces[HOST_MAX_PROTOCOLS];
+} HOST_HANDLE;
+
+typedef struct _HOST_EVENT
+{
+    struct _HOST_EVENT* Next;
+    UINT32              Type;
+    EFI_EVENT_NOTIFY    Notify;
+    VOID*               Context;
+    BOOLEAN             Signalled;
+    UINT64              Due;    // next timer expiry, 0 when the timer is not armed
+    UINT64              Period; // 0 for a one shot timer
+} HOST_EVENT;
+
+typedef struct _HOST_PENDING
+{
+    BOOLEAN         Used;
+    UINT64          Due;
+    HOST_COMPLETION Completion;
+    VOID*           Context;
+    EFI_EVENT       Event;
+} HOST_PENDING;
+
+static EFI_BOOT_SERVICES               BootServices;
+static EFI_RUNTIME_SERVICES            RuntimeServices;
+static EFI_SYSTEM_TABLE                SystemTable;
+static EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL ConsoleOut;
+static EFI_SIMPLE_TEXT_OUTPUT_MODE     ConsoleMode;
+static EFI_SIMPLE_TEXT_INPUT_PROTOCOL  ConsoleIn;
+static EFI_LOADED_IMAGE_PROTOCOL       LoadedImage;
+
+static HOST_HANDLE              Handles[HOST_MAX_HANDLES];
+static HOST_EVENT*              Events;
+static HOST_PENDING             Pending[HOST_MAX_PENDING];
+static EFI_TPL                  CurrentTpl = TPL_APPLICATION;
+static UINT64                   PagesInUse;
+static HOST_FIRMWARE_STATISTICS Statistics;
+
+//
+//
+// Memory
+//
+//
+
+static
+EFI_STATUS
+EFIAPI
+HostpAllocatePages(
+    IN     EFI_ALLOCATE_TYPE Type,
+    IN     EFI_MEMORY_TYPE MemoryType,
+    IN     UINTN Pages,
+    IN OUT EFI_PHYSICAL_ADDRESS* Memory
+)
+{
+    (VOID)MemoryType;
+
+    if (!Memory || !Pages)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    UINT64 Base = 0;
+    switch (Type)
+    {
+    case AllocateAnyPages:
+        Base = HostMapPages(0, Pages, MAX_UINT64);
+        break;
+    case AllocateMaxAddress:
+        Base = HostMapPages(0, Pages, *Memory);
+        break;
+    case AllocateAddress:
+        if ((*Memory & EFI_PAGE_MASK) || !HostFirmware.FixedAddresses)
+        {
+            return EFI_NOT_FOUND;
+        }
+        Base = HostMapPages(*Memory, Pages, MAX_UINT64);
+        break;
+    default:
+        return EFI_INVALID_PARAMETER;
+    }
+
+    if (!Base)
+    {
+        return Type == AllocateAddress ? EFI_NOT_FOUND : EFI_OUT_OF_RESOURCES;
+    }
+
+    PagesInUse += Pages;
+    Statistics.PagesAllocated = MAX(Statistics.PagesAllocated, PagesInUse);
+
+    *Memory = Base;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFreePages(
+    IN EFI_PHYSICAL_ADDRESS Memory,
+    IN UINTN Pages
+)
+{
+    if ((Memory & EFI_PAGE_MASK) || !Pages || Pages > PagesInUse)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    HostUnmapPages(Memory, Pages);
+    PagesInUse -= Pages;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpGetMemoryMap(
+    IN OUT UINTN* MemoryMapSize,
+    OUT    EFI_MEMORY_DESCRIPTOR* MemoryMap,
+    OUT    UINTN* MapKey,
+    OUT    UINTN* DescriptorSize,
+    OUT    UINT32* DescriptorVersion
+)
+{
+    (VOID)MemoryMapSize;
+    (VOID)MemoryMap;
+    (VOID)MapKey;
+    (VOID)DescriptorSize;
+    (VOID)DescriptorVersion;
+
+    // the host has no physical memory map to give out
+    return EFI_UNSUPPORTED;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpAllocatePool(
+    IN  EFI_MEMORY_TYPE PoolType,
+    IN  UINTN Size,
+    OUT VOID** Buffer
+)
+{
+    (VOID)PoolType;
+
+    if (!Buffer)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    *Buffer = HostAlloc(Size);
+    if (!*Buffer)
+    {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    Statistics.PoolAllocations++;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFreePool(
+    IN VOID* Buffer
+)
+{
+    if (!Buffer)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    HostFree(Buffer);
+    return EFI_SUCCESS;
+}
+
+static
+VOID
+EFIAPI
+HostpCopyMem(
+    IN VOID* Destination,
+    IN VOID* Source,
+    IN UINTN Length
+)
+{
+    CopyMem(Destination, Source, Length);
+}
+
+static
+VOID
+EFIAPI
+HostpSetMem(
+    IN VOID* Buffer,
+    IN UINTN Size,
+    IN UINT8 Value
+)
+{
+    SetMem(Buffer, Size, Value);
+}
+
+//
+//
+// Events, timers and completions
+//
+//
+
+static
+EFI_TPL
+EFIAPI
+HostpRaiseTpl(
+    IN EFI_TPL NewTpl
+)
+{
+    EFI_TPL Old = CurrentTpl;
+    CurrentTpl  = NewTpl;
+    return Old;
+}
+
+static
+VOID
+EFIAPI
+HostpRestoreTpl(
+    IN EFI_TPL OldTpl
+)
+{
+    CurrentTpl = OldTpl;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpCreateEvent(
+    IN  UINT32 Type,
+    IN  EFI_TPL NotifyTpl,
+    IN  EFI_EVENT_NOTIFY NotifyFunction,
+    IN  VOID* NotifyContext,
+    OUT EFI_EVENT* Event
+)
+{
+    (VOID)NotifyTpl;
+
+    if (!Event || ((Type & EVT_NOTIFY_SIGNAL) && !NotifyFunction))
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    HOST_EVENT* New = HostAlloc(sizeof(HOST_EVENT));
+    if (!New)
+    {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    New->Type    = Type;
+    New->Notify  = NotifyFunction;
+    New->Context = NotifyContext;
+    New->Next    = Events;
+    Events       = New;
+
+    *Event = New;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpCreateEventEx(
+    IN           UINT32 Type,
+    IN           EFI_TPL NotifyTpl,
+    IN           EFI_EVENT_NOTIFY NotifyFunction,
+    IN OPTIONAL  CONST VOID* NotifyContext,
+    IN OPTIONAL  CONST EFI_GUID* EventGroup,
+    OUT          EFI_EVENT* Event
+)
+{
+    (VOID)EventGroup;
+    return HostpCreateEvent(Type, NotifyTpl, NotifyFunction, (VOID*)NotifyContext, Event);
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpSignalEvent(
+    IN EFI_EVENT Event
+)
+{
+    HOST_EVENT* Signalled = Event;
+    if (!Signalled)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    if ((Signalled->Type & EVT_NOTIFY_SIGNAL) && Signalled->Notify)
+    {
+        Signalled->Notify(Event, Signalled->Context);
+    }
+    else
+    {
+        Signalled->Signalled = TRUE;
+    }
+
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpCloseEvent(
+    IN EFI_EVENT Event
+)
+{
+    for (HOST_EVENT** Link = &Events; *Link; Link = &(*Link)->Next)
+    {
+        if (*Link == Event)
+        {
+            *Link = (*Link)->Next;
+
+            // a completion still pointing at it would signal freed memory
+            for (UINT32 i = 0; i < HOST_MAX_PENDING; i++)
+            {
+                if (Pending[i].Used && Pending[i].Event == Event)
+                {
+                    Pending[i].Event = NULL;
+                }
+            }
+
+            HostFree(Event);
+            return EFI_SUCCESS;
+        }
+    }
+
+    return EFI_INVALID_PARAMETER;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpSetTimer(
+    IN EFI_EVENT Event,
+    IN EFI_TIMER_DELAY Type,
+    IN UINT64 TriggerTime
+)
+{
+    HOST_EVENT* Timer = Event;
+    if (!Timer || !(Timer->Type & EVT_TIMER))
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    // TriggerTime counts 100 ns units
+    UINT64 Delay = TriggerTime * 100;
+
+    switch (Type)
+    {
+    case TimerCancel:
+        Timer->Due    = 0;
+        Timer->Period = 0;
+        return EFI_SUCCESS;
+    case TimerRelative:
+        Timer->Due    = HostNow() + Delay;
+        Timer->Period = 0;
+        return EFI_SUCCESS;
+    case TimerPeriodic:
+        Timer->Due    = HostNow() + Delay;
+        Timer->Period = MAX(Delay, 1ULL);
+        return EFI_SUCCESS;
+    default:
+        return EFI_INVALID_PARAMETER;
+    }
+}
+
+VOID
+HostPoll(
+    VOID
+)
+{
+    UINT64 Now = HostNow();
+
+    // oldest first, a device completes its requests in the order they were queued
+    while (TRUE)
+    {
+        HOST_PENDING* Next = NULL;
+        for (UINT32 i = 0; i < HOST_MAX_PENDING; i++)
+        {
+            if (Pending[i].Used && Pending[i].Due <= Now && (!Next || Pending[i].Due < Next->Due))
+            {
+                Next = &Pending[i];
+            }
+        }
+
+        if (!Next)
+        {
+            break;
+        }
+
+        HOST_PENDING Done = *Next;
+        Next->Used = FALSE;
+
+        if (Done.Completion)
+        {
+            Done.Completion(Done.Context);
+        }
+
+        if (Done.Event)
+        {
+            HostpSignalEvent(Done.Event);
+        }
+    }
+
+    for (HOST_EVENT* Timer = Events; Timer; Timer = Timer->Next)
+    {
+        if (!Timer->Due || Timer->Due > Now)
+        {
+            continue;
+        }
+
+        if (Timer->Period)
+        {
+            // a late poll signals once, not once per missed period
+            Timer->Due += ((Now - Timer->Due) / Timer->Period + 1) * Timer->Period;
+        }
+        else
+        {
+            Timer->Due = 0;
+        }
+
+        HostpSignalEvent(Timer);
+    }
+}
+
+/**
+* @return When the next completion or timer is due, MAX_UINT64 when nothing is.
+*/
+static
+UINT64
+HostpNextDue(
+    VOID
+)
+{
+    UINT64 Next = MAX_UINT64;
+
+    for (UINT32 i = 0; i < HOST_MAX_PENDING; i++)
+    {
+        if (Pending[i].Used)
+        {
+            Next = MIN(Next, Pending[i].Due);
+        }
+    }
+
+    for (HOST_EVENT* Timer = Events; Timer; Timer = Timer->Next)
+    {
+        if (Timer->Due)
+        {
+            Next = MIN(Next, Timer->Due);
+        }
+    }
+
+    return Next;
+}
+
+VOID
+HostWaitUntil(
+    _In_ UINT64 Due
+)
+{
+    UINT64 Start = HostNow();
+    if (Start < Due)
+    {
+        HostSleepUntil(Due);
+        Statistics.Waits++;
+        Statistics.WaitTime += HostNow() - Start;
+    }
+
+    HostPoll();
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpWaitForEvent(
+    IN  UINTN NumberOfEvents,
+    IN  EFI_EVENT* Event,
+    OUT UINTN* Index
+)
+{
+    if (!NumberOfEvents || !Event || !Index || CurrentTpl != TPL_APPLICATION)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    while (TRUE)
+    {
+        HostPoll();
+
+        for (UINTN i = 0; i < NumberOfEvents; i++)
+        {
+            HOST_EVENT* Waited = Event[i];
+            if (!Waited || (Waited->Type & EVT_NOTIFY_SIGNAL))
+            {
+                *Index = i;
+                return EFI_INVALID_PARAMETER;
+            }
+
+            if (Waited->Signalled)
+            {
+                Waited->Signalled = FALSE;
+                *Index = i;
+                return EFI_SUCCESS;
+            }
+        }
+
+        UINT64 Next = HostpNextDue();
+        if (Next == MAX_UINT64)
+        {
+            HostFatal("WaitForEvent on events nothing will ever signal");
+        }
+
+        HostWaitUntil(Next);
+    }
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpCheckEvent(
+    IN EFI_EVENT Event
+)
+{
+    HOST_EVENT* Checked = Event;
+    if (!Checked || (Checked->Type & EVT_NOTIFY_SIGNAL))
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    HostPoll();
+
+    if (!Checked->Signalled)
+    {
+        return EFI_NOT_READY;
+    }
+
+    Checked->Signalled = FALSE;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpStall(
+    IN UINTN Microseconds
+)
+{
+    HostWaitUntil(HostNow() + Microseconds * 1000);
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpSetWatchdogTimer(
+    IN UINTN Timeout,
+    IN UINT64 WatchdogCode,
+    IN UINTN DataSize,
+    IN CHAR16* WatchdogData
+)
+{
+    (VOID)Timeout;
+    (VOID)WatchdogCode;
+    (VOID)DataSize;
+    (VOID)WatchdogData;
+    return EFI_SUCCESS;
+}
+
+UINT64
+HostSchedule(
+    _Inout_ HOST_DEVICE* Device,
+    _In_    UINT64 Requests,
+    _In_    UINT64 Bytes
+)
+{
+    UINT64 Start = MAX(HostNow(), Device->Busy);
+    UINT64 Cost  = Requests * Device->Latency;
+
+    if (Device->Bandwidth)
+    {
+        Cost += Bytes * 1000000000ULL / Device->Bandwidth;
+    }
+
+    Device->Busy      = Start + Cost;
+    Device->Requests += Requests;
+    Device->Bytes    += Bytes;
+    return Device->Busy;
+}
+
+VOID
+HostComplete(
+    _In_     UINT64 Due,
+    _In_opt_ HOST_COMPLETION Completion,
+    _In_opt_ VOID* Context,
+    _In_opt_ EFI_EVENT Event
+)
+{
+    for (UINT32 i = 0; i < HOST_MAX_PENDING; i++)
+    {
+        if (!Pending[i].Used)
+        {
+            Pending[i].Used       = TRUE;
+            Pending[i].Due        = Due;
+            Pending[i].Completion = Completion;
+            Pending[i].Context    = Context;
+            Pending[i].Event      = Event;
+            return;
+        }
+    }
+
+    HostFatal("too many requests in flight, raise HOST_MAX_PENDING");
+}
+
+//
+//
+// Handles and protocols
+//
+//
+
+EFI_STATUS
+HostInstallProtocol(
+    _Inout_ EFI_HANDLE* Handle,
+    _In_    EFI_GUID* Protocol,
+    _In_    VOID* Interface
+)
+{
+    HOST_HANDLE* Entry = *Handle;
+
+    if (!Entry)
+    {
+        for (UINT32 i = 0; i < HOST_MAX_HANDLES && !Entry; i++)
+        {
+            if (!Handles[i].Used)
+            {
+                Entry = &Handles[i];
+            }
+        }
+
+        if (!Entry)
+        {
+            return EFI_OUT_OF_RESOURCES;
+        }
+
+        ZeroMem(Entry, sizeof(HOST_HANDLE));
+        Entry->Used = TRUE;
+        *Handle     = Entry;
+    }
+
+    if (Entry->Count == HOST_MAX_PROTOCOLS)
+    {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    CopyMem(&Entry->Protocols[Entry->Count], Protocol, sizeof(EFI_GUID));
+    Entry->Interfaces[Entry->Count++] = Interface;
+    return EFI_SUCCESS;
+}
+
+static
+VOID*
+HostpFindProtocol(
+    _In_ HOST_HANDLE* Handle,
+    _In_ CONST EFI_GUID* Protocol
+)
+{
+    for (UINT32 i = 0; i < Handle->Count; i++)
+    {
+        if (!CompareMem(&Handle->Protocols[i], Protocol, sizeof(EFI_GUID)))
+        {
+            return Handle->Interfaces[i];
+        }
+    }
+
+    return NULL;
+}
+
+static
+BOOLEAN
+HostpIsHandle(
+    _In_ EFI_HANDLE Handle
+)
+{
+    HOST_HANDLE* Entry = Handle;
+    return Entry >= Handles && Entry < Handles + HOST_MAX_HANDLES && Entry->Used;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpHandleProtocol(
+    IN  EFI_HANDLE Handle,
+    IN  EFI_GUID* Protocol,
+    OUT VOID** Interface
+)
+{
+    if (!HostpIsHandle(Handle) || !Protocol || !Interface)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    *Interface = HostpFindProtocol(Handle, Protocol);
+    return *Interface ? EFI_SUCCESS : EFI_UNSUPPORTED;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpOpenProtocol(
+    IN  EFI_HANDLE Handle,
+    IN  EFI_GUID* Protocol,
+    OUT VOID** Interface OPTIONAL,
+    IN  EFI_HANDLE AgentHandle,
+    IN  EFI_HANDLE ControllerHandle,
+    IN  UINT32 Attributes
+)
+{
+    (VOID)AgentHandle;
+    (VOID)ControllerHandle;
+    (VOID)Attributes;
+
+    VOID* Found;
+    EFI_STATUS Status = HostpHandleProtocol(Handle, Protocol, &Found);
+    if (Interface)
+    {
+        *Interface = EFI_ERROR(Status) ? NULL : Found;
+    }
+
+    return Status;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpCloseProtocol(
+    IN EFI_HANDLE Handle,
+    IN EFI_GUID* Protocol,
+    IN EFI_HANDLE AgentHandle,
+    IN EFI_HANDLE ControllerHandle
+)
+{
+    (VOID)AgentHandle;
+    (VOID)ControllerHandle;
+
+    VOID* Found;
+    return HostpHandleProtocol(Handle, Protocol, &Found);
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpLocateHandleBuffer(
+    IN     EFI_LOCATE_SEARCH_TYPE SearchType,
+    IN     EFI_GUID* Protocol OPTIONAL,
+    IN     VOID* SearchKey OPTIONAL,
+    OUT    UINTN* NoHandles,
+    OUT    EFI_HANDLE** Buffer
+)
+{
+    (VOID)SearchKey;
+
+    if (!NoHandles || !Buffer || (SearchType == ByProtocol && !Protocol) || SearchType == ByRegisterNotify)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    EFI_HANDLE* Found = HostAlloc(sizeof(EFI_HANDLE) * HOST_MAX_HANDLES);
+    UINTN       Count = 0;
+    if (!Found)
+    {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    for (UINT32 i = 0; i < HOST_MAX_HANDLES; i++)
+    {
+        if (Handles[i].Used && (SearchType == AllHandles || HostpFindProtocol(&Handles[i], Protocol)))
+        {
+            Found[Count++] = &Handles[i];
+        }
+    }
+
+    if (!Count)
+    {
+        HostFree(Found);
+        return EFI_NOT_FOUND;
+    }
+
+    *NoHandles = Count;
+    *Buffer    = Found;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpLocateProtocol(
+    IN  EFI_GUID* Protocol,
+    IN  VOID* Registration OPTIONAL,
+    OUT VOID** Interface
+)
+{
+    (VOID)Registration;
+
+    if (!Protocol || !Interface)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    for (UINT32 i = 0; i < HOST_MAX_HANDLES; i++)
+    {
+        if (Handles[i].Used && (*Interface = HostpFindProtocol(&Handles[i], Protocol)))
+        {
+            return EFI_SUCCESS;
+        }
+    }
+
+    *Interface = NULL;
+    return EFI_NOT_FOUND;
+}
+
+VOID
+HostSetBootDevice(
+    _In_ EFI_HANDLE Handle
+)
+{
+    LoadedImage.DeviceHandle = Handle;
+}
+
+//
+//
+// Console and runtime services
+//
+//
+
+static
+EFI_STATUS
+EFIAPI
+HostpOutputString(
+    IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL* This,
+    IN CHAR16* String
+)
+{
+    (VOID)This;
+
+    if (HostFirmware.Quiet)
+    {
+        return EFI_SUCCESS;
+    }
+
+    CHAR8 Line[256];
+    UINTN Length = 0;
+
+    for (; *String; String++)
+    {
+        // the console speaks UCS-2, the terminal gets ASCII and '?' for the rest
+        if (*String != L'\r')
+        {
+            Line[Length++] = *String < 0x80 ? (CHAR8)*String : '?';
+        }
+
+        if (Length == sizeof(Line))
+        {
+            HostWrite(Line, Length);
+            Length = 0;
+        }
+    }
+
+    HostWrite(Line, Length);
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpTextReset(
+    IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL* This,
+    IN BOOLEAN ExtendedVerification
+)
+{
+    (VOID)This;
+    (VOID)ExtendedVerification;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpSetAttribute(
+    IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL* This,
+    IN UINTN Attribute
+)
+{
+    This->Mode->Attribute = (INT32)Attribute;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpClearScreen(
+    IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL* This
+)
+{
+    (VOID)This;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpSetCursorPosition(
+    IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL* This,
+    IN UINTN Column,
+    IN UINTN Row
+)
+{
+    This->Mode->CursorColumn = (INT32)Column;
+    This->Mode->CursorRow    = (INT32)Row;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpEnableCursor(
+    IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL* This,
+    IN BOOLEAN Visible
+)
+{
+    This->Mode->CursorVisible = Visible;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpQueryMode(
+    IN  EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL* This,
+    IN  UINTN ModeNumber,
+    OUT UINTN* Columns,
+    OUT UINTN* Rows
+)
+{
+    (VOID)This;
+
+    if (ModeNumber)
+    {
+        return EFI_UNSUPPORTED;
+    }
+
+    *Columns = 80;
+    *Rows    = 25;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpReadKeyStroke(
+    IN  EFI_SIMPLE_TEXT_INPUT_PROTOCOL* This,
+    OUT EFI_INPUT_KEY* Key
+)
+{
+    (VOID)This;
+    (VOID)Key;
+
+    // nobody is at the keyboard
+    return EFI_NOT_READY;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpInputReset(
+    IN EFI_SIMPLE_TEXT_INPUT_PROTOCOL* This,
+    IN BOOLEAN ExtendedVerification
+)
+{
+    (VOID)This;
+    (VOID)ExtendedVerification;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpGetVariable(
+    IN      CHAR16* VariableName,
+    IN      EFI_GUID* VendorGuid,
+    OUT     UINT32* Attributes OPTIONAL,
+    IN OUT  UINTN* DataSize,
+    OUT     VOID* Data OPTIONAL
+)
+{
+    (VOID)VariableName;
+    (VOID)VendorGuid;
+    (VOID)Attributes;
+    (VOID)DataSize;
+    (VOID)Data;
+    return EFI_NOT_FOUND;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpSetVariable(
+    IN CHAR16* VariableName,
+    IN EFI_GUID* VendorGuid,
+    IN UINT32 Attributes,
+    IN UINTN DataSize,
+    IN VOID* Data
+)
+{
+    (VOID)VariableName;
+    (VOID)VendorGuid;
+    (VOID)Attributes;
+    (VOID)DataSize;
+    (VOID)Data;
+
+    // accepted and forgotten, every run starts like a first boot
+    return EFI_SUCCESS;
+}
+
+/**
+* Stands in for every service nothing in the host build is expected to call.
+*/
+static
+EFI_STATUS
+EFIAPI
+HostpMissingService(
+    VOID
+)
+{
+    HostFatal("the loader called a boot or runtime service the host firmware does not have");
+    return EFI_UNSUPPORTED;
+}
+
+static
+VOID
+HostpFillMissing(
+    _Inout_ VOID* Table,
+    _In_    UINTN Size
+)
+{
+    // every member past the header is a function pointer
+    VOID** Service = (VOID**)((UINT8*)Table + sizeof(EFI_TABLE_HEADER));
+    VOID** End     = (VOID**)((UINT8*)Table + Size);
+
+    for (; Service < End; Service++)
+    {
+        if (!*Service)
+        {
+            *Service = (VOID*)HostpMissingService;
+        }
+    }
+}
+
+VOID
+HostFirmwareInit(
+    VOID
+)
+{
+    HostFirmwareReset();
+
+    ZeroMem(&BootServices, sizeof(BootServices));
+    BootServices.Hdr.Signature          = EFI_BOOT_SERVICES_SIGNATURE;
+    BootServices.Hdr.Revision           = EFI_2_70_SYSTEM_TABLE_REVISION;
+    BootServices.Hdr.HeaderSize         = sizeof(EFI_BOOT_SERVICES);
+    BootServices.RaiseTPL               = HostpRaiseTpl;
+    BootServices.RestoreTPL             = HostpRestoreTpl;
+    BootServices.AllocatePages          = HostpAllocatePages;
+    BootServices.FreePages              = HostpFreePages;
+    BootServices.GetMemoryMap           = HostpGetMemoryMap;
+    BootServices.AllocatePool           = HostpAllocatePool;
+    BootServices.FreePool               = HostpFreePool;
+    BootServices.CreateEvent            = HostpCreateEvent;
+    BootServices.CreateEventEx          = HostpCreateEventEx;
+    BootServices.SetTimer               = HostpSetTimer;
+    BootServices.WaitForEvent           = HostpWaitForEvent;
+    BootServices.SignalEvent            = HostpSignalEvent;
+    BootServices.CloseEvent             = HostpCloseEvent;
+    BootServices.CheckEvent             = HostpCheckEvent;
+    BootServices.HandleProtocol         = HostpHandleProtocol;
+    BootServices.OpenProtocol           = HostpOpenProtocol;
+    BootServices.CloseProtocol          = HostpCloseProtocol;
+    BootServices.LocateHandleBuffer     = HostpLocateHandleBuffer;
+    BootServices.LocateProtocol         = HostpLocateProtocol;
+    BootServices.Stall                  = HostpStall;
+    BootServices.SetWatchdogTimer       = HostpSetWatchdogTimer;
+    BootServices.CopyMem                = HostpCopyMem;
+    BootServices.SetMem                 = HostpSetMem;
+    HostpFillMissing(&BootServices, sizeof(BootServices));
+
+    ZeroMem(&RuntimeServices, sizeof(RuntimeServices));
+    RuntimeServices.Hdr.Signature  = EFI_RUNTIME_SERVICES_SIGNATURE;
+    RuntimeServices.Hdr.HeaderSize = sizeof(EFI_RUNTIME_SERVICES);
+    RuntimeServices.GetVariable    = HostpGetVariable;
+    RuntimeServices.SetVariable    = HostpSetVariable;
+    HostpFillMissing(&RuntimeServices, sizeof(RuntimeServices));
+
+    ZeroMem(&ConsoleMode, sizeof(ConsoleMode));
+    ConsoleMode.MaxMode       = 1;
+    ConsoleMode.CursorVisible = TRUE;
+
+    ZeroMem(&ConsoleOut, sizeof(ConsoleOut));
+    ConsoleOut.Reset             = HostpTextReset;
+    ConsoleOut.OutputString      = HostpOutputString;
+    ConsoleOut.QueryMode         = HostpQueryMode;
+    ConsoleOut.SetAttribute      = HostpSetAttribute;
+    ConsoleOut.ClearScreen       = HostpClearScreen;
+    ConsoleOut.SetCursorPosition = HostpSetCursorPosition;
+    ConsoleOut.EnableCursor      = HostpEnableCursor;
+    ConsoleOut.Mode              = &ConsoleMode;
+
+    ZeroMem(&ConsoleIn, sizeof(ConsoleIn));
+    ConsoleIn.Reset         = HostpInputReset;
+    ConsoleIn.ReadKeyStroke = HostpReadKeyStroke;
+    HostpCreateEvent(EVT_NOTIFY_WAIT, TPL_NOTIFY, NULL, NULL, &ConsoleIn.WaitForKey);
+
+    ZeroMem(&SystemTable, sizeof(SystemTable));
+    SystemTable.Hdr.Signature    = EFI_SYSTEM_TABLE_SIGNATURE;
+    SystemTable.Hdr.Revision     = EFI_2_70_SYSTEM_TABLE_REVISION;
+    SystemTable.Hdr.HeaderSize   = sizeof(EFI_SYSTEM_TABLE);
+    SystemTable.FirmwareVendor   = L"OpliOS host";
+    SystemTable.ConIn            = &ConsoleIn;
+    SystemTable.ConOut           = &ConsoleOut;
+    SystemTable.StdErr           = &ConsoleOut;
+    SystemTable.RuntimeServices  = &RuntimeServices;
+    SystemTable.BootServices     = &BootServices;
+
+    gST = &SystemTable;
+    gBS = &BootServices;
+    gRT = &RuntimeServices;
+
+    ZeroMem(&LoadedImage, sizeof(LoadedImage));
+    LoadedImage.Revision    = EFI_LOADED_IMAGE_PROTOCOL_REVISION;
+    LoadedImage.SystemTable = &SystemTable;
+
+    gImageHandle = NULL;
+    HostInstallProtocol(&gImageHandle, &gEfiLoadedImageProtocolGuid, &LoadedImage);
+    LoadedImage.ParentHandle = gImageHandle;
+
+    EFI_HANDLE Decompressor = NULL;
+    HostInstallProtocol(&Decompressor, &gEfiDecompressProtocolGuid, &HostDecompress);
+}
+
+VOID
+HostFirmwareReset(
+    VOID
+)
+{
+    while (Events)
+    {
+        HOST_EVENT* Next = Events->Next;
+        HostFree(Events);
+        Events = Next;
+    }
+
+    ZeroMem(Handles, sizeof(Handles));
+    ZeroMem(Pending, sizeof(Pending));
+    ZeroMem(&Statistics, sizeof(Statistics));
+    CurrentTpl   = TPL_APPLICATION;
+    PagesInUse   = 0;
+    gImageHandle = NULL;
+}
+
+VOID
+HostGetFirmwareStatistics(
+    _Out_ HOST_FIRMWARE_STATISTICS* Out
+)
+{
+    *Out = Statistics;
+}
\ No newline at end of file
@@ -0,0 +1,147 @@
+#ifndef _FIRMWARE_H
+#define _FIRMWARE_H
+
+// the loader headers are written for MSVC, gcc warnings from them are not the host build's
+#pragma GCC system_header
+#include "../bootloader/boot.h"
+#include <Guid/FileSystemInfo.h>
+#include <Protocol/BlockIo.h>
+#include <Protocol/BlockIo2.h>
+#include <Protocol/Decompress.h>
+
+//
+//
+// Mock UEFI firmware for running loader sources on a Linux host. gBS, gST and gImageHandle
+// are real tables whose services run on host memory and host time.
+//
+// Devices are modelled by their completion time. A request is scheduled on its device
+// behind whatever is already in flight, so queued reads overlap with the caller's own
+// work exactly like DMA would. Its data is copied when it is submitted, its event is
+// signalled once the host clock passes the completion time. Waiting for an event sleeps
+// until then.
+//
+//
+
+#define HOST_MAX_HANDLES    16
+#define HOST_MAX_PROTOCOLS  4
+#define HOST_MAX_PENDING    64
+
+typedef struct _HOST_FIRMWARE_CONFIG
+{
+    BOOLEAN Quiet;          // ConOut output is dropped
+    BOOLEAN FixedAddresses; // AllocateAddress is honoured when the range is free on the host
+} HOST_FIRMWARE_CONFIG;
+
+/**
+* A device requests queue up on, one request is served at a time.
+*/
+typedef struct _HOST_DEVICE
+{
+    UINT64 Latency;   // nanoseconds before a request's first byte
+    UINT64 Bandwidth; // bytes per second once it streams, 0 for no limit
+    UINT64 Busy;      // when the device finishes what is queued on it
+    UINT64 Requests;
+    UINT64 Bytes;
+} HOST_DEVICE;
+
+typedef
+VOID
+(*HOST_COMPLETION)(
+    _In_ VOID* Context
+);
+
+typedef struct _HOST_FIRMWARE_STATISTICS
+{
+    UINT64 PagesAllocated;  // high water mark
+    UINT64 PoolAllocations;
+    UINT64 Waits;           // WaitForEvent calls that had to sleep
+    UINT64 WaitTime;        // nanoseconds slept in them
+} HOST_FIRMWARE_STATISTICS;
+
+extern HOST_FIRMWARE_CONFIG HostFirmware;
+
+// the UEFI decompressor firmware installs on its own handle, see decompress.c
+extern EFI_DECOMPRESS_PROTOCOL HostDecompress;
+
+/**
+* Sets up gBS, gST and gImageHandle. Volumes mounted afterwards can be made the boot
+* device with HostSetBootDevice.
+*/
+VOID
+HostFirmwareInit(
+    VOID
+);
+
+/**
+* Releases every handle and pending request, the firmware can be set up again afterwards.
+*/
+VOID
+HostFirmwareReset(
+    VOID
+);
+
+/**
+* Installs a protocol, Handle is created when it points to NULL.
+*/
+EFI_STATUS
+HostInstallProtocol(
+    _Inout_ EFI_HANDLE* Handle,
+    _In_    EFI_GUID* Protocol,
+    _In_    VOID* Interface
+);
+
+/**
+* Makes Handle the device the loader was started from.
+*/
+VOID
+HostSetBootDevice(
+    _In_ EFI_HANDLE Handle
+);
+
+/**
+* Books a request of Bytes bytes on Device.
+*
+* @param Requests How many back to back requests the transfer takes, each one pays the latency.
+*
+* @return When the request completes, in HostNow nanoseconds.
+*/
+UINT64
+HostSchedule(
+    _Inout_ HOST_DEVICE* Device,
+    _In_    UINT64 Requests,
+    _In_    UINT64 Bytes
+);
+
+/**
+* Runs Completion once the host clock reaches Due, then signals Event if there is one.
+*/
+VOID
+HostComplete(
+    _In_     UINT64 Due,
+    _In_opt_ HOST_COMPLETION Completion,
+    _In_opt_ VOID* Context,
+    _In_opt_ EFI_EVENT Event
+);
+
+/**
+* Sleeps until Due, running whatever completes in the meantime.
+*/
+VOID
+HostWaitUntil(
+    _In_ UINT64 Due
+);
+
+/**
+* Runs completions and timers that are due.
+*/
+VOID
+HostPoll(
+    VOID
+);
+
+VOID
+HostGetFirmwareStatistics(
+    _Out_ HOST_FIRMWARE_STATISTICS* Statistics
+);
+
+#endif // !_FIRMWARE_H
\ No newline at end of file
@@ -0,0 +1,412 @@
+#define _GNU_SOURCE
+#include "host.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+__thread unsigned long long HostGsBase;
+
+unsigned long long
+HostNow(
+    void
+)
+{
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (unsigned long long)Now.tv_sec * 1000000000ULL + (unsigned long long)Now.tv_nsec;
+}
+
+void
+HostSleepUntil(
+    unsigned long long Deadline
+)
+{
+    struct timespec Until = { (time_t)(Deadline / 1000000000ULL), (long)(Deadline % 1000000000ULL) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &Until, NULL) == EINTR)
+    {
+    }
+}
+
+unsigned int
+HostProcessorCount(
+    void
+)
+{
+    long Count = sysconf(_SC_NPROCESSORS_ONLN);
+    return Count > 0 ? (unsigned int)Count : 1;
+}
+
+typedef struct _HOSTP_THREAD
+{
+    pthread_t           Thread;
+    pthread_barrier_t*  Start;
+    HOST_THREAD_ROUTINE Routine;
+    void*               Context;
+    unsigned int        Index;
+} HOSTP_THREAD;
+
+static
+void*
+HostpThread(
+    void* Parameter
+)
+{
+    HOSTP_THREAD* Thread = Parameter;
+
+    pthread_barrier_wait(Thread->Start);
+    Thread->Routine(Thread->Context, Thread->Index);
+    return NULL;
+}
+
+unsigned long long
+HostRunThreads(
+    unsigned int Count,
+    HOST_THREAD_ROUTINE Routine,
+    void* Context
+)
+{
+    HOSTP_THREAD*     Threads = HostAlloc(Count * sizeof(HOSTP_THREAD));
+    pthread_barrier_t Start;
+
+    // the caller waits at the barrier too, so creating the threads is not timed
+    pthread_barrier_init(&Start, NULL, Count + 1);
+    for (unsigned int i = 0; i < Count; i++)
+    {
+        Threads[i].Start   = &Start;
+        Threads[i].Routine = Routine;
+        Threads[i].Context = Context;
+        Threads[i].Index   = i;
+        if (pthread_create(&Threads[i].Thread, NULL, HostpThread, &Threads[i]))
+        {
+            HostFatal("pthread_create failed");
+        }
+    }
+
+    pthread_barrier_wait(&Start);
+    unsigned long long Begin = HostNow();
+    for (unsigned int i = 0; i < Count; i++)
+    {
+        pthread_join(Threads[i].Thread, NULL);
+    }
+    unsigned long long Elapsed = HostNow() - Begin;
+
+    pthread_barrier_destroy(&Start);
+    HostFree(Threads);
+    return Elapsed;
+}
+
+unsigned long long
+HostMapPages(
+    unsigned long long Address,
+    unsigned long long Pages,
+    unsigned long long Limit
+)
+{
+    int Flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (Address)
+    {
+        Flags |= MAP_FIXED_NOREPLACE;
+    }
+    else if (Limit < 0xFFFFFFFFULL)
+    {
+        // nothing the host can promise below 2 GiB
+        return 0;
+    }
+    else if (Limit < 0x7FFFFFFFFFFFULL)
+    {
+        // MAP_32BIT hands out the low 2 GiB, good enough for anything below 4 GiB
+        Flags |= MAP_32BIT;
+    }
+
+    void*              Base = mmap((void*)Address, Pages * 4096, PROT_READ | PROT_WRITE, Flags, -1, 0);
+    unsigned long long End  = (unsigned long long)Base + Pages * 4096 - 1;
+
+    if (Base == MAP_FAILED)
+    {
+        return 0;
+    }
+
+    if ((Address && (unsigned long long)Base != Address) || End > Limit)
+    {
+        munmap(Base, Pages * 4096);
+        return 0;
+    }
+
+    return (unsigned long long)Base;
+}
+
+void
+HostUnmapPages(
+    unsigned long long Address,
+    unsigned long long Pages
+)
+{
+    munmap((void*)Address, Pages * 4096);
+}
+
+void
+HostGuardPages(
+    unsigned long long Address,
+    unsigned long long Pages
+)
+{
+    if (mprotect((void*)Address, Pages * 4096, PROT_NONE))
+    {
+        HostFatal("mprotect failed");
+    }
+}
+
+void*
+HostAlloc(
+    unsigned long long Size
+)
+{
+    // pool allocations are 8 byte aligned in the firmware, 16 is what malloc gives anyway
+    return calloc(1, Size ? Size : 1);
+}
+
+void
+HostFree(
+    void* Buffer
+)
+{
+    free(Buffer);
+}
+
+static
+void
+HostpFill(
+    const struct stat* Info,
+    HOST_ENTRY* Entry
+)
+{
+    Entry->Directory        = S_ISDIR(Info->st_mode);
+    Entry->Size             = Entry->Directory ? 0 : (unsigned long long)Info->st_size;
+    Entry->ModificationTime = (long long)Info->st_mtime;
+}
+
+int
+HostStat(
+    const char* Path,
+    HOST_ENTRY* Entry
+)
+{
+    struct stat Info;
+    if (stat(Path, &Info))
+    {
+        return -1;
+    }
+
+    const char* Name = strrchr(Path, '/');
+    snprintf(Entry->Name, sizeof(Entry->Name), "%s", Name ? Name + 1 : Path);
+    HostpFill(&Info, Entry);
+    return 0;
+}
+
+void*
+HostOpenDirectory(
+    const char* Path
+)
+{
+    return opendir(Path);
+}
+
+int
+HostReadDirectory(
+    void* Directory,
+    const char* Path,
+    HOST_ENTRY* Entry
+)
+{
+    struct dirent* Next;
+
+    while ((Next = readdir((DIR*)Directory)))
+    {
+        if (!strcmp(Next->d_name, ".") || !strcmp(Next->d_name, ".."))
+        {
+            continue;
+        }
+
+        char        Full[4096];
+        struct stat Info;
+        snprintf(Full, sizeof(Full), "%s/%s", Path, Next->d_name);
+        if (stat(Full, &Info))
+        {
+            continue;
+        }
+
+        snprintf(Entry->Name, sizeof(Entry->Name), "%s", Next->d_name);
+        HostpFill(&Info, Entry);
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+HostCloseDirectory(
+    void* Directory
+)
+{
+    closedir((DIR*)Directory);
+}
+
+int
+HostOpenFile(
+    const char* Path,
+    int Write
+)
+{
+    return open(Path, Write ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+}
+
+long long
+HostReadFile(
+    int File,
+    unsigned long long Offset,
+    void* Buffer,
+    unsigned long long Size
+)
+{
+    unsigned long long Done = 0;
+
+    while (Done < Size)
+    {
+        ssize_t Read = pread(File, (char*)Buffer + Done, Size - Done, (off_t)(Offset + Done));
+        if (Read < 0)
+        {
+            return -1;
+        }
+
+        if (!Read)
+        {
+            break;
+        }
+
+        Done += (unsigned long long)Read;
+    }
+
+    return (long long)Done;
+}
+
+int
+HostWriteFile(
+    int File,
+    unsigned long long Offset,
+    const void* Buffer,
+    unsigned long long Size
+)
+{
+    unsigned long long Done = 0;
+
+    while (Done < Size)
+    {
+        ssize_t Written = pwrite(File, (const char*)Buffer + Done, Size - Done, (off_t)(Offset + Done));
+        if (Written <= 0)
+        {
+            return -1;
+        }
+
+        Done += (unsigned long long)Written;
+    }
+
+    return 0;
+}
+
+int
+HostResizeFile(
+    int File,
+    unsigned long long Size
+)
+{
+    return ftruncate(File, (off_t)Size);
+}
+
+void
+HostCloseFile(
+    int File
+)
+{
+    close(File);
+}
+
+int
+HostCreateTemporary(
+    char* Path
+)
+{
+    const char* Directory = getenv("TMPDIR");
+    snprintf(Path, 64, "%.40s/oplios-XXXXXX", Directory && strlen(Directory) <= 40 ? Directory : "/tmp");
+    return mkstemp(Path);
+}
+
+void
+HostRemove(
+    const char* Path
+)
+{
+    unlink(Path);
+}
+
+void
+HostWrite(
+    const char* Text,
+    unsigned long long Length
+)
+{
+    fwrite(Text, 1, Length, stdout);
+}
+
+void
+HostPrint(
+    const char* Format,
+    ...
+)
+{
+    va_list Arguments;
+
+    va_start(Arguments, Format);
+    vprintf(Format, Arguments);
+    va_end(Arguments);
+}
+
+void
+HostFatal(
+    const char* Message
+)
+{
+    fflush(stdout);
+    fprintf(stderr, "host: %s\n", Message);
+    abort();
+}
+
+void
+HostReportFailure(
+    const char* File,
+    int Line,
+    const char* Condition
+)
+{
+    fflush(stdout);
+    fprintf(stderr, "%s:%d: check failed: %s\n", File, Line, Condition);
+}
+
+void
+HostReportResult(
+    unsigned int Checks,
+    unsigned int Failures
+)
+{
+    fflush(stdout);
+    printf("%u checks, %u failed\n", Checks, Failures);
+    fflush(stdout);
+}
\ No newline at end of file
@@ -0,0 +1,243 @@
+#ifndef _HOST_H
+#define _HOST_H
+
+//
+//
+// The libc side of the host build. Loader sources are compiled against the EDK2 headers,
+// which cannot share a translation unit with the host's libc headers, so everything the
+// mock firmware needs from the host goes through these functions and plain C types.
+//
+//
+
+typedef struct _HOST_ENTRY
+{
+    char               Name[256];
+    int                Directory;
+    unsigned long long Size;
+    long long          ModificationTime; // seconds since the epoch
+} HOST_ENTRY;
+
+/**
+* @return Monotonic nanoseconds.
+*/
+unsigned long long
+HostNow(
+    void
+);
+
+/**
+* Sleeps until HostNow reaches Deadline, returns at once if it already did.
+*/
+void
+HostSleepUntil(
+    unsigned long long Deadline
+);
+
+/**
+* @return Processors the host has online.
+*/
+unsigned int
+HostProcessorCount(
+    void
+);
+
+typedef void (*HOST_THREAD_ROUTINE)(void* Context, unsigned int Index);
+
+/**
+* Runs Routine on Count threads at once, Index 0 to Count - 1, and waits for all of them.
+* Each thread has its own gs base, see include/intrin.h, so each can play a processor.
+*
+* @return Nanoseconds from when they were all let go to when the last one returned.
+*/
+unsigned long long
+HostRunThreads(
+    unsigned int Count,
+    HOST_THREAD_ROUTINE Routine,
+    void* Context
+);
+
+/**
+* Maps zeroed pages, at Address when it is not 0 and nothing is mapped there yet, else
+* anywhere that ends at or below Limit.
+*
+* @return The pages, 0 if they could not be mapped.
+*/
+unsigned long long
+HostMapPages(
+    unsigned long long Address,
+    unsigned long long Pages,
+    unsigned long long Limit
+);
+
+/**
+* Unmaps any page aligned run of what HostMapPages returned.
+*/
+void
+HostUnmapPages(
+    unsigned long long Address,
+    unsigned long long Pages
+);
+
+/**
+* Makes pages HostMapPages returned inaccessible, any access to them faults. Guard pages
+* for the tests of routines that must not read past a buffer.
+*/
+void
+HostGuardPages(
+    unsigned long long Address,
+    unsigned long long Pages
+);
+
+void*
+HostAlloc(
+    unsigned long long Size
+);
+
+void
+HostFree(
+    void* Buffer
+);
+
+/**
+* @return 0 if Path exists, with Entry filled in.
+*/
+int
+HostStat(
+    const char* Path,
+    HOST_ENTRY* Entry
+);
+
+/**
+* Opens a directory for HostReadDirectory.
+*
+* @return The handle, 0 on failure.
+*/
+void*
+HostOpenDirectory(
+    const char* Path
+);
+
+/**
+* Reads the next entry of a directory, "." and ".." are skipped.
+*
+* @return 1 when Entry was filled in, 0 at the end.
+*/
+int
+HostReadDirectory(
+    void* Directory,
+    const char* Path,
+    HOST_ENTRY* Entry
+);
+
+void
+HostCloseDirectory(
+    void* Directory
+);
+
+/**
+* Opens a file for reading, or creates and truncates it when Write is set.
+*
+* @return The descriptor, -1 on failure.
+*/
+int
+HostOpenFile(
+    const char* Path,
+    int Write
+);
+
+/**
+* @return Bytes read at Offset, -1 on failure.
+*/
+long long
+HostReadFile(
+    int File,
+    unsigned long long Offset,
+    void* Buffer,
+    unsigned long long Size
+);
+
+/**
+* @return 0 when all of Buffer was written at Offset.
+*/
+int
+HostWriteFile(
+    int File,
+    unsigned long long Offset,
+    const void* Buffer,
+    unsigned long long Size
+);
+
+/**
+* Sets the size of a file, what is added reads as zeroes and takes no space.
+*/
+int
+HostResizeFile(
+    int File,
+    unsigned long long Size
+);
+
+void
+HostCloseFile(
+    int File
+);
+
+/**
+* Creates an empty file under the temporary directory.
+*
+* @param Path Receives its name, at least 64 bytes.
+*
+* @return The descriptor open for reading and writing, -1 on failure.
+*/
+int
+HostCreateTemporary(
+    char* Path
+);
+
+void
+HostRemove(
+    const char* Path
+);
+
+/**
+* Writes to standard output.
+*/
+void
+HostWrite(
+    const char* Text,
+    unsigned long long Length
+);
+
+/**
+* printf to standard output, for programs built on the kernel's types, which have no PrintLib.
+*/
+void
+HostPrint(
+    const char* Format,
+    ...
+) __attribute__((format(printf, 1, 2)));
+
+/**
+* Reports a broken invariant of the host build itself and exits.
+*/
+void
+HostFatal(
+    const char* Message
+);
+
+/**
+* Reports a failed HOST_CHECK, see test.h.
+*/
+void
+HostReportFailure(
+    const char* File,
+    int Line,
+    const char* Condition
+);
+
+void
+HostReportResult(
+    unsigned int Checks,
+    unsigned int Failures
+);
+
+#endif // !_HOST_H
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef __PROCESSOR_BIND_H__
+#define __PROCESSOR_BIND_H__
+
+//
+//
+// X64 processor bindings for building loader sources on a Linux host with gcc. The EDK2
+// tree in bootloader/edk2 carries no X64 directory, and the host build wants the System V
+// calling convention everywhere: EFIAPI is empty, so the loader, the mock firmware and
+// the benchmark drivers all call each other like ordinary host functions.
+//
+//
+
+#define MDE_CPU_X64
+
+#define EFIAPI
+#define NO_MSABI_VA_FUNCS
+
+typedef unsigned long long  UINT64;
+typedef long long           INT64;
+typedef unsigned int        UINT32;
+typedef int                 INT32;
+typedef unsigned short      UINT16;
+typedef unsigned short      CHAR16;
+typedef short               INT16;
+typedef unsigned char       BOOLEAN;
+typedef unsigned char       UINT8;
+typedef char                CHAR8;
+typedef signed char         INT8;
+
+typedef UINT64 UINTN;
+typedef INT64  INTN;
+
+#define MAX_BIT            0x8000000000000000ULL
+#define MAX_2_BITS         0xC000000000000000ULL
+#define MAX_ADDRESS        0xFFFFFFFFFFFFFFFFULL
+#define MAX_ALLOC_ADDRESS  MAX_ADDRESS
+#define MAX_INTN           ((INTN)0x7FFFFFFFFFFFFFFFLL)
+#define MAX_UINTN          ((UINTN)0xFFFFFFFFFFFFFFFFULL)
+#define MIN_INTN           (((INTN)-9223372036854775807LL) - 1)
+
+#define CPU_STACK_ALIGNMENT                  16
+#define DEFAULT_PAGE_ALLOCATION_GRANULARITY  (0x1000)
+#define RUNTIME_PAGE_ALLOCATION_GRANULARITY  (0x1000)
+
+#define ASM_GLOBAL  .globl
+#define FUNCTION_ENTRY_POINT(FunctionPointer)  (VOID *)(UINTN)(FunctionPointer)
+
+#ifndef __USER_LABEL_PREFIX__
+#define __USER_LABEL_PREFIX__
+#endif
+
+#endif // !__PROCESSOR_BIND_H__
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifndef _HOST_INTRIN_H
+#define _HOST_INTRIN_H
+
+//
+//
+// The MSVC intrinsics the loader and kernel sources use, as the host can run them. Port
+// I/O and privileged instructions do nothing: there is no debug console to probe and no
+// interrupt flag a user process may touch. The GS base is a thread local, so every host
+// thread plays one processor.
+//
+//
+
+#include <x86intrin.h>
+
+#define HOST_MSR_GS_BASE        0xC0000101
+#define HOST_MSR_KERNEL_GS_BASE 0xC0000102
+
+extern __thread unsigned long long HostGsBase;
+
+static __inline unsigned char __inbyte(unsigned short Port) { (void)Port; return 0; }
+static __inline void __outbyte(unsigned short Port, unsigned char Value) { (void)Port; (void)Value; }
+static __inline void __halt(void) { __builtin_ia32_pause(); }
+static __inline void _disable(void) { }
+static __inline void _enable(void) { }
+static __inline unsigned long long __readeflags(void) { unsigned long long Flags; __asm__ __volatile__("pushfq; popq %0" : "=r"(Flags)); return Flags; }
+static __inline void __writemsr(unsigned long Msr, unsigned long long Value) { if (Msr == HOST_MSR_GS_BASE || Msr == HOST_MSR_KERNEL_GS_BASE) HostGsBase = Value; }
+static __inline unsigned long long __readgsqword(unsigned long Offset) { return *(unsigned long long*)(HostGsBase + Offset); }
+static __inline long _InterlockedExchange(volatile long* Target, long Value) { return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST); }
+static __inline long _InterlockedIncrement(volatile long* Target) { return __atomic_add_fetch(Target, 1, __ATOMIC_SEQ_CST); }
+static __inline long _InterlockedDecrement(volatile long* Target) { return __atomic_sub_fetch(Target, 1, __ATOMIC_SEQ_CST); }
+static __inline long _InterlockedCompareExchange(volatile long* Target, long Exchange, long Comparand) { __atomic_compare_exchange_n(Target, &Comparand, Exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); return Comparand; }
+
+#endif // !_HOST_INTRIN_H
\ No newline at end of file
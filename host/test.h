@@ -0,0 +1,32 @@
+#ifndef _TEST_H
+#define _TEST_H
+
+#include "host.h"
+
+//
+//
+// Checks for the host tests. A failed check is reported with its line and the test goes
+// on, main returns HostTestResult() so make check stops at the first failing binary.
+//
+//
+
+static unsigned int HostChecks;
+static unsigned int HostFailures;
+
+/**
+* Evaluates to the condition, so a test can skip what depends on a failed check.
+*/
+#define HOST_CHECK(Condition) \
+    (HostChecks++, (Condition) ? 1 : (HostFailures++, HostReportFailure(__FILE__, __LINE__, #Condition), 0))
+
+static
+int
+HostTestResult(
+    void
+)
+{
+    HostReportResult(HostChecks, HostFailures);
+    return HostFailures ? 1 : 0;
+}
+
+#endif // !_TEST_H
\ No newline at end of file
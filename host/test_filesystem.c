@@ -0,0 +1,530 @@
+#include "volume.h"
+#include "test.h"
+#include "../bootloader/filesystem.h"
+#include "../bootloader/fat.h"
+#include "../bootloader/image.h"
+#include "../bootloader/bundle.h"
+#include "../bootloader/log.h"
+#include "../bootloader/config.h"
+#include "../bootloader/preload.h"
+
+//
+//
+// Reads the synthetic volume (Makefile) through every loader path and checks the bytes
+// against the host files: the file protocol with and without ReadEx, the raw FAT reader on
+// 512 and 4096 byte blocks with and without BlockIo2, images plain and packed, bundles,
+// the loader directory index with what it leaves out, a failed stream wait, the configuration,
+// the stepped preload of a bare kernel and a media change.
+//
+//
+
+static CONST HOST_VOLUME_CONFIG Configs[] =
+{
+    // Directory, Label, Latency, Bandwidth, FileChunk, BlockSize, IoAlign, ReadEx, BlockIo2, Boot
+    { NULL, L"SYNC512",  20000, 0, 0x1000,  512,  0,      FALSE, FALSE, TRUE  },
+    { NULL, L"ASYNC4K",  20000, 0, 0x10000, 4096, 0x1000, TRUE,  TRUE,  FALSE },
+    { NULL, L"ASYNC512", 0,     0, 0,       512,  0x200,  TRUE,  TRUE,  FALSE },
+    { NULL, L"NOBLOCK",  0,     0, 0,       0,    0,      TRUE,  FALSE, FALSE },
+};
+
+static CONST CHAR16* CONST Files[] =
+{
+    L"kernel.exe",
+    L"kernel.lz4",
+    L"boot.bnd",
+    L"EFI\\OpliOS\\oplios.cfg",
+    L"EFI\\OpliOS\\drivers\\Long Module Name 3.sys",
+    L"EFI\\OpliOS\\drivers\\mod15.sys",
+    L"EFI\\OpliOS\\deep\\1\\2\\3\\4\\5\\6\\7\\8\\9\\10\\11\\12\\13\\14\\15\\16\\deep.cfg",
+};
+
+#define TEST_LONG_NAME 140 // characters of the long directory and file names, see the Makefile
+
+static CONST CHAR8* Root;
+
+/**
+* Reads a whole file of the volume directory with the host's own calls.
+*/
+static
+UINT8*
+TestHostFile(
+    _In_  CONST CHAR16* Path,
+    _Out_ UINT64* Size
+)
+{
+    CHAR8      Name[512];
+    HOST_ENTRY Entry;
+
+    AsciiSPrint(Name, sizeof(Name), "%a/%s", Root, Path);
+    for (UINTN i = 0; Name[i]; i++)
+    {
+        Name[i] = Name[i] == '\\' ? '/' : Name[i];
+    }
+
+    INT32 File = HostOpenFile(Name, 0);
+    if (File < 0 || HostStat(Name, &Entry))
+    {
+        HostFatal("synthetic volume is incomplete, run make check");
+    }
+
+    UINT8* Buffer = HostAlloc(Entry.Size + 1);
+    if (!Buffer || HostReadFile(File, 0, Buffer, Entry.Size) != (INT64)Entry.Size)
+    {
+        HostFatal("cannot read the synthetic volume");
+    }
+
+    HostCloseFile(File);
+    *Size = Entry.Size;
+    return Buffer;
+}
+
+/**
+* Lays a PE file out the way the loader maps it, headers and sections at their RVAs.
+*/
+static
+UINT8*
+TestLayoutImage(
+    _In_  CONST UINT8* File,
+    _Out_ UINT64* Size
+)
+{
+    CONST EFI_IMAGE_DOS_HEADER*   Dos     = (CONST EFI_IMAGE_DOS_HEADER*)File;
+    CONST EFI_IMAGE_NT_HEADERS64* Headers = (CONST EFI_IMAGE_NT_HEADERS64*)(File + Dos->e_lfanew);
+    CONST EFI_IMAGE_SECTION_HEADER* Section = (CONST EFI_IMAGE_SECTION_HEADER*)
+        ((CONST UINT8*)&Headers->OptionalHeader + Headers->FileHeader.SizeOfOptionalHeader);
+
+    *Size = Headers->OptionalHeader.SizeOfImage;
+    UINT8* Image = HostAlloc(*Size);
+    CopyMem(Image, File, Headers->OptionalHeader.SizeOfHeaders);
+
+    for (UINT32 i = 0; i < Headers->FileHeader.NumberOfSections; i++, Section++)
+    {
+        UINT64 Raw = Section->SizeOfRawData;
+        if (Section->Misc.VirtualSize && Raw > Section->Misc.VirtualSize)
+        {
+            Raw = Section->Misc.VirtualSize;
+        }
+
+        CopyMem(Image + Section->VirtualAddress, File + Section->PointerToRawData, Raw);
+    }
+
+    return Image;
+}
+
+/**
+* Reads a file with BlReaderStep and compares it with the host copy.
+*/
+static
+VOID
+TestReader(
+    _In_     EFI_FILE_PROTOCOL* File,
+    _In_opt_ PBL_FAT_FILE Raw,
+    _In_     CONST UINT8* Expected,
+    _In_     UINT64 Size
+)
+{
+    BL_FILE_READER Reader;
+    UINT64         Start;
+    UINT64         End;
+
+    if (!HOST_CHECK(BlReaderOpen(File, Raw, &Reader)) || !HOST_CHECK(Reader.Size == Size))
+    {
+        return;
+    }
+
+    Reader.Buffer = HostAlloc(Size + 1);
+    BOOLEAN Read = TRUE;
+    while (Read && Reader.Done < Reader.Size)
+    {
+        Read = BlReaderStep(&Reader, TRUE, &Start, &End);
+        HOST_CHECK(!Read || (Start <= End && End <= Size));
+    }
+
+    BlReaderClose(&Reader);
+    if (HOST_CHECK(Read))
+    {
+        HOST_CHECK(!CompareMem(Reader.Buffer, Expected, Size));
+    }
+
+    HostFree(Reader.Buffer);
+}
+
+/**
+* Loads Path through BlLoadPEImage64, moves it back to its preferred base and compares the
+* result with the expected layout.
+*/
+static
+VOID
+TestImage(
+    _In_     EFI_FILE_PROTOCOL* File,
+    _In_opt_ PBL_FAT_FILE Raw,
+    _In_     CONST UINT8* Layout,
+    _In_     UINT64 LayoutSize
+)
+{
+    BL_LOADED_IMAGE Image;
+
+    File->SetPosition(File, 0);
+    if (!HOST_CHECK(BL_SUCCESS(BlLoadPEImage64(File, Raw, &Image))))
+    {
+        return;
+    }
+
+    // the mock never hands out the preferred base, so the relocation pass always runs
+    HOST_CHECK(Image.ImageBase != Image.PreferredBase);
+    HOST_CHECK(Image.Relocations != 0);
+    HOST_CHECK(Image.ImageSize == LayoutSize);
+    HOST_CHECK(!(Image.ImageBase & (BL_IMAGE_ALIGNMENT - 1)));
+
+    HOST_CHECK(BL_SUCCESS(BlRebasePEImage64(&Image, Image.PreferredBase)));
+    HOST_CHECK(!CompareMem((VOID*)(UINTN)Image.ImageBase, Layout, LayoutSize));
+
+    BlUnloadPEImage64(&Image);
+}
+
+static
+VOID
+TestBundle(
+    _In_     EFI_FILE_PROTOCOL* File,
+    _In_opt_ PBL_FAT_FILE Raw,
+    _In_     CONST UINT8* Kernel,
+    _In_     UINT64 KernelSize
+)
+{
+    BL_BOOT_BUNDLE Bundle;
+
+    File->SetPosition(File, 0);
+    if (!HOST_CHECK(BL_SUCCESS(BlLoadBundle(File, Raw, &Bundle))))
+    {
+        return;
+    }
+
+    CONST BL_BUNDLE_ENTRY* Entry = BlBundleFind(&Bundle, BlBundleKernel, NULL);
+    if (HOST_CHECK(Entry != NULL) && HOST_CHECK(Entry->Size == KernelSize))
+    {
+        HOST_CHECK(!CompareMem(BlBundlePayload(&Bundle, Entry), Kernel, KernelSize));
+    }
+
+    HOST_CHECK(BlBundleFind(&Bundle, BlBundleModule, "disk.sys") != NULL);
+    HOST_CHECK(BlBundleFind(&Bundle, BlBundleModule, "missing.sys") == NULL);
+    BlFreeBundle(&Bundle);
+}
+
+static
+VOID
+TestVolume(
+    _In_ CONST HOST_VOLUME_CONFIG* Config,
+    _In_ EFI_HANDLE Handle
+)
+{
+    UINT32 Index;
+    if (!HOST_CHECK(BlFindVolumeIndex(Handle, &Index)))
+    {
+        return;
+    }
+
+    UINT64 KernelSize;
+    UINT64 LayoutSize;
+    UINT8* Kernel = TestHostFile(L"kernel.exe", &KernelSize);
+    UINT8* Layout = TestLayoutImage(Kernel, &LayoutSize);
+
+    for (UINT32 i = 0; i < ARRAY_SIZE(Files); i++)
+    {
+        EFI_FILE_PROTOCOL* File;
+        BL_FAT_FILE        Raw;
+        UINT64             Size;
+        UINT8*             Expected = TestHostFile(Files[i], &Size);
+        CHAR16             Path[256];
+
+        if (!HOST_CHECK(BlOpenVolumeFile(Index, Files[i], &File)))
+        {
+            HostFree(Expected);
+            continue;
+        }
+
+        TestReader(File, NULL, Expected, Size);
+
+        UnicodeSPrint(Path, sizeof(Path), L"\\%s", Files[i]);
+        BOOLEAN HasRaw = Config->BlockSize && HOST_CHECK(BL_SUCCESS(BlFatOpen(Handle, Path, &Raw)));
+        if (HasRaw)
+        {
+            HOST_CHECK(Raw.FileSize == Size);
+            File->SetPosition(File, 0);
+            TestReader(File, &Raw, Expected, Size);
+        }
+
+        if (!StrCmp(Files[i], L"kernel.exe") || !StrCmp(Files[i], L"kernel.lz4"))
+        {
+            TestImage(File, NULL, Layout, LayoutSize);
+            if (HasRaw)
+            {
+                TestImage(File, &Raw, Layout, LayoutSize);
+            }
+        }
+        else if (!StrCmp(Files[i], L"boot.bnd"))
+        {
+            TestBundle(File, NULL, Kernel, KernelSize);
+            if (HasRaw)
+            {
+                TestBundle(File, &Raw, Kernel, KernelSize);
+            }
+        }
+
+        if (HasRaw)
+        {
+            BlFatClose(&Raw);
+        }
+
+        File->Close(File);
+        HostFree(Expected);
+    }
+
+    // FAT names are case insensitive both through the index and the raw reader
+    EFI_FILE_PROTOCOL* File;
+    BL_FAT_FILE        Raw;
+    if (HOST_CHECK(BlOpenVolumeFile(Index, L"efi\\OPLIOS\\Drivers\\LONG MODULE NAME 3.SYS", &File)))
+    {
+        File->Close(File);
+    }
+    HOST_CHECK(!BlOpenVolumeFile(Index, L"EFI\\OpliOS\\drivers\\missing.sys", &File));
+    HOST_CHECK(!BlOpenVolumeFile(Index, L"missing.exe", &File));
+
+    // too long a path for the index, it is found on the volume instead
+    CHAR16 Long[2 * TEST_LONG_NAME + 32];
+    StrCpyS(Long, ARRAY_SIZE(Long), L"EFI\\OpliOS\\");
+
+    UINTN Length = StrLen(Long);
+    for (UINT32 i = 0; i < 2 * TEST_LONG_NAME + 1; i++)
+    {
+        Long[Length++] = i == TEST_LONG_NAME ? L'\\' : L'L';
+    }
+    StrCpyS(Long + Length, ARRAY_SIZE(Long) - Length, L".cfg");
+
+    if (HOST_CHECK(BlOpenVolumeFile(Index, Long, &File)))
+    {
+        CHAR8 Text[8];
+        UINTN Size = sizeof(Text);
+        HOST_CHECK(!EFI_ERROR(File->Read(File, &Size, Text)) && Size == 5 && !CompareMem(Text, "long\n", 5));
+        File->Close(File);
+    }
+
+    if (Config->BlockSize)
+    {
+        HOST_CHECK(BL_SUCCESS(BlFatOpen(Handle, L"\\EFI\\opliOS\\DRIVERS\\long module name 3.sys", &Raw)) && (BlFatClose(&Raw), TRUE));
+        HOST_CHECK(!BL_SUCCESS(BlFatOpen(Handle, L"\\EFI\\OpliOS\\drivers\\missing.sys", &Raw)));
+    }
+
+    HostFree(Layout);
+    HostFree(Kernel);
+}
+
+/**
+* Handles opened before a media change fail, the volume table opens the new media.
+*/
+static
+VOID
+TestMediaChange(
+    _In_ EFI_HANDLE Handle
+)
+{
+    UINT32             Index;
+    EFI_FILE_PROTOCOL* File;
+    UINT8              Buffer[16];
+    UINTN              Size = sizeof(Buffer);
+
+    if (!HOST_CHECK(BlFindVolumeIndex(Handle, &Index)) || !HOST_CHECK(BlOpenVolumeFile(Index, L"kernel.exe", &File)))
+    {
+        return;
+    }
+
+    HostChangeMedia(Handle);
+    HOST_CHECK(File->Read(File, &Size, Buffer) == EFI_MEDIA_CHANGED);
+    File->Close(File);
+
+    CONST BL_VOLUME* Volume = BlGetVolume(Index);
+    if (HOST_CHECK(Volume != NULL))
+    {
+        HOST_CHECK(Volume->MediaId == Volume->BlockIo->Media->MediaId);
+    }
+
+    if (HOST_CHECK(BlOpenVolumeFile(Index, L"EFI\\OpliOS\\oplios.cfg", &File)))
+    {
+        Size = sizeof(Buffer);
+        HOST_CHECK(!EFI_ERROR(File->Read(File, &Size, Buffer)) && Size == sizeof(Buffer));
+        File->Close(File);
+    }
+}
+
+/**
+* A stream whose wait fails still retires the request, so BlStreamClose can finish. The
+* mock's WaitForEvent refuses to wait above TPL_APPLICATION.
+*/
+static
+VOID
+TestStreamWaitFails(
+    _In_ EFI_HANDLE Handle
+)
+{
+    static BL_FILE_STREAM Stream; // a read given up on still completes into it later
+    static UINT8          Buffer[2][0x1000];
+    UINT32                Index;
+    EFI_FILE_PROTOCOL*    File;
+
+    if (!HOST_CHECK(BlFindVolumeIndex(Handle, &Index)) || !HOST_CHECK(BlOpenVolumeFile(Index, L"kernel.exe", &File)))
+    {
+        return;
+    }
+
+    if (HOST_CHECK(BlStreamOpen(File, 0, &Stream)) && HOST_CHECK(Stream.Overlapped))
+    {
+        HOST_CHECK(BlStreamQueue(&Stream, Buffer[0], sizeof(Buffer[0])));
+        HOST_CHECK(BlStreamQueue(&Stream, Buffer[1], sizeof(Buffer[1])));
+
+        EFI_TPL Tpl = gBS->RaiseTPL(TPL_CALLBACK);
+        HOST_CHECK(!BlStreamWait(&Stream, NULL, NULL));
+        gBS->RestoreTPL(Tpl);
+
+        HOST_CHECK(Stream.Count == 1);
+        BlStreamClose(&Stream);
+        HOST_CHECK(Stream.Count == 0);
+    }
+
+    File->Close(File);
+}
+
+/**
+* Preloads the bare kernel at Path from volume Index a step at a time, the way the menu does
+* during its countdown, and compares the image with the expected layout.
+*/
+static
+VOID
+TestPreload(
+    _In_ UINT32 Index,
+    _In_ CONST CHAR16* Path,
+    _In_ CONST UINT8* Layout,
+    _In_ UINT64 LayoutSize
+)
+{
+    BL_CONFIG* Config = (BL_CONFIG*)BlGetConfig();
+    BL_CONFIG  Saved  = *Config;
+    BL_PRELOAD Preload;
+
+    Config->Volume        = Index;
+    Config->BundlePath[0] = L'\0';
+    StrCpyS(Config->KernelPath, BL_CONFIG_MAX_PATH, Path);
+
+    if (HOST_CHECK(BL_SUCCESS(BlStartPreload(&Preload))))
+    {
+        // a few steps that do not wait, BlWaitPreload does the rest
+        for (UINT32 Step = 0; Step < 8 && !BlPreloadFinished(&Preload); Step++)
+        {
+            BlPreloadStep(&Preload);
+        }
+
+        if (HOST_CHECK(BL_SUCCESS(BlWaitPreload(&Preload))))
+        {
+            HOST_CHECK(Preload.Volume == Index && !Preload.FromBundle);
+            HOST_CHECK(Preload.Kernel.ImageSize == LayoutSize);
+            HOST_CHECK(BL_SUCCESS(BlRebasePEImage64(&Preload.Kernel, Preload.Kernel.PreferredBase)));
+            HOST_CHECK(!CompareMem((VOID*)(UINTN)Preload.Kernel.ImageBase, Layout, LayoutSize));
+            BlUnloadPEImage64(&Preload.Kernel);
+        }
+
+        BlClosePreload(&Preload);
+    }
+
+    *Config = Saved;
+}
+
+/**
+* The defaults before BlLoadConfig, then the volume's \EFI\OpliOS\oplios.cfg on top of
+* them: a fast profile, the bundle and one module, the kernel path left alone.
+*/
+static
+VOID
+TestConfig(
+    VOID
+)
+{
+    CONST BL_CONFIG* Config = BlGetConfig();
+
+    HOST_CHECK(Config->Profile == BlProfileInteractive);
+    HOST_CHECK(Config->Timeout == BL_CONFIG_DEFAULT_TIMEOUT);
+    HOST_CHECK(Config->Volume == BL_CONFIG_ANY_VOLUME);
+    HOST_CHECK(Config->Processors == BL_CONFIG_ALL_PROCESSORS);
+    HOST_CHECK(Config->ListFiles && Config->Pause && !Config->Loaded && !Config->LoadedFrom);
+    HOST_CHECK(!StrCmp(Config->KernelPath, L"\\" BL_KERNEL_PATH));
+    HOST_CHECK(!StrCmp(Config->BundlePath, L"\\" BL_BUNDLE_PATH));
+    HOST_CHECK(Config->ModuleCount == 0);
+
+    HOST_CHECK(BlLoadConfig() == BL_STATUS_OK);
+    HOST_CHECK(Config->Loaded && !StrCmp(Config->LoadedFrom, L"\\" BL_LOADER_DIRECTORY L"\\" BL_CONFIG_PATH));
+    HOST_CHECK(Config->Profile == BlProfileFast && Config->Timeout == 0 && !Config->ListFiles && !Config->Pause);
+    HOST_CHECK(!StrCmp(Config->KernelPath, L"\\" BL_KERNEL_PATH));
+    HOST_CHECK(!StrCmp(Config->BundlePath, L"\\boot.bnd"));
+    HOST_CHECK(Config->ModuleCount == 1 && BlConfigWantsModule("disk.sys") && !BlConfigWantsModule("mod1.sys"));
+}
+
+INT32
+main(
+    INT32 Argc,
+    CHAR8** Argv
+)
+{
+    EFI_HANDLE Handles[ARRAY_SIZE(Configs)];
+
+    Root = Argc > 1 ? Argv[1] : "out/volume";
+
+    HostFirmware.Quiet = TRUE;
+    HostFirmwareInit();
+    BlLogInit();
+
+    for (UINT32 i = 0; i < ARRAY_SIZE(Configs); i++)
+    {
+        HOST_VOLUME_CONFIG Config = Configs[i];
+        Config.Directory = Root;
+        Handles[i] = HostMountVolume(&Config);
+        if (!HOST_CHECK(Handles[i] != NULL))
+        {
+            return HostTestResult();
+        }
+    }
+
+    HOST_CHECK(BlInitFileSystem());
+    HOST_CHECK(BlGetVolumeCount() == ARRAY_SIZE(Configs));
+
+    UINT32 Boot = BlGetBootVolumeIndex();
+    HOST_CHECK(Boot != MAX_UINT32 && BlGetVolume(Boot)->Handle == Handles[0]);
+
+    for (UINT32 i = 0; i < ARRAY_SIZE(Configs); i++)
+    {
+        TestVolume(&Configs[i], Handles[i]);
+    }
+
+    TestStreamWaitFails(Handles[1]);
+    TestConfig();
+
+    // over the raw FAT extents, then streamed where there is no block device
+    UINT64 KernelSize;
+    UINT64 LayoutSize;
+    UINT8* Kernel = TestHostFile(L"kernel.exe", &KernelSize);
+    UINT8* Layout = TestLayoutImage(Kernel, &LayoutSize);
+    UINT32 Preloaded[] = { 0, 3 };
+    for (UINT32 i = 0; i < ARRAY_SIZE(Preloaded); i++)
+    {
+        UINT32 Index;
+        if (HOST_CHECK(BlFindVolumeIndex(Handles[Preloaded[i]], &Index)))
+        {
+            TestPreload(Index, L"\\kernel.exe", Layout, LayoutSize);
+            TestPreload(Index, L"\\kernel.lz4", Layout, LayoutSize);
+        }
+    }
+    HostFree(Layout);
+    HostFree(Kernel);
+
+    TestMediaChange(Handles[0]);
+
+    HostUnmountVolumes();
+    HostFirmwareReset();
+    return HostTestResult();
+}
\ No newline at end of file
@@ -0,0 +1,518 @@
+#include "test.h"
+#include "../kernal/mm.h"
+#include <intrin.h>
+
+//
+//
+// Runs the page allocator on a 256 MiB block of host memory described by a fake loader
+// memory map: holes, a range below MM_LOW_LIMIT, ranges that do not start or end on a large
+// block boundary. Random allocations and frees of every kind are checked against a map of
+// who owns each frame, every page handed out is stamped with its block's address and the
+// stamp checked when it comes back, so an overlap shows up either way. Frees the allocator
+// has to refuse are tried along the way, and at the end everything has to merge back to the
+// blocks it was seeded with.
+//
+//
+
+#define TEST_MEMORY (256ULL << 20)
+#define TEST_FRAMES (TEST_MEMORY >> MM_PAGE_SHIFT)
+#define TEST_LIVE   50000
+#define TEST_ROUNDS 1000000
+
+#define TEST_FREE  0 // the allocator may hand it out
+#define TEST_TAKEN 1 // in a block the test holds
+#define TEST_NEVER 2 // must never be handed out
+
+typedef struct _TEST_BLOCK
+{
+    UINT64  Address;
+    UINT64  Pages;
+    UINT32  Order;      // MmAllocatePages blocks
+    BOOLEAN Contiguous; // MmAllocateContiguous
+} TEST_BLOCK;
+
+typedef struct _TEST_BOOT
+{
+    BOOT_INFO         Info;
+    BOOT_MEMORY_RANGE Ranges[8];
+} TEST_BOOT;
+
+static CONST BOOT_MEMORY_RANGE Ranges[] =
+{
+    { 0x0,        0x9F,  BootMemoryFree,     0 }, // below MM_LOW_LIMIT
+    { 0x9F000,    0x61,  BootMemoryReserved, 0 },
+    { 0x100000,   0x700, BootMemoryFree,     0 },
+    { 0x800000,   0x1,   BootMemoryBootInfo, 0 }, // TEST_BOOT
+    { 0x801000,   0xFF,  BootMemoryLoader,   0 },
+    { 0x900000,   0x3000, BootMemoryFree,    0 },
+    { 0x3900000,  0x203, BootMemoryModule,   0 }, // the big range starts 3 pages past 2 MiB
+    { 0x3B03000,  (UINT32)(TEST_FRAMES - 0x3B03 - 0x100), BootMemoryFree, 0 },
+};
+
+static UINT8*     Memory;
+static UINT8      Owner[TEST_FRAMES];
+static TEST_BLOCK Live[TEST_LIVE];
+static UINT32     LiveCount;
+static UINT32     Seed = 0x4D4D;
+
+static
+UINT32
+TestRandom(
+    VOID
+)
+{
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 17;
+    Seed ^= Seed << 5;
+    return Seed;
+}
+
+static
+VOID
+TestMark(
+    _In_ UINT64 Address,
+    _In_ UINT64 Pages,
+    _In_ UINT8 State
+)
+{
+    for (UINT64 i = 0; i < Pages; i++)
+    {
+        Owner[(Address >> MM_PAGE_SHIFT) + i] = State;
+    }
+}
+
+/**
+* Lays out the fake memory map and the boot information in the BootMemoryBootInfo page.
+*/
+static
+BOOT_INFO*
+TestBootInfo(
+    VOID
+)
+{
+    Memory = (UINT8*)(UINTN)HostMapPages(0, TEST_FRAMES, MM_ANY_ADDRESS);
+    if (!Memory)
+    {
+        HostFatal("cannot map the test memory");
+    }
+
+    TEST_BOOT* Boot = (TEST_BOOT*)(Memory + 0x800000);
+    for (UINT32 i = 0; i < sizeof(Ranges) / sizeof(Ranges[0]); i++)
+    {
+        Boot->Ranges[i] = Ranges[i];
+        if (Ranges[i].Type != BootMemoryFree || Ranges[i].Base < MM_LOW_LIMIT)
+        {
+            TestMark(Ranges[i].Base, Ranges[i].Pages, TEST_NEVER);
+        }
+    }
+
+    // nothing describes the last MiB, it must stay out of the allocator too
+    TestMark(TEST_MEMORY - 0x100000, 0x100, TEST_NEVER);
+
+    Boot->Info.Signature        = BOOT_INFO_SIGNATURE;
+    Boot->Info.Version          = BOOT_INFO_VERSION;
+    Boot->Info.HeaderSize       = sizeof(BOOT_INFO);
+    Boot->Info.Base             = 0x800000;
+    Boot->Info.Size             = sizeof(TEST_BOOT);
+    Boot->Info.MemoryMap        = 0x800000 + __builtin_offsetof(TEST_BOOT, Ranges);
+    Boot->Info.MemoryRangeCount = sizeof(Ranges) / sizeof(Ranges[0]);
+    Boot->Info.MemoryRangeSize  = sizeof(BOOT_MEMORY_RANGE);
+    Boot->Info.DirectMapBase    = (UINT64)(UINTN)Memory;
+    Boot->Info.DirectMapSize    = TEST_MEMORY;
+    return &Boot->Info;
+}
+
+/**
+* Takes ownership of a block the allocator handed out and stamps every page of it.
+*/
+static
+BOOLEAN
+TestClaim(
+    _In_ CONST TEST_BLOCK* Block
+)
+{
+    UINT64 Frame = Block->Address >> MM_PAGE_SHIFT;
+
+    if (!HOST_CHECK(Block->Address + Block->Pages * MM_PAGE_SIZE <= TEST_MEMORY))
+    {
+        return FALSE;
+    }
+
+    for (UINT64 i = 0; i < Block->Pages; i++)
+    {
+        if (!HOST_CHECK(Owner[Frame + i] == TEST_FREE))
+        {
+            return FALSE;
+        }
+
+        Owner[Frame + i] = TEST_TAKEN;
+        *(UINT64*)(Memory + Block->Address + i * MM_PAGE_SIZE) = Block->Address;
+    }
+
+    return TRUE;
+}
+
+/**
+* Checks the stamps of a block about to be freed and gives up ownership.
+*/
+static
+BOOLEAN
+TestRelease(
+    _In_ CONST TEST_BLOCK* Block
+)
+{
+    UINT64 Frame = Block->Address >> MM_PAGE_SHIFT;
+
+    for (UINT64 i = 0; i < Block->Pages; i++)
+    {
+        if (!HOST_CHECK(*(UINT64*)(Memory + Block->Address + i * MM_PAGE_SIZE) == Block->Address))
+        {
+            return FALSE;
+        }
+
+        Owner[Frame + i] = TEST_FREE;
+    }
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+TestFree(
+    _In_ CONST TEST_BLOCK* Block
+)
+{
+    if (!TestRelease(Block))
+    {
+        return FALSE;
+    }
+
+    if (Block->Contiguous)
+    {
+        return HOST_CHECK(MmFreeContiguous(Block->Address, Block->Pages));
+    }
+
+    return HOST_CHECK(MmFreePages(Block->Address, Block->Order));
+}
+
+/**
+* One random allocation: mostly small orders, some large ones, contiguous runs of odd
+* sizes, some of them below 16 MiB.
+*/
+static
+BOOLEAN
+TestAllocate(
+    _Out_ TEST_BLOCK* Block
+)
+{
+    Block->Contiguous = TestRandom() % 3 == 0;
+
+    if (!Block->Contiguous)
+    {
+        Block->Order   = TestRandom() % 10 ? TestRandom() % 4 : TestRandom() % 12;
+        Block->Pages   = 1ULL << Block->Order;
+        Block->Address = MmAllocatePages(Block->Order);
+        return !Block->Address ||
+               HOST_CHECK(!(Block->Address & (Block->Pages * MM_PAGE_SIZE - 1)));
+    }
+
+    UINT64 Highest = TestRandom() % 4 ? MM_ANY_ADDRESS : 0xFFFFFF;
+
+    Block->Order   = 0;
+    Block->Pages   = 1 + TestRandom() % (TestRandom() % 10 ? 40 : 3000);
+    Block->Address = MmAllocateContiguous(Block->Pages, Highest);
+    return !Block->Address ||
+           HOST_CHECK(Block->Address + Block->Pages * MM_PAGE_SIZE - 1 <= Highest);
+}
+
+static
+VOID
+TestRandomRounds(
+    VOID
+)
+{
+    UINT32 Failed = 0;
+
+    for (UINT32 Round = 0; Round < TEST_ROUNDS; Round++)
+    {
+        if (LiveCount && (TestRandom() % 2 || LiveCount == TEST_LIVE))
+        {
+            UINT32     Index = TestRandom() % LiveCount;
+            TEST_BLOCK Block = Live[Index];
+
+            Live[Index] = Live[--LiveCount];
+            if (!TestFree(&Block))
+            {
+                return;
+            }
+            continue;
+        }
+
+        TEST_BLOCK Block;
+        if (!TestAllocate(&Block))
+        {
+            return;
+        }
+
+        if (!Block.Address)
+        {
+            Failed++;
+            continue;
+        }
+
+        if (!TestClaim(&Block))
+        {
+            return;
+        }
+
+        Live[LiveCount++] = Block;
+    }
+
+    // the live set is large enough that the big orders run out every so often
+    HOST_CHECK(Failed > 0 && Failed < TEST_ROUNDS / 10);
+}
+
+/**
+* A free the allocator has to refuse, or for order 0 and MM_LARGE_ORDER take into the
+* magazine and drop when it drains. The test holds the block Address is in, so freeing it
+* for real would show up as a broken stamp or a failed merge later on.
+*/
+static
+VOID
+TestBadFree(
+    _In_ UINT64 Address,
+    _In_ UINT32 Order
+)
+{
+    MM_PROCESSOR_STATISTICS Before;
+    MM_PROCESSOR_STATISTICS After;
+    UINT32                  Index = Order ? 1 : 0;
+
+    MmQueryProcessorStatistics(0, &Before);
+    if (!MmFreePages(Address, Order) || !HOST_CHECK(Order == 0 || Order == MM_LARGE_ORDER))
+    {
+        return;
+    }
+
+    MmDrainProcessor();
+    MmQueryProcessorStatistics(0, &After);
+    HOST_CHECK(After.Counters[Index].Discarded == Before.Counters[Index].Discarded + 1);
+}
+
+static
+VOID
+TestBadFrees(
+    VOID
+)
+{
+    static CONST UINT32 Orders[] = { 0, 1, 3, MM_LARGE_ORDER, 11 };
+
+    for (UINT32 o = 0; o < sizeof(Orders) / sizeof(Orders[0]); o++)
+    {
+        UINT32 Order   = Orders[o];
+        UINT64 Size    = MM_PAGE_SIZE << Order;
+        UINT64 Address = MmAllocatePages(Order);
+
+        if (!HOST_CHECK(Address))
+        {
+            continue;
+        }
+
+        TestBadFree(Address, Order + 1);
+        TestBadFree(Address + 1, Order);
+        if (Order)
+        {
+            TestBadFree(Address, Order - 1);
+            TestBadFree(Address + Size / 2, Order - 1);
+            TestBadFree(Address + MM_PAGE_SIZE, 0);
+        }
+
+        // free twice, and addresses nothing was allocated at
+        HOST_CHECK(MmFreePages(Address, Order));
+        HOST_CHECK(!MmFreePages(Address, Order));
+        TestBadFree(0x9F000, Order);
+        TestBadFree(TEST_MEMORY + Size, Order);
+
+        // twice with a drain in between, the magazine no longer knows it has the block
+        if (Order == 0 || Order == MM_LARGE_ORDER)
+        {
+            MmDrainProcessor();
+            TestBadFree(Address, Order);
+        }
+    }
+
+    // 5 pages come out of an 8 page block, the 3 past them are freed straight away
+    UINT64 Address = MmAllocateContiguous(5, MM_ANY_ADDRESS);
+    if (HOST_CHECK(Address))
+    {
+        HOST_CHECK(!MmFreeContiguous(Address, 8));
+        HOST_CHECK(!MmFreeContiguous(Address + MM_PAGE_SIZE, 4));
+        HOST_CHECK(!MmFreePages(Address, 3));
+        TestBadFree(Address + 5 * MM_PAGE_SIZE, 0);
+        HOST_CHECK(MmFreeContiguous(Address, 5));
+        HOST_CHECK(!MmFreeContiguous(Address, 5));
+    }
+
+    // too large, and nothing that low
+    HOST_CHECK(!MmAllocatePages(MM_MAX_ORDER + 1));
+    HOST_CHECK(!MmAllocateContiguous(0, MM_ANY_ADDRESS));
+    HOST_CHECK(!MmAllocateContiguous((1ULL << MM_MAX_ORDER) + 1, MM_ANY_ADDRESS));
+    HOST_CHECK(!MmAllocateContiguous(1, MM_LOW_LIMIT - 1));
+}
+
+static
+BOOLEAN
+TestSameFreeBlocks(
+    _In_ CONST MM_STATISTICS* Expected
+)
+{
+    MM_STATISTICS Statistics;
+
+    MmQueryStatistics(&Statistics);
+    if (!HOST_CHECK(Statistics.FreePages == Expected->FreePages) || !HOST_CHECK(Statistics.CachedPages == 0))
+    {
+        return FALSE;
+    }
+
+    for (UINT32 Order = 0; Order < MM_ORDERS; Order++)
+    {
+        if (!HOST_CHECK(Statistics.FreeBlocks[Order] == Expected->FreeBlocks[Order]))
+        {
+            HostPrint("order %u: %llu free blocks, %llu after seeding\n", Order,
+                      Statistics.FreeBlocks[Order], Expected->FreeBlocks[Order]);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+* Takes every page one at a time, then everything below 16 MiB as DMA memory.
+*/
+static
+VOID
+TestExhaust(
+    _In_ CONST MM_STATISTICS* Seeded
+)
+{
+    TEST_BLOCK Block  = { 0, 1, 0, FALSE };
+    UINT64     Handed = 0;
+
+    LiveCount = 0;
+    while ((Block.Address = MmAllocatePages(0)))
+    {
+        if (!TestClaim(&Block))
+        {
+            return;
+        }
+        Handed++;
+    }
+
+    HOST_CHECK(Handed == Seeded->FreePages);
+    HOST_CHECK(!MmAllocateContiguous(1, MM_ANY_ADDRESS));
+
+    for (UINT64 Frame = 0; Frame < TEST_FRAMES; Frame++)
+    {
+        if (Owner[Frame] == TEST_TAKEN)
+        {
+            Block.Address = Frame << MM_PAGE_SHIFT;
+            if (!TestFree(&Block))
+            {
+                return;
+            }
+        }
+    }
+
+    MmDrainProcessor();
+    if (!TestSameFreeBlocks(Seeded))
+    {
+        return;
+    }
+
+    Block.Contiguous = TRUE;
+    Handed           = 0;
+    while ((Block.Address = MmAllocateContiguous(3, 0xFFFFFF)))
+    {
+        Block.Pages = 3;
+        if (!TestClaim(&Block) || !HOST_CHECK(Block.Address + 3 * MM_PAGE_SIZE <= 0x1000000))
+        {
+            return;
+        }
+        Live[LiveCount++] = Block;
+        Handed           += 3;
+    }
+
+    // each run of 3 takes a 4 page block and gives the last page back, where no run fits
+    HOST_CHECK(Handed == (0x700 + 0x700) / 4 * 3);
+    while (LiveCount)
+    {
+        if (!TestFree(&Live[--LiveCount]))
+        {
+            return;
+        }
+    }
+}
+
+INT32
+main(
+    INT32 Argc,
+    CHAR8** Argv
+)
+{
+    BOOT_INFO*              BootInfo = TestBootInfo();
+    MM_STATISTICS           Seeded;
+    MM_PROCESSOR_STATISTICS Processor;
+
+    if (!HOST_CHECK(MmInitialize(BootInfo)) || !HOST_CHECK(MmInitializeProcessor(0)))
+    {
+        return HostTestResult();
+    }
+
+    HOST_CHECK(!MmInitializeProcessor(0));
+    HOST_CHECK(!MmInitializeProcessor(MM_MAX_PROCESSORS));
+    HOST_CHECK(!MmQueryProcessorStatistics(1, &Processor));
+
+    // the page array and the magazine page, at the gs base, are taken by the allocator itself
+    MmQueryStatistics(&Seeded);
+    TestMark(Seeded.MetadataBase, (Seeded.MetadataSize + MM_PAGE_SIZE - 1) >> MM_PAGE_SHIFT, TEST_NEVER);
+    TestMark(HostGsBase - (UINT64)(UINTN)Memory, 1, TEST_NEVER);
+
+    UINT64 Usable = 0;
+    for (UINT64 Frame = 0; Frame < TEST_FRAMES; Frame++)
+    {
+        Usable += Owner[Frame] == TEST_FREE;
+    }
+    HOST_CHECK(Seeded.FreePages == Usable);
+    HOST_CHECK(Seeded.TotalPages == Usable + 1);
+    HOST_CHECK(Seeded.MetadataBase >= 0x3B03000 && Seeded.MetadataBase + Seeded.MetadataSize <= TEST_MEMORY - 0x100000);
+
+    TestRandomRounds();
+    while (LiveCount)
+    {
+        if (!TestFree(&Live[--LiveCount]))
+        {
+            return HostTestResult();
+        }
+    }
+
+    TestBadFrees();
+
+    MmDrainProcessor();
+    if (TestSameFreeBlocks(&Seeded))
+    {
+        TestExhaust(&Seeded);
+    }
+
+    if (HOST_CHECK(MmQueryProcessorStatistics(0, &Processor)))
+    {
+        HOST_CHECK(Processor.Counters[0].AllocateHits > Processor.Counters[0].AllocateMisses);
+        HOST_CHECK(Processor.Counters[0].FreeHits > Processor.Counters[0].FreeMisses);
+        HOST_CHECK(Processor.Counters[1].AllocateHits + Processor.Counters[1].AllocateMisses > 0);
+
+        // the bad frees TestBadFrees got into a magazine
+        HOST_CHECK(Processor.Counters[0].Discarded && Processor.Counters[1].Discarded);
+    }
+
+    return HostTestResult();
+}
\ No newline at end of file
@@ -0,0 +1,281 @@
+#include "test.h"
+#include "../kernal/mm.h"
+#include <intrin.h>
+
+//
+//
+// The page allocator with TEST_THREADS host threads playing processors at once, each with
+// its own magazines. They allocate and free a random mix of magazine and locked orders and
+// pass blocks to each other through a mailbox, so a block is often freed into a different
+// magazine than the one it came from. Every frame handed out is claimed in a shared owner map
+// with a compare and swap, two processors getting the same frame fails the claim. When all
+// are done every page has to be back on the free lists.
+//
+// The host may have fewer cores than threads, the threads are then interleaved by the
+// scheduler, which still preempts them in the middle of the magazine paths.
+//
+//
+
+#define TEST_MEMORY  (128ULL << 20)
+#define TEST_FRAMES  (TEST_MEMORY >> MM_PAGE_SHIFT)
+#define TEST_THREADS 8
+#define TEST_ROUNDS  200000 // per thread
+#define TEST_LIVE    1024   // blocks a thread holds at most
+#define TEST_MAILBOX 64
+
+typedef struct _TEST_THREAD
+{
+    UINT64       Live[TEST_LIVE];
+    UINT32       Orders[TEST_LIVE];
+    UINT32       Count;
+    UINT32       Seed;
+    CONST CHAR8* Broken; // what went wrong, the thread stops at the first
+} TEST_THREAD;
+
+typedef struct _TEST_BOOT
+{
+    BOOT_INFO         Info;
+    BOOT_MEMORY_RANGE Ranges[2];
+} TEST_BOOT;
+
+static volatile long Owner[TEST_FRAMES];     // 1 while a thread holds the frame
+static volatile long Mailbox[TEST_MAILBOX];  // frame << 5 | order, 0 when empty
+static TEST_THREAD   Threads[TEST_THREADS];
+
+static
+UINT32
+TestRandom(
+    _Inout_ UINT32* Seed
+)
+{
+    *Seed ^= *Seed << 13;
+    *Seed ^= *Seed >> 17;
+    *Seed ^= *Seed << 5;
+    return *Seed;
+}
+
+static
+BOOT_INFO*
+TestBootInfo(
+    VOID
+)
+{
+    UINT8* Memory = (UINT8*)(UINTN)HostMapPages(0, TEST_FRAMES, MM_ANY_ADDRESS);
+    if (!Memory)
+    {
+        HostFatal("cannot map the test memory");
+    }
+
+    TEST_BOOT* Boot = (TEST_BOOT*)(Memory + MM_LOW_LIMIT);
+
+    Boot->Ranges[0].Base  = MM_LOW_LIMIT;
+    Boot->Ranges[0].Pages = 1;
+    Boot->Ranges[0].Type  = BootMemoryBootInfo;
+    Boot->Ranges[1].Base  = MM_LOW_LIMIT + MM_PAGE_SIZE;
+    Boot->Ranges[1].Pages = (UINT32)(TEST_FRAMES - (MM_LOW_LIMIT >> MM_PAGE_SHIFT) - 1);
+    Boot->Ranges[1].Type  = BootMemoryFree;
+
+    Boot->Info.Signature        = BOOT_INFO_SIGNATURE;
+    Boot->Info.Version          = BOOT_INFO_VERSION;
+    Boot->Info.HeaderSize       = sizeof(BOOT_INFO);
+    Boot->Info.MemoryMap        = MM_LOW_LIMIT + __builtin_offsetof(TEST_BOOT, Ranges);
+    Boot->Info.MemoryRangeCount = 2;
+    Boot->Info.MemoryRangeSize  = sizeof(BOOT_MEMORY_RANGE);
+    Boot->Info.DirectMapBase    = (UINT64)(UINTN)Memory;
+    Boot->Info.DirectMapSize    = TEST_MEMORY;
+    return &Boot->Info;
+}
+
+/**
+* Swaps every frame of a block between Expected and Value in the owner map.
+*/
+static
+BOOLEAN
+TestOwn(
+    _In_ UINT64 Address,
+    _In_ UINT32 Order,
+    _In_ long Expected,
+    _In_ long Value
+)
+{
+    UINT64 Frame = Address >> MM_PAGE_SHIFT;
+
+    for (UINT64 i = 0; i < (1ULL << Order); i++)
+    {
+        if (_InterlockedCompareExchange(&Owner[Frame + i], Value, Expected) != Expected)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static
+VOID
+TestKeep(
+    _Inout_ TEST_THREAD* Thread,
+    _In_    UINT64 Address,
+    _In_    UINT32 Order
+)
+{
+    Thread->Live[Thread->Count]   = Address;
+    Thread->Orders[Thread->Count] = Order;
+    Thread->Count++;
+}
+
+static
+VOID
+TestFree(
+    _Inout_ TEST_THREAD* Thread,
+    _In_    UINT32 At
+)
+{
+    UINT64 Address = Thread->Live[At];
+    UINT32 Order   = Thread->Orders[At];
+
+    Thread->Count--;
+    Thread->Live[At]   = Thread->Live[Thread->Count];
+    Thread->Orders[At] = Thread->Orders[Thread->Count];
+
+    if (!TestOwn(Address, Order, 1, 0))
+    {
+        Thread->Broken = "a held block was freed by someone else";
+    }
+    else if (!MmFreePages(Address, Order))
+    {
+        Thread->Broken = "a free was refused";
+    }
+}
+
+static
+VOID
+TestThread(
+    _In_ VOID* Context,
+    _In_ UINT32 Index
+)
+{
+    TEST_THREAD* Thread = &Threads[Index];
+
+    Thread->Seed = Index * 7919 + 1;
+    if (!MmInitializeProcessor(Index + 1))
+    {
+        Thread->Broken = "MmInitializeProcessor failed";
+        return;
+    }
+
+    for (UINT32 Round = 0; Round < TEST_ROUNDS && !Thread->Broken; Round++)
+    {
+        UINT32 Random = TestRandom(&Thread->Seed);
+
+        if (Thread->Count && ((Random & 1) || Thread->Count == TEST_LIVE))
+        {
+            TestFree(Thread, (Random >> 8) % Thread->Count);
+            continue;
+        }
+
+        // a held block for whatever another processor left in the slot
+        if (Thread->Count && (Random >> 1) % 16 == 0)
+        {
+            UINT32 At   = (Random >> 8) % Thread->Count;
+            long   Sent = (long)((Thread->Live[At] >> MM_PAGE_SHIFT) << 5 | Thread->Orders[At]);
+            long   Got  = _InterlockedExchange(&Mailbox[(Random >> 20) % TEST_MAILBOX], Sent);
+
+            Thread->Count--;
+            Thread->Live[At]   = Thread->Live[Thread->Count];
+            Thread->Orders[At] = Thread->Orders[Thread->Count];
+            if (Got)
+            {
+                TestKeep(Thread, (UINT64)(Got >> 5) << MM_PAGE_SHIFT, Got & 31);
+            }
+            continue;
+        }
+
+        UINT32 Kind    = (Random >> 12) % 10;
+        UINT32 Order   = Kind < 6 ? 0 : Kind < 8 ? MM_LARGE_ORDER : (Random >> 16) % 4;
+        UINT64 Address = MmAllocatePages(Order);
+
+        if (!Address)
+        {
+            continue;
+        }
+
+        if (Address & ((MM_PAGE_SIZE << Order) - 1))
+        {
+            Thread->Broken = "a block is not aligned to its size";
+        }
+        else if (!TestOwn(Address, Order, 0, 1))
+        {
+            Thread->Broken = "two processors got the same frame";
+        }
+        else
+        {
+            TestKeep(Thread, Address, Order);
+        }
+    }
+
+    while (Thread->Count && !Thread->Broken)
+    {
+        TestFree(Thread, Thread->Count - 1);
+    }
+
+    MmDrainProcessor();
+}
+
+INT32
+main(
+    INT32 Argc,
+    CHAR8** Argv
+)
+{
+    MM_STATISTICS Seeded;
+    MM_STATISTICS Statistics;
+
+    // processor 0 is the main thread, it frees what is left in the mailbox
+    if (!HOST_CHECK(MmInitialize(TestBootInfo())) || !HOST_CHECK(MmInitializeProcessor(0)))
+    {
+        return HostTestResult();
+    }
+
+    MmQueryStatistics(&Seeded);
+    HostRunThreads(TEST_THREADS, TestThread, NULL);
+
+    for (UINT32 i = 0; i < TEST_THREADS; i++)
+    {
+        if (!HOST_CHECK(!Threads[i].Broken))
+        {
+            HostPrint("thread %u: %s\n", i, Threads[i].Broken);
+            return HostTestResult();
+        }
+    }
+
+    for (UINT32 i = 0; i < TEST_MAILBOX; i++)
+    {
+        if (Mailbox[i])
+        {
+            UINT64 Address = (UINT64)(Mailbox[i] >> 5) << MM_PAGE_SHIFT;
+            UINT32 Order   = Mailbox[i] & 31;
+            HOST_CHECK(TestOwn(Address, Order, 1, 0) && MmFreePages(Address, Order));
+        }
+    }
+    MmDrainProcessor();
+
+    // every thread's processor keeps the page its magazines are in
+    MmQueryStatistics(&Statistics);
+    HOST_CHECK(Statistics.CachedPages == 0);
+    HOST_CHECK(Statistics.FreePages == Seeded.FreePages - TEST_THREADS);
+
+    for (UINT32 i = 1; i <= TEST_THREADS; i++)
+    {
+        MM_PROCESSOR_STATISTICS Processor;
+
+        if (HOST_CHECK(MmQueryProcessorStatistics(i, &Processor)))
+        {
+            HOST_CHECK(Processor.Counters[0].AllocateHits > Processor.Counters[0].AllocateMisses);
+            HOST_CHECK(Processor.Counters[1].AllocateHits > 0);
+            HOST_CHECK(!Processor.Counters[0].Discarded && !Processor.Counters[1].Discarded);
+        }
+    }
+
+    return HostTestResult();
+}
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include "firmware.h"
+#include "test.h"
+#include "../kernal/rtl.h"
+
+//
+//
+// Checks the rtl.h routines against the plain loops of the host BaseLib. Strings and
+// buffers are placed on a page with inaccessible pages on both sides, flush against either
+// edge and at every alignment, so a load that strays off the page faults instead of
+// reading a neighbour's bytes. The random rounds then cover lengths and mismatch positions
+// the edge cases do not.
+//
+//
+
+#define TEST_PAGE  RTL_PAGE_SIZE
+#define TEST_RANGE 80 // lengths tried flush against a page edge
+
+static UINT8* Page; // readable, with a guard page before and after
+static UINT8* Other;
+static UINT32 Seed = 0x12345;
+
+static
+UINT32
+TestRandom(
+    VOID
+)
+{
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 17;
+    Seed ^= Seed << 5;
+    return Seed;
+}
+
+static
+UINT8*
+TestGuardedPage(
+    VOID
+)
+{
+    UINT64 Base = HostMapPages(0, 3, MAX_UINT64);
+    if (!Base)
+    {
+        HostFatal("cannot map the test pages");
+    }
+
+    HostGuardPages(Base, 1);
+    HostGuardPages(Base + 2 * TEST_PAGE, 1);
+    return (UINT8*)(UINTN)(Base + TEST_PAGE);
+}
+
+static
+INTN
+TestSign(
+    _In_ INTN Value
+)
+{
+    return Value < 0 ? -1 : Value > 0;
+}
+
+/**
+* Writes an ASCII string of Length non-NUL bytes and its NUL at String.
+*/
+static
+VOID
+TestFillAscii(
+    _Out_ CHAR8* String,
+    _In_  UINTN Length
+)
+{
+    for (UINTN i = 0; i < Length; i++)
+    {
+        String[i] = (CHAR8)(TestRandom() % 255 + 1);
+    }
+    String[Length] = 0;
+}
+
+static
+VOID
+TestFillString(
+    _Out_ CHAR16* String,
+    _In_  UINTN Length
+)
+{
+    for (UINTN i = 0; i < Length; i++)
+    {
+        // high bytes set too, a scan must test whole characters
+        String[i] = (CHAR16)(TestRandom() % 0xFFFF + 1);
+        if (TestRandom() % 4 == 0)
+        {
+            String[i] = (CHAR16)(String[i] & 0xFF00 ? String[i] & 0xFF00 : 0x100);
+        }
+    }
+    String[Length] = 0;
+}
+
+static
+VOID
+TestLengths(
+    VOID
+)
+{
+    for (UINTN Length = 0; Length < TEST_RANGE; Length++)
+    {
+        // NUL on the last byte of the page, then the string at the start of the page
+        CHAR8* Ascii = (CHAR8*)Page + TEST_PAGE - 1 - Length;
+        TestFillAscii(Ascii, Length);
+        HOST_CHECK(RtlAsciiLength(Ascii) == Length);
+
+        TestFillAscii((CHAR8*)Page, Length);
+        HOST_CHECK(RtlAsciiLength((CHAR8*)Page) == Length);
+
+        // UCS-2 ending on the last character, even and odd addresses
+        for (UINTN Odd = 0; Odd < 2; Odd++)
+        {
+            CHAR16* String = (CHAR16*)(Page + TEST_PAGE - Odd - (Length + 1) * sizeof(CHAR16));
+            TestFillString(String, Length);
+            HOST_CHECK(RtlStringLength(String) == Length);
+
+            String = (CHAR16*)(Page + Odd);
+            TestFillString(String, Length);
+            HOST_CHECK(RtlStringLength(String) == Length);
+        }
+    }
+}
+
+static
+VOID
+TestCompareStrings(
+    VOID
+)
+{
+    for (UINTN Length = 0; Length < TEST_RANGE; Length++)
+    {
+        for (UINTN Shift = 0; Shift < 2 * RTL_VECTOR_SIZE; Shift++)
+        {
+            // both strings end on their page's last bytes, Shift moves one off alignment
+            CHAR16* First  = (CHAR16*)(Page + TEST_PAGE - (Length + 1) * sizeof(CHAR16) - (Shift & 1));
+            CHAR16* Second = (CHAR16*)(Other + TEST_PAGE - (Length + 1) * sizeof(CHAR16) - Shift);
+
+            TestFillString(First, Length);
+            CopyMem(Second, First, (Length + 1) * sizeof(CHAR16));
+            HOST_CHECK(RtlStringCompare(First, Second) == 0);
+
+            if (!Length)
+            {
+                continue;
+            }
+
+            // one character differs, or Second ends early
+            UINTN At = TestRandom() % Length;
+            Second[At] = (CHAR16)(TestRandom() % 3 == 0 ? 0 : Second[At] + 1 + TestRandom() % 0xFFFE);
+            HOST_CHECK(TestSign(RtlStringCompare(First, Second)) == TestSign(StrCmp(First, Second)));
+            HOST_CHECK(TestSign(RtlStringCompare(Second, First)) == TestSign(StrCmp(Second, First)));
+        }
+    }
+}
+
+static
+VOID
+TestCompareMemory(
+    VOID
+)
+{
+    for (UINTN Length = 0; Length < TEST_RANGE; Length++)
+    {
+        for (UINTN Shift = 0; Shift < RTL_VECTOR_SIZE; Shift++)
+        {
+            UINT8* First  = Page + TEST_PAGE - Length;
+            UINT8* Second = Other + TEST_PAGE - Length - Shift;
+
+            for (UINTN i = 0; i < Length; i++)
+            {
+                First[i] = (UINT8)TestRandom();
+            }
+            CopyMem(Second, First, Length);
+            HOST_CHECK(RtlCompareMemory(First, Second, Length) == 0);
+
+            if (!Length)
+            {
+                continue;
+            }
+
+            // the difference of the first mismatching bytes, later ones must not matter
+            UINTN At = TestRandom() % Length;
+            Second[At] = (UINT8)(Second[At] + 1 + TestRandom() % 255);
+            if (At + 1 < Length)
+            {
+                Second[Length - 1] ^= 0x80;
+            }
+            HOST_CHECK(RtlCompareMemory(First, Second, Length) == (INTN)First[At] - (INTN)Second[At]);
+
+            // the same buffers from the start of the page
+            CopyMem(Page, First, Length);
+            HOST_CHECK(RtlCompareMemory(Page, Second, Length) == (INTN)Page[At] - (INTN)Second[At]);
+        }
+    }
+}
+
+static
+VOID
+TestCopy(
+    VOID
+)
+{
+    for (UINTN Length = 0; Length < TEST_RANGE; Length++)
+    {
+        for (UINTN Shift = 0; Shift < RTL_VECTOR_SIZE; Shift += 2)
+        {
+            CHAR16* Source      = (CHAR16*)(Page + TEST_PAGE - (Length + 1) * sizeof(CHAR16));
+            CHAR16* Destination = (CHAR16*)(Other + TEST_PAGE - (Length + 1) * sizeof(CHAR16) - Shift);
+
+            TestFillString(Source, Length);
+            HOST_CHECK(RtlStringCopy(Destination, Source) == Length);
+            HOST_CHECK(!CompareMem(Destination, Source, (Length + 1) * sizeof(CHAR16)));
+        }
+
+        UINT8* Bytes = Other + TEST_PAGE - Length;
+        RtlFillMemory(Bytes, Length, 0x5A);
+        HOST_CHECK(Length == 0 || (Bytes[0] == 0x5A && Bytes[Length - 1] == 0x5A));
+
+        RtlCopyMemory(Page + TEST_PAGE - Length, Bytes, Length);
+        HOST_CHECK(!CompareMem(Page + TEST_PAGE - Length, Bytes, Length));
+    }
+}
+
+/**
+* Random lengths at random places on the page, against the plain loops.
+*/
+static
+VOID
+TestRandomRounds(
+    VOID
+)
+{
+    for (UINT32 Round = 0; Round < 20000; Round++)
+    {
+        UINTN Length = TestRandom() % (Round & 1 ? 2000 : 64);
+        UINTN Offset = TestRandom() % (TEST_PAGE - (Length + 1) * sizeof(CHAR16));
+
+        CHAR16* First  = (CHAR16*)(Page + Offset);
+        CHAR16* Second = (CHAR16*)(Other + TestRandom() % (TEST_PAGE - (Length + 1) * sizeof(CHAR16)));
+
+        TestFillString(First, Length);
+        CopyMem(Second, First, (Length + 1) * sizeof(CHAR16));
+        if (Length && TestRandom() % 2)
+        {
+            Second[TestRandom() % Length] ^= (CHAR16)(1u << (TestRandom() % 16));
+        }
+
+        if (!HOST_CHECK(RtlStringLength(First) == StrLen(First)) ||
+            !HOST_CHECK(RtlAsciiLength((CHAR8*)First) == AsciiStrLen((CHAR8*)First)) ||
+            !HOST_CHECK(TestSign(RtlStringCompare(First, Second)) == TestSign(StrCmp(First, Second))) ||
+            !HOST_CHECK(TestSign(RtlCompareMemory(First, Second, Length * sizeof(CHAR16))) ==
+                        TestSign(CompareMem(First, Second, Length * sizeof(CHAR16)))))
+        {
+            break;
+        }
+    }
+}
+
+INT32
+main(
+    INT32 Argc,
+    CHAR8** Argv
+)
+{
+    Page  = TestGuardedPage();
+    Other = TestGuardedPage();
+
+    TestLengths();
+    TestCompareStrings();
+    TestCompareMemory();
+    TestCopy();
+    TestRandomRounds();
+
+    return HostTestResult();
+}
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "firmware.h"
+#include "test.h"
+#include "../bootloader/sha256.h"
+
+//
+//
+// Known answers for both SHA-256 block functions: the FIPS 180-4 examples (one block, two
+// blocks, a million 'a') and lengths around the 55/56 and 64 byte padding edges. Every
+// message is hashed in one piece and fed in uneven slices, and the two backends have to
+// agree on random lengths. The SHA-NI half is skipped on CPUs without the SHA extensions.
+//
+//
+
+typedef struct _TEST_VECTOR
+{
+    CONST CHAR8* Message; // NULL for Length bytes of the (i * 7 + 1) pattern
+    UINT32       Length;
+    UINT32       Repeat;  // the message is hashed this many times over
+    CONST CHAR8* Digest;
+} TEST_VECTOR;
+
+static CONST TEST_VECTOR Vectors[] =
+{
+    { "",    0, 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+    { "abc", 3, 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56, 1,
+      "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+    { "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+      112, 1, "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+    { "a",   1, 1000000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+    { NULL,  1,    1, "4bf5122f344554c53bde2ebb8cd2b7e3d1600ad631c385a5d7cce23c7785459a" },
+    { NULL,  55,   1, "16fa57a0a3423a715d594516339f36189d6b5f93754a9714fef202616a9fabfe" },
+    { NULL,  56,   1, "c37b44e5f1b18554b36966f4f8e08bfbf3164c4b6c10374d12d89850892073c5" },
+    { NULL,  57,   1, "12b234922502022f755ab8550a3d4e202ad39c81d961a4f59ec39d5fd83d15a7" },
+    { NULL,  63,   1, "bbba992d2c85af960fb2987a1fd05e0aa82a3db3c740dd8982a9e273b75e36a3" },
+    { NULL,  64,   1, "66bd4633ed6f71c4ecfa4763bf7ba1c8ec7612de9aa6c0578a7b675207c71e0b" },
+    { NULL,  65,   1, "9f7dc47107b750a1f3d35db5d9547f24ef40da5b731b9540d4f43710a154f6c9" },
+    { NULL,  119,  1, "a3ed307b730fa77c07531300c6e4a282330011d4d4caf6bb7b63ae05950f4b66" },
+    { NULL,  120,  1, "8e3b15d9fea7472655aa069620b7f8c2e55ee1499f763200a7515fe826e99d20" },
+    { NULL,  127,  1, "44480fb9672845177f5368a08b69ea263275f2a5ec42e06a933370fe0d2968a4" },
+    { NULL,  128,  1, "e462c130fef8c97e34f7dc3ff3ad2f8b3533ab849af21c10531552a2852387a4" },
+    { NULL,  129,  1, "aa7ea4e8bf89146aeb67ff195fd8182a0e504c9d580aa7af8d2c862e14b98405" },
+    { NULL,  1000, 1, "095ecb62e30793ab4b954cd6a0586d0cc91f7ea5b1332694d8da780e98676d78" },
+};
+
+static UINT32 Seed = 0x5EED;
+
+static
+UINT32
+TestRandom(
+    VOID
+)
+{
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 17;
+    Seed ^= Seed << 5;
+    return Seed;
+}
+
+static
+BOOLEAN
+TestDigestMatches(
+    _In_ CONST UINT8* Digest,
+    _In_ CONST CHAR8* Hex
+)
+{
+    CHAR8 Text[BL_SHA256_DIGEST_SIZE * 2 + 1];
+
+    for (UINT32 i = 0; i < BL_SHA256_DIGEST_SIZE; i++)
+    {
+        Text[i * 2]     = "0123456789abcdef"[Digest[i] >> 4];
+        Text[i * 2 + 1] = "0123456789abcdef"[Digest[i] & 0xF];
+    }
+    Text[BL_SHA256_DIGEST_SIZE * 2] = 0;
+
+    return !CompareMem(Text, Hex, sizeof(Text));
+}
+
+/**
+* Hashes Repeat copies of Message, in slices of up to Slice bytes when Slice is not 0.
+*/
+static
+VOID
+TestHash(
+    _In_  CONST UINT8* Message,
+    _In_  UINT32 Length,
+    _In_  UINT32 Repeat,
+    _In_  UINT32 Slice,
+    _Out_ UINT8* Digest
+)
+{
+    BL_SHA256 Hash;
+
+    BlSha256Init(&Hash);
+    for (UINT32 r = 0; r < Repeat; r++)
+    {
+        for (UINT32 Offset = 0; Offset < Length;)
+        {
+            // MIN evaluates its arguments twice
+            UINT32 Size = Slice ? TestRandom() % Slice + 1 : Length;
+            Size = MIN(Size, Length - Offset);
+            BlSha256Update(&Hash, Message + Offset, Size);
+            Offset += Size;
+        }
+    }
+    BlSha256Final(&Hash, Digest);
+}
+
+static
+VOID
+TestVectors(
+    VOID
+)
+{
+    UINT8 Pattern[1000];
+    UINT8 Digest[BL_SHA256_DIGEST_SIZE];
+
+    for (UINT32 i = 0; i < sizeof(Pattern); i++)
+    {
+        Pattern[i] = (UINT8)(i * 7 + 1);
+    }
+
+    for (UINT32 v = 0; v < ARRAY_SIZE(Vectors); v++)
+    {
+        CONST TEST_VECTOR* Vector  = &Vectors[v];
+        CONST UINT8*       Message = Vector->Message ? (CONST UINT8*)Vector->Message : Pattern;
+
+        TestHash(Message, Vector->Length, Vector->Repeat, 0, Digest);
+        HOST_CHECK(TestDigestMatches(Digest, Vector->Digest));
+
+        TestHash(Message, Vector->Length, Vector->Repeat, 70, Digest);
+        HOST_CHECK(TestDigestMatches(Digest, Vector->Digest));
+    }
+
+    // the million 'a' again, as one Update of the whole message
+    UINT8* Million = HostAlloc(1000000);
+    SetMem(Million, 1000000, 'a');
+    TestHash(Million, 1000000, 1, 0, Digest);
+    HOST_CHECK(TestDigestMatches(Digest, Vectors[4].Digest));
+    HostFree(Million);
+}
+
+INT32
+main(
+    INT32 Argc,
+    CHAR8** Argv
+)
+{
+    BlSha256AllowAcceleration(FALSE);
+    HOST_CHECK(!BlSha256Accelerated());
+    TestVectors();
+
+    BlSha256AllowAcceleration(TRUE);
+    if (!BlSha256Accelerated())
+    {
+        CONST CHAR8 Note[] = "no SHA extensions, only the portable block function was checked\n";
+        HostWrite(Note, sizeof(Note) - 1);
+        return HostTestResult();
+    }
+
+    TestVectors();
+
+    // random lengths and offsets, the portable result is the reference
+    UINT8* Buffer = HostAlloc(4096 + 64);
+    for (UINT32 i = 0; i < 4096 + 64; i++)
+    {
+        Buffer[i] = (UINT8)TestRandom();
+    }
+
+    for (UINT32 Round = 0; Round < 2000; Round++)
+    {
+        UINT8  Portable[BL_SHA256_DIGEST_SIZE];
+        UINT8  ShaNi[BL_SHA256_DIGEST_SIZE];
+        UINT32 Offset = TestRandom() % 64;
+        UINT32 Length = TestRandom() % 4097;
+        UINT32 Slice  = TestRandom() % 2 ? 0 : 200;
+
+        BlSha256AllowAcceleration(FALSE);
+        TestHash(Buffer + Offset, Length, 1, Slice, Portable);
+        BlSha256AllowAcceleration(TRUE);
+        TestHash(Buffer + Offset, Length, 1, Slice, ShaNi);
+
+        if (!HOST_CHECK(!CompareMem(Portable, ShaNi, sizeof(ShaNi))))
+        {
+            break;
+        }
+    }
+    HostFree(Buffer);
+
+    return HostTestResult();
+}
\ No newline at end of file
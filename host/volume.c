@@ -0,0 +1,1814 @@
+#include "volume.h"
+#include "host.h"
+
+#define HOST_PATH_MAX           1024
+#define HOST_DIRECTORY_BATCH    16      // entries a directory read gets out of one request
+#define HOST_FAT_CLUSTER_SIZE   0x1000
+#define HOST_FAT_ENTRY_SIZE     32
+#define HOST_FAT_LFN_CHARS      13
+#define HOST_FAT_COPY_SIZE      0x100000
+
+typedef struct _HOST_VOLUME
+{
+    BOOLEAN                         Used;
+    EFI_HANDLE                      Handle;
+    HOST_VOLUME_CONFIG              Config;
+    CHAR8                           Root[HOST_PATH_MAX];
+    CHAR16                          Label[32];
+    HOST_DEVICE                     Device;
+    HOST_VOLUME_STATISTICS          Statistics;
+    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL FileSystem;
+    EFI_BLOCK_IO_PROTOCOL           BlockIo;
+    EFI_BLOCK_IO2_PROTOCOL          BlockIo2;
+    EFI_BLOCK_IO_MEDIA              Media;
+    INT32                           Image;      // FAT image descriptor, -1 without one
+    CHAR8                           ImagePath[64];
+    UINT64                          ImageSize;
+} HOST_VOLUME;
+
+typedef struct _HOST_FILE
+{
+    EFI_FILE_PROTOCOL Protocol;   // This is cast back to the file
+    HOST_VOLUME*      Volume;
+    UINT32            MediaId;    // media the file was opened on
+    CHAR8             Relative[HOST_PATH_MAX]; // from the volume root, "" for the root itself
+    HOST_ENTRY        Entry;
+    INT32             Descriptor; // files only
+    UINT64            Position;
+    VOID*             Directory;  // directories only
+    HOST_ENTRY        Held;       // entry a too small buffer could not take
+    BOOLEAN           Holding;
+    UINT64            EntriesRead;
+} HOST_FILE;
+
+typedef struct _HOST_TOKEN
+{
+    EFI_STATUS* Status;
+    EFI_STATUS  Result;
+} HOST_TOKEN;
+
+static HOST_VOLUME Volumes[HOST_MAX_VOLUMES];
+
+static
+HOST_VOLUME*
+HostpVolume(
+    _In_ EFI_HANDLE Handle
+)
+{
+    for (UINT32 i = 0; i < HOST_MAX_VOLUMES; i++)
+    {
+        if (Volumes[i].Used && Volumes[i].Handle == Handle)
+        {
+            return &Volumes[i];
+        }
+    }
+
+    HostFatal("not a volume handle");
+    return NULL;
+}
+
+/**
+* Books a synchronous request on the volume's device and waits for it.
+*/
+static
+VOID
+HostpTransfer(
+    _Inout_ HOST_VOLUME* Volume,
+    _In_    UINT64 Requests,
+    _In_    UINT64 Bytes
+)
+{
+    HostWaitUntil(HostSchedule(&Volume->Device, Requests, Bytes));
+}
+
+/**
+* @return Requests a file protocol read of Bytes takes.
+*/
+static
+UINT64
+HostpFileRequests(
+    _In_ CONST HOST_VOLUME* Volume,
+    _In_ UINT64 Bytes
+)
+{
+    if (!Volume->Config.FileChunk)
+    {
+        return 1;
+    }
+
+    return (Bytes + Volume->Config.FileChunk - 1) / Volume->Config.FileChunk;
+}
+
+static
+VOID
+HostpFinishToken(
+    _In_ VOID* Context
+)
+{
+    HOST_TOKEN* Token = Context;
+    *Token->Status = Token->Result;
+    HostFree(Token);
+}
+
+/**
+* Completes a queued request once the device gets to it, Status receives Result.
+*/
+static
+VOID
+HostpQueue(
+    _Inout_ HOST_VOLUME* Volume,
+    _In_    UINT64 Requests,
+    _In_    UINT64 Bytes,
+    _In_    EFI_STATUS* Status,
+    _In_    EFI_STATUS Result,
+    _In_    EFI_EVENT Event
+)
+{
+    HOST_TOKEN* Token = HostAlloc(sizeof(HOST_TOKEN));
+    if (!Token)
+    {
+        HostFatal("out of memory for a queued request");
+    }
+
+    Token->Status = Status;
+    Token->Result = Result;
+    HostComplete(HostSchedule(&Volume->Device, Requests, Bytes), HostpFinishToken, Token, Event);
+}
+
+//
+//
+// Paths
+//
+//
+
+static
+CHAR8
+HostpUpper(
+    _In_ CHAR8 Char
+)
+{
+    return (Char >= 'a' && Char <= 'z') ? (CHAR8)(Char - 'a' + 'A') : Char;
+}
+
+static
+BOOLEAN
+HostpSameName(
+    _In_ CONST CHAR8* First,
+    _In_ CONST CHAR8* Second
+)
+{
+    while (*First && HostpUpper(*First) == HostpUpper(*Second))
+    {
+        First++;
+        Second++;
+    }
+
+    return !*First && !*Second;
+}
+
+static
+VOID
+HostpJoin(
+    _Out_ CHAR8* Path,
+    _In_  CONST CHAR8* Directory,
+    _In_  CONST CHAR8* Name
+)
+{
+    AsciiSPrint(Path, HOST_PATH_MAX, *Directory ? "%a/%a" : "%a%a", Directory, Name);
+}
+
+/**
+* Finds Name in a directory of the volume the way FAT would, ignoring case.
+*/
+static
+BOOLEAN
+HostpFindName(
+    _In_  CONST HOST_VOLUME* Volume,
+    _In_  CONST CHAR8* Relative,
+    _In_  CONST CHAR8* Name,
+    _Out_ CHAR8* Actual,
+    _Out_ HOST_ENTRY* Entry
+)
+{
+    CHAR8 Directory[HOST_PATH_MAX];
+    CHAR8 Path[HOST_PATH_MAX];
+
+    HostpJoin(Directory, Volume->Root, Relative);
+    AsciiSPrint(Path, sizeof(Path), "%a/%a", Directory, Name);
+    if (!HostStat(Path, Entry))
+    {
+        AsciiSPrint(Actual, HOST_PATH_MAX, "%a", Name);
+        return TRUE;
+    }
+
+    VOID* Handle = HostOpenDirectory(Directory);
+    if (!Handle)
+    {
+        return FALSE;
+    }
+
+    BOOLEAN Found = FALSE;
+    while (!Found && HostReadDirectory(Handle, Directory, Entry))
+    {
+        if (HostpSameName(Entry->Name, Name))
+        {
+            AsciiSPrint(Actual, HOST_PATH_MAX, "%a", Entry->Name);
+            Found = TRUE;
+        }
+    }
+
+    HostCloseDirectory(Handle);
+    return Found;
+}
+
+/**
+* Resolves an EFI path against a directory of the volume, every component searched costs
+* one request like a FAT driver reading the directory.
+*
+* @param Relative The directory FileName is relative to, receives the resolved path.
+*/
+static
+EFI_STATUS
+HostpResolve(
+    _Inout_ HOST_VOLUME* Volume,
+    _Inout_ CHAR8* Relative,
+    _In_    CONST CHAR16* FileName,
+    _Out_   HOST_ENTRY* Entry
+)
+{
+    CHAR8 Path[HOST_PATH_MAX];
+
+    if (*FileName == L'\\')
+    {
+        *Relative = '\0';
+    }
+
+    HostpJoin(Path, Volume->Root, Relative);
+    if (HostStat(Path, Entry) || !Entry->Directory)
+    {
+        return EFI_NOT_FOUND;
+    }
+
+    while (*FileName)
+    {
+        CHAR8 Component[256];
+        UINTN Length = 0;
+
+        while (*FileName == L'\\')
+        {
+            FileName++;
+        }
+
+        while (*FileName && *FileName != L'\\')
+        {
+            if (*FileName >= 0x80 || *FileName == L'/' || Length + 1 == sizeof(Component))
+            {
+                return EFI_NOT_FOUND;
+            }
+
+            Component[Length++] = (CHAR8)*FileName++;
+        }
+
+        Component[Length] = '\0';
+        if (!Length || !AsciiStrnCmp(Component, ".", 2))
+        {
+            continue;
+        }
+
+        if (!Entry->Directory)
+        {
+            return EFI_NOT_FOUND;
+        }
+
+        if (!AsciiStrnCmp(Component, "..", 3))
+        {
+            // the root is its own parent
+            UINTN End = AsciiStrLen(Relative);
+            while (End && Relative[End - 1] != '/')
+            {
+                End--;
+            }
+            Relative[End ? End - 1 : 0] = '\0';
+        }
+        else
+        {
+            CHAR8 Actual[HOST_PATH_MAX];
+
+            Volume->Statistics.Lookups++;
+            HostpTransfer(Volume, 1, 0);
+            if (!HostpFindName(Volume, Relative, Component, Actual, Entry))
+            {
+                return EFI_NOT_FOUND;
+            }
+
+            HostpJoin(Path, Relative, Actual);
+            AsciiSPrint(Relative, HOST_PATH_MAX, "%a", Path);
+        }
+
+        HostpJoin(Path, Volume->Root, Relative);
+        if (HostStat(Path, Entry))
+        {
+            return EFI_NOT_FOUND;
+        }
+    }
+
+    return EFI_SUCCESS;
+}
+
+//
+//
+// EFI_FILE_PROTOCOL
+//
+//
+
+static
+VOID
+HostpTime(
+    _In_  INT64 Seconds,
+    _Out_ EFI_TIME* Time
+)
+{
+    // days to civil date, proleptic Gregorian, UTC
+    INT64  Days = Seconds >= 0 ? Seconds / 86400 : (Seconds - 86399) / 86400;
+    INT64  Rest = Seconds - Days * 86400;
+    INT64  Z    = Days + 719468;
+    INT64  Era  = (Z >= 0 ? Z : Z - 146096) / 146097;
+    UINT64 Doe  = (UINT64)(Z - Era * 146097);
+    UINT64 Yoe  = (Doe - Doe / 1460 + Doe / 36524 - Doe / 146096) / 365;
+    UINT64 Doy  = Doe - (365 * Yoe + Yoe / 4 - Yoe / 100);
+    UINT64 Mp   = (5 * Doy + 2) / 153;
+    UINT64 Day  = Doy - (153 * Mp + 2) / 5 + 1;
+    UINT64 Mon  = Mp < 10 ? Mp + 3 : Mp - 9;
+
+    ZeroMem(Time, sizeof(EFI_TIME));
+    Time->Year     = (UINT16)((INT64)Yoe + Era * 400 + (Mon <= 2));
+    Time->Month    = (UINT8)Mon;
+    Time->Day      = (UINT8)Day;
+    Time->Hour     = (UINT8)(Rest / 3600);
+    Time->Minute   = (UINT8)(Rest / 60 % 60);
+    Time->Second   = (UINT8)(Rest % 60);
+    Time->TimeZone = EFI_UNSPECIFIED_TIMEZONE;
+}
+
+/**
+* Fills in an EFI_FILE_INFO, or says how large it has to be.
+*/
+static
+EFI_STATUS
+HostpFileInfo(
+    _In_    CONST HOST_ENTRY* Entry,
+    _Inout_ UINTN* BufferSize,
+    _Out_   VOID* Buffer
+)
+{
+    UINTN NameLength = AsciiStrLen(Entry->Name);
+    UINTN Size       = SIZE_OF_EFI_FILE_INFO + (NameLength + 1) * sizeof(CHAR16);
+
+    if (*BufferSize < Size)
+    {
+        *BufferSize = Size;
+        return EFI_BUFFER_TOO_SMALL;
+    }
+
+    EFI_FILE_INFO* Info = Buffer;
+    ZeroMem(Info, Size);
+    Info->Size         = Size;
+    Info->FileSize     = Entry->Size;
+    Info->PhysicalSize = ALIGN_VALUE(Entry->Size, HOST_FAT_CLUSTER_SIZE);
+    Info->Attribute    = EFI_FILE_READ_ONLY | (Entry->Directory ? EFI_FILE_DIRECTORY : EFI_FILE_ARCHIVE);
+    HostpTime(Entry->ModificationTime, &Info->ModificationTime);
+    Info->CreateTime     = Info->ModificationTime;
+    Info->LastAccessTime = Info->ModificationTime;
+
+    for (UINTN i = 0; i <= NameLength; i++)
+    {
+        Info->FileName[i] = (CHAR16)(UINT8)Entry->Name[i];
+    }
+
+    *BufferSize = Size;
+    return EFI_SUCCESS;
+}
+
+static EFI_FILE_PROTOCOL HostpFileTemplate;
+
+static
+EFI_STATUS
+HostpNewFile(
+    _In_  HOST_VOLUME* Volume,
+    _In_  CONST CHAR8* Relative,
+    _In_  CONST HOST_ENTRY* Entry,
+    _Out_ EFI_FILE_PROTOCOL** NewHandle
+)
+{
+    CHAR8      Path[HOST_PATH_MAX];
+    HOST_FILE* File = HostAlloc(sizeof(HOST_FILE));
+    if (!File)
+    {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    File->Protocol   = HostpFileTemplate;
+    File->Volume     = Volume;
+    File->MediaId    = Volume->Media.MediaId;
+    File->Entry      = *Entry;
+    File->Descriptor = -1;
+    AsciiSPrint(File->Relative, sizeof(File->Relative), "%a", Relative);
+
+    if (!Volume->Config.ReadEx)
+    {
+        File->Protocol.Revision = EFI_FILE_PROTOCOL_REVISION;
+    }
+
+    HostpJoin(Path, Volume->Root, Relative);
+    if (Entry->Directory)
+    {
+        File->Directory = HostOpenDirectory(Path);
+    }
+    else
+    {
+        File->Descriptor = HostOpenFile(Path, 0);
+    }
+
+    if (Entry->Directory ? !File->Directory : File->Descriptor < 0)
+    {
+        HostFree(File);
+        return EFI_DEVICE_ERROR;
+    }
+
+    *NewHandle = &File->Protocol;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileOpen(
+    IN  EFI_FILE_PROTOCOL* This,
+    OUT EFI_FILE_PROTOCOL** NewHandle,
+    IN  CHAR16* FileName,
+    IN  UINT64 OpenMode,
+    IN  UINT64 Attributes
+)
+{
+    HOST_FILE* File = (HOST_FILE*)This;
+    (VOID)Attributes;
+
+    if (!NewHandle || !FileName)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    if (File->MediaId != File->Volume->Media.MediaId)
+    {
+        return EFI_MEDIA_CHANGED;
+    }
+
+    if (OpenMode != EFI_FILE_MODE_READ)
+    {
+        return EFI_WRITE_PROTECTED;
+    }
+
+    File->Volume->Statistics.Opens++;
+
+    CHAR8      Relative[HOST_PATH_MAX];
+    HOST_ENTRY Entry;
+    AsciiSPrint(Relative, sizeof(Relative), "%a", File->Entry.Directory ? File->Relative : "");
+    if (!File->Entry.Directory)
+    {
+        // a file resolves relative names against the directory it is in
+        AsciiSPrint(Relative, sizeof(Relative), "%a", File->Relative);
+        UINTN End = AsciiStrLen(Relative);
+        while (End && Relative[End - 1] != '/')
+        {
+            End--;
+        }
+        Relative[End ? End - 1 : 0] = '\0';
+    }
+
+    EFI_STATUS Status = HostpResolve(File->Volume, Relative, FileName, &Entry);
+    if (EFI_ERROR(Status))
+    {
+        return Status;
+    }
+
+    return HostpNewFile(File->Volume, Relative, &Entry, NewHandle);
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileClose(
+    IN EFI_FILE_PROTOCOL* This
+)
+{
+    HOST_FILE* File = (HOST_FILE*)This;
+
+    if (File->Descriptor >= 0)
+    {
+        HostCloseFile(File->Descriptor);
+    }
+
+    if (File->Directory)
+    {
+        HostCloseDirectory(File->Directory);
+    }
+
+    HostFree(File);
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileDelete(
+    IN EFI_FILE_PROTOCOL* This
+)
+{
+    HostpFileClose(This);
+    return EFI_WARN_DELETE_FAILURE;
+}
+
+static
+EFI_STATUS
+HostpReadDirectory(
+    _Inout_ HOST_FILE* File,
+    _Inout_ UINTN* BufferSize,
+    _Out_   VOID* Buffer
+)
+{
+    CHAR8 Path[HOST_PATH_MAX];
+
+    if (!File->Holding)
+    {
+        HostpJoin(Path, File->Volume->Root, File->Relative);
+        if (!HostReadDirectory(File->Directory, Path, &File->Held))
+        {
+            *BufferSize = 0;
+            return EFI_SUCCESS;
+        }
+
+        if (!(File->EntriesRead++ % HOST_DIRECTORY_BATCH))
+        {
+            HostpTransfer(File->Volume, 1, HOST_DIRECTORY_BATCH * HOST_FAT_ENTRY_SIZE);
+        }
+    }
+
+    EFI_STATUS Status = HostpFileInfo(&File->Held, BufferSize, Buffer);
+    File->Holding = Status == EFI_BUFFER_TOO_SMALL;
+    return Status;
+}
+
+/**
+* @return Bytes a read of Size at the current position gets.
+*/
+static
+UINT64
+HostpReadable(
+    _In_ CONST HOST_FILE* File,
+    _In_ UINT64 Size
+)
+{
+    return File->Position >= File->Entry.Size ? 0 : MIN(Size, File->Entry.Size - File->Position);
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileRead(
+    IN     EFI_FILE_PROTOCOL* This,
+    IN OUT UINTN* BufferSize,
+    OUT    VOID* Buffer
+)
+{
+    HOST_FILE* File = (HOST_FILE*)This;
+
+    if (!BufferSize || (*BufferSize && !Buffer))
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    if (File->MediaId != File->Volume->Media.MediaId)
+    {
+        return EFI_MEDIA_CHANGED;
+    }
+
+    if (File->Entry.Directory)
+    {
+        return HostpReadDirectory(File, BufferSize, Buffer);
+    }
+
+    if (File->Position > File->Entry.Size)
+    {
+        return EFI_DEVICE_ERROR;
+    }
+
+    UINT64 Size = HostpReadable(File, *BufferSize);
+    if (Size && HostReadFile(File->Descriptor, File->Position, Buffer, Size) != (INT64)Size)
+    {
+        return EFI_DEVICE_ERROR;
+    }
+
+    if (Size)
+    {
+        UINT64 Requests = HostpFileRequests(File->Volume, Size);
+        File->Volume->Statistics.FileRequests += Requests;
+        File->Volume->Statistics.FileBytes    += Size;
+        HostpTransfer(File->Volume, Requests, Size);
+    }
+
+    File->Position += Size;
+    *BufferSize     = (UINTN)Size;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileReadEx(
+    IN     EFI_FILE_PROTOCOL* This,
+    IN OUT EFI_FILE_IO_TOKEN* Token
+)
+{
+    HOST_FILE* File = (HOST_FILE*)This;
+
+    if (!File->Volume->Config.ReadEx)
+    {
+        return EFI_UNSUPPORTED;
+    }
+
+    if (!Token)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    if (!Token->Event || File->Entry.Directory)
+    {
+        Token->Status = HostpFileRead(This, &Token->BufferSize, Token->Buffer);
+        return Token->Status;
+    }
+
+    if (File->MediaId != File->Volume->Media.MediaId)
+    {
+        return EFI_MEDIA_CHANGED;
+    }
+
+    // the data lands now, the caller only gets to see it once the event is signalled
+    UINT64 Size = HostpReadable(File, Token->BufferSize);
+    if (Size && HostReadFile(File->Descriptor, File->Position, Token->Buffer, Size) != (INT64)Size)
+    {
+        return EFI_DEVICE_ERROR;
+    }
+
+    UINT64 Requests = Size ? HostpFileRequests(File->Volume, Size) : 0;
+    File->Volume->Statistics.FileRequests += Requests;
+    File->Volume->Statistics.FileBytes    += Size;
+
+    File->Position    += Size;
+    Token->BufferSize  = (UINTN)Size;
+    HostpQueue(File->Volume, Requests, Size, &Token->Status, EFI_SUCCESS, Token->Event);
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileWrite(
+    IN     EFI_FILE_PROTOCOL* This,
+    IN OUT UINTN* BufferSize,
+    IN     VOID* Buffer
+)
+{
+    (VOID)This;
+    (VOID)BufferSize;
+    (VOID)Buffer;
+    return EFI_WRITE_PROTECTED;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileGetPosition(
+    IN  EFI_FILE_PROTOCOL* This,
+    OUT UINT64* Position
+)
+{
+    HOST_FILE* File = (HOST_FILE*)This;
+
+    if (File->Entry.Directory)
+    {
+        return EFI_UNSUPPORTED;
+    }
+
+    *Position = File->Position;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileSetPosition(
+    IN EFI_FILE_PROTOCOL* This,
+    IN UINT64 Position
+)
+{
+    HOST_FILE* File = (HOST_FILE*)This;
+
+    if (File->MediaId != File->Volume->Media.MediaId)
+    {
+        return EFI_MEDIA_CHANGED;
+    }
+
+    if (!File->Entry.Directory)
+    {
+        File->Position = Position == MAX_UINT64 ? File->Entry.Size : Position;
+        return EFI_SUCCESS;
+    }
+
+    if (Position)
+    {
+        return EFI_UNSUPPORTED;
+    }
+
+    // rewinding a directory starts its enumeration over
+    CHAR8 Path[HOST_PATH_MAX];
+    HostpJoin(Path, File->Volume->Root, File->Relative);
+    HostCloseDirectory(File->Directory);
+    File->Directory   = HostOpenDirectory(Path);
+    File->Holding     = FALSE;
+    File->EntriesRead = 0;
+    return File->Directory ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileGetInfo(
+    IN     EFI_FILE_PROTOCOL* This,
+    IN     EFI_GUID* InformationType,
+    IN OUT UINTN* BufferSize,
+    OUT    VOID* Buffer
+)
+{
+    HOST_FILE*   File   = (HOST_FILE*)This;
+    HOST_VOLUME* Volume = File->Volume;
+
+    if (!InformationType || !BufferSize)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    if (File->MediaId != Volume->Media.MediaId)
+    {
+        return EFI_MEDIA_CHANGED;
+    }
+
+    if (!CompareMem(InformationType, &gEfiFileInfoGuid, sizeof(EFI_GUID)))
+    {
+        HOST_ENTRY Entry = File->Entry;
+        if (!*File->Relative)
+        {
+            // the root directory has no name of its own
+            Entry.Name[0] = '\0';
+        }
+
+        return HostpFileInfo(&Entry, BufferSize, Buffer);
+    }
+
+    if (!CompareMem(InformationType, &gEfiFileSystemInfoGuid, sizeof(EFI_GUID)))
+    {
+        UINTN Size = SIZE_OF_EFI_FILE_SYSTEM_INFO + StrSize(Volume->Label);
+        if (*BufferSize < Size)
+        {
+            *BufferSize = Size;
+            return EFI_BUFFER_TOO_SMALL;
+        }
+
+        EFI_FILE_SYSTEM_INFO* Info = Buffer;
+        ZeroMem(Info, Size);
+        Info->Size       = Size;
+        Info->ReadOnly   = TRUE;
+        Info->VolumeSize = Volume->ImageSize;
+        Info->BlockSize  = Volume->Config.BlockSize ? Volume->Config.BlockSize : 512;
+        CopyMem(Info->VolumeLabel, Volume->Label, StrSize(Volume->Label));
+        *BufferSize = Size;
+        return EFI_SUCCESS;
+    }
+
+    return EFI_UNSUPPORTED;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileSetInfo(
+    IN EFI_FILE_PROTOCOL* This,
+    IN EFI_GUID* InformationType,
+    IN UINTN BufferSize,
+    IN VOID* Buffer
+)
+{
+    (VOID)This;
+    (VOID)InformationType;
+    (VOID)BufferSize;
+    (VOID)Buffer;
+    return EFI_WRITE_PROTECTED;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileFlush(
+    IN EFI_FILE_PROTOCOL* This
+)
+{
+    (VOID)This;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileOpenEx(
+    IN     EFI_FILE_PROTOCOL* This,
+    OUT    EFI_FILE_PROTOCOL** NewHandle,
+    IN     CHAR16* FileName,
+    IN     UINT64 OpenMode,
+    IN     UINT64 Attributes,
+    IN OUT EFI_FILE_IO_TOKEN* Token
+)
+{
+    (VOID)This;
+    (VOID)NewHandle;
+    (VOID)FileName;
+    (VOID)OpenMode;
+    (VOID)Attributes;
+    (VOID)Token;
+    return EFI_UNSUPPORTED;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileWriteEx(
+    IN     EFI_FILE_PROTOCOL* This,
+    IN OUT EFI_FILE_IO_TOKEN* Token
+)
+{
+    (VOID)This;
+    (VOID)Token;
+    return EFI_WRITE_PROTECTED;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFileFlushEx(
+    IN     EFI_FILE_PROTOCOL* This,
+    IN OUT EFI_FILE_IO_TOKEN* Token
+)
+{
+    (VOID)This;
+    (VOID)Token;
+    return EFI_UNSUPPORTED;
+}
+
+static EFI_FILE_PROTOCOL HostpFileTemplate =
+{
+    EFI_FILE_PROTOCOL_REVISION2,
+    HostpFileOpen,
+    HostpFileClose,
+    HostpFileDelete,
+    HostpFileRead,
+    HostpFileWrite,
+    HostpFileGetPosition,
+    HostpFileSetPosition,
+    HostpFileGetInfo,
+    HostpFileSetInfo,
+    HostpFileFlush,
+    HostpFileOpenEx,
+    HostpFileReadEx,
+    HostpFileWriteEx,
+    HostpFileFlushEx
+};
+
+static
+EFI_STATUS
+EFIAPI
+HostpOpenVolume(
+    IN  EFI_SIMPLE_FILE_SYSTEM_PROTOCOL* This,
+    OUT EFI_FILE_PROTOCOL** Root
+)
+{
+    HOST_VOLUME* Volume = BASE_CR(This, HOST_VOLUME, FileSystem);
+    HOST_ENTRY   Entry;
+    CHAR8        Relative[HOST_PATH_MAX] = "";
+
+    if (!Root)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    EFI_STATUS Status = HostpResolve(Volume, Relative, L"\\", &Entry);
+    if (EFI_ERROR(Status))
+    {
+        return EFI_DEVICE_ERROR;
+    }
+
+    return HostpNewFile(Volume, Relative, &Entry, Root);
+}
+
+//
+//
+// EFI_BLOCK_IO_PROTOCOL and EFI_BLOCK_IO2_PROTOCOL over the FAT image
+//
+//
+
+/**
+* Checks a block request and reads it from the image.
+*/
+static
+EFI_STATUS
+HostpReadImage(
+    _Inout_ HOST_VOLUME* Volume,
+    _In_    UINT32 MediaId,
+    _In_    EFI_LBA Lba,
+    _In_    UINTN BufferSize,
+    _Out_   VOID* Buffer
+)
+{
+    EFI_BLOCK_IO_MEDIA* Media = &Volume->Media;
+
+    if (MediaId != Media->MediaId)
+    {
+        return EFI_MEDIA_CHANGED;
+    }
+
+    if (!Buffer)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    if (BufferSize % Media->BlockSize)
+    {
+        return EFI_BAD_BUFFER_SIZE;
+    }
+
+    UINT64 Blocks = BufferSize / Media->BlockSize;
+    if (Lba > Media->LastBlock || Blocks > Media->LastBlock - Lba + 1 ||
+        (Media->IoAlign > 1 && ((UINTN)Buffer & (Media->IoAlign - 1))))
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    if (HostReadFile(Volume->Image, Lba * Media->BlockSize, Buffer, BufferSize) != (INT64)BufferSize)
+    {
+        return EFI_DEVICE_ERROR;
+    }
+
+    Volume->Statistics.BlockRequests++;
+    Volume->Statistics.BlockBytes += BufferSize;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpReadBlocks(
+    IN  EFI_BLOCK_IO_PROTOCOL* This,
+    IN  UINT32 MediaId,
+    IN  EFI_LBA Lba,
+    IN  UINTN BufferSize,
+    OUT VOID* Buffer
+)
+{
+    HOST_VOLUME* Volume = BASE_CR(This, HOST_VOLUME, BlockIo);
+
+    EFI_STATUS Status = HostpReadImage(Volume, MediaId, Lba, BufferSize, Buffer);
+    if (!EFI_ERROR(Status))
+    {
+        HostpTransfer(Volume, 1, BufferSize);
+    }
+
+    return Status;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpWriteBlocks(
+    IN EFI_BLOCK_IO_PROTOCOL* This,
+    IN UINT32 MediaId,
+    IN EFI_LBA Lba,
+    IN UINTN BufferSize,
+    IN VOID* Buffer
+)
+{
+    (VOID)This;
+    (VOID)MediaId;
+    (VOID)Lba;
+    (VOID)BufferSize;
+    (VOID)Buffer;
+    return EFI_WRITE_PROTECTED;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpBlockReset(
+    IN EFI_BLOCK_IO_PROTOCOL* This,
+    IN BOOLEAN ExtendedVerification
+)
+{
+    (VOID)This;
+    (VOID)ExtendedVerification;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFlushBlocks(
+    IN EFI_BLOCK_IO_PROTOCOL* This
+)
+{
+    (VOID)This;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpBlockResetEx(
+    IN EFI_BLOCK_IO2_PROTOCOL* This,
+    IN BOOLEAN ExtendedVerification
+)
+{
+    (VOID)This;
+    (VOID)ExtendedVerification;
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpReadBlocksEx(
+    IN     EFI_BLOCK_IO2_PROTOCOL* This,
+    IN     UINT32 MediaId,
+    IN     EFI_LBA Lba,
+    IN OUT EFI_BLOCK_IO2_TOKEN* Token,
+    IN     UINTN BufferSize,
+    OUT    VOID* Buffer
+)
+{
+    HOST_VOLUME* Volume = BASE_CR(This, HOST_VOLUME, BlockIo2);
+
+    if (!Token || !Token->Event)
+    {
+        return HostpReadBlocks(&Volume->BlockIo, MediaId, Lba, BufferSize, Buffer);
+    }
+
+    EFI_STATUS Status = HostpReadImage(Volume, MediaId, Lba, BufferSize, Buffer);
+    if (EFI_ERROR(Status))
+    {
+        return Status;
+    }
+
+    HostpQueue(Volume, 1, BufferSize, &Token->TransactionStatus, EFI_SUCCESS, Token->Event);
+    return EFI_SUCCESS;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpWriteBlocksEx(
+    IN     EFI_BLOCK_IO2_PROTOCOL* This,
+    IN     UINT32 MediaId,
+    IN     EFI_LBA Lba,
+    IN OUT EFI_BLOCK_IO2_TOKEN* Token,
+    IN     UINTN BufferSize,
+    IN     VOID* Buffer
+)
+{
+    (VOID)This;
+    (VOID)MediaId;
+    (VOID)Lba;
+    (VOID)Token;
+    (VOID)BufferSize;
+    (VOID)Buffer;
+    return EFI_WRITE_PROTECTED;
+}
+
+static
+EFI_STATUS
+EFIAPI
+HostpFlushBlocksEx(
+    IN     EFI_BLOCK_IO2_PROTOCOL* This,
+    IN OUT EFI_BLOCK_IO2_TOKEN* Token
+)
+{
+    (VOID)This;
+
+    if (Token && Token->Event)
+    {
+        Token->TransactionStatus = EFI_SUCCESS;
+        gBS->SignalEvent(Token->Event);
+    }
+
+    return EFI_SUCCESS;
+}
+
+//
+//
+// FAT image
+//
+//
+
+typedef struct _HOST_FAT_NODE
+{
+    struct _HOST_FAT_NODE* Next;      // next entry of the same directory
+    struct _HOST_FAT_NODE* Children;
+    CHAR8                  Name[256];
+    CHAR8                  Path[HOST_PATH_MAX];
+    BOOLEAN                Directory;
+    UINT64                 Size;      // file bytes, or directory bytes once laid out
+    UINT8                  Short[11];
+    BOOLEAN                Long;      // needs long name entries
+    UINT32                 Cluster;
+    UINT32                 Clusters;
+} HOST_FAT_NODE;
+
+typedef struct _HOST_FAT_LAYOUT
+{
+    UINT32 BlockSize;
+    UINT32 SectorsPerCluster;
+    UINT32 Type;            // 16 or 32
+    UINT32 ClusterCount;
+    UINT32 ReservedSectors;
+    UINT32 FatSectors;
+    UINT32 RootEntries;     // FAT16 only
+    UINT64 TotalSectors;
+    UINT64 FatOffset;
+    UINT64 RootOffset;      // FAT16 only
+    UINT64 DataOffset;
+    UINT32 NextCluster;
+    UINT8* Fat;
+} HOST_FAT_LAYOUT;
+
+static
+BOOLEAN
+HostpShortChar(
+    _In_ CHAR8 Char
+)
+{
+    return (Char >= 'A' && Char <= 'Z') || (Char >= 'a' && Char <= 'z') || (Char >= '0' && Char <= '9') ||
+           Char == '!' || Char == '#' || Char == '$' || Char == '%' || Char == '&' || Char == '\'' ||
+           Char == '(' || Char == ')' || Char == '-' || Char == '@' || Char == '^' || Char == '_' ||
+           Char == '`' || Char == '{' || Char == '}' || Char == '~';
+}
+
+/**
+* Makes the 8.3 name of an entry. Names that do not fit get a NAME~N alias and long name
+* entries, Ordinal keeps the aliases of one directory apart.
+*/
+static
+VOID
+HostpShortName(
+    _Inout_ HOST_FAT_NODE* Node,
+    _In_    UINT32 Ordinal
+)
+{
+    CONST CHAR8* Name = Node->Name;
+    CONST CHAR8* Dot  = NULL;
+    UINTN        Length = AsciiStrLen(Name);
+
+    for (UINTN i = 0; i < Length; i++)
+    {
+        if (Name[i] == '.')
+        {
+            Dot = Name + i;
+        }
+    }
+
+    UINTN BaseLength = Dot ? (UINTN)(Dot - Name) : Length;
+    UINTN ExtLength  = Dot ? Length - BaseLength - 1 : 0;
+
+    BOOLEAN Fits = BaseLength && BaseLength <= 8 && ExtLength <= 3 && (!Dot || ExtLength);
+    for (UINTN i = 0; Fits && i < Length; i++)
+    {
+        Fits = Name + i == Dot || HostpShortChar(Name[i]);
+    }
+
+    SetMem(Node->Short, sizeof(Node->Short), ' ');
+    Node->Long = !Fits;
+
+    UINTN Out = 0;
+    for (UINTN i = 0; i < BaseLength && Out < (Fits ? 8u : 6u); i++)
+    {
+        if (HostpShortChar(Name[i]))
+        {
+            Node->Short[Out++] = (UINT8)HostpUpper(Name[i]);
+        }
+    }
+
+    if (!Fits)
+    {
+        CHAR8 Tail[8];
+        UINTN TailLength = AsciiSPrint(Tail, sizeof(Tail), "~%u", Ordinal);
+        Out = MIN(Out, 8 - TailLength);
+        CopyMem(Node->Short + Out, Tail, TailLength);
+    }
+
+    for (UINTN i = 0, e = 8; Dot && i < ExtLength && e < 11; i++)
+    {
+        if (HostpShortChar(Dot[1 + i]))
+        {
+            Node->Short[e++] = (UINT8)HostpUpper(Dot[1 + i]);
+        }
+    }
+}
+
+/**
+* @return Directory entries Node takes in its parent.
+*/
+static
+UINT32
+HostpEntrySlots(
+    _In_ CONST HOST_FAT_NODE* Node
+)
+{
+    return 1 + (Node->Long ? (UINT32)((AsciiStrLen(Node->Name) + HOST_FAT_LFN_CHARS - 1) / HOST_FAT_LFN_CHARS) : 0);
+}
+
+static
+VOID
+HostpFreeNodes(
+    _In_opt_ HOST_FAT_NODE* Node
+)
+{
+    while (Node)
+    {
+        HOST_FAT_NODE* Next = Node->Next;
+        HostpFreeNodes(Node->Children);
+        HostFree(Node);
+        Node = Next;
+    }
+}
+
+/**
+* Reads a host directory tree into nodes.
+*/
+static
+BOOLEAN
+HostpScan(
+    _Inout_ HOST_FAT_NODE* Directory
+)
+{
+    VOID* Handle = HostOpenDirectory(Directory->Path);
+    if (!Handle)
+    {
+        return FALSE;
+    }
+
+    HOST_ENTRY      Entry;
+    HOST_FAT_NODE** Tail    = &Directory->Children;
+    UINT32          Ordinal = 0;
+    BOOLEAN         Result  = TRUE;
+
+    while (Result && HostReadDirectory(Handle, Directory->Path, &Entry))
+    {
+        HOST_FAT_NODE* Node = HostAlloc(sizeof(HOST_FAT_NODE));
+        if (!Node || AsciiStrLen(Entry.Name) > 255)
+        {
+            HostFree(Node);
+            Result = FALSE;
+            break;
+        }
+
+        AsciiSPrint(Node->Name, sizeof(Node->Name), "%a", Entry.Name);
+        AsciiSPrint(Node->Path, sizeof(Node->Path), "%a/%a", Directory->Path, Entry.Name);
+        Node->Directory = Entry.Directory != 0;
+        Node->Size      = Entry.Size;
+        HostpShortName(Node, ++Ordinal);
+
+        *Tail = Node;
+        Tail  = &Node->Next;
+
+        if (Node->Directory)
+        {
+            Result = HostpScan(Node);
+        }
+    }
+
+    HostCloseDirectory(Handle);
+    return Result;
+}
+
+/**
+* Sizes every directory and counts the clusters the tree needs.
+*/
+static
+UINT64
+HostpCountClusters(
+    _Inout_ HOST_FAT_NODE* Directory,
+    _In_    BOOLEAN Root
+)
+{
+    UINT64 Slots    = Root ? 0 : 2;
+    UINT64 Clusters = 0;
+
+    for (HOST_FAT_NODE* Node = Directory->Children; Node; Node = Node->Next)
+    {
+        Slots += HostpEntrySlots(Node);
+
+        if (Node->Directory)
+        {
+            Clusters += HostpCountClusters(Node, FALSE);
+        }
+        else
+        {
+            Node->Clusters = (UINT32)((Node->Size + HOST_FAT_CLUSTER_SIZE - 1) / HOST_FAT_CLUSTER_SIZE);
+            Clusters      += Node->Clusters;
+        }
+    }
+
+    // room for the end marker, so a full last cluster never hides entries behind it
+    Directory->Size     = (Slots + 1) * HOST_FAT_ENTRY_SIZE;
+    Directory->Clusters = (UINT32)MAX((Directory->Size + HOST_FAT_CLUSTER_SIZE - 1) / HOST_FAT_CLUSTER_SIZE, 1ULL);
+    return Clusters + Directory->Clusters;
+}
+
+static
+VOID
+HostpSetFat(
+    _Inout_ HOST_FAT_LAYOUT* Layout,
+    _In_    UINT32 Cluster,
+    _In_    UINT32 Value
+)
+{
+    if (Layout->Type == 16)
+    {
+        Layout->Fat[Cluster * 2]     = (UINT8)Value;
+        Layout->Fat[Cluster * 2 + 1] = (UINT8)(Value >> 8);
+    }
+    else
+    {
+        for (UINT32 i = 0; i < 4; i++)
+        {
+            Layout->Fat[Cluster * 4 + i] = (UINT8)(Value >> (8 * i));
+        }
+    }
+}
+
+/**
+* Hands out a contiguous run of clusters and chains it in the FAT.
+*/
+static
+UINT32
+HostpAllocateRun(
+    _Inout_ HOST_FAT_LAYOUT* Layout,
+    _In_    UINT32 Clusters
+)
+{
+    if (!Clusters)
+    {
+        return 0;
+    }
+
+    UINT32 First = Layout->NextCluster;
+    UINT32 End   = Layout->Type == 16 ? 0xFFFF : 0x0FFFFFFF;
+
+    for (UINT32 i = 0; i < Clusters; i++)
+    {
+        HostpSetFat(Layout, First + i, i + 1 < Clusters ? First + i + 1 : End);
+    }
+
+    Layout->NextCluster += Clusters;
+    return First;
+}
+
+static
+VOID
+HostpPut16(
+    _Out_ UINT8* Out,
+    _In_  UINT32 Value
+)
+{
+    Out[0] = (UINT8)Value;
+    Out[1] = (UINT8)(Value >> 8);
+}
+
+static
+VOID
+HostpPut32(
+    _Out_ UINT8* Out,
+    _In_  UINT32 Value
+)
+{
+    HostpPut16(Out, Value);
+    HostpPut16(Out + 2, Value >> 16);
+}
+
+static
+VOID
+HostpShortEntry(
+    _Out_ UINT8* Entry,
+    _In_  CONST UINT8* Name,
+    _In_  UINT8 Attributes,
+    _In_  UINT32 Cluster,
+    _In_  UINT32 Size
+)
+{
+    ZeroMem(Entry, HOST_FAT_ENTRY_SIZE);
+    CopyMem(Entry, Name, 11);
+    Entry[11] = Attributes;
+    HostpPut16(Entry + 20, Cluster >> 16);
+    HostpPut16(Entry + 22, 0);
+    HostpPut16(Entry + 24, (44 << 9) | (1 << 5) | 1); // 2024-01-01
+    HostpPut16(Entry + 26, Cluster);
+    HostpPut32(Entry + 28, Size);
+}
+
+/**
+* Writes the entries of one directory, long names first, into a zeroed buffer.
+*/
+static
+VOID
+HostpDirectoryEntries(
+    _In_  CONST HOST_FAT_NODE* Directory,
+    _In_  UINT32 Parent,
+    _In_  BOOLEAN Root,
+    _Out_ UINT8* Buffer
+)
+{
+    static CONST UINT8 CharOffsets[HOST_FAT_LFN_CHARS] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+    static CONST UINT8 Dot[11]    = { '.', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ' };
+    static CONST UINT8 DotDot[11] = { '.', '.', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ' };
+
+    UINT8* Entry = Buffer;
+
+    if (!Root)
+    {
+        HostpShortEntry(Entry, Dot, 0x10, Directory->Cluster, 0);
+        HostpShortEntry(Entry + HOST_FAT_ENTRY_SIZE, DotDot, 0x10, Parent, 0);
+        Entry += 2 * HOST_FAT_ENTRY_SIZE;
+    }
+
+    for (CONST HOST_FAT_NODE* Node = Directory->Children; Node; Node = Node->Next)
+    {
+        if (Node->Long)
+        {
+            UINT8 Checksum = 0;
+            for (UINT32 i = 0; i < 11; i++)
+            {
+                Checksum = (UINT8)(((Checksum & 1) << 7) + (Checksum >> 1) + Node->Short[i]);
+            }
+
+            UINTN  Length = AsciiStrLen(Node->Name);
+            UINT32 Count  = HostpEntrySlots(Node) - 1;
+
+            for (UINT32 Sequence = Count; Sequence; Sequence--)
+            {
+                ZeroMem(Entry, HOST_FAT_ENTRY_SIZE);
+                Entry[0]  = (UINT8)(Sequence | (Sequence == Count ? 0x40 : 0));
+                Entry[11] = 0x0F;
+                Entry[13] = Checksum;
+
+                for (UINT32 c = 0; c < HOST_FAT_LFN_CHARS; c++)
+                {
+                    UINTN  At   = (Sequence - 1) * HOST_FAT_LFN_CHARS + c;
+                    UINT32 Char = At < Length ? (UINT8)Node->Name[At] : (At == Length ? 0 : 0xFFFF);
+                    HostpPut16(Entry + CharOffsets[c], Char);
+                }
+
+                Entry += HOST_FAT_ENTRY_SIZE;
+            }
+        }
+
+        HostpShortEntry(Entry, Node->Short, Node->Directory ? 0x10 : 0x01, Node->Cluster, Node->Directory ? 0 : (UINT32)Node->Size);
+        Entry += HOST_FAT_ENTRY_SIZE;
+    }
+}
+
+/**
+* Gives every node its clusters, directories before what is in them.
+*/
+static
+VOID
+HostpPlace(
+    _Inout_ HOST_FAT_LAYOUT* Layout,
+    _Inout_ HOST_FAT_NODE* Directory
+)
+{
+    for (HOST_FAT_NODE* Node = Directory->Children; Node; Node = Node->Next)
+    {
+        Node->Cluster = HostpAllocateRun(Layout, Node->Clusters);
+        if (Node->Directory)
+        {
+            HostpPlace(Layout, Node);
+        }
+    }
+}
+
+static
+BOOLEAN
+HostpWriteTree(
+    _In_ CONST HOST_FAT_LAYOUT* Layout,
+    _In_ INT32 Image,
+    _In_ CONST HOST_FAT_NODE* Directory,
+    _In_ UINT32 Parent,
+    _In_ BOOLEAN Root,
+    _In_ UINT8* Copy
+)
+{
+    UINT64 Size   = Root && Layout->Type == 16 ? (UINT64)Layout->RootEntries * HOST_FAT_ENTRY_SIZE : (UINT64)Directory->Clusters * HOST_FAT_CLUSTER_SIZE;
+    UINT64 Offset = Root && Layout->Type == 16 ? Layout->RootOffset : Layout->DataOffset + (UINT64)(Directory->Cluster - 2) * HOST_FAT_CLUSTER_SIZE;
+    UINT8* Entries = HostAlloc(Size);
+    if (!Entries)
+    {
+        return FALSE;
+    }
+
+    HostpDirectoryEntries(Directory, Parent, Root, Entries);
+    BOOLEAN Written = !HostWriteFile(Image, Offset, Entries, Size);
+    HostFree(Entries);
+
+    // ".." of a directory in the root says cluster 0 whatever the FAT type
+    UINT32 Self = Root ? 0 : Directory->Cluster;
+
+    for (CONST HOST_FAT_NODE* Node = Directory->Children; Written && Node; Node = Node->Next)
+    {
+        if (Node->Directory)
+        {
+            Written = HostpWriteTree(Layout, Image, Node, Self, FALSE, Copy);
+            continue;
+        }
+
+        INT32 Source = HostOpenFile(Node->Path, 0);
+        if (Source < 0)
+        {
+            return FALSE;
+        }
+
+        UINT64 Target = Layout->DataOffset + (UINT64)(Node->Cluster - 2) * HOST_FAT_CLUSTER_SIZE;
+        for (UINT64 Done = 0; Written && Done < Node->Size; Done += HOST_FAT_COPY_SIZE)
+        {
+            UINT64 Chunk = MIN(Node->Size - Done, (UINT64)HOST_FAT_COPY_SIZE);
+            Written = HostReadFile(Source, Done, Copy, Chunk) == (INT64)Chunk &&
+                      !HostWriteFile(Image, Target + Done, Copy, Chunk);
+        }
+
+        HostCloseFile(Source);
+    }
+
+    return Written;
+}
+
+/**
+* Lays the volume's directory out as a FAT image in a temporary host file.
+*/
+static
+BOOLEAN
+HostpBuildImage(
+    _Inout_ HOST_VOLUME* Volume
+)
+{
+    HOST_FAT_NODE Root;
+    ZeroMem(&Root, sizeof(Root));
+    AsciiSPrint(Root.Path, sizeof(Root.Path), "%a", Volume->Root);
+
+    HOST_FAT_LAYOUT Layout;
+    ZeroMem(&Layout, sizeof(Layout));
+    Layout.BlockSize         = Volume->Config.BlockSize;
+    Layout.SectorsPerCluster = HOST_FAT_CLUSTER_SIZE / Layout.BlockSize;
+
+    if (!HostpScan(&Root))
+    {
+        HostpFreeNodes(Root.Children);
+        return FALSE;
+    }
+
+    UINT64 Used      = HostpCountClusters(&Root, TRUE);
+    UINT64 RootSlots = Root.Size / HOST_FAT_ENTRY_SIZE;
+
+    // FAT16 while the tree fits, the cluster count alone tells the types apart
+    if (Used + 16 < 65525 && RootSlots <= 4096)
+    {
+        Layout.Type            = 16;
+        Layout.ClusterCount    = (UINT32)MAX(Used - Root.Clusters + 16, 4085ULL + 16);
+        Layout.ReservedSectors = 1;
+        Layout.RootEntries     = (UINT32)ALIGN_VALUE(MAX(RootSlots, 512ULL), Layout.BlockSize / HOST_FAT_ENTRY_SIZE);
+    }
+    else
+    {
+        Layout.Type            = 32;
+        Layout.ClusterCount    = (UINT32)MAX(Used + 16, 65525ULL + 16);
+        Layout.ReservedSectors = 32;
+    }
+
+    UINT64 FatBytes   = ((UINT64)Layout.ClusterCount + 2) * (Layout.Type / 8);
+    UINT32 RootBlocks = (UINT32)((UINT64)Layout.RootEntries * HOST_FAT_ENTRY_SIZE / Layout.BlockSize);
+
+    Layout.FatSectors   = (UINT32)((FatBytes + Layout.BlockSize - 1) / Layout.BlockSize);
+    Layout.FatOffset    = (UINT64)Layout.ReservedSectors * Layout.BlockSize;
+    Layout.RootOffset   = Layout.FatOffset + 2ULL * Layout.FatSectors * Layout.BlockSize;
+    Layout.DataOffset   = Layout.RootOffset + (UINT64)RootBlocks * Layout.BlockSize;
+    Layout.TotalSectors = Layout.DataOffset / Layout.BlockSize + (UINT64)Layout.ClusterCount * Layout.SectorsPerCluster;
+    Layout.NextCluster  = 2;
+    Layout.Fat          = HostAlloc((UINT64)Layout.FatSectors * Layout.BlockSize);
+
+    UINT8*  Copy    = HostAlloc(HOST_FAT_COPY_SIZE);
+    UINT8*  Boot    = HostAlloc(Layout.BlockSize);
+    BOOLEAN Written = Layout.Fat && Copy && Boot && Layout.TotalSectors <= MAX_UINT32;
+
+    if (Written)
+    {
+        HostpSetFat(&Layout, 0, Layout.Type == 16 ? 0xFFF8 : 0x0FFFFFF8);
+        HostpSetFat(&Layout, 1, Layout.Type == 16 ? 0xFFFF : 0x0FFFFFFF);
+
+        Root.Cluster = Layout.Type == 32 ? HostpAllocateRun(&Layout, Root.Clusters) : 0;
+        HostpPlace(&Layout, &Root);
+
+        Volume->Image = HostCreateTemporary(Volume->ImagePath);
+        Written       = Volume->Image >= 0;
+    }
+
+    if (Written)
+    {
+        Volume->ImageSize = Layout.TotalSectors * Layout.BlockSize;
+
+        // boot sector, the BPB fields BlpFatMountVolume reads and the signature at 510
+        Boot[0] = 0xEB;
+        Boot[1] = 0x58;
+        Boot[2] = 0x90;
+        CopyMem(Boot + 3, "OPLIHOST", 8);
+        HostpPut16(Boot + 11, Layout.BlockSize);
+        Boot[13] = (UINT8)Layout.SectorsPerCluster;
+        HostpPut16(Boot + 14, Layout.ReservedSectors);
+        Boot[16] = 2;
+        HostpPut16(Boot + 17, Layout.RootEntries);
+        HostpPut16(Boot + 19, Layout.TotalSectors <= 0xFFFF ? (UINT32)Layout.TotalSectors : 0);
+        Boot[21] = 0xF8;
+        HostpPut16(Boot + 22, Layout.Type == 16 ? Layout.FatSectors : 0);
+        HostpPut32(Boot + 32, Layout.TotalSectors > 0xFFFF ? (UINT32)Layout.TotalSectors : 0);
+        if (Layout.Type == 32)
+        {
+            HostpPut32(Boot + 36, Layout.FatSectors);
+            HostpPut32(Boot + 44, Root.Cluster);
+        }
+        Boot[510] = 0x55;
+        Boot[511] = 0xAA;
+
+        UINT64 FatSize = (UINT64)Layout.FatSectors * Layout.BlockSize;
+        Written = !HostResizeFile(Volume->Image, Volume->ImageSize) &&
+                  !HostWriteFile(Volume->Image, 0, Boot, Layout.BlockSize) &&
+                  !HostWriteFile(Volume->Image, Layout.FatOffset, Layout.Fat, FatSize) &&
+                  !HostWriteFile(Volume->Image, Layout.FatOffset + FatSize, Layout.Fat, FatSize) &&
+                  HostpWriteTree(&Layout, Volume->Image, &Root, 0, TRUE, Copy);
+    }
+
+    HostFree(Boot);
+    HostFree(Copy);
+    HostFree(Layout.Fat);
+    HostpFreeNodes(Root.Children);
+
+    if (Written)
+    {
+        Volume->Media.LastBlock = Layout.TotalSectors - 1;
+    }
+
+    return Written;
+}
+
+//
+//
+// Mounting
+//
+//
+
+EFI_HANDLE
+HostMountVolume(
+    _In_ CONST HOST_VOLUME_CONFIG* Config
+)
+{
+    HOST_VOLUME* Volume = NULL;
+    for (UINT32 i = 0; i < HOST_MAX_VOLUMES && !Volume; i++)
+    {
+        if (!Volumes[i].Used)
+        {
+            Volume = &Volumes[i];
+        }
+    }
+
+    HOST_ENTRY Entry;
+    if (!Volume || !Config->Directory || HostStat(Config->Directory, &Entry) || !Entry.Directory ||
+        AsciiStrLen(Config->Directory) >= HOST_PATH_MAX / 2 ||
+        (Config->BlockSize && (Config->BlockSize < 512 || Config->BlockSize > HOST_FAT_CLUSTER_SIZE ||
+                               (Config->BlockSize & (Config->BlockSize - 1)))))
+    {
+        return NULL;
+    }
+
+    ZeroMem(Volume, sizeof(HOST_VOLUME));
+    Volume->Config           = *Config;
+    Volume->Image            = -1;
+    Volume->Device.Latency   = Config->Latency;
+    Volume->Device.Bandwidth = Config->Bandwidth;
+    AsciiSPrint(Volume->Root, sizeof(Volume->Root), "%a", Config->Directory);
+    StrnCpyS(Volume->Label, ARRAY_SIZE(Volume->Label), Config->Label ? Config->Label : L"HOST", ARRAY_SIZE(Volume->Label) - 1);
+
+    Volume->Media.MediaId          = 1;
+    Volume->Media.MediaPresent     = TRUE;
+    Volume->Media.LogicalPartition = TRUE;
+    Volume->Media.ReadOnly         = TRUE;
+    Volume->Media.BlockSize        = Config->BlockSize ? Config->BlockSize : 512;
+    Volume->Media.IoAlign          = Config->IoAlign;
+
+    if (Config->BlockSize && !HostpBuildImage(Volume))
+    {
+        if (Volume->Image >= 0)
+        {
+            HostCloseFile(Volume->Image);
+            HostRemove(Volume->ImagePath);
+        }
+        return NULL;
+    }
+
+    Volume->FileSystem.Revision   = EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_REVISION;
+    Volume->FileSystem.OpenVolume = HostpOpenVolume;
+
+    Volume->BlockIo.Revision    = EFI_BLOCK_IO_PROTOCOL_REVISION3;
+    Volume->BlockIo.Media       = &Volume->Media;
+    Volume->BlockIo.Reset       = HostpBlockReset;
+    Volume->BlockIo.ReadBlocks  = HostpReadBlocks;
+    Volume->BlockIo.WriteBlocks = HostpWriteBlocks;
+    Volume->BlockIo.FlushBlocks = HostpFlushBlocks;
+
+    Volume->BlockIo2.Media         = &Volume->Media;
+    Volume->BlockIo2.Reset         = HostpBlockResetEx;
+    Volume->BlockIo2.ReadBlocksEx  = HostpReadBlocksEx;
+    Volume->BlockIo2.WriteBlocksEx = HostpWriteBlocksEx;
+    Volume->BlockIo2.FlushBlocksEx = HostpFlushBlocksEx;
+
+    Volume->Used = TRUE;
+    HostInstallProtocol(&Volume->Handle, &gEfiSimpleFileSystemProtocolGuid, &Volume->FileSystem);
+    if (Config->BlockSize)
+    {
+        HostInstallProtocol(&Volume->Handle, &gEfiBlockIoProtocolGuid, &Volume->BlockIo);
+        if (Config->BlockIo2)
+        {
+            HostInstallProtocol(&Volume->Handle, &gEfiBlockIo2ProtocolGuid, &Volume->BlockIo2);
+        }
+    }
+
+    if (Config->Boot)
+    {
+        HostSetBootDevice(Volume->Handle);
+    }
+
+    return Volume->Handle;
+}
+
+VOID
+HostUnmountVolumes(
+    VOID
+)
+{
+    for (UINT32 i = 0; i < HOST_MAX_VOLUMES; i++)
+    {
+        if (Volumes[i].Used && Volumes[i].Image >= 0)
+        {
+            HostCloseFile(Volumes[i].Image);
+            HostRemove(Volumes[i].ImagePath);
+        }
+
+        ZeroMem(&Volumes[i], sizeof(HOST_VOLUME));
+    }
+}
+
+VOID
+HostChangeMedia(
+    _In_ EFI_HANDLE Handle
+)
+{
+    HostpVolume(Handle)->Media.MediaId++;
+}
+
+VOID
+HostGetVolumeStatistics(
+    _In_  EFI_HANDLE Handle,
+    _Out_ HOST_VOLUME_STATISTICS* Statistics
+)
+{
+    *Statistics = HostpVolume(Handle)->Statistics;
+}
+
+VOID
+HostResetVolumeStatistics(
+    _In_ EFI_HANDLE Handle
+)
+{
+    HOST_VOLUME* Volume = HostpVolume(Handle);
+    ZeroMem(&Volume->Statistics, sizeof(HOST_VOLUME_STATISTICS));
+    Volume->Device.Requests = 0;
+    Volume->Device.Bytes    = 0;
+}
\ No newline at end of file
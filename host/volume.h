@@ -0,0 +1,84 @@
+#ifndef _VOLUME_H
+#define _VOLUME_H
+
+#include "firmware.h"
+
+//
+//
+// Mock volumes backed by a host directory. EFI_SIMPLE_FILE_SYSTEM_PROTOCOL serves the
+// directory itself, read only and with FAT's case insensitive names. With a block size set
+// the same tree is also laid out as a FAT16 or FAT32 image in a temporary host file, which
+// EFI_BLOCK_IO_PROTOCOL (and EFI_BLOCK_IO2_PROTOCOL when asked for) serve for the loader's
+// raw FAT reader. The image is a snapshot taken at mount time.
+//
+// Both protocols share one HOST_DEVICE, so their requests queue behind each other. A file
+// protocol read pays the latency once per FileChunk bytes, the way a firmware FAT driver
+// goes through its disk cache a cluster at a time, an Open pays it once for every directory
+// it searches. A block read pays it once per call.
+//
+//
+
+#define HOST_MAX_VOLUMES 4
+
+typedef struct _HOST_VOLUME_CONFIG
+{
+    CONST CHAR8*  Directory;  // host directory served as the volume root
+    CONST CHAR16* Label;
+    UINT64        Latency;    // nanoseconds per request
+    UINT64        Bandwidth;  // bytes per second, 0 for no limit
+    UINT32        FileChunk;  // bytes a file protocol read moves per request, 0 for one request per read
+    UINT32        BlockSize;  // bytes per block of the FAT image, 0 for no block device
+    UINT32        IoAlign;    // buffer alignment BlockIo asks for, 0 or 1 for none
+    BOOLEAN       ReadEx;     // EFI_FILE_PROTOCOL revision 2 with queued reads
+    BOOLEAN       BlockIo2;   // queued block reads too
+    BOOLEAN       Boot;       // the loader was started from this volume
+} HOST_VOLUME_CONFIG;
+
+typedef struct _HOST_VOLUME_STATISTICS
+{
+    UINT64 FileRequests;  // requests the file protocol booked on the device
+    UINT64 FileBytes;
+    UINT64 BlockRequests; // BlockIo and BlockIo2 calls
+    UINT64 BlockBytes;
+    UINT64 Opens;
+    UINT64 Lookups;       // directories searched by Open, one request each
+} HOST_VOLUME_STATISTICS;
+
+/**
+* Mounts a host directory as a volume.
+*
+* @return The volume's handle, NULL if the directory or its FAT image could not be set up.
+*/
+EFI_HANDLE
+HostMountVolume(
+    _In_ CONST HOST_VOLUME_CONFIG* Config
+);
+
+/**
+* Closes every volume and removes the FAT images. Call before HostFirmwareReset.
+*/
+VOID
+HostUnmountVolumes(
+    VOID
+);
+
+/**
+* Changes the media id, like swapping the disk, handles opened before fail from then on.
+*/
+VOID
+HostChangeMedia(
+    _In_ EFI_HANDLE Volume
+);
+
+VOID
+HostGetVolumeStatistics(
+    _In_  EFI_HANDLE Volume,
+    _Out_ HOST_VOLUME_STATISTICS* Statistics
+);
+
+VOID
+HostResetVolumeStatistics(
+    _In_ EFI_HANDLE Volume
+);
+
+#endif // !_VOLUME_H
\ No newline at end of file
@@ -0,0 +1,242 @@
+#ifndef _BOOTINFO_H
+#define _BOOTINFO_H
+
+//
+//
+// Boot information the loader hands to KernelMain, shared by both sides so it only uses
+// fixed width types. Everything lives in one page allocation:
+//
+//   BOOT_INFO                                   four cache lines
+//   BOOT_MEMORY_RANGE[MemoryRangeCount]         cache line aligned, 16 bytes each
+//   BOOT_MODULE[ModuleCount]                    cache line aligned
+//
+// The boot trace and the loader's log live in allocations of their own so they survive
+// the kernel reclaiming the boot information.
+//
+// The memory map is the one the firmware reported at ExitBootServices, sorted by address,
+// with neighbouring ranges of the same type and caching merged, so the physical allocator
+// is seeded in one pass. Regions the loader set up for the kernel come with types of their
+// own instead of EFI loader data. Addresses are physical unless noted, the kernel reaches
+// them through the direct map at DirectMapBase.
+//
+// Newer loaders only ever append fields and bump Version, HeaderSize says how much of
+// BOOT_INFO a given loader filled in.
+//
+//
+
+#ifndef __BASE_H__
+#include "ktypes.h"
+#endif
+
+#define BOOT_INFO_SIGNATURE  0x544F4F42494C504FULL // 'OPLIBOOT'
+#define BOOT_INFO_VERSION    3                     // 2 added Trace, 3 added Log
+#define BOOT_INFO_ALIGNMENT  64                    // cache line, every table starts on one
+#define BOOT_STACK_SIZE      0x10000               // the stack KernelMain is entered on
+
+// BOOT_INFO Flags
+#define BOOT_INFO_KERNEL_VERIFIED 0x00000001 // KernelDigest was checked while the kernel was read
+#define BOOT_INFO_NO_EXECUTE      0x00000002 // EFER.NXE is set and the tables use NX
+#define BOOT_INFO_MAP_TRUNCATED   0x00000004 // the memory map did not fit, the tail is missing
+
+typedef enum _BOOT_MEMORY_TYPE
+{
+    BootMemoryFree = 1,       // usable RAM, boot services memory included
+    BootMemoryReserved,
+    BootMemoryAcpiReclaim,    // usable once the ACPI tables are parsed
+    BootMemoryAcpiNvs,
+    BootMemoryMmio,
+    BootMemoryRuntime,        // firmware runtime services code and data
+    BootMemoryUnusable,       // errors were detected in it
+    BootMemoryPersistent,
+    BootMemoryLoader,         // the loader's own code, data and pool, reclaimable
+    BootMemoryKernel,         // the kernel image
+    BootMemoryKernelStack,    // the BOOT_STACK_SIZE stack KernelMain starts on
+    BootMemoryPageTables,     // the tables in CR3 at entry
+    BootMemoryBootInfo,       // this structure and its tables
+    BootMemoryModule,         // boot bundle, payloads are described by BOOT_MODULE
+    BootMemoryTypeCount
+} BOOT_MEMORY_TYPE;
+
+// BOOT_MEMORY_RANGE Flags, the caching the range supports and whether firmware uses it at runtime
+#define BOOT_MEMORY_UC      0x0001
+#define BOOT_MEMORY_WC      0x0002
+#define BOOT_MEMORY_WB      0x0004
+#define BOOT_MEMORY_NV      0x0008
+#define BOOT_MEMORY_RUNTIME 0x0010
+
+typedef struct _BOOT_MEMORY_RANGE
+{
+    UINT64 Base;  // page aligned
+    UINT32 Pages; // 4 KiB pages, longer ranges are split
+    UINT16 Type;  // BOOT_MEMORY_TYPE
+    UINT16 Flags; // BOOT_MEMORY_*
+} BOOT_MEMORY_RANGE;
+
+// BOOT_MODULE Flags
+#define BOOT_MODULE_VERIFIED 0x00000001 // Digest matched while the bundle was read
+
+typedef struct _BOOT_MODULE
+{
+    CHAR8  Name[32];   // ASCII, NUL padded
+    UINT64 Base;
+    UINT64 Size;       // bytes, without padding
+    UINT32 Type;       // bundle entry type, 2 for modules and 3 for config
+    UINT32 Flags;
+    UINT8  Digest[32]; // SHA-256 of the payload
+    UINT64 Reserved;
+} BOOT_MODULE;
+
+//
+//
+// Boot trace, a ring of TSC stamped stage events the loader starts at entry and hands over
+// in BOOT_INFO.Trace. The kernel appends its own events with BootTraceRecord. TraceDump.py
+// turns a memory dump of the ring into a Chrome trace, Begin and End events with the same
+// name and source pair up into a slice.
+//
+// Both sides also write every event they record as a line to the QEMU and Bochs debug
+// console at BOOT_DEBUGCON_PORT when one is present, reading the port back returns its own
+// number there. debugger/BootBench.py times boots from these lines without touching guest
+// memory. Numbers are hexadecimal:
+//
+//   @opli <source L|K> <kind B|E|M> <TSC> <name>
+//   @opli L F <TSC ticks per second> tsc           once the loader has calibrated
+//
+//
+
+#define BOOT_TRACE_SIGNATURE   0x45435254494C504FULL // 'OPLITRCE'
+#define BOOT_TRACE_CAPACITY    256                   // power of two, older events are overwritten
+#define BOOT_TRACE_NAME_LENGTH 20                    // NUL included
+#define BOOT_DEBUGCON_PORT     0xE9
+
+typedef enum _BOOT_TRACE_KIND
+{
+    BootTraceBegin = 1,
+    BootTraceEnd,
+    BootTraceMark // a point in time without a duration
+} BOOT_TRACE_KIND;
+
+typedef enum _BOOT_TRACE_SOURCE
+{
+    BootTraceLoader = 1,
+    BootTraceKernel
+} BOOT_TRACE_SOURCE;
+
+typedef struct _BOOT_TRACE_EVENT
+{
+    UINT64 Tsc;
+    CHAR8  Name[BOOT_TRACE_NAME_LENGTH]; // ASCII, NUL padded, longer names are cut
+    UINT8  Kind;                         // BOOT_TRACE_KIND
+    UINT8  Source;                       // BOOT_TRACE_SOURCE
+    UINT16 Cpu;                          // 0 for the boot processor
+} BOOT_TRACE_EVENT;
+
+typedef struct _BOOT_TRACE
+{
+    UINT64 Signature;    // BOOT_TRACE_SIGNATURE
+    UINT32 Capacity;     // BOOT_TRACE_CAPACITY
+    UINT32 EventSize;    // sizeof(BOOT_TRACE_EVENT)
+    UINT64 Count;        // events ever recorded, the newest is Events[(Count - 1) % Capacity]
+    UINT64 TscFrequency; // ticks per second, measured by the loader before the handoff
+    UINT64 Reserved[4];
+    BOOT_TRACE_EVENT Events[BOOT_TRACE_CAPACITY];
+} BOOT_TRACE;
+
+/**
+* Appends an event to the ring. Not safe against concurrent callers, the loader and the
+* kernel only record from the boot processor.
+*
+* @param Trace  The ring.
+* @param Tsc    The time stamp counter at the event.
+* @param Name   Stage name, cut to BOOT_TRACE_NAME_LENGTH - 1 characters.
+* @param Kind   BOOT_TRACE_KIND.
+* @param Source BOOT_TRACE_SOURCE.
+*/
+static __inline
+VOID
+BootTraceRecord(
+    _Inout_ BOOT_TRACE* Trace,
+    _In_    UINT64 Tsc,
+    _In_    CONST CHAR8* Name,
+    _In_    UINT8 Kind,
+    _In_    UINT8 Source
+)
+{
+    BOOT_TRACE_EVENT* Event = &Trace->Events[Trace->Count++ & (BOOT_TRACE_CAPACITY - 1)];
+    UINT32 Index = 0;
+
+    Event->Tsc    = Tsc;
+    Event->Kind   = Kind;
+    Event->Source = Source;
+    Event->Cpu    = 0;
+
+    for (; Index < BOOT_TRACE_NAME_LENGTH - 1 && Name[Index]; Index++)
+    {
+        Event->Name[Index] = Name[Index];
+    }
+
+    for (; Index < BOOT_TRACE_NAME_LENGTH; Index++)
+    {
+        Event->Name[Index] = '\0';
+    }
+}
+
+//
+//
+// The loader's console output, kept as the kernel's early dmesg. Text is ASCII with the
+// loader's own line breaks and follows the header, once Head passes Size only the last
+// Size bytes are left.
+//
+//
+
+#define BOOT_LOG_SIGNATURE 0x474F4C494C504FULL // 'OPLILOG'
+
+typedef struct _BOOT_LOG
+{
+    UINT64 Signature;   // BOOT_LOG_SIGNATURE
+    UINT32 Size;        // bytes of text, a power of two
+    UINT32 HeaderSize;  // sizeof(BOOT_LOG), where the text starts
+    UINT64 Head;        // bytes ever written, the newest byte is at (Head - 1) % Size
+    UINT64 Reserved[5];
+} BOOT_LOG;
+
+typedef struct _BOOT_INFO
+{
+    UINT64 Signature;          // BOOT_INFO_SIGNATURE
+    UINT32 Version;            // BOOT_INFO_VERSION
+    UINT32 HeaderSize;         // sizeof(BOOT_INFO) of the loader that filled it in
+    UINT64 Base;               // this allocation
+    UINT64 Size;               // bytes in it, tables included
+    UINT64 MemoryMap;          // BOOT_MEMORY_RANGE[MemoryRangeCount]
+    UINT32 MemoryRangeCount;
+    UINT32 MemoryRangeSize;    // sizeof(BOOT_MEMORY_RANGE)
+    UINT64 Modules;            // BOOT_MODULE[ModuleCount]
+    UINT32 ModuleCount;
+    UINT32 ModuleSize;         // sizeof(BOOT_MODULE)
+
+    UINT64 KernelPhysicalBase;
+    UINT64 KernelVirtualBase;
+    UINT64 KernelSize;         // bytes mapped at KernelVirtualBase
+    UINT64 KernelStack;        // lowest address of the boot stack
+    UINT64 PageTableRoot;      // CR3 at entry
+    UINT64 PageTablePages;     // one allocation starting at PageTableRoot
+    UINT64 DirectMapBase;      // virtual, physical 0 is mapped here
+    UINT64 DirectMapSize;
+
+    UINT8  KernelDigest[32];   // SHA-256 of the kernel file when BOOT_INFO_KERNEL_VERIFIED
+    UINT32 Flags;              // BOOT_INFO_*
+    UINT32 Reserved0;
+    UINT64 RuntimeServices;    // EFI_RUNTIME_SERVICES, no virtual address map is set
+    UINT64 AcpiRsdp;           // 0 when the firmware published none
+    UINT64 Trace;              // BOOT_TRACE, 0 when tracing could not be set up
+
+    UINT64 Log;                // BOOT_LOG, 0 when the loader had none
+    UINT64 Reserved2[7];
+} BOOT_INFO;
+
+/**
+* The kernel entry point. Runs on the boot stack through the loader's page tables with
+* interrupts disabled, BootInfo is its direct map address.
+*/
+typedef VOID (*BOOT_KERNEL_ENTRY)(BOOT_INFO* BootInfo);
+
+#endif // !_BOOTINFO_H
\ No newline at end of file
@@ -1,8 +1,123 @@
 
 
-int KernelMain(
+#include "bootinfo.h"
+#include "mm.h"
+#include <intrin.h>
+
+/**
+* Parks the CPU for good.
+*/
+static
+VOID
+KiHalt(
     VOID
 )
 {
-    return 1;
+    for (;;)
+    {
+        __halt();
+    }
+}
+
+static BOOLEAN KiDebugcon; // the emulator's debug console is present
+
+/**
+* Writes a string to the debug console.
+*/
+static
+VOID
+KiDebugconWrite(
+    _In_ CONST CHAR8* String
+)
+{
+    for (; *String; String++)
+    {
+        __outbyte(BOOT_DEBUGCON_PORT, (UINT8)*String);
+    }
+}
+
+/**
+* Writes a number to the debug console in hexadecimal, without leading zeros.
+*/
+static
+VOID
+KiDebugconHex(
+    _In_ UINT64 Value
+)
+{
+    CHAR8  Digits[17];
+    UINT32 Index = 16;
+
+    Digits[Index] = '\0';
+    do
+    {
+        Digits[--Index] = "0123456789abcdef"[Value & 0xF];
+        Value >>= 4;
+    } while (Value);
+
+    KiDebugconWrite(&Digits[Index]);
+}
+
+/**
+* Appends a kernel event to the loader's boot trace, if it handed one over, and echoes it
+* to the debug console in the format bootinfo.h describes.
+*/
+static
+VOID
+KiTrace(
+    _In_ BOOT_INFO* BootInfo,
+    _In_ CONST CHAR8* Name,
+    _In_ UINT8 Kind
+)
+{
+    static CONST CHAR8* CONST Kinds[] = { " ? ", " B ", " E ", " M " };
+
+    UINT64 Tsc = __rdtsc();
+
+    if (BootInfo->Trace)
+    {
+        BootTraceRecord((BOOT_TRACE*)(BootInfo->DirectMapBase + BootInfo->Trace), Tsc, Name, Kind, BootTraceKernel);
+    }
+
+    if (KiDebugcon)
+    {
+        KiDebugconWrite("@opli K");
+        KiDebugconWrite(Kinds[Kind]);
+        KiDebugconHex(Tsc);
+        KiDebugconWrite(" ");
+        KiDebugconWrite(Name);
+        KiDebugconWrite("\n");
+    }
+}
+
+/**
+* Entered by the loader on the boot stack with interrupts disabled, see bootinfo.h.
+*
+* @param BootInfo Direct map address of the boot information.
+*/
+VOID
+KernelMain(
+    _In_ BOOT_INFO* BootInfo
+)
+{
+    if (BootInfo->Signature != BOOT_INFO_SIGNATURE || BootInfo->Version < BOOT_INFO_VERSION)
+    {
+        // handed over by a loader this kernel does not understand, nothing in it can be trusted
+        KiHalt();
+    }
+
+    KiDebugcon = __inbyte(BOOT_DEBUGCON_PORT) == BOOT_DEBUGCON_PORT;
+    KiTrace(BootInfo, "kernel.entry", BootTraceMark);
+
+    // everything else allocates from here
+    KiTrace(BootInfo, "mm.init", BootTraceBegin);
+    if (!MmInitialize(BootInfo) || !MmInitializeProcessor(0))
+    {
+        KiHalt();
+    }
+    KiTrace(BootInfo, "mm.init", BootTraceEnd);
+
+    // the last stage there is for now, BootBench.py stops the machine when it sees it
+    KiTrace(BootInfo, "kernel.idle", BootTraceMark);
+    KiHalt();
 }
\ No newline at end of file
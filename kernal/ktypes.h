@@ -0,0 +1,52 @@
+#ifndef _KTYPES_H
+#define _KTYPES_H
+
+//
+//
+// Base types for the kernel. They carry the same names and sizes as the EDK2 ones so
+// headers shared with the loader (bootinfo.h) read the same on both sides.
+//
+//
+
+typedef unsigned char      UINT8;
+typedef unsigned short     UINT16;
+typedef unsigned int       UINT32;
+typedef unsigned long long UINT64;
+typedef signed char        INT8;
+typedef short              INT16;
+typedef int                INT32;
+typedef long long          INT64;
+typedef UINT64             UINTN;
+typedef INT64              INTN;
+typedef UINT8              BOOLEAN;
+typedef char               CHAR8;
+typedef unsigned short     CHAR16;
+
+#define VOID  void
+#define CONST const
+#define TRUE  ((BOOLEAN)1)
+#define FALSE ((BOOLEAN)0)
+#define NULL  ((VOID*)0)
+
+// MSVC's intrinsic headers pull in sal.h, which defines the annotations for real
+#if defined(_MSC_VER)
+#include <sal.h>
+#else
+#ifndef _In_
+#define _In_
+#endif
+#ifndef _In_opt_
+#define _In_opt_
+#endif
+#ifndef _Inout_
+#define _Inout_
+#endif
+#ifndef _Out_
+#define _Out_
+#endif
+#ifndef _Out_opt_
+#define _Out_opt_
+#endif
+#endif
+
+#endif // !_KTYPES_H
\ No newline at end of file
@@ -0,0 +1,854 @@
+#include "mm.h"
+#include "rtl.h"
+#include <intrin.h>
+
+#define MI_IA32_GS_BASE 0xC0000101
+#define MI_EFLAGS_IF    0x200
+
+typedef struct _MM_MAGAZINE
+{
+    UINT32 Count;
+    UINT32 Capacity;
+    UINT32 Batch;                        // blocks a refill brings in and a drain sends back
+    UINT32 Order;
+    UINT32 Frames[MM_MAGAZINE_CAPACITY]; // the top was freed last and is likely still in cache
+} MM_MAGAZINE;
+
+typedef struct _MM_PROCESSOR
+{
+    struct _MM_PROCESSOR* Self;          // at gs:0, how a processor finds its own
+    MM_MAGAZINE           Magazines[MM_CACHED_ORDERS];
+    MM_CACHE_COUNTERS     Counters[MM_CACHED_ORDERS];
+} MM_PROCESSOR;
+
+static MM_PROCESSOR* MiProcessors[MM_MAX_PROCESSORS]; // each in a page of its own, so no two share a line
+static volatile long MiLockWord;          // guards everything below
+static UINT64   MiDirectMap;
+static MM_PAGE* MiPages;                  // the page array, through the direct map
+static UINT32   MiPageCount;              // frames it covers, from 0
+static UINT32   MiFreeHead[MM_ORDERS];
+static UINT64   MiFreeBlocks[MM_ORDERS];
+static UINT64   MiFreePages;
+static UINT64   MiTotalPages;
+static UINT64   MiMetadataBase;
+static UINT64   MiMetadataSize;
+
+/**
+* Takes the allocator lock with interrupts off, an interrupt handler that allocates would
+* otherwise spin on a lock its own processor holds.
+*
+* @return The flags to hand to MiUnlock.
+*/
+static
+UINT64
+MiLock(
+    VOID
+)
+{
+    UINT64 Flags = __readeflags();
+    _disable();
+
+    while (_InterlockedExchange(&MiLockWord, 1))
+    {
+        // wait on plain reads, every exchange would pull the line away from the holder
+        while (MiLockWord)
+        {
+            _mm_pause();
+        }
+    }
+
+    return Flags;
+}
+
+static
+VOID
+MiUnlock(
+    _In_ UINT64 Flags
+)
+{
+    _InterlockedExchange(&MiLockWord, 0);
+    if (Flags & MI_EFLAGS_IF)
+    {
+        _enable();
+    }
+}
+
+/**
+* @return The calling processor's magazines, interrupts must be off so it cannot change.
+*/
+static
+MM_PROCESSOR*
+MiCurrentProcessor(
+    VOID
+)
+{
+    return (MM_PROCESSOR*)__readgsqword(0);
+}
+
+/**
+* @return The magazine index for Order, MM_CACHED_ORDERS if it has none.
+*/
+static
+UINT32
+MiCacheIndex(
+    _In_ UINT32 Order
+)
+{
+    return Order == 0 ? 0 : Order == MM_LARGE_ORDER ? 1 : MM_CACHED_ORDERS;
+}
+
+/**
+* Puts a block on the front of its free list.
+*/
+static
+VOID
+MiPush(
+    _In_ UINT32 Frame,
+    _In_ UINT32 Order
+)
+{
+    MM_PAGE* Page = &MiPages[Frame];
+
+    Page->State = MmPageFree;
+    Page->Order = (UINT8)Order;
+    Page->Prev  = MM_NO_PAGE;
+    Page->Next  = MiFreeHead[Order];
+
+    if (Page->Next != MM_NO_PAGE)
+    {
+        MiPages[Page->Next].Prev = Frame;
+    }
+
+    MiFreeHead[Order] = Frame;
+    MiFreeBlocks[Order]++;
+}
+
+/**
+* Takes a free block off its list, the caller gives its head a new state.
+*/
+static
+VOID
+MiUnlink(
+    _In_ UINT32 Frame
+)
+{
+    MM_PAGE* Page = &MiPages[Frame];
+
+    if (Page->Prev != MM_NO_PAGE)
+    {
+        MiPages[Page->Prev].Next = Page->Next;
+    }
+    else
+    {
+        MiFreeHead[Page->Order] = Page->Next;
+    }
+
+    if (Page->Next != MM_NO_PAGE)
+    {
+        MiPages[Page->Next].Prev = Page->Prev;
+    }
+
+    MiFreeBlocks[Page->Order]--;
+}
+
+/**
+* Frees a block, merging it with its buddy for as long as the buddy heads a free block of
+* the same order. Only heads of free blocks are ever MmPageFree, so that check is exact.
+*/
+static
+VOID
+MiRelease(
+    _In_ UINT32 Frame,
+    _In_ UINT32 Order
+)
+{
+    MiFreePages += 1ULL << Order;
+
+    while (Order < MM_MAX_ORDER)
+    {
+        UINT32 Buddy = Frame ^ (1u << Order);
+        if (Buddy >= MiPageCount || MiPages[Buddy].State != MmPageFree || MiPages[Buddy].Order != Order)
+        {
+            break;
+        }
+
+        // whichever of the two does not head the merged block is inside it now
+        MiUnlink(Buddy);
+        MiPages[Buddy].State = MmPageTail;
+        MiPages[Frame].State = MmPageTail;
+        Frame &= ~(1u << Order);
+        Order++;
+    }
+
+    MiPush(Frame, Order);
+}
+
+/**
+* Allocates the low 2^Want pages of a free block already taken off its list, the upper
+* halves go back on the lists of their orders.
+*/
+static
+UINT64
+MiSplit(
+    _In_ UINT32 Frame,
+    _In_ UINT32 Order,
+    _In_ UINT32 Want
+)
+{
+    while (Order > Want)
+    {
+        Order--;
+        MiPush(Frame + (1u << Order), Order);
+    }
+
+    MiPages[Frame].State = MmPageAllocated;
+    MiPages[Frame].Order = (UINT8)Want;
+    MiFreePages -= 1ULL << Want;
+    return (UINT64)Frame << MM_PAGE_SHIFT;
+}
+
+/**
+* @return The order of the largest block that starts at Frame, is aligned to its size and
+*         holds no more than Count pages. Cutting a range with it front to back gives the
+*         same blocks every time.
+*/
+static
+UINT32
+MiRunOrder(
+    _In_ UINT32 Frame,
+    _In_ UINT64 Count
+)
+{
+    UINT32 Order = 0;
+    while (Order < MM_MAX_ORDER && !(Frame & (1u << Order)) && (2ULL << Order) <= Count)
+    {
+        Order++;
+    }
+
+    return Order;
+}
+
+/**
+* Frees a range of frames during seeding.
+*/
+static
+VOID
+MiSeedRange(
+    _In_ UINT64 First,
+    _In_ UINT64 End
+)
+{
+    while (First < End)
+    {
+        UINT32 Order = MiRunOrder((UINT32)First, End - First);
+        MiRelease((UINT32)First, Order);
+        MiTotalPages += 1ULL << Order;
+        First        += 1ULL << Order;
+    }
+}
+
+BOOLEAN
+MmInitialize(
+    _In_ BOOT_INFO* BootInfo
+)
+{
+    UINT64             DirectMap = BootInfo->DirectMapBase;
+    BOOT_MEMORY_RANGE* Ranges    = (BOOT_MEMORY_RANGE*)(DirectMap + BootInfo->MemoryMap);
+    UINT64             Limit     = BootInfo->DirectMapSize >> MM_PAGE_SHIFT;
+    UINT64             Top       = 0;
+
+    // the array only has to reach the end of the highest free range, nothing above it is
+    // ever handed out or merged with
+    Limit = Limit < MM_NO_PAGE ? Limit : MM_NO_PAGE;
+    for (UINT32 i = 0; i < BootInfo->MemoryRangeCount; i++)
+    {
+        UINT64 End = (Ranges[i].Base >> MM_PAGE_SHIFT) + Ranges[i].Pages;
+        if (Ranges[i].Type == BootMemoryFree && End > Top)
+        {
+            Top = End < Limit ? End : Limit;
+        }
+    }
+
+    UINT64 ArrayPages = (Top * sizeof(MM_PAGE) + MM_PAGE_SIZE - 1) >> MM_PAGE_SHIFT;
+    UINT64 ArrayFirst = 0;
+
+    // carved from the top of the highest free range that holds it, low memory stays free
+    // for devices that cannot reach far
+    for (UINT32 i = 0; Top && i < BootInfo->MemoryRangeCount; i++)
+    {
+        UINT64 First = Ranges[i].Base >> MM_PAGE_SHIFT;
+        UINT64 End   = First + Ranges[i].Pages;
+
+        First = First > (MM_LOW_LIMIT >> MM_PAGE_SHIFT) ? First : (MM_LOW_LIMIT >> MM_PAGE_SHIFT);
+        End   = End < Top ? End : Top;
+        if (Ranges[i].Type == BootMemoryFree && End > First && End - First >= ArrayPages)
+        {
+            ArrayFirst = End - ArrayPages;
+        }
+    }
+
+    if (!ArrayFirst)
+    {
+        return FALSE;
+    }
+
+    MiDirectMap    = DirectMap;
+    MiPages        = (MM_PAGE*)(DirectMap + (ArrayFirst << MM_PAGE_SHIFT));
+    MiPageCount    = (UINT32)Top;
+    MiMetadataBase = ArrayFirst << MM_PAGE_SHIFT;
+    MiMetadataSize = Top * sizeof(MM_PAGE);
+
+    // zero is MmPageReserved, every frame not seeded below can never be merged with
+    RtlFillMemory(MiPages, (UINTN)MiMetadataSize, 0);
+    RtlFillMemory(MiFreeHead, sizeof(MiFreeHead), 0xFF);
+
+    for (UINT32 i = 0; i < BootInfo->MemoryRangeCount; i++)
+    {
+        if (Ranges[i].Type != BootMemoryFree)
+        {
+            continue;
+        }
+
+        UINT64 First = Ranges[i].Base >> MM_PAGE_SHIFT;
+        UINT64 End   = First + Ranges[i].Pages;
+
+        First = First > (MM_LOW_LIMIT >> MM_PAGE_SHIFT) ? First : (MM_LOW_LIMIT >> MM_PAGE_SHIFT);
+        End   = End < Top ? End : Top;
+        if (First >= End)
+        {
+            continue;
+        }
+
+        // the array sits inside one of these ranges, only what is around it is free
+        UINT64 ArrayEnd = ArrayFirst + ArrayPages;
+        if (ArrayFirst < End && ArrayEnd > First)
+        {
+            MiSeedRange(First, ArrayFirst);
+            MiSeedRange(ArrayEnd, End);
+        }
+        else
+        {
+            MiSeedRange(First, End);
+        }
+    }
+
+    return MiTotalPages != 0;
+}
+
+/**
+* Takes a block off the free lists, the lock must be held.
+*/
+static
+UINT64
+MiAllocate(
+    _In_ UINT32 Order
+)
+{
+    for (UINT32 From = Order; From <= MM_MAX_ORDER; From++)
+    {
+        UINT32 Frame = MiFreeHead[From];
+        if (Frame != MM_NO_PAGE)
+        {
+            MiUnlink(Frame);
+            return MiSplit(Frame, From, Order);
+        }
+    }
+
+    return 0;
+}
+
+/**
+* Fills an empty magazine with a batch of blocks, as many as there are up to Batch. They are
+* marked cached here, the magazine hands them out without touching the page array again.
+*/
+static
+VOID
+MiRefill(
+    _Inout_ MM_MAGAZINE* Magazine
+)
+{
+    UINT64 Flags = MiLock();
+
+    while (Magazine->Count < Magazine->Batch)
+    {
+        UINT64 Address = MiAllocate(Magazine->Order);
+        if (!Address)
+        {
+            break;
+        }
+
+        UINT32 Frame = (UINT32)(Address >> MM_PAGE_SHIFT);
+        MiPages[Frame].State = MmPageCached;
+        Magazine->Frames[Magazine->Count++] = Frame;
+    }
+
+    MiUnlock(Flags);
+}
+
+/**
+* Frees the Count blocks at the bottom of a magazine, the ones longest out of cache, the
+* lock must be held. This is where a free that went into the magazine is checked: a block
+* that was not handed out with this order, or was freed twice with a drain in between, is
+* dropped and counted instead.
+*/
+static
+VOID
+MiDrain(
+    _Inout_ MM_MAGAZINE* Magazine,
+    _In_    UINT32 Count,
+    _Inout_ MM_CACHE_COUNTERS* Counters
+)
+{
+    for (UINT32 i = 0; i < Count; i++)
+    {
+        MM_PAGE* Page = &MiPages[Magazine->Frames[i]];
+
+        if ((Page->State != MmPageCached && Page->State != MmPageAllocated) || Page->Order != Magazine->Order)
+        {
+            Counters->Discarded++;
+            continue;
+        }
+
+        MiRelease(Magazine->Frames[i], Magazine->Order);
+    }
+
+    Magazine->Count -= Count;
+    RtlCopyMemory(Magazine->Frames, Magazine->Frames + Count, Magazine->Count * sizeof(UINT32));
+}
+
+/**
+* Empties every magazine of a processor, the lock must be held.
+*
+* @return TRUE if that freed anything.
+*/
+static
+BOOLEAN
+MiFlush(
+    _Inout_ MM_PROCESSOR* Processor
+)
+{
+    BOOLEAN Freed = FALSE;
+
+    for (UINT32 i = 0; i < MM_CACHED_ORDERS; i++)
+    {
+        if (Processor->Magazines[i].Count)
+        {
+            MiDrain(&Processor->Magazines[i], Processor->Magazines[i].Count, &Processor->Counters[i]);
+            Freed = TRUE;
+        }
+    }
+
+    return Freed;
+}
+
+BOOLEAN
+MmInitializeProcessor(
+    _In_ UINT32 Number
+)
+{
+    if (Number >= MM_MAX_PROCESSORS || MiProcessors[Number])
+    {
+        return FALSE;
+    }
+
+    UINT64 Flags   = MiLock();
+    UINT64 Address = MiAllocate(0);
+    MiUnlock(Flags);
+
+    if (!Address)
+    {
+        return FALSE;
+    }
+
+    MM_PROCESSOR* Processor = (MM_PROCESSOR*)(MiDirectMap + Address);
+    RtlFillMemory(Processor, sizeof(MM_PROCESSOR), 0);
+
+    Processor->Self = Processor;
+    Processor->Magazines[0].Order    = 0;
+    Processor->Magazines[0].Capacity = MM_MAGAZINE_CAPACITY;
+    Processor->Magazines[0].Batch    = MM_MAGAZINE_BATCH;
+    Processor->Magazines[1].Order    = MM_LARGE_ORDER;
+    Processor->Magazines[1].Capacity = MM_LARGE_CAPACITY;
+    Processor->Magazines[1].Batch    = MM_LARGE_BATCH;
+
+    MiProcessors[Number] = Processor;
+    __writemsr(MI_IA32_GS_BASE, (UINT64)Processor);
+    return TRUE;
+}
+
+VOID
+MmDrainProcessor(
+    VOID
+)
+{
+    UINT64 Flags = MiLock();
+    MiFlush(MiCurrentProcessor());
+    MiUnlock(Flags);
+}
+
+UINT64
+MmAllocatePages(
+    _In_ UINT32 Order
+)
+{
+    UINT32 Index = MiCacheIndex(Order);
+
+    if (Index < MM_CACHED_ORDERS)
+    {
+        UINT64 Flags = __readeflags();
+        _disable();
+
+        MM_PROCESSOR* Processor = MiCurrentProcessor();
+        MM_MAGAZINE*  Magazine  = &Processor->Magazines[Index];
+        UINT64        Address   = 0;
+
+        if (Magazine->Count)
+        {
+            Processor->Counters[Index].AllocateHits++;
+        }
+        else
+        {
+            Processor->Counters[Index].AllocateMisses++;
+            MiRefill(Magazine);
+        }
+
+        // the block stays MmPageCached, MiDrain takes that for allocated
+        if (Magazine->Count)
+        {
+            Address = (UINT64)Magazine->Frames[--Magazine->Count] << MM_PAGE_SHIFT;
+        }
+
+        if (Flags & MI_EFLAGS_IF)
+        {
+            _enable();
+        }
+
+        if (Address)
+        {
+            return Address;
+        }
+    }
+
+    // the calling processor's magazines may hold what the free lists are missing
+    UINT64 Flags   = MiLock();
+    UINT64 Address = MiAllocate(Order);
+    if (!Address && MiFlush(MiCurrentProcessor()))
+    {
+        Address = MiAllocate(Order);
+    }
+    MiUnlock(Flags);
+
+    return Address;
+}
+
+/**
+* @return TRUE if Frame is in the magazine already, a block freed twice. The frames are
+*         compared 8 at a time and the matches only looked at once at the end, 32 rounds for
+*         a full order 0 magazine.
+*/
+static
+BOOLEAN
+MiInMagazine(
+    _In_ CONST MM_MAGAZINE* Magazine,
+    _In_ UINT32 Frame
+)
+{
+    CONST UINT32* Frames = Magazine->Frames;
+    UINT32        Count  = Magazine->Count;
+    __m128i       Wanted = _mm_set1_epi32((INT32)Frame);
+    __m128i       Found  = _mm_setzero_si128();
+    UINT32        i      = 0;
+
+    // frames past Count are stale, only whole groups below it are loaded
+    for (; i + 8 <= Count; i += 8)
+    {
+        __m128i Low  = _mm_cmpeq_epi32(_mm_loadu_si128((CONST __m128i*)(Frames + i)), Wanted);
+        __m128i High = _mm_cmpeq_epi32(_mm_loadu_si128((CONST __m128i*)(Frames + i + 4)), Wanted);
+        Found = _mm_or_si128(Found, _mm_or_si128(Low, High));
+    }
+
+    BOOLEAN InMagazine = _mm_movemask_epi8(Found) != 0;
+    for (; i < Count; i++)
+    {
+        InMagazine |= Frames[i] == Frame;
+    }
+
+    return InMagazine;
+}
+
+BOOLEAN
+MmFreePages(
+    _In_ UINT64 Address,
+    _In_ UINT32 Order
+)
+{
+    UINT64 Frame = Address >> MM_PAGE_SHIFT;
+
+    if (Order > MM_MAX_ORDER || (Address & ((MM_PAGE_SIZE << Order) - 1)) || Frame >= MiPageCount)
+    {
+        return FALSE;
+    }
+
+    UINT32  Index = MiCacheIndex(Order);
+    BOOLEAN Freed;
+    UINT64  Flags;
+
+    if (Index < MM_CACHED_ORDERS)
+    {
+        Flags = __readeflags();
+        _disable();
+
+        MM_PROCESSOR* Processor = MiCurrentProcessor();
+        MM_MAGAZINE*  Magazine  = &Processor->Magazines[Index];
+
+        // nothing but the magazine is read here, the page array is checked when it drains
+        Freed = !MiInMagazine(Magazine, (UINT32)Frame);
+        if (Freed)
+        {
+            if (Magazine->Count < Magazine->Capacity)
+            {
+                Processor->Counters[Index].FreeHits++;
+            }
+            else
+            {
+                Processor->Counters[Index].FreeMisses++;
+
+                UINT64 LockFlags = MiLock();
+                MiDrain(Magazine, Magazine->Batch, &Processor->Counters[Index]);
+                MiUnlock(LockFlags);
+            }
+
+            Magazine->Frames[Magazine->Count++] = (UINT32)Frame;
+        }
+
+        if (Flags & MI_EFLAGS_IF)
+        {
+            _enable();
+        }
+
+        return Freed;
+    }
+
+    Flags = MiLock();
+    Freed = MiPages[Frame].State == MmPageAllocated && MiPages[Frame].Order == Order;
+    if (Freed)
+    {
+        MiRelease((UINT32)Frame, Order);
+    }
+    MiUnlock(Flags);
+
+    return Freed;
+}
+
+/**
+* MmAllocateContiguous with the lock held.
+*/
+static
+UINT64
+MiAllocateContiguous(
+    _In_ UINT64 Pages,
+    _In_ UINT64 HighestAddress
+)
+{
+    if (!Pages || Pages > (1ULL << MM_MAX_ORDER))
+    {
+        return 0;
+    }
+
+    UINT32 Order = 0;
+    while ((1ULL << Order) < Pages)
+    {
+        Order++;
+    }
+
+    // whole frames below HighestAddress, written so MM_ANY_ADDRESS does not overflow
+    UINT64 Limit = (HighestAddress >> MM_PAGE_SHIFT) + ((HighestAddress & (MM_PAGE_SIZE - 1)) == MM_PAGE_SIZE - 1);
+    UINT32 Frame      = MM_NO_PAGE;
+    UINT32 BlockOrder = Order;
+
+    // the low end of a larger free block is as good as a block of the right size
+    for (; BlockOrder <= MM_MAX_ORDER; BlockOrder++)
+    {
+        for (Frame = MiFreeHead[BlockOrder]; Frame != MM_NO_PAGE; Frame = MiPages[Frame].Next)
+        {
+            if ((UINT64)Frame + (1ULL << Order) <= Limit)
+            {
+                break;
+            }
+        }
+
+        if (Frame != MM_NO_PAGE)
+        {
+            break;
+        }
+    }
+
+    if (Frame == MM_NO_PAGE)
+    {
+        return 0;
+    }
+
+    MiUnlink(Frame);
+    UINT64 Address = MiSplit(Frame, BlockOrder, Order);
+
+    // cut into the runs MmFreeContiguous looks for, the pages past Pages go back
+    UINT64 End      = (UINT64)Frame + Pages;
+    UINT64 BlockEnd = (UINT64)Frame + (1ULL << Order);
+    for (UINT64 Run = Frame; Run < BlockEnd; )
+    {
+        UINT32 RunOrder = MiRunOrder((UINT32)Run, (Run < End ? End : BlockEnd) - Run);
+        if (Run < End)
+        {
+            MiPages[Run].State = MmPageAllocated;
+            MiPages[Run].Order = (UINT8)RunOrder;
+        }
+        else
+        {
+            MiRelease((UINT32)Run, RunOrder);
+        }
+
+        Run += 1ULL << RunOrder;
+    }
+
+    return Address;
+}
+
+UINT64
+MmAllocateContiguous(
+    _In_ UINT64 Pages,
+    _In_ UINT64 HighestAddress
+)
+{
+    UINT64 Flags   = MiLock();
+    UINT64 Address = MiAllocateContiguous(Pages, HighestAddress);
+    if (!Address && MiFlush(MiCurrentProcessor()))
+    {
+        Address = MiAllocateContiguous(Pages, HighestAddress);
+    }
+    MiUnlock(Flags);
+
+    return Address;
+}
+
+/**
+* MmFreeContiguous with the lock held.
+*/
+static
+BOOLEAN
+MiFreeContiguous(
+    _In_ UINT64 Address,
+    _In_ UINT64 Pages
+)
+{
+    UINT64 Frame = Address >> MM_PAGE_SHIFT;
+    UINT64 End   = Frame + Pages;
+
+    if ((Address & (MM_PAGE_SIZE - 1)) || !Pages || End > MiPageCount)
+    {
+        return FALSE;
+    }
+
+    // every run must be there before any of them is freed
+    for (UINT64 Run = Frame; Run < End; )
+    {
+        UINT32 RunOrder = MiRunOrder((UINT32)Run, End - Run);
+        if (MiPages[Run].State != MmPageAllocated || MiPages[Run].Order != RunOrder)
+        {
+            return FALSE;
+        }
+
+        Run += 1ULL << RunOrder;
+    }
+
+    for (UINT64 Run = Frame; Run < End; )
+    {
+        UINT32 RunOrder = MiRunOrder((UINT32)Run, End - Run);
+        MiRelease((UINT32)Run, RunOrder);
+        Run += 1ULL << RunOrder;
+    }
+
+    return TRUE;
+}
+
+BOOLEAN
+MmFreeContiguous(
+    _In_ UINT64 Address,
+    _In_ UINT64 Pages
+)
+{
+    UINT64  Flags = MiLock();
+    BOOLEAN Freed = MiFreeContiguous(Address, Pages);
+    MiUnlock(Flags);
+
+    return Freed;
+}
+
+/**
+* @return Pages in a processor's magazines, read while it may be changing them.
+*/
+static
+UINT64
+MiCachedPages(
+    _In_ MM_PROCESSOR* Processor
+)
+{
+    UINT64 Pages = 0;
+
+    for (UINT32 i = 0; i < MM_CACHED_ORDERS; i++)
+    {
+        Pages += (UINT64)Processor->Magazines[i].Count << Processor->Magazines[i].Order;
+    }
+
+    return Pages;
+}
+
+VOID
+MmQueryStatistics(
+    _Out_ MM_STATISTICS* Statistics
+)
+{
+    UINT64 Flags = MiLock();
+
+    Statistics->TotalPages   = MiTotalPages;
+    Statistics->FreePages    = MiFreePages;
+    Statistics->CachedPages  = 0;
+    Statistics->MetadataBase = MiMetadataBase;
+    Statistics->MetadataSize = MiMetadataSize;
+
+    for (UINT32 i = 0; i < MM_ORDERS; i++)
+    {
+        Statistics->FreeBlocks[i] = MiFreeBlocks[i];
+    }
+
+    MiUnlock(Flags);
+
+    for (UINT32 i = 0; i < MM_MAX_PROCESSORS; i++)
+    {
+        if (MiProcessors[i])
+        {
+            Statistics->CachedPages += MiCachedPages(MiProcessors[i]);
+        }
+    }
+}
+
+BOOLEAN
+MmQueryProcessorStatistics(
+    _In_  UINT32 Number,
+    _Out_ MM_PROCESSOR_STATISTICS* Statistics
+)
+{
+    if (Number >= MM_MAX_PROCESSORS || !MiProcessors[Number])
+    {
+        return FALSE;
+    }
+
+    MM_PROCESSOR* Processor = MiProcessors[Number];
+
+    Statistics->CachedPages = MiCachedPages(Processor);
+    for (UINT32 i = 0; i < MM_CACHED_ORDERS; i++)
+    {
+        Statistics->Counters[i] = Processor->Counters[i];
+    }
+
+    return TRUE;
+}
\ No newline at end of file
@@ -0,0 +1,199 @@
+#ifndef _MM_H
+#define _MM_H
+
+//
+//
+// Physical page allocator. Free memory is kept in buddy blocks of 2^Order pages, Order 0
+// (4 KiB) to MM_MAX_ORDER (1 GiB), every block naturally aligned to its size so order 9
+// blocks can back 2 MiB pages directly. Each page frame has an MM_PAGE in one array that
+// covers physical memory up to the end of the highest free range, it holds the free list
+// links and the state of the block the page heads.
+//
+// MmInitialize seeds the allocator from the loader's memory map. Only BootMemoryFree is
+// handed out, loader data, boot modules, the boot information and everything the kernel
+// was started on stay reserved, as does memory below MM_LOW_LIMIT.
+//
+// Addresses are physical, the kernel reaches them through the direct map.
+//
+// Order 0 and MM_LARGE_ORDER blocks, what page faults and packet buffers ask for, go through
+// a magazine on the calling processor first: a small stack of blocks that only that
+// processor touches, so the common allocation and free take no lock and touch no memory
+// other processors use, the page array included. An empty magazine is refilled and a full
+// one drained MM_MAGAZINE_BATCH blocks at a time under the allocator lock, everything else
+// takes that lock on every call. Each processor calls MmInitializeProcessor before it
+// allocates, it points the gs base at the processor's magazines. Interrupts are held off
+// while a magazine or the lock is in use, so interrupt handlers may allocate too.
+//
+// A refill marks its blocks MmPageCached and they keep that state while allocated, so a
+// free into a magazine can only be checked against the magazine itself: a block freed twice
+// is refused while the first free is still there. Any other bad free of these two orders is
+// only found when the magazine drains, it is dropped and counted in Discarded then, but the
+// magazine may have handed the block out again before that.
+//
+//
+
+#include "bootinfo.h"
+
+#define MM_PAGE_SHIFT  12
+#define MM_PAGE_SIZE   (1ULL << MM_PAGE_SHIFT)
+#define MM_MAX_ORDER   18                    // 2^18 pages, 1 GiB
+#define MM_ORDERS      (MM_MAX_ORDER + 1)
+#define MM_LOW_LIMIT   0x100000              // the first MiB is left for AP startup code and firmware leftovers
+#define MM_NO_PAGE     0xFFFFFFFF            // end of a free list, frames are 32 bit so up to 16 TiB is managed
+#define MM_ANY_ADDRESS 0xFFFFFFFFFFFFFFFFULL // HighestAddress when any will do
+
+#define MM_MAX_PROCESSORS      256
+#define MM_LARGE_ORDER         9   // 2 MiB, the other order with a magazine
+#define MM_CACHED_ORDERS       2   // magazines per processor, order 0 and MM_LARGE_ORDER
+#define MM_MAGAZINE_CAPACITY   256 // order 0 blocks a magazine holds, 1 MiB
+#define MM_MAGAZINE_BATCH      64  // order 0 blocks moved per refill or drain
+#define MM_LARGE_CAPACITY      4   // MM_LARGE_ORDER blocks a magazine holds, 8 MiB
+#define MM_LARGE_BATCH         2
+
+typedef enum _MM_PAGE_STATE
+{
+    MmPageReserved = 0, // never handed out, the array starts out zeroed
+    MmPageFree,         // heads a free block of Order
+    MmPageAllocated,    // heads an allocated block of Order
+    MmPageTail,         // inside a block, free or allocated
+    MmPageCached        // heads a block a magazine took, held by it or by whoever it handed the block to
+} MM_PAGE_STATE;
+
+typedef struct _MM_PAGE
+{
+    UINT32 Next;  // free list links, page frame numbers
+    UINT32 Prev;
+    UINT8  Order; // of the block this page heads
+    UINT8  State; // MM_PAGE_STATE
+    UINT16 Spare;
+} MM_PAGE;
+
+typedef struct _MM_STATISTICS
+{
+    UINT64 TotalPages;             // pages the allocator was seeded with
+    UINT64 FreePages;              // on the free lists, magazines not counted
+    UINT64 CachedPages;            // in the magazines of every processor
+    UINT64 FreeBlocks[MM_ORDERS];  // blocks on each free list
+    UINT64 MetadataBase;           // the MM_PAGE array, physical
+    UINT64 MetadataSize;           // bytes
+} MM_STATISTICS;
+
+typedef struct _MM_CACHE_COUNTERS
+{
+    UINT64 AllocateHits;   // served from the magazine
+    UINT64 AllocateMisses; // the magazine was empty and had to be refilled
+    UINT64 FreeHits;       // kept in the magazine
+    UINT64 FreeMisses;     // the magazine was full and had to be drained
+    UINT64 Discarded;      // bad frees the magazine took, dropped when it drained
+} MM_CACHE_COUNTERS;
+
+typedef struct _MM_PROCESSOR_STATISTICS
+{
+    UINT64            CachedPages;
+    MM_CACHE_COUNTERS Counters[MM_CACHED_ORDERS]; // order 0, then MM_LARGE_ORDER
+} MM_PROCESSOR_STATISTICS;
+
+/**
+* Builds the page array and frees every usable range into it.
+*
+* @param BootInfo The boot information, through the direct map.
+*
+* @return FALSE when there is no free memory or no range large enough for the page array.
+*/
+BOOLEAN
+MmInitialize(
+    _In_ BOOT_INFO* BootInfo
+);
+
+/**
+* Gives the calling processor its magazines and points its gs base at them. Call once on
+* every processor, the boot processor right after MmInitialize, before it allocates.
+*
+* @param Number The processor's number, below MM_MAX_PROCESSORS, for MmQueryProcessorStatistics.
+*
+* @return FALSE if Number is out of range or taken, or there is no page for the magazines.
+*/
+BOOLEAN
+MmInitializeProcessor(
+    _In_ UINT32 Number
+);
+
+/**
+* Hands every block in the calling processor's magazines back to the free lists, before it
+* goes offline or when a large allocation failed.
+*/
+VOID
+MmDrainProcessor(
+    VOID
+);
+
+/**
+* Allocates 2^Order contiguous pages aligned to their size, from high memory first.
+*
+* @return The physical address, 0 when no block that large is free.
+*/
+UINT64
+MmAllocatePages(
+    _In_ UINT32 Order
+);
+
+/**
+* Frees a block allocated by MmAllocatePages, merging it with its free buddies.
+*
+* @return FALSE if Address does not head an allocated block of Order, nothing is freed then.
+*         For order 0 and MM_LARGE_ORDER that is only known for a block still in the calling
+*         processor's magazine, see above.
+*/
+BOOLEAN
+MmFreePages(
+    _In_ UINT64 Address,
+    _In_ UINT32 Order
+);
+
+/**
+* Allocates Pages contiguous pages, for DMA buffers and anything else that is not a power
+* of two. The block is aligned to the next power of two above Pages and the pages past
+* Pages are given back straight away.
+*
+* @param Pages          Pages wanted, at most 2^MM_MAX_ORDER.
+* @param HighestAddress The last byte the allocation may reach, MM_ANY_ADDRESS for any.
+*
+* @return The physical address, 0 when nothing fits.
+*/
+UINT64
+MmAllocateContiguous(
+    _In_ UINT64 Pages,
+    _In_ UINT64 HighestAddress
+);
+
+/**
+* Frees an allocation made by MmAllocateContiguous with the same Pages.
+*
+* @return FALSE if the range was not allocated that way, nothing is freed then.
+*/
+BOOLEAN
+MmFreeContiguous(
+    _In_ UINT64 Address,
+    _In_ UINT64 Pages
+);
+
+/**
+* @return How much is free and where the page array lives. The magazines are read without
+*         stopping their processors, CachedPages is a snapshot.
+*/
+VOID
+MmQueryStatistics(
+    _Out_ MM_STATISTICS* Statistics
+);
+
+/**
+* @return The magazine counters of one processor, FALSE if Number never called
+*         MmInitializeProcessor.
+*/
+BOOLEAN
+MmQueryProcessorStatistics(
+    _In_  UINT32 Number,
+    _Out_ MM_PROCESSOR_STATISTICS* Statistics
+);
+
+#endif // !_MM_H
\ No newline at end of file
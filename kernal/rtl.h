@@ -0,0 +1,273 @@
+#ifndef _RTL_H
+#define _RTL_H
+
+//
+//
+// String and memory routines shared by the loader and the kernel, SSE2 so they work on any
+// x86-64 without asking the firmware or the kernel to enable wider vector state first.
+//
+// Scans for a terminator cannot know where the string ends, so they only use aligned 16
+// byte loads: an aligned load never crosses a page, the bytes it reads before the string
+// or past its end share a page with it. Two strings at different alignments cannot both
+// be read aligned, the comparison uses unaligned loads and steps one character at a time
+// while either side is within 16 bytes of a page end. Routines with a length never read
+// past it. UCS-2 strings at odd addresses take the scalar path.
+//
+//
+
+#ifndef __BASE_H__
+#include "ktypes.h"
+#endif
+
+#include <emmintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define RTL_VECTOR_SIZE 16
+#define RTL_PAGE_SIZE   0x1000
+
+/**
+* @return Index of the lowest set bit, Mask must not be 0.
+*/
+static __inline
+UINT32
+RtlpLowestBit(
+    _In_ UINT32 Mask
+)
+{
+#if defined(_MSC_VER)
+    unsigned long Index;
+    _BitScanForward(&Index, Mask);
+    return (UINT32)Index;
+#else
+    return (UINT32)__builtin_ctz(Mask);
+#endif
+}
+
+/**
+* @return TRUE if a 16 byte load at Address stays within its page.
+*/
+static __inline
+BOOLEAN
+RtlpLoadFitsPage(
+    _In_ CONST VOID* Address
+)
+{
+    return ((UINTN)Address & (RTL_PAGE_SIZE - 1)) <= RTL_PAGE_SIZE - RTL_VECTOR_SIZE;
+}
+
+/**
+* @return The number of characters before the NUL of a UCS-2 string.
+*/
+static __inline
+UINTN
+RtlStringLength(
+    _In_ CONST CHAR16* String
+)
+{
+    if ((UINTN)String & 1)
+    {
+        CONST CHAR16* End = String;
+        while (*End)
+        {
+            End++;
+        }
+        return (UINTN)(End - String);
+    }
+
+    __m128i        Zero  = _mm_setzero_si128();
+    CONST __m128i* Block = (CONST __m128i*)((UINTN)String & ~(UINTN)(RTL_VECTOR_SIZE - 1));
+
+    // lanes in front of the string are masked off, both sides are 2 byte aligned so the
+    // lanes line up with its characters
+    UINT32 Mask = (UINT32)_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_load_si128(Block), Zero));
+    Mask &= 0xFFFFu << ((UINTN)String & (RTL_VECTOR_SIZE - 1));
+
+    while (!Mask)
+    {
+        Block++;
+        Mask = (UINT32)_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_load_si128(Block), Zero));
+    }
+
+    return ((UINTN)Block + RtlpLowestBit(Mask) - (UINTN)String) / sizeof(CHAR16);
+}
+
+/**
+* @return The number of characters before the NUL of an ASCII string.
+*/
+static __inline
+UINTN
+RtlAsciiLength(
+    _In_ CONST CHAR8* String
+)
+{
+    __m128i        Zero  = _mm_setzero_si128();
+    CONST __m128i* Block = (CONST __m128i*)((UINTN)String & ~(UINTN)(RTL_VECTOR_SIZE - 1));
+
+    UINT32 Mask = (UINT32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(Block), Zero));
+    Mask &= 0xFFFFu << ((UINTN)String & (RTL_VECTOR_SIZE - 1));
+
+    while (!Mask)
+    {
+        Block++;
+        Mask = (UINT32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(Block), Zero));
+    }
+
+    return (UINTN)Block + RtlpLowestBit(Mask) - (UINTN)String;
+}
+
+/**
+* Compares Length bytes.
+*
+* @return 0 if they are equal, else the difference of the first bytes that are not.
+*/
+static __inline
+INTN
+RtlCompareMemory(
+    _In_ CONST VOID* First,
+    _In_ CONST VOID* Second,
+    _In_ UINTN Length
+)
+{
+    CONST UINT8* A = (CONST UINT8*)First;
+    CONST UINT8* B = (CONST UINT8*)Second;
+
+    for (; Length >= RTL_VECTOR_SIZE; Length -= RTL_VECTOR_SIZE, A += RTL_VECTOR_SIZE, B += RTL_VECTOR_SIZE)
+    {
+        __m128i Equal = _mm_cmpeq_epi8(_mm_loadu_si128((CONST __m128i*)A), _mm_loadu_si128((CONST __m128i*)B));
+        UINT32  Mask  = (UINT32)_mm_movemask_epi8(Equal) ^ 0xFFFFu;
+        if (Mask)
+        {
+            UINT32 Index = RtlpLowestBit(Mask);
+            return (INTN)A[Index] - (INTN)B[Index];
+        }
+    }
+
+    for (; Length; Length--, A++, B++)
+    {
+        if (*A != *B)
+        {
+            return (INTN)*A - (INTN)*B;
+        }
+    }
+
+    return 0;
+}
+
+/**
+* Case sensitive comparison of two UCS-2 strings.
+*
+* @return 0 if they are the same, else the difference of the first characters that are not.
+*/
+static __inline
+INTN
+RtlStringCompare(
+    _In_ CONST CHAR16* First,
+    _In_ CONST CHAR16* Second
+)
+{
+    __m128i Zero = _mm_setzero_si128();
+
+    for (;;)
+    {
+        if (RtlpLoadFitsPage(First) && RtlpLoadFitsPage(Second))
+        {
+            __m128i A = _mm_loadu_si128((CONST __m128i*)First);
+            __m128i B = _mm_loadu_si128((CONST __m128i*)Second);
+
+            // stop at the first character that differs or ends First, an odd address only
+            // costs the load its alignment
+            UINT32 Mask = ((UINT32)_mm_movemask_epi8(_mm_cmpeq_epi16(A, B)) ^ 0xFFFFu) |
+                          (UINT32)_mm_movemask_epi8(_mm_cmpeq_epi16(A, Zero));
+            if (Mask)
+            {
+                UINT32 Index = RtlpLowestBit(Mask) / sizeof(CHAR16);
+                return (INTN)First[Index] - (INTN)Second[Index];
+            }
+
+            First  += RTL_VECTOR_SIZE / sizeof(CHAR16);
+            Second += RTL_VECTOR_SIZE / sizeof(CHAR16);
+            continue;
+        }
+
+        if (*First != *Second || !*First)
+        {
+            return (INTN)*First - (INTN)*Second;
+        }
+
+        First++;
+        Second++;
+    }
+}
+
+/**
+* Copies a UCS-2 string with its NUL, Destination must have room for it.
+*
+* @return The number of characters copied, the NUL not counted.
+*/
+static __inline
+UINTN
+RtlStringCopy(
+    _Out_ CHAR16* Destination,
+    _In_  CONST CHAR16* Source
+)
+{
+    UINTN        Length = RtlStringLength(Source);
+    UINTN        Bytes  = (Length + 1) * sizeof(CHAR16);
+    UINT8*       To     = (UINT8*)Destination;
+    CONST UINT8* From   = (CONST UINT8*)Source;
+
+    for (; Bytes >= RTL_VECTOR_SIZE; Bytes -= RTL_VECTOR_SIZE, To += RTL_VECTOR_SIZE, From += RTL_VECTOR_SIZE)
+    {
+        _mm_storeu_si128((__m128i*)To, _mm_loadu_si128((CONST __m128i*)From));
+    }
+
+    for (; Bytes; Bytes--)
+    {
+        *To++ = *From++;
+    }
+
+    return Length;
+}
+
+/**
+* Copies Length bytes front to back with rep movsb, which fast string microcode turns into
+* full cache line moves. Destination may only overlap Source from below. Never calls out,
+* so the loader can use it on processors that must not touch boot services.
+*/
+static __inline
+VOID
+RtlCopyMemory(
+    _Out_ VOID* Destination,
+    _In_  CONST VOID* Source,
+    _In_  UINTN Length
+)
+{
+#if defined(_MSC_VER)
+    __movsb((unsigned char*)Destination, (CONST unsigned char*)Source, Length);
+#else
+    __asm__ __volatile__("rep movsb" : "+D"(Destination), "+S"(Source), "+c"(Length) : : "memory");
+#endif
+}
+
+/**
+* Sets Length bytes to Value with rep stosb.
+*/
+static __inline
+VOID
+RtlFillMemory(
+    _Out_ VOID* Destination,
+    _In_  UINTN Length,
+    _In_  UINT8 Value
+)
+{
+#if defined(_MSC_VER)
+    __stosb((unsigned char*)Destination, Value, Length);
+#else
+    __asm__ __volatile__("rep stosb" : "+D"(Destination), "+c"(Length) : "a"(Value) : "memory");
+#endif
+}
+
+#endif // !_RTL_H
\ No newline at end of file